@@ -13,6 +13,7 @@ const authRoutes = require('./routes/auth');
 const imageRoutes = require('./routes/images');
 const configRoutes = require('./routes/config');
 const userRoutes = require('./routes/users');
+const uploadRoutes = require('./routes/uploads');
 
 // Initialize Express app
 const app = express();
@@ -48,6 +49,7 @@ app.use((req, res, next) => {
 app.use('/api/auth', authRoutes);
 app.use('/api/users', userRoutes);
 app.use('/api/config', configRoutes);
+app.use('/api/uploads', uploadRoutes);
 app.use('/api', imageRoutes);
 
 // Health check endpoint
@@ -236,7 +238,10 @@ io.on('connection', (socket) => {
   // Handle commands from frontend
   socket.on('send-command', (command) => {
     console.log('Command from frontend:', command);
-    mqttService.sendCommand(command);
+    const result = mqttService.sendCommand(command);
+    if (result && typeof result.catch === 'function') {
+      result.catch((err) => socket.emit('command-error', { message: err.message }));
+    }
   });
 });
 
@@ -5,6 +5,8 @@ const nodemailer = require('nodemailer');
 const TelegramBot = require('node-telegram-bot-api');
 const path = require('path');
 const fs = require('fs');
+const crypto = require('crypto');
+const mqttService = require('../services/mqttService');
 
 const APP_ROOT = path.join(__dirname, '..');
 const UPLOAD_DIR = path.join(APP_ROOT, 'uploads');
@@ -79,6 +81,10 @@ const transformImageDoc = (imageDoc, req) => {
 
   image.path = normalizedPath;
   image.url = baseUrl && normalizedPath ? `${baseUrl}${normalizedPath}` : '';
+  if (image.thumbnailPath) {
+    image.thumbnailPath = normalizeImagePath(image.thumbnailPath);
+    image.thumbnailUrl = baseUrl ? `${baseUrl}${image.thumbnailPath}` : '';
+  }
 
   delete image.__v;
   delete image.userId;
@@ -93,6 +99,15 @@ if (process.env.TELEGRAM_TOKEN) {
 }
 
 // Email transporter
+// SHA-256 of a stored upload, streamed so large images are not buffered twice
+const hashFile = (filePath) => new Promise((resolve, reject) => {
+  const hash = crypto.createHash('sha256');
+  fs.createReadStream(filePath)
+    .on('data', (chunk) => hash.update(chunk))
+    .on('end', () => resolve(hash.digest('hex')))
+    .on('error', reject);
+});
+
 const createEmailTransporter = () => {
   if (!process.env.GMAIL_USER || !process.env.GMAIL_PASS) {
     console.warn('Email credentials not configured');
@@ -199,42 +214,173 @@ const sendTelegramNotification = async (user, imageData) => {
   }
 };
 
-// @desc    Upload image from ESP32 and process
-// @route   POST /api/upload-image
+// @desc    Tell the device whether an image with this content hash is stored
+// @route   GET /api/upload-image/:hash
 // @access  Private (JWT)
-exports.uploadImage = async (req, res) => {
+exports.checkUpload = async (req, res) => {
   try {
-    if (!req.file) {
+    const contentHash = String(req.params.hash).toLowerCase();
+    if (!Image.isContentHash(contentHash)) {
       return res.status(400).json({
         success: false,
-        message: 'No image file provided'
+        message: 'Invalid content hash'
       });
     }
 
-    const imagePath = req.file.path;
-    const filename = req.file.filename;
+    const existing = await Image.findByContentHash(req.user._id, contentHash);
+    if (!existing) {
+      return res.status(404).json({
+        success: false,
+        exists: false
+      });
+    }
 
-    console.log(`Image received: ${filename}`);
+    res.status(200).json({
+      success: true,
+      exists: true,
+      data: { image: { id: existing._id } }
+    });
+  } catch (error) {
+    console.error('Check upload error:', error.message);
+    res.status(500).json({
+      success: false,
+      message: 'Error checking upload',
+      error: error.message
+    });
+  }
+};
 
+// @desc    Upload image from ESP32 and process
+// @route   POST /api/upload-image
+// @access  Private (JWT)
+exports.uploadImage = async (req, res) => {
+  if (!req.file) {
+    return res.status(400).json({
+      success: false,
+      message: 'No image file provided'
+    });
+  }
+
+  console.log(`Image received: ${req.file.filename}`);
+
+  await exports.processDeviceImage(req, res, {
+    imagePath: req.file.path,
+    filename: req.file.filename,
+    captureId: req.get('X-Capture-Id'),
+    imageKind: req.get('X-Image-Kind'),
+    roiHeader: req.get('X-Roi'),
+    capturedAtHeader: req.get('X-Captured-At'),
+    claimedHash: req.get('X-Content-SHA256'),
+    detectionHeader: req.get('X-Detection')
+  });
+};
+
+// Store an image file that has fully arrived in uploads/ (multipart or resumable):
+// dedupe by content hash, pair with its thumbnail, detect, notify.
+exports.processDeviceImage = async (req, res, { imagePath, filename, captureId, imageKind, roiHeader, capturedAtHeader, claimedHash, detectionHeader }) => {
+  try {
     // Normalize path for URL (convert backslashes to forward slashes)
     // Remove any leading slashes and ensure it starts with /uploads/
     const normalizedPath = normalizeImagePath(imagePath);
 
     console.log(`Normalized path: ${normalizedPath}`);
 
-    // Detect person using OpenCV
-    const isPersonDetected = await detectPerson(imagePath);
+    // Thumbnail-first delivery: the device sends a preview, then the full image later.
+    // ROI crops stand in for the thumbnail; the full frame stays on the device SD
+    const isThumbnail = imageKind === 'thumb' || imageKind === 'roi';
+    const roi = imageKind === 'roi' ? Image.parseRoi(roiHeader) : undefined;
+    // Fleet: which camera sent it (fetch_full is addressed to that camera only)
+    const deviceId = req.get('X-Device-Id') || undefined;
+    const captureFields = Image.captureFields(captureId, capturedAtHeader);
+
+    // Capture ids never repeat on a camera: a second preview for one is a resend
+    if (isThumbnail) {
+      const existing = await Image.findCapture(req.user._id, deviceId, captureId);
+      if (existing) {
+        fs.unlinkSync(imagePath);
+        console.log(`Duplicate preview for ${deviceId}/${captureId} ignored`);
+        return res.status(200).json({
+          success: true,
+          message: 'Duplicate upload ignored',
+          data: { image: { id: existing._id }, duplicate: true }
+        });
+      }
+    }
+
+    // Crash-safe queue: the device may resend a file it already delivered
+    let contentHash;
+    if (!isThumbnail) {
+      contentHash = await hashFile(imagePath);
+      claimedHash = (claimedHash || '').toLowerCase();
+      if (claimedHash && claimedHash !== contentHash) {
+        fs.unlinkSync(imagePath);
+        console.warn(`Content hash mismatch for ${filename} - body corrupted in transit`);
+        return res.status(400).json({
+          success: false,
+          message: 'Content hash mismatch'
+        });
+      }
+
+      const existing = await Image.findByContentHash(req.user._id, contentHash);
+      if (existing) {
+        fs.unlinkSync(imagePath);
+        console.log(`Duplicate upload ignored (${contentHash.slice(0, 12)}), already stored as ${existing._id}`);
+        return res.status(200).json({
+          success: true,
+          message: 'Duplicate upload ignored',
+          data: { image: { id: existing._id }, duplicate: true }
+        });
+      }
+    }
+
+    if (imageKind === 'full' && captureId) {
+      const updated = await Image.attachFullImage(captureId, req.user._id, {
+        filename,
+        path: normalizedPath,
+        contentHash,
+        deviceId
+      });
+      if (updated) {
+        console.log(`Full image attached to capture ${captureId}`);
+        const serialized = transformImageDoc(updated, req);
+        return res.status(200).json({
+          success: true,
+          message: 'Full image attached',
+          data: {
+            image: {
+              id: updated._id,
+              path: serialized?.path,
+              url: serialized?.url
+            }
+          }
+        });
+      }
+    }
+
+    // The camera's own detector (X-Detection: "person,87") replaces the server check;
+    // without it, detect a person using OpenCV
+    const detection = Image.parseDetection(detectionHeader);
+    const isPersonDetected = detection ? true : await detectPerson(imagePath);
+    const detectedObject = detection ? detection.detectedObject : 'person';
 
     if (isPersonDetected) {
-      console.log('Person detected in image!');
+      console.log(`${detectedObject} detected in image${detection ? ' (on device)' : ''}!`);
 
       // Save to MongoDB
       const image = await Image.create({
         filename,
         path: normalizedPath,  // Use normalized path for URL
         timestamp: new Date(),
-        detectedObject: 'person',
-        userId: req.user._id
+        detectedObject,
+        confidence: detection?.confidence,
+        userId: req.user._id,
+        deviceId,
+        captureId,
+        thumbnailPath: isThumbnail ? normalizedPath : undefined,
+        fullAvailable: !isThumbnail,
+        contentHash,
+        roi,
+        ...captureFields
       });
 
       const serializedImage = transformImageDoc(image, req);
@@ -242,33 +388,40 @@ exports.uploadImage = async (req, res) => {
       // Get user data for notifications
       const user = await User.findById(req.user._id);
 
-      // Send notifications in parallel
-      await Promise.all([
-        sendEmailNotification(user, {
-          filename,
-          path: imagePath,
-          timestamp: image.timestamp,
-          detectedObject: 'person'
-        }),
-        sendTelegramNotification(user, {
-          filename,
-          path: imagePath,
-          timestamp: image.timestamp,
-          detectedObject: 'person'
-        })
-      ]);
+      // Captures the device labelled background are kept but don't alert anyone
+      const notify = detectedObject !== 'background';
+      if (notify) {
+        // Send notifications in parallel
+        await Promise.all([
+          sendEmailNotification(user, {
+            filename,
+            path: imagePath,
+            timestamp: image.timestamp,
+            detectedObject
+          }),
+          sendTelegramNotification(user, {
+            filename,
+            path: imagePath,
+            timestamp: image.timestamp,
+            detectedObject
+          })
+        ]);
+      }
 
+      const label = detectedObject.charAt(0).toUpperCase() + detectedObject.slice(1);
       res.status(201).json({
         success: true,
-        message: 'Person detected! Image saved and notifications sent.',
+        message: notify ? `${label} detected! Image saved and notifications sent.` : `${label}: image saved.`,
         data: {
           image: {
             id: image._id,
             filename: image.filename,
             timestamp: image.timestamp,
             detectedObject: image.detectedObject,
+            confidence: image.confidence,
             path: serializedImage?.path,
-            url: serializedImage?.url
+            url: serializedImage?.url,
+            fullAvailable: image.fullAvailable
           }
         }
       });
@@ -286,9 +439,9 @@ exports.uploadImage = async (req, res) => {
     console.error('Upload error:', error.message);
     
     // Clean up file on error
-    if (req.file && req.file.path) {
+    if (imagePath) {
       try {
-        fs.unlinkSync(req.file.path);
+        fs.unlinkSync(imagePath);
       } catch (e) {
         console.error('Error deleting file:', e.message);
       }
@@ -314,10 +467,17 @@ exports.getImages = async (req, res) => {
     // Build query based on user role
     // Admin and Manager see all images, regular user sees only their own
     const query = (req.user.role === 'admin' || req.user.role === 'manager') ? {} : { userId: req.user._id };
+    if (req.query.deviceId) {
+      query.deviceId = String(req.query.deviceId);
+    }
+    // order=capture: newest capture first by the camera's own sequence (clock-independent)
+    const sort = req.query.order === 'capture'
+      ? { captureBoot: -1, captureSeq: -1, timestamp: -1 }
+      : { timestamp: -1 };
 
     // Get images
     const images = await Image.find(query)
-      .sort({ timestamp: -1 })
+      .sort(sort)
       .skip(skip)
       .limit(limit)
       .populate('userId', 'username') // Populate uploader info
@@ -383,6 +543,58 @@ exports.getImageById = async (req, res) => {
   }
 };
 
+// @desc    Ask the camera to upload the full-resolution image for a thumbnail
+// @route   POST /api/images/:id/fetch-full
+// @access  Private (JWT)
+exports.requestFullImage = async (req, res) => {
+  try {
+    const query = (req.user.role === 'admin' || req.user.role === 'manager')
+      ? { _id: req.params.id }
+      : { _id: req.params.id, userId: req.user._id };
+
+    const image = await Image.findOne(query);
+
+    if (!image) {
+      return res.status(404).json({
+        success: false,
+        message: 'Image not found'
+      });
+    }
+
+    if (image.fullAvailable || !image.captureId) {
+      return res.status(200).json({
+        success: true,
+        message: 'Full image already available',
+        data: transformImageDoc(image, req)
+      });
+    }
+
+    // The ack means "queued": the camera's backlog pass uploads the file next,
+    // and 'image-full-ready' goes out over Socket.IO when it arrives
+    const ack = await mqttService.sendTuningCommand('fetch_full', image.captureId, 10000, image.deviceId);
+    if (ack.result !== 'ok') {
+      return res.status(502).json({
+        success: false,
+        message: `Camera could not queue the full image (${ack.result})`,
+        data: { ack }
+      });
+    }
+
+    res.status(202).json({
+      success: true,
+      message: 'Full image requested from the camera',
+      data: transformImageDoc(image, req)
+    });
+  } catch (error) {
+    console.error('Fetch full image error:', error.message);
+    res.status(504).json({
+      success: false,
+      message: 'Error fetching full image',
+      error: error.message
+    });
+  }
+};
+
 // @desc    Delete image
 // @route   DELETE /api/images/:id
 // @access  Private (JWT)
@@ -411,6 +623,14 @@ exports.deleteImage = async (req, res) => {
       fs.unlinkSync(image.path);
     }
 
+    // Thumbnail file is separate once the full image has been attached
+    if (image.thumbnailPath && image.thumbnailPath !== image.path) {
+      const thumbPath = resolveUploadPath(image.thumbnailPath);
+      if (thumbPath && fs.existsSync(thumbPath)) {
+        fs.unlinkSync(thumbPath);
+      }
+    }
+
     // Delete from database
     await Image.deleteOne({ _id: req.params.id });
 
@@ -0,0 +1,241 @@
+const path = require('path');
+const fs = require('fs');
+const fsp = require('fs').promises;
+const { Transform, pipeline } = require('stream');
+const mongoose = require('mongoose');
+const Image = require('../models/Image');
+const UploadSession = require('../models/UploadSession');
+const { processDeviceImage } = require('./imageController');
+
+const UPLOAD_DIR = path.join(__dirname, '../uploads');
+const PARTIAL_DIR = path.join(UPLOAD_DIR, 'partial');
+const MAX_UPLOAD_BYTES = 5 * 1024 * 1024; // Same cap as the multipart route
+
+const partPath = (session) => path.join(PARTIAL_DIR, `${session._id}.part`);
+
+// Sessions with a PATCH body being written. Two appends on one session would
+// both pass the offset check and interleave their bytes in the .part file.
+// Per process: all of a session's PATCHes must reach the process that holds it.
+const appending = new Set();
+
+// Bytes on disk are the only acknowledged offset: whatever survived a dropped
+// connection counts, nothing else does.
+const currentOffset = async (session) => {
+  try {
+    const stat = await fsp.stat(partPath(session));
+    return Math.min(stat.size, session.length);
+  } catch (error) {
+    return 0;
+  }
+};
+
+const findSession = (req) => (mongoose.isValidObjectId(req.params.id)
+  ? UploadSession.findOne({ _id: req.params.id, userId: req.user._id })
+  : Promise.resolve(null));
+
+// Remove partial files whose session has expired
+const purgeStaleParts = async () => {
+  const entries = await fsp.readdir(PARTIAL_DIR).catch(() => []);
+  const cutoff = Date.now() - UploadSession.SESSION_TTL_MS;
+  await Promise.all(entries.map(async (name) => {
+    const file = path.join(PARTIAL_DIR, name);
+    const stat = await fsp.stat(file).catch(() => null);
+    if (stat && stat.mtimeMs < cutoff) {
+      await fsp.unlink(file).catch(() => {});
+    }
+  }));
+};
+
+// Pass through at most `limit` bytes, dropping anything past the declared length
+const limitBytes = (limit) => {
+  let seen = 0;
+  return new Transform({
+    transform(chunk, encoding, callback) {
+      const room = Math.max(0, limit - seen);
+      seen += chunk.length;
+      callback(null, chunk.length > room ? chunk.subarray(0, room) : chunk);
+    }
+  });
+};
+
+// @desc    Open (or reopen) a resumable upload session
+// @route   POST /api/uploads
+// @headers Upload-Length, X-Content-SHA256, optional X-Capture-Id / X-Image-Kind / X-Roi / X-Captured-At
+// @access  Private (JWT)
+exports.createUpload = async (req, res) => {
+  try {
+    const length = parseInt(req.get('Upload-Length'), 10);
+    const contentHash = (req.get('X-Content-SHA256') || '').toLowerCase();
+
+    if (!Number.isInteger(length) || length <= 0 || length > MAX_UPLOAD_BYTES) {
+      return res.status(400).json({
+        success: false,
+        message: `Upload-Length must be 1..${MAX_UPLOAD_BYTES}`
+      });
+    }
+    if (!Image.isContentHash(contentHash)) {
+      return res.status(400).json({
+        success: false,
+        message: 'X-Content-SHA256 is required'
+      });
+    }
+
+    const existing = await Image.findByContentHash(req.user._id, contentHash);
+    if (existing) {
+      return res.status(200).json({
+        success: true,
+        message: 'Duplicate upload ignored',
+        data: { image: { id: existing._id }, duplicate: true }
+      });
+    }
+
+    await fsp.mkdir(PARTIAL_DIR, { recursive: true });
+    purgeStaleParts().catch(() => {});
+
+    // Same bytes as an unfinished session: resume it instead of starting over
+    let session = await UploadSession.findOne({ userId: req.user._id, contentHash });
+    if (session && session.length !== length) {
+      await fsp.unlink(partPath(session)).catch(() => {});
+      await session.deleteOne();
+      session = null;
+    }
+    if (!session) {
+      session = await UploadSession.create({
+        userId: req.user._id,
+        contentHash,
+        length,
+        captureId: req.get('X-Capture-Id'),
+        kind: req.get('X-Image-Kind'),
+        roi: req.get('X-Roi'),
+        capturedAt: Number(req.get('X-Captured-At')) || undefined
+      });
+    } else {
+      await session.touch();
+    }
+
+    const offset = await currentOffset(session);
+    console.log(`📦 Upload session ${session._id}: ${offset}/${length} bytes`);
+
+    res.status(201)
+      .set('Location', `/api/uploads/${session._id}`)
+      .set('Upload-Offset', String(offset))
+      .json({
+        success: true,
+        data: { id: session._id, offset, length }
+      });
+  } catch (error) {
+    console.error('Create upload error:', error.message);
+    res.status(500).json({
+      success: false,
+      message: 'Error creating upload session',
+      error: error.message
+    });
+  }
+};
+
+// @desc    Current offset of an upload session
+// @route   HEAD /api/uploads/:id
+// @access  Private (JWT)
+exports.getUploadOffset = async (req, res) => {
+  try {
+    const session = await findSession(req);
+    if (!session) {
+      return res.status(404).end();
+    }
+    res.status(200)
+      .set('Upload-Offset', String(await currentOffset(session)))
+      .set('Upload-Length', String(session.length))
+      .set('Cache-Control', 'no-store')
+      .end();
+  } catch (error) {
+    console.error('Upload offset error:', error.message);
+    res.status(500).end();
+  }
+};
+
+// @desc    Append bytes at Upload-Offset; the last chunk stores the image
+// @route   PATCH /api/uploads/:id  (Content-Type: application/offset+octet-stream)
+// @access  Private (JWT)
+exports.appendUpload = async (req, res) => {
+  try {
+    const session = await findSession(req);
+    if (!session) {
+      return res.status(404).json({
+        success: false,
+        message: 'Upload session not found'
+      });
+    }
+
+    // One append per session at a time (see appending)
+    const key = String(session._id);
+    if (appending.has(key)) {
+      return res.status(423)
+        .set('Retry-After', '1')
+        .json({
+          success: false,
+          message: 'Another append to this upload is in progress'
+        });
+    }
+    appending.add(key);
+    try {
+      const offset = await currentOffset(session);
+      const clientOffset = parseInt(req.get('Upload-Offset'), 10);
+      if (clientOffset !== offset) {
+        return res.status(409)
+          .set('Upload-Offset', String(offset))
+          .json({
+            success: false,
+            message: 'Offset mismatch',
+            data: { offset }
+          });
+      }
+
+      // Keep everything that arrives, even if the connection drops mid-body
+      const interrupted = await new Promise((resolve) => {
+        const out = fs.createWriteStream(partPath(session), { flags: 'a' });
+        pipeline(req, limitBytes(session.length - offset), out, (error) => {
+          if (error) {
+            console.log(`⚠️ Upload ${session._id} interrupted: ${error.message}`);
+          }
+          resolve(Boolean(error));
+        });
+      });
+      const written = await currentOffset(session);
+      await session.touch();
+
+      if (interrupted || req.socket.destroyed) {
+        return; // Client is gone; it will ask for the offset on reconnect
+      }
+      if (written < session.length) {
+        return res.status(204).set('Upload-Offset', String(written)).end();
+      }
+
+      // Complete: hand over to the normal image path (hash check, pairing, detection)
+      const filename = `capture-${Date.now()}-${Math.round(Math.random() * 1E9)}.jpg`;
+      const imagePath = path.join(UPLOAD_DIR, filename);
+      await fsp.rename(partPath(session), imagePath);
+      await session.deleteOne();
+      console.log(`📦 Upload session ${session._id} complete (${session.length} bytes)`);
+
+      res.set('Upload-Offset', String(written));
+      await processDeviceImage(req, res, {
+        imagePath,
+        filename,
+        captureId: session.captureId,
+        imageKind: session.kind,
+        roiHeader: session.roi,
+        capturedAtHeader: session.capturedAt,
+        claimedHash: session.contentHash
+      });
+    } finally {
+      appending.delete(key);
+    }
+  } catch (error) {
+    console.error('Append upload error:', error.message);
+    res.status(500).json({
+      success: false,
+      message: 'Error appending upload',
+      error: error.message
+    });
+  }
+};
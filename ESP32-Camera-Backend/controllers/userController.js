@@ -104,7 +104,7 @@ exports.banUser = async (req, res) => {
 
     // Notify ESP32 via MQTT (so it can log it)
     if (mqttService.isConnected()) {
-      mqttService.publish(mqttService.topics.command, `User ${user.username} has been banned`);
+      mqttService.publish(mqttService.commandTopic(), `User ${user.username} has been banned`);
     }
 
     res.status(200).json({
@@ -0,0 +1,551 @@
+/**
+ * main.cpp - Detector kernel tests and benchmarks (Linux)
+ *
+ * Builds the firmware's int8_kernels.cpp and detector_model.cpp unchanged.
+ *
+ *   detector_bench test [iterations]      fast == reference, bit for bit, on
+ *                                         random layers and whole models;
+ *                                         exits 1 on any difference
+ *   detector_bench bench [model.bin]      per-inference and per-layer latency
+ *                                         of both kernel paths, arena and
+ *                                         weight memory (RUNS, default 200)
+ *   detector_bench make-model out.bin [seed]
+ *                                         random-weight model in the device
+ *                                         format (for /models/detector.bin)
+ *   detector_bench classify model.bin frame.pgm
+ *                                         label one 8-bit grayscale PGM
+ *
+ * Without a model file the random standard model (model_writer.h) is used.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "detector_model.h"
+#include "int8_kernels.h"
+#include "model_writer.h"
+
+static const uint8_t CANARY = 0xA5;
+static const size_t GUARD = 64;
+
+static uint64_t nowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool readFile(const char* path, std::vector<uint8_t>& out) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        return false;
+    }
+    uint8_t buf[65536];
+    size_t n;
+    out.clear();
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        out.insert(out.end(), buf, buf + n);
+    }
+    fclose(f);
+    return true;
+}
+
+// Model blob in 4-aligned storage (std::vector<uint8_t> makes no promise)
+struct ModelBlob {
+    std::vector<uint32_t> words;
+    size_t len = 0;
+
+    void assign(const std::vector<uint8_t>& bytes) {
+        len = bytes.size();
+        words.assign((len + 3) / 4, 0);
+        if (len) {
+            memcpy(words.data(), bytes.data(), len);
+        }
+    }
+    const uint8_t* data() const { return (const uint8_t*)words.data(); }
+};
+
+static bool loadModel(const char* path, ModelBlob& blob, DetectorModel& model) {
+    if (path) {
+        std::vector<uint8_t> bytes;
+        if (!readFile(path, bytes)) {
+            fprintf(stderr, "❌ Cannot read %s\n", path);
+            return false;
+        }
+        blob.assign(bytes);
+    } else {
+        blob.assign(ModelWriter::standard(1).bytes());
+    }
+    if (!model.parse(blob.data(), blob.len)) {
+        fprintf(stderr, "❌ %s: %s\n", path ? path : "standard model", model.error());
+        return false;
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// test
+
+struct TestCounts {
+    unsigned run = 0;
+    unsigned failed = 0;
+
+    void check(bool ok, const char* what) {
+        run++;
+        if (!ok) {
+            failed++;
+            if (failed <= 20) {
+                printf("❌ %s\n", what);
+            }
+        }
+    }
+};
+
+// TFLite values worked out by hand
+static void testRequantize(TestCounts& t) {
+    t.check(saturatingRoundingDoublingHighMul(INT32_MIN, INT32_MIN) == INT32_MAX, "SRDHM saturates");
+    t.check(saturatingRoundingDoublingHighMul(1 << 30, 1 << 30) == (1 << 29), "SRDHM 0.5 * 0.5");
+    t.check(saturatingRoundingDoublingHighMul(-1, 1 << 30) == 0, "SRDHM -1 * 0.5");
+    t.check(roundingDivideByPOT(5, 1) == 3, "RDBP 5 / 2");
+    t.check(roundingDivideByPOT(-5, 1) == -3, "RDBP -5 / 2");
+    t.check(roundingDivideByPOT(4, 1) == 2, "RDBP 4 / 2");
+    t.check(roundingDivideByPOT(-3, 1) == -2, "RDBP -3 / 2");
+    t.check(roundingDivideByPOT(7, 0) == 7, "RDBP by 1");
+    t.check(multiplyByQuantizedMultiplier(1000, 1 << 30, 0) == 500, "MBQM 1000 * 0.5");
+    t.check(multiplyByQuantizedMultiplier(1001, 1 << 30, 0) == 501, "MBQM 1001 * 0.5");
+    t.check(multiplyByQuantizedMultiplier(100, 1 << 30, -1) == 25, "MBQM 100 * 0.25");
+    t.check(multiplyByQuantizedMultiplier(-75, 1 << 30, -1) == -19, "MBQM -75 * 0.25");
+    t.check(multiplyByQuantizedMultiplier(3, 1 << 30, 2) == 6, "MBQM 3 * 2");
+
+    int8_t in[4] = { 1, 2, -1, -2 };    // 2x1 pixels x 2 channels
+    int8_t out[2];
+    averagePoolGlobal(in, { 2, 1, 2 }, -128, 127, out);
+    t.check(out[0] == 0 && out[1] == 0, "avgpool (1 + -1) / 2, (2 + -2) / 2");
+    int8_t up[4] = { 1, -1, 2, -2 };
+    averagePoolGlobal(up, { 2, 1, 2 }, -128, 127, out);
+    t.check(out[0] == 2 && out[1] == -2, "avgpool 1.5 -> 2, -1.5 -> -2");
+}
+
+struct RandomLayer {
+    std::mt19937& random;
+    std::vector<int32_t> bias, multiplier, shift;
+    QuantParams quant;
+
+    explicit RandomLayer(std::mt19937& r) : random(r), quant() {}
+
+    int range(int lo, int hi) { return std::uniform_int_distribution<int>(lo, hi)(random); }
+
+    void fill(std::vector<int8_t>& v, size_t n) {
+        v.resize(n);
+        for (auto& x : v) {
+            x = (int8_t)range(-128, 127);
+        }
+    }
+
+    // Includes the edges: zero and full-scale multipliers, large shifts,
+    // narrow clamps, offsets at both ends
+    void makeQuant(uint16_t channels) {
+        bias.resize(channels);
+        multiplier.resize(channels);
+        shift.resize(channels);
+        for (uint16_t c = 0; c < channels; c++) {
+            bias[c] = range(-(1 << 20), 1 << 20);
+            switch (range(0, 9)) {
+                case 0: multiplier[c] = 0; break;
+                case 1: multiplier[c] = INT32_MAX; break;
+                case 2: multiplier[c] = 1 << 30; break;
+                default: multiplier[c] = range(1 << 30, INT32_MAX); break;
+            }
+            shift[c] = range(0, 4) == 0 ? range(-31, 4) : range(-12, 0);
+        }
+        quant.multiplier = multiplier.data();
+        quant.shift = shift.data();
+        quant.inputOffset = range(0, 3) == 0 ? 128 : range(-127, 128);
+        quant.outputOffset = range(-128, 127);
+        int a = range(-128, 127), b = range(-128, 127);
+        quant.actMin = range(0, 1) ? -128 : std::min(a, b);
+        quant.actMax = range(0, 1) ? 127 : std::max(a, b);
+    }
+
+    const int32_t* maybeBias() { return range(0, 9) == 0 ? nullptr : bias.data(); }
+};
+
+static bool convDimension(uint16_t in, uint8_t kernel, uint8_t stride, bool same,
+                          uint16_t& out, uint8_t& pad) {
+    if (same) {
+        out = (in + stride - 1) / stride;
+        int total = (out - 1) * stride + kernel - in;
+        pad = total > 0 ? total / 2 : 0;
+        return true;
+    }
+    if (in < kernel) {
+        return false;
+    }
+    out = (in - kernel) / stride + 1;
+    pad = 0;
+    return true;
+}
+
+// Output and scratch get guard bytes: an overrun counts as a failure
+static bool sameWithGuards(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b, size_t len,
+                           const std::vector<uint8_t>& scratch, size_t scratchLen) {
+    for (size_t i = len; i < len + GUARD; i++) {
+        if (a[i] != CANARY || b[i] != CANARY) {
+            return false;
+        }
+    }
+    for (size_t i = scratchLen; i < scratchLen + GUARD; i++) {
+        if (scratch[i] != CANARY) {
+            return false;
+        }
+    }
+    return memcmp(a.data(), b.data(), len) == 0;
+}
+
+static void testKernels(TestCounts& t, unsigned iterations, uint32_t seed) {
+    std::mt19937 random(seed);
+    RandomLayer r(random);
+    std::vector<int8_t> input, filter;
+    std::vector<uint8_t> ref, fast, scratch;
+    char what[192];
+
+    for (unsigned i = 0; i < iterations; i++) {
+        int kind = i % 3;
+        TensorShape in = { (uint16_t)r.range(1, 12), (uint16_t)r.range(1, 12), (uint16_t)r.range(1, 24) };
+        ConvGeometry g = { (uint8_t)r.range(1, 5), (uint8_t)r.range(1, 5), (uint8_t)r.range(1, 3),
+                           (uint8_t)r.range(1, 3), 0, 0 };
+        bool same = r.range(0, 1);
+        TensorShape out = { 0, 0, 0 };
+        if (kind < 2 && (!convDimension(in.h, g.kernelH, g.strideH, same, out.h, g.padTop) ||
+                         !convDimension(in.w, g.kernelW, g.strideW, same, out.w, g.padLeft))) {
+            same = true;
+            convDimension(in.h, g.kernelH, g.strideH, true, out.h, g.padTop);
+            convDimension(in.w, g.kernelW, g.strideW, true, out.w, g.padLeft);
+        }
+        r.fill(input, in.size());
+
+        size_t outLen = 0, scratchLen = 0;
+        if (kind == 0) {
+            out.c = r.range(1, 24);
+            outLen = out.size();
+            scratchLen = conv2dScratchBytes(in, g, out);
+            r.fill(filter, (size_t)out.c * g.kernelH * g.kernelW * in.c);
+        } else if (kind == 1) {
+            out.c = in.c;
+            outLen = out.size();
+            scratchLen = depthwiseConvScratchBytes(in, g, out);
+            r.fill(filter, (size_t)g.kernelH * g.kernelW * in.c);
+        } else {
+            outLen = r.range(1, 24);
+            scratchLen = fullyConnectedScratchBytes(in.size());
+            r.fill(filter, in.size() * outLen);
+        }
+        r.makeQuant(kind == 2 ? outLen : out.c);
+        const int32_t* bias = r.maybeBias();
+
+        ref.assign(outLen + GUARD, CANARY);
+        fast.assign(outLen + GUARD, CANARY);
+        scratch.assign(scratchLen + GUARD, CANARY);
+        int8_t* refOut = (int8_t*)ref.data();
+        int8_t* fastOut = (int8_t*)fast.data();
+
+        if (kind == 0) {
+            conv2dRef(input.data(), in, filter.data(), bias, g, r.quant, refOut, out);
+            conv2dFast(input.data(), in, filter.data(), bias, g, r.quant, fastOut, out, scratch.data());
+        } else if (kind == 1) {
+            depthwiseConvRef(input.data(), in, filter.data(), bias, g, r.quant, refOut, out);
+            depthwiseConvFast(input.data(), in, filter.data(), bias, g, r.quant, fastOut, out, scratch.data());
+        } else {
+            fullyConnectedRef(input.data(), in.size(), filter.data(), bias, r.quant, refOut, outLen);
+            fullyConnectedFast(input.data(), in.size(), filter.data(), bias, r.quant, fastOut, outLen,
+                               scratch.data());
+        }
+
+        static const char* KINDS[] = { "conv", "depthwise", "fc" };
+        snprintf(what, sizeof(what),
+                 "%s #%u: in %ux%ux%u, kernel %ux%u stride %ux%u pad %u,%u (%s), out %ux%ux%u",
+                 KINDS[kind], i, in.h, in.w, in.c, g.kernelH, g.kernelW, g.strideH, g.strideW,
+                 g.padTop, g.padLeft, same ? "same" : "valid", out.h, out.w, kind == 2 ? (unsigned)outLen : out.c);
+        t.check(sameWithGuards(ref, fast, outLen, scratch, scratchLen), what);
+    }
+}
+
+static void randomPlane(std::mt19937& random, std::vector<uint8_t>& plane, uint16_t w, uint16_t h) {
+    plane.resize((size_t)w * h);
+    // Smooth-ish content: gradient plus noise, like a small camera frame
+    std::uniform_int_distribution<int> noise(-40, 40);
+    for (uint16_t y = 0; y < h; y++) {
+        for (uint16_t x = 0; x < w; x++) {
+            int v = (x * 255 / w + y * 128 / h) / 2 + 64 + noise(random);
+            plane[(size_t)y * w + x] = (uint8_t)std::min(255, std::max(0, v));
+        }
+    }
+}
+
+static void testModels(TestCounts& t, uint32_t seed) {
+    static const uint16_t SIZES[][2] = { { 200, 150 }, { 80, 60 }, { 96, 96 }, { 40, 30 }, { 1, 1 } };
+    std::mt19937 random(seed);
+    std::vector<uint8_t> plane;
+    char what[128];
+
+    for (uint32_t s = 1; s <= 4; s++) {
+        ModelBlob blob;
+        blob.assign(ModelWriter::standard(seed + s).bytes());
+        DetectorModel model;
+        t.check(model.parse(blob.data(), blob.len), "standard model parses");
+        if (model.layerCount() == 0) {
+            continue;
+        }
+        std::vector<uint8_t> arena(model.arenaBytes());
+        for (auto& size : SIZES) {
+            randomPlane(random, plane, size[0], size[1]);
+            Detection ref, fast;
+            model.run(plane.data(), size[0], size[1], arena.data(), KERNELS_REFERENCE, ref);
+            model.run(plane.data(), size[0], size[1], arena.data(), KERNELS_FAST, fast);
+            snprintf(what, sizeof(what), "model seed %u, %ux%u plane: logits differ",
+                     seed + s, size[0], size[1]);
+            t.check(memcmp(ref.logits, fast.logits, sizeof(ref.logits)) == 0 && ref.label == fast.label, what);
+        }
+    }
+
+    // Damaged files are refused, never read past their end
+    std::vector<uint8_t> bytes = ModelWriter::standard(seed).bytes();
+    for (size_t len = 0; len < bytes.size(); len += 1 + len / 16) {
+        ModelBlob cut;
+        cut.assign(std::vector<uint8_t>(bytes.begin(), bytes.begin() + len));
+        DetectorModel model;
+        snprintf(what, sizeof(what), "model cut to %zu of %zu bytes accepted", len, bytes.size());
+        t.check(!model.parse(cut.data(), cut.len), what);
+    }
+    ModelBlob bad;
+    bytes[0] ^= 0xFF;
+    bad.assign(bytes);
+    DetectorModel model;
+    t.check(!model.parse(bad.data(), bad.len), "bad magic accepted");
+    bytes[0] ^= 0xFF;
+    bytes[8 + 0] = 0;   // Input width 0
+    bytes[8 + 1] = 0;
+    bad.assign(bytes);
+    t.check(!model.parse(bad.data(), bad.len), "zero input width accepted");
+}
+
+static int runTests(unsigned iterations) {
+    TestCounts t;
+    uint32_t seed = getenv("SEED") ? strtoul(getenv("SEED"), nullptr, 10) : 1;
+    printf("🧪 int8 kernels (%s) vs reference: %u random layers, seed %u\n",
+           int8KernelBackend(), iterations, seed);
+    testRequantize(t);
+    testKernels(t, iterations, seed);
+    testModels(t, seed);
+    printf("%s %u checks, %u failed\n", t.failed ? "❌" : "✅", t.run, t.failed);
+    return t.failed ? 1 : 0;
+}
+
+// ---------------------------------------------------------------------------
+// bench
+
+struct Timing {
+    uint64_t min, median, p95;
+};
+
+static Timing summarize(std::vector<uint64_t>& samples) {
+    std::sort(samples.begin(), samples.end());
+    return { samples.front(), samples[samples.size() / 2], samples[samples.size() * 95 / 100] };
+}
+
+static void runLayer(const DetectorLayer& l, const int8_t* src, int8_t* dst, void* scratch, bool fast) {
+    switch (l.type) {
+        case LAYER_CONV:
+            if (fast) {
+                conv2dFast(src, l.in, l.weights, l.bias, l.geometry, l.quant, dst, l.out, scratch);
+            } else {
+                conv2dRef(src, l.in, l.weights, l.bias, l.geometry, l.quant, dst, l.out);
+            }
+            break;
+        case LAYER_DEPTHWISE:
+            if (fast) {
+                depthwiseConvFast(src, l.in, l.weights, l.bias, l.geometry, l.quant, dst, l.out, scratch);
+            } else {
+                depthwiseConvRef(src, l.in, l.weights, l.bias, l.geometry, l.quant, dst, l.out);
+            }
+            break;
+        case LAYER_FC:
+            if (fast) {
+                fullyConnectedFast(src, l.in.size(), l.weights, l.bias, l.quant, dst, l.out.c, scratch);
+            } else {
+                fullyConnectedRef(src, l.in.size(), l.weights, l.bias, l.quant, dst, l.out.c);
+            }
+            break;
+        case LAYER_AVGPOOL:
+            averagePoolGlobal(src, l.in, l.quant.actMin, l.quant.actMax, dst);
+            break;
+    }
+}
+
+static int runBench(const char* path) {
+    ModelBlob blob;
+    DetectorModel model;
+    if (!loadModel(path, blob, model)) {
+        return 1;
+    }
+    unsigned runs = getenv("RUNS") ? strtoul(getenv("RUNS"), nullptr, 10) : 200;
+    runs = std::max(runs, 10u);
+
+    size_t largest = (size_t)model.inputW() * model.inputH();
+    size_t scratch = 0;
+    for (uint16_t i = 0; i < model.layerCount(); i++) {
+        largest = std::max(largest, model.layer(i).out.size());
+        scratch = std::max(scratch, model.layer(i).scratch);
+    }
+    printf("📐 %s: %u layers, %ux%u input, %u classes, %" PRIu32 " MACs\n",
+           path ? path : "standard random model", model.layerCount(), model.inputW(), model.inputH(),
+           model.classCount(), model.macs());
+    printf("💾 Memory: model file %zu B (weights %zu B), arena %zu B = 2 x %zu B activations + %zu B scratch, "
+           "frame plane %u B\n",
+           blob.len, model.weightBytes(), model.arenaBytes(), largest, scratch, (unsigned)PIPELINE_GRAY_MAX);
+
+    // Per layer, on random activations
+    std::vector<uint8_t> arena(model.arenaBytes());
+    std::mt19937 random(7);
+    size_t activation = (largest + 15) & ~(size_t)15;   // Same split as DetectorModel::run
+    int8_t* a = (int8_t*)arena.data();
+    int8_t* b = a + activation;
+    void* scratchBuf = arena.data() + 2 * activation;
+    for (size_t i = 0; i < largest; i++) {
+        a[i] = (int8_t)(random() & 0xFF);
+    }
+    static const char* TYPES[] = { "conv", "depthwise", "fc", "avgpool" };
+    printf("\n  #  layer      in            out           MACs       ref us   fast us  speedup\n");
+    unsigned layerRuns = std::max(runs / 10, 5u);
+    for (uint16_t i = 0; i < model.layerCount(); i++) {
+        const DetectorLayer& l = model.layer(i);
+        std::vector<uint64_t> ref, fast;
+        for (unsigned r = 0; r < layerRuns; r++) {
+            uint64_t t0 = nowUs();
+            runLayer(l, a, b, scratchBuf, false);
+            uint64_t t1 = nowUs();
+            runLayer(l, a, b, scratchBuf, true);
+            ref.push_back(t1 - t0);
+            fast.push_back(nowUs() - t1);
+        }
+        uint64_t refUs = summarize(ref).median;
+        uint64_t fastUs = summarize(fast).median;
+        char in[24], out[24];
+        snprintf(in, sizeof(in), "%ux%ux%u", l.in.h, l.in.w, l.in.c);
+        snprintf(out, sizeof(out), "%ux%ux%u", l.out.h, l.out.w, l.out.c);
+        char speedup[16] = "      -";     // Below the timer's resolution
+        if (refUs && fastUs) {
+            snprintf(speedup, sizeof(speedup), "%6.1fx", (double)refUs / fastUs);
+        }
+        printf("%3u  %-9s  %-12s  %-12s  %9" PRIu32 "  %7" PRIu64 "  %8" PRIu64 "  %s\n", i,
+               TYPES[l.type], in, out, l.macs, refUs, fastUs, speedup);
+    }
+
+    // Whole inferences from a camera-sized plane, resize included
+    std::vector<uint8_t> plane;
+    randomPlane(random, plane, 200, 150);
+    printf("\n🏁 Per inference (200x150 plane, %u runs, %s fast path):\n", runs, int8KernelBackend());
+    for (KernelPath path : { KERNELS_REFERENCE, KERNELS_FAST }) {
+        std::vector<uint64_t> samples;
+        Detection d;
+        for (unsigned r = 0; r < runs; r++) {
+            uint64_t t0 = nowUs();
+            model.run(plane.data(), 200, 150, arena.data(), path, d);
+            samples.push_back(nowUs() - t0);
+        }
+        Timing t = summarize(samples);
+        printf("   %-9s  min %6" PRIu64 " us  median %6" PRIu64 " us  p95 %6" PRIu64 " us  %7.1f MMAC/s  -> %s %u%%\n",
+               path == KERNELS_FAST ? "fast" : "reference", t.min, t.median, t.p95,
+               t.median ? (double)model.macs() / t.median : 0.0, d.name, d.confidence);
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// classify
+
+// Binary PGM (P5), 8-bit
+static bool readPgm(const char* path, std::vector<uint8_t>& pixels, uint16_t& w, uint16_t& h) {
+    std::vector<uint8_t> bytes;
+    if (!readFile(path, bytes)) {
+        return false;
+    }
+    std::string text(bytes.begin(), bytes.begin() + std::min<size_t>(bytes.size(), 64));
+    unsigned pw = 0, ph = 0, maxval = 0;
+    int used = 0;
+    if (sscanf(text.c_str(), "P5 %u %u %u%n", &pw, &ph, &maxval, &used) != 3 || maxval != 255 ||
+        pw == 0 || ph == 0 || pw > 65535 || ph > 65535) {
+        return false;
+    }
+    size_t start = used + 1;
+    if (bytes.size() < start + (size_t)pw * ph) {
+        return false;
+    }
+    w = pw;
+    h = ph;
+    pixels.assign(bytes.begin() + start, bytes.begin() + start + (size_t)pw * ph);
+    return true;
+}
+
+static int runClassify(const char* modelPath, const char* imagePath) {
+    ModelBlob blob;
+    DetectorModel model;
+    if (!loadModel(modelPath, blob, model)) {
+        return 1;
+    }
+    std::vector<uint8_t> plane;
+    uint16_t w, h;
+    if (!readPgm(imagePath, plane, w, h)) {
+        fprintf(stderr, "❌ %s is not an 8-bit binary PGM\n", imagePath);
+        return 1;
+    }
+    std::vector<uint8_t> arena(model.arenaBytes());
+    Detection d;
+    uint64_t t0 = nowUs();
+    model.run(plane.data(), w, h, arena.data(), KERNELS_FAST, d);
+    uint64_t us = nowUs() - t0;
+    char tag[DETECTOR_LABEL_LEN + 8];
+    formatDetection(d, tag, sizeof(tag));
+    printf("%s  (", tag);
+    for (uint16_t i = 0; i < model.classCount(); i++) {
+        printf("%s%s %u%%", i ? ", " : "", model.label(i), d.scores[i]);
+    }
+    printf(")  %ux%u in %" PRIu64 " us\n", w, h, us);
+    return 0;
+}
+
+static int usage() {
+    fprintf(stderr, "usage: detector_bench test [iterations]\n"
+                    "       detector_bench bench [model.bin]\n"
+                    "       detector_bench make-model out.bin [seed]\n"
+                    "       detector_bench classify model.bin frame.pgm\n");
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    std::string command = argc > 1 ? argv[1] : "";
+    if (command == "test") {
+        return runTests(argc > 2 ? strtoul(argv[2], nullptr, 10) : 3000);
+    }
+    if (command == "bench") {
+        return runBench(argc > 2 ? argv[2] : nullptr);
+    }
+    if (command == "make-model" && argc > 2) {
+        ModelWriter model = ModelWriter::standard(argc > 3 ? strtoul(argv[3], nullptr, 10) : 1);
+        if (!model.save(argv[2])) {
+            fprintf(stderr, "❌ Cannot write %s\n", argv[2]);
+            return 1;
+        }
+        printf("✅ %s: %zu bytes (random weights)\n", argv[2], model.bytes().size());
+        return 0;
+    }
+    if (command == "classify" && argc > 3) {
+        return runClassify(argv[2], argv[3]);
+    }
+    return usage();
+}
@@ -0,0 +1,165 @@
+/**
+ * model_writer.cpp - Random-weight DET1 models
+ */
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "detector_model.h"
+#include "model_writer.h"
+
+void quantizeMultiplier(double real, int32_t& multiplier, int32_t& shift) {
+    if (real == 0) {
+        multiplier = 0;
+        shift = 0;
+        return;
+    }
+    int exponent;
+    double q = std::frexp(real, &exponent);
+    int64_t fixed = std::llround(q * (1LL << 31));
+    if (fixed == (1LL << 31)) {
+        fixed /= 2;
+        exponent++;
+    }
+    if (exponent < -31) {
+        fixed = 0;
+        exponent = 0;
+    }
+    multiplier = (int32_t)fixed;
+    shift = exponent;
+}
+
+ModelWriter::ModelWriter(uint16_t inputW, uint16_t inputH, uint32_t seed)
+    : _random(seed), _layers(0), _h(inputH), _w(inputW), _c(1), _zeroPoint(-128) {
+    put<uint32_t>(DETECTOR_MODEL_MAGIC);
+    put<uint16_t>(1);           // Version
+    put<uint16_t>(0);           // Layer count, set as layers are added
+    put<uint16_t>(inputW);
+    put<uint16_t>(inputH);
+    put<uint16_t>(0);           // Class count, set by classifier()
+    put<uint16_t>(0);
+    put<float>(0);              // Output scale, set by classifier()
+    put<int32_t>(0);
+    _bytes.resize(_bytes.size() + DETECTOR_MAX_CLASSES * DETECTOR_LABEL_LEN, 0);
+}
+
+template <typename T>
+void ModelWriter::put(T v) {
+    size_t at = _bytes.size();
+    _bytes.resize(at + sizeof(v));
+    memcpy(_bytes.data() + at, &v, sizeof(v));
+}
+
+void ModelWriter::layer(uint8_t type, uint8_t kernel, uint8_t stride, uint16_t outChannels,
+                        int32_t outZeroPoint, int8_t actMin, int8_t actMax) {
+    put<uint8_t>(type);
+    put<uint8_t>(kernel);
+    put<uint8_t>(kernel);
+    put<uint8_t>(stride);
+    put<uint8_t>(1);            // SAME
+    put<int8_t>(actMin);
+    put<int8_t>(actMax);
+    put<uint8_t>(0);
+    put<uint16_t>(outChannels);
+    put<uint16_t>(0);
+    put<int32_t>(-_zeroPoint);
+    put<int32_t>(outZeroPoint);
+    _zeroPoint = outZeroPoint;
+    _layers++;
+    memcpy(_bytes.data() + 6, &_layers, sizeof(_layers));
+}
+
+// Bias, per-channel requantisation and weights. The scale keeps a channel's
+// output spread over the int8 range for inputs like the previous layer's.
+void ModelWriter::parameters(uint16_t channels, size_t weights, size_t taps) {
+    std::uniform_real_distribution<double> jitter(0.7, 1.3);
+    std::uniform_int_distribution<int> weight(-127, 127);
+    double spread = std::sqrt((double)taps) * 2000;
+    std::uniform_int_distribution<int32_t> bias(-(int32_t)spread, (int32_t)spread);
+
+    std::vector<int32_t> multipliers(channels), shifts(channels);
+    for (uint16_t c = 0; c < channels; c++) {
+        put<int32_t>(bias(_random));
+        quantizeMultiplier(48.0 / (std::sqrt((double)taps) * 80 * 73) * jitter(_random),
+                           multipliers[c], shifts[c]);
+    }
+    for (int32_t m : multipliers) {
+        put<int32_t>(m);
+    }
+    for (int32_t s : shifts) {
+        put<int32_t>(s);
+    }
+    for (size_t i = 0; i < weights; i++) {
+        put<int8_t>((int8_t)weight(_random));
+    }
+    while (_bytes.size() % 4) {
+        put<uint8_t>(0);
+    }
+}
+
+void ModelWriter::conv(uint8_t kernel, uint8_t stride, uint16_t outChannels) {
+    layer(LAYER_CONV, kernel, stride, outChannels, -128, -128, 127);   // ReLU
+    parameters(outChannels, (size_t)outChannels * kernel * kernel * _c, (size_t)kernel * kernel * _c);
+    _h = (_h + stride - 1) / stride;
+    _w = (_w + stride - 1) / stride;
+    _c = outChannels;
+}
+
+void ModelWriter::depthwise(uint8_t kernel, uint8_t stride) {
+    layer(LAYER_DEPTHWISE, kernel, stride, _c, -128, -128, 127);
+    parameters(_c, (size_t)kernel * kernel * _c, (size_t)kernel * kernel);
+    _h = (_h + stride - 1) / stride;
+    _w = (_w + stride - 1) / stride;
+}
+
+void ModelWriter::averagePool() {
+    layer(LAYER_AVGPOOL, 0, 0, _c, _zeroPoint, -128, 127);
+    _h = _w = 1;
+}
+
+void ModelWriter::classifier(const std::vector<std::string>& labels) {
+    uint16_t classes = (uint16_t)labels.size();
+    size_t inputs = (size_t)_h * _w * _c;
+    layer(LAYER_FC, 0, 0, classes, 0, -128, 127);
+    parameters(classes, inputs * classes, inputs);
+    _h = _w = 1;
+    _c = classes;
+
+    float outputScale = 0.1f;
+    memcpy(_bytes.data() + 12, &classes, sizeof(classes));
+    memcpy(_bytes.data() + 16, &outputScale, sizeof(outputScale));
+    for (uint16_t i = 0; i < classes && i < DETECTOR_MAX_CLASSES; i++) {
+        strncpy((char*)_bytes.data() + 24 + i * DETECTOR_LABEL_LEN, labels[i].c_str(), DETECTOR_LABEL_LEN);
+    }
+}
+
+bool ModelWriter::save(const std::string& path) const {
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f) {
+        return false;
+    }
+    bool ok = fwrite(_bytes.data(), 1, _bytes.size(), f) == _bytes.size();
+    return fclose(f) == 0 && ok;
+}
+
+ModelWriter ModelWriter::standard(uint32_t seed) {
+    ModelWriter m(96, 96, seed);
+    m.conv(3, 2, 8);                        // 48x48x8
+    m.depthwise(3, 1);
+    m.pointwise(16);
+    m.depthwise(3, 2);                      // 24x24
+    m.pointwise(32);
+    m.depthwise(3, 1);
+    m.pointwise(32);
+    m.depthwise(3, 2);                      // 12x12
+    m.pointwise(64);
+    m.depthwise(3, 1);
+    m.pointwise(64);
+    m.depthwise(3, 2);                      // 6x6
+    m.pointwise(128);
+    m.depthwise(3, 1);
+    m.pointwise(128);
+    m.averagePool();
+    m.classifier({ "background", "person", "vehicle" });
+    return m;
+}
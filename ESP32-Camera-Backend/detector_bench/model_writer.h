@@ -0,0 +1,55 @@
+/**
+ * model_writer.h - DET1 model files with random weights
+ *
+ * A MobileNet-v1-style stack (3x3 conv, then depthwise + pointwise pairs,
+ * global average pool, fully connected) in the file format of
+ * detector_model.h, with plausible per-channel quantisation. The weights
+ * are noise: good for bit-exact tests, timing and memory numbers, not for
+ * detecting anything.
+ */
+
+#ifndef MODEL_WRITER_H
+#define MODEL_WRITER_H
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+// (multiplier, shift) for a real multiplier, as TFLite's QuantizeMultiplier
+void quantizeMultiplier(double real, int32_t& multiplier, int32_t& shift);
+
+class ModelWriter {
+public:
+    ModelWriter(uint16_t inputW, uint16_t inputH, uint32_t seed);
+
+    void conv(uint8_t kernel, uint8_t stride, uint16_t outChannels);
+    void depthwise(uint8_t kernel, uint8_t stride);
+    void pointwise(uint16_t outChannels) { conv(1, 1, outChannels); }
+    void averagePool();
+    // Last layer: one logit per label
+    void classifier(const std::vector<std::string>& labels);
+
+    const std::vector<uint8_t>& bytes() const { return _bytes; }
+    bool save(const std::string& path) const;
+
+    // The stack detector_bench uses by default: 96x96 in, ~3.7 M MACs
+    static ModelWriter standard(uint32_t seed);
+
+private:
+    std::vector<uint8_t> _bytes;
+    std::mt19937 _random;
+    uint16_t _layers;
+    uint16_t _h;
+    uint16_t _w;
+    uint16_t _c;
+    int32_t _zeroPoint;         // Of the current activation
+
+    template <typename T>
+    void put(T v);
+    void layer(uint8_t type, uint8_t kernel, uint8_t stride, uint16_t outChannels, int32_t outZeroPoint,
+               int8_t actMin, int8_t actMax);
+    void parameters(uint16_t channels, size_t weights, size_t taps);
+};
+
+#endif // MODEL_WRITER_H
@@ -3,10 +3,30 @@
  */
 
 #include <Arduino.h>
+#include "esp_timer.h"
+#include "capture_arena.h"
+#include "frame_pipeline.h"
 #include "camera_manager.h"
 
 CameraManager::CameraManager() {
     _initialized = false;
+    _jpegQuality = -1;
+    _streamQuality = -1;
+    _frameSize = FRAMESIZE_INVALID;
+    _initFrameSize = FRAMESIZE_INVALID;
+    _stillSize = FRAMESIZE_INVALID;
+    _stillStartUs = 0;
+    _stillHandedUs = 0;
+    memset(&_stillStats, 0, sizeof(_stillStats));
+    _ownerLock = xSemaphoreCreateMutex();
+}
+
+bool CameraManager::lock(uint32_t waitMs) {
+    return _ownerLock && xSemaphoreTake(_ownerLock, pdMS_TO_TICKS(waitMs)) == pdTRUE;
+}
+
+void CameraManager::unlock() {
+    xSemaphoreGive(_ownerLock);
 }
 
 bool CameraManager::init() {
@@ -51,6 +71,24 @@ bool CameraManager::init() {
         Serial.println("No PSRAM - Standard quality mode");
     }
     
+    // Apply remote-tuned overrides
+    if (_frameSize != FRAMESIZE_INVALID) {
+        config.frame_size = _frameSize;
+    }
+    if (_jpegQuality >= 0) {
+        config.jpeg_quality = _jpegQuality;
+    }
+    _frameSize = config.frame_size;
+    _jpegQuality = config.jpeg_quality;
+
+    // Allocate framebuffers for the still profile so captureStill() can
+    // switch up in place; the sensor is then set back to the stream size
+    _stillSize = _frameSize;
+    if (config.fb_location == CAMERA_FB_IN_PSRAM && FRAME_SIZE_STILL > _frameSize) {
+        _stillSize = FRAME_SIZE_STILL;
+    }
+    config.frame_size = _stillSize;
+    
     esp_err_t err = esp_camera_init(&config);
     if (err != ESP_OK) {
         Serial.printf("✗ Camera init failed: 0x%x\n", err);
@@ -58,6 +96,8 @@ bool CameraManager::init() {
     }
     
     configureSensor();
+    _initFrameSize = config.frame_size;
+    applyStreamProfile();
     _initialized = true;
     Serial.println("✓ Camera ready");
     return true;
@@ -109,3 +149,256 @@ void CameraManager::returnFrameBuffer(camera_fb_t* fb) {
 bool CameraManager::isInitialized() {
     return _initialized;
 }
+
+bool CameraManager::setJpegQuality(int quality) {
+    _jpegQuality = quality;
+    if (!_initialized || _streamQuality >= 0) {
+        return true; // Applied on next init() / when the stream override ends
+    }
+    sensor_t* s = esp_camera_sensor_get();
+    return s && s->set_quality(s, quality) == 0;
+}
+
+bool CameraManager::setStreamQualityOverride(int quality) {
+    _streamQuality = quality;
+    if (!_initialized) {
+        return true;
+    }
+    sensor_t* s = esp_camera_sensor_get();
+    return s && s->set_quality(s, quality >= 0 ? quality : _jpegQuality) == 0;
+}
+
+bool CameraManager::setFrameSize(framesize_t size) {
+    if (!_initialized) {
+        _frameSize = size;
+        return true;
+    }
+    if (size <= _initFrameSize) {
+        // Fits in the existing framebuffers - switch sensor output in place
+        sensor_t* s = esp_camera_sensor_get();
+        if (!s || s->set_framesize(s, size) != 0) {
+            return false;
+        }
+        _frameSize = size;
+        return true;
+    }
+    if (isStreaming) {
+        return false; // Larger buffers need a re-init; not while frames are in flight
+    }
+    _frameSize = size;
+    deinit();
+    return init();
+}
+
+void CameraManager::applyStreamProfile() {
+    sensor_t* s = esp_camera_sensor_get();
+    if (s) {
+        s->set_framesize(s, _frameSize);
+        s->set_quality(s, _streamQuality >= 0 ? _streamQuality : _jpegQuality);
+    }
+}
+
+camera_fb_t* CameraManager::captureStill(bool settle) {
+    if (!_initialized) {
+        Serial.println("✗ Camera not initialized");
+        return nullptr;
+    }
+    memset(&_stillStats, 0, sizeof(_stillStats));
+    _stillStartUs = esp_timer_get_time();
+
+    sensor_t* s = esp_camera_sensor_get();
+    if (!s || _stillSize == _frameSize) {
+        camera_fb_t* fb = esp_camera_fb_get(); // No larger profile available
+        fb = settle ? settleExposure(fb) : fb;
+        _stillHandedUs = esp_timer_get_time();
+        return fb;
+    }
+
+    s->set_quality(s, JPEG_QUALITY_STILL);
+    s->set_framesize(s, _stillSize);
+
+    // Frames already queued were exposed at the stream size; skip them
+    uint16_t width = resolution[_stillSize].width;
+    camera_fb_t* fb = nullptr;
+    while ((fb = esp_camera_fb_get()) != nullptr && fb->width != width) {
+        esp_camera_fb_return(fb);
+        fb = nullptr;
+        if (++_stillStats.droppedUp >= STILL_SWITCH_MAX_FRAMES) {
+            break;
+        }
+    }
+    _stillStats.switchUs = (uint32_t)(esp_timer_get_time() - _stillStartUs);
+
+    if (!fb) {
+        Serial.printf("✗ Still capture failed after %u frames\n", _stillStats.droppedUp);
+        applyStreamProfile();
+        return nullptr;
+    }
+    fb = settle ? settleExposure(fb) : fb;
+    _stillHandedUs = esp_timer_get_time();
+    return fb;
+}
+
+// Exposure lines x gain (1/16 steps) as the sensor's AE/AGC last set them;
+// -1 when the sensor's registers are unknown or unreadable
+int32_t CameraManager::exposureReading(sensor_t* s) {
+    if (!s->get_reg) {
+        return -1;
+    }
+    switch (s->id.PID) {
+        case OV2640_PID: {
+            // Bit 8 of the address selects the sensor bank: AEC is REG45[5:0] AEC[7:0] REG04[1:0]
+            int hi = s->get_reg(s, 0x145, 0x3F);
+            int mid = s->get_reg(s, 0x110, 0xFF);
+            int lo = s->get_reg(s, 0x104, 0x03);
+            int gain = s->get_reg(s, 0x100, 0xFF);
+            if (hi < 0 || mid < 0 || lo < 0 || gain < 0) {
+                return -1;
+            }
+            // GAIN: bits 7..4 each double, bits 3..0 add sixteenths
+            int32_t g = 16 + (gain & 0x0F);
+            for (int bit = 4; bit < 8; bit++) {
+                if (gain & (1 << bit)) {
+                    g *= 2;
+                }
+            }
+            return ((hi << 10) | (mid << 2) | lo) * g;
+        }
+        case OV3660_PID:
+        case OV5640_PID: {
+            // 0x3500-0x3502: exposure in 1/16 lines; 0x350A-0x350B: gain x16
+            int e2 = s->get_reg(s, 0x3500, 0x0F);
+            int e1 = s->get_reg(s, 0x3501, 0xFF);
+            int e0 = s->get_reg(s, 0x3502, 0xFF);
+            int g1 = s->get_reg(s, 0x350A, 0x03);
+            int g0 = s->get_reg(s, 0x350B, 0xFF);
+            if (e2 < 0 || e1 < 0 || e0 < 0 || g1 < 0 || g0 < 0) {
+                return -1;
+            }
+            return (((e2 << 16) | (e1 << 8) | e0) >> 4) * ((g1 << 8) | g0);
+        }
+        default:
+            return -1;
+    }
+}
+
+// Mean of the frame's 1/8-scale grayscale plane; -1 if it cannot be decoded
+int CameraManager::meanLuma(const camera_fb_t* fb) {
+    if (fb->format != PIXFORMAT_JPEG) {
+        return -1;
+    }
+    uint8_t* plane = (uint8_t*)arenaAlloc(PIPELINE_GRAY_MAX);
+    if (!plane) {
+        return -1;
+    }
+    int mean = -1;
+    uint16_t w = 0, h = 0;
+    if (framePipeline.grayFromJpeg(fb->buf, fb->len, plane, PIPELINE_GRAY_MAX, &w, &h) && w && h) {
+        uint32_t sum = 0;
+        uint32_t n = (uint32_t)w * h;
+        for (uint32_t i = 0; i < n; i++) {
+            sum += plane[i];
+        }
+        mean = (int)(sum / n);
+    }
+    arenaFree(plane);
+    return mean;
+}
+
+/**
+ * Hold frames until AE/AGC has converged: EXPOSURE_STABLE_FRAMES readings in a
+ * row within tolerance of the one before. The reading is exposure x gain from
+ * the sensor registers where known (no decode), otherwise the frame's mean
+ * luminance. A reading that stops changing is converged even when AE is
+ * clamped (too dark at full exposure), which is the best frame there will be.
+ * After EXPOSURE_SETTLE_TIMEOUT_MS the newest frame is used as it is.
+ */
+camera_fb_t* CameraManager::settleExposure(camera_fb_t* fb) {
+    if (!fb || !EXPOSURE_SETTLE_ENABLED) {
+        return fb;
+    }
+    sensor_t* s = esp_camera_sensor_get();
+    if (!s || (!s->status.aec && !s->status.agc)) {
+        _stillStats.settled = true; // Manual exposure: nothing to wait for
+        return fb;
+    }
+
+    ArenaScope arenaScope(captureArena); // Luminance planes, released on return
+    int64_t start = esp_timer_get_time();
+    int32_t last = exposureReading(s);
+    bool useRegisters = last >= 0;
+    if (!useRegisters) {
+        last = meanLuma(fb);
+    }
+    uint8_t steady = 0;
+
+    while (last >= 0) {
+        if ((esp_timer_get_time() - start) / 1000 >= EXPOSURE_SETTLE_TIMEOUT_MS) {
+            break;
+        }
+        camera_fb_t* next = esp_camera_fb_get();
+        if (!next) {
+            break;
+        }
+        esp_camera_fb_return(fb);
+        fb = next;
+        _stillStats.settleFrames++;
+
+        int32_t reading = useRegisters ? exposureReading(s) : meanLuma(fb);
+        if (reading < 0) {
+            break;
+        }
+        int32_t delta = reading > last ? reading - last : last - reading;
+        bool stable = useRegisters ? delta * 100 <= last * EXPOSURE_TOLERANCE_PCT
+                                   : delta <= EXPOSURE_LUMA_TOLERANCE;
+        steady = stable ? steady + 1 : 0;
+        last = reading;
+        if (steady >= EXPOSURE_STABLE_FRAMES) {
+            _stillStats.settled = true;
+            break;
+        }
+    }
+
+    _stillStats.settleUs = (uint32_t)(esp_timer_get_time() - start);
+    Serial.printf("[AE] %s in %lu ms, %u frames skipped (%s %ld)\n",
+                  _stillStats.settled ? "Exposure settled" : last < 0 ? "Exposure not measurable" : "⚠️ Settle timeout",
+                  (unsigned long)(_stillStats.settleUs / 1000), _stillStats.settleFrames,
+                  useRegisters ? "exposure x gain" : "mean luma", (long)last);
+    return fb;
+}
+
+void CameraManager::endStill(camera_fb_t* fb) {
+    if (fb) {
+        esp_camera_fb_return(fb);
+    }
+    if (!_initialized || _stillSize == _frameSize) {
+        return;
+    }
+
+    int64_t restoreStart = esp_timer_get_time();
+    _stillStats.holdUs = (uint32_t)(restoreStart - _stillHandedUs);
+    applyStreamProfile();
+
+    // Only the stream cares about the first stream-size frame
+    if (isStreaming) {
+        uint16_t width = resolution[_frameSize].width;
+        camera_fb_t* f;
+        while ((f = esp_camera_fb_get()) != nullptr) {
+            bool ready = f->width == width;
+            esp_camera_fb_return(f);
+            if (ready || ++_stillStats.droppedDown >= STILL_SWITCH_MAX_FRAMES) {
+                break;
+            }
+        }
+    }
+
+    int64_t now = esp_timer_get_time();
+    _stillStats.restoreUs = (uint32_t)(now - restoreStart);
+    _stillStats.totalUs = (uint32_t)(now - _stillStartUs);
+    Serial.printf("[STILL] %ux%u q%d: switch %lu ms (%u dropped), hold %lu ms, restore %lu ms (%u dropped), gap %lu ms\n",
+                  resolution[_stillSize].width, resolution[_stillSize].height, JPEG_QUALITY_STILL,
+                  (unsigned long)(_stillStats.switchUs / 1000), _stillStats.droppedUp,
+                  (unsigned long)(_stillStats.holdUs / 1000),
+                  (unsigned long)(_stillStats.restoreUs / 1000), _stillStats.droppedDown,
+                  (unsigned long)(_stillStats.totalUs / 1000));
+}
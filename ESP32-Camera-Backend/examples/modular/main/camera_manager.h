@@ -5,9 +5,24 @@
 #ifndef CAMERA_MANAGER_H
 #define CAMERA_MANAGER_H
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "esp_camera.h"
 #include "config.h"
 
+// Cost of the last still-profile switch (see captureStill)
+struct StillSwitchStats {
+    uint32_t switchUs;      // Profile change until first full-size frame
+    uint32_t holdUs;        // Still handed out until endStill() (copy, or processing outside a stream)
+    uint32_t restoreUs;     // Profile restore until first stream-size frame
+    uint32_t totalUs;       // Whole interruption seen by the stream
+    uint8_t droppedUp;      // Stale stream-size frames discarded after switching up
+    uint8_t droppedDown;    // Still-size frames discarded after switching back
+    uint32_t settleUs;      // First still-size frame until exposure converged (or timed out)
+    uint8_t settleFrames;   // Frames discarded while exposure settled
+    bool settled;           // false = timed out, or exposure could not be measured
+};
+
 class CameraManager {
 public:
     CameraManager();
@@ -17,9 +32,69 @@ public:
     void returnFrameBuffer(camera_fb_t* fb);
     bool isInitialized();
 
+    // Runtime tuning (remote commands). Values persist across deinit/init.
+    bool setJpegQuality(int quality);
+    // Quality for the current /stream client (-1 = none); survives stills
+    // and setJpegQuality() without replacing the configured quality
+    bool setStreamQualityOverride(int quality);
+    bool setFrameSize(framesize_t size);
+    int getJpegQuality() const { return _jpegQuality; }
+    framesize_t getFrameSize() const { return _frameSize; }
+
+    /**
+     * Switch the sensor to the still profile (FRAME_SIZE_STILL / JPEG_QUALITY_STILL)
+     * and return the first full-size frame. Framebuffers are allocated for the
+     * still size at init(), so no deinit is needed. Always pair with endStill().
+     * With settle, return the first frame whose exposure has converged instead
+     * (see settleExposure), for a just-initialised or just-lit sensor.
+     */
+    camera_fb_t* captureStill(bool settle = false);
+    void endStill(camera_fb_t* fb);     // Return fb and restore the stream profile
+    const StillSwitchStats& lastStillStats() const { return _stillStats; }
+
+    /**
+     * Camera ownership outside a running stream. loop() captures, stream
+     * on/off, the /stream start and the idle /capture handler each run
+     * init / capture / deinit (and the isStreaming change) while holding it,
+     * so one of them cannot deinit the driver under another's framebuffer.
+     * While isStreaming, the stream task owns the camera without it; take
+     * the lock, then check isStreaming. Use through CameraLock.
+     */
+    bool lock(uint32_t waitMs);
+    void unlock();
+
 private:
     bool _initialized;
+    int _jpegQuality;           // -1 = use config.h default
+    int _streamQuality;         // /stream?quality=, -1 = none
+    framesize_t _frameSize;     // FRAMESIZE_INVALID = use config.h default
+    framesize_t _initFrameSize; // Size the framebuffers were allocated for
+    framesize_t _stillSize;     // Still profile (== stream size without PSRAM)
+    int64_t _stillStartUs;
+    int64_t _stillHandedUs;       // captureStill() returned the frame
+    StillSwitchStats _stillStats;
+    SemaphoreHandle_t _ownerLock;
+    void applyStreamProfile();
     void configureSensor();
+    camera_fb_t* settleExposure(camera_fb_t* fb);
+    int32_t exposureReading(sensor_t* s);
+    int meanLuma(const camera_fb_t* fb);
+};
+
+// RAII hold of CameraManager::lock(); check held() before touching the camera
+class CameraLock {
+public:
+    CameraLock(CameraManager& camera, uint32_t waitMs) : _camera(camera), _held(camera.lock(waitMs)) {}
+    ~CameraLock() {
+        if (_held) {
+            _camera.unlock();
+        }
+    }
+    bool held() const { return _held; }
+
+private:
+    CameraManager& _camera;
+    bool _held;
 };
 
 #endif // CAMERA_MANAGER_H
@@ -0,0 +1,118 @@
+/**
+ * capture_arena.cpp - Bump-pointer PSRAM arena implementation
+ */
+
+#include <esp32-hal-psram.h>
+#include "capture_arena.h"
+
+CaptureArena captureArena("capture");
+CaptureArena netArena("net");
+
+CaptureArena::CaptureArena(const char* name)
+    : _name(name), _base(nullptr), _capacity(0), _offset(0), _highWater(0), _fallbacks(0),
+      _owner(NULL), _depth(0), _lock(NULL) {}
+
+bool CaptureArena::begin(size_t capacity) {
+    if (_base) {
+        return true;
+    }
+    _lock = xSemaphoreCreateMutex();
+    _base = (uint8_t*)ps_malloc(capacity);
+    if (!_base) {
+        Serial.printf("[ARENA] %s: failed to reserve %u bytes - using heap\n", _name, (unsigned)capacity);
+        return false;
+    }
+    _capacity = capacity;
+    Serial.printf("[ARENA] %s: %u KB reserved in PSRAM\n", _name, (unsigned)(capacity / 1024));
+    return true;
+}
+
+bool CaptureArena::claim() {
+    if (!_base || !_lock) {
+        return false;
+    }
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    if (_owner == self) {
+        _depth++;
+        return true;
+    }
+    // Never wait: a second task (e.g. stream capture during sync_sd) just uses the heap
+    if (xSemaphoreTake(_lock, 0) != pdTRUE) {
+        return false;
+    }
+    _owner = self;
+    _depth = 1;
+    return true;
+}
+
+void CaptureArena::release(size_t mark) {
+    _offset = mark;
+    if (--_depth == 0) {
+        _offset = 0;
+        _owner = NULL;
+        xSemaphoreGive(_lock);
+    }
+}
+
+void* CaptureArena::alloc(size_t size, size_t align) {
+    if (!_base || _owner != xTaskGetCurrentTaskHandle()) {
+        return nullptr;
+    }
+    size_t start = (_offset + align - 1) & ~(align - 1);
+    if (start + size > _capacity) {
+        return nullptr;
+    }
+    _offset = start + size;
+    if (_offset > _highWater) {
+        _highWater = _offset;
+    }
+    return _base + start;
+}
+
+bool CaptureArena::owns(const void* ptr) const {
+    const uint8_t* p = (const uint8_t*)ptr;
+    return _base && p >= _base && p < _base + _capacity;
+}
+
+ArenaScope::ArenaScope(CaptureArena& arena) : _arena(arena), _mark(0), _active(false) {
+    if (_arena.claim()) {
+        _mark = _arena._offset;
+        _active = true;
+    } else if (_arena._base) {
+        TaskHandle_t owner = _arena._owner;
+        Serial.printf("[ARENA] %s arena held by %s - %s uses the heap\n", _arena._name,
+                      owner ? pcTaskGetName(owner) : "?", pcTaskGetName(nullptr));
+    }
+}
+
+ArenaScope::~ArenaScope() {
+    if (_active) {
+        _arena.release(_mark);
+    }
+}
+
+void* arenaAlloc(size_t size) {
+    CaptureArena* arena = captureArena.heldByCaller() ? &captureArena
+                        : netArena.heldByCaller() ? &netArena : nullptr;
+    void* p = arena ? arena->alloc(size) : nullptr;
+    if (!p) {
+        // A missing scope was already logged by ArenaScope; a full arena was not
+        (arena ? arena : &captureArena)->countFallback();
+        if (arena) {
+            Serial.printf("[ARENA] %s arena full (%u of %u B used) - %u B from the heap\n", arena->name(),
+                          (unsigned)arena->used(), (unsigned)arena->capacity(), (unsigned)size);
+        }
+        p = malloc(size);
+    }
+    return p;
+}
+
+bool arenaOwns(const void* ptr) {
+    return captureArena.owns(ptr) || netArena.owns(ptr);
+}
+
+void arenaFree(void* ptr) {
+    if (ptr && !arenaOwns(ptr)) {
+        free(ptr);
+    }
+}
@@ -0,0 +1,111 @@
+/**
+ * capture_arena.h - Bump-pointer PSRAM arena for per-capture scratch memory
+ *
+ * One PSRAM block is allocated at boot and handed out linearly. An
+ * ArenaScope claims the arena for the current task and rewinds it on
+ * destruction, so everything a capture allocates is released at once and
+ * never fragments the heap. Calls from a task that does not own the arena
+ * (or that overflow it) return nullptr; callers then fall back to the heap
+ * and release through arenaFree().
+ *
+ * Two arenas exist: captureArena for the capture side (loop, stream task)
+ * and netArena for net_task. loop() holds captureArena while it waits for
+ * net_task to send a job, so net_task's upload scratch needs its own.
+ */
+
+#ifndef CAPTURE_ARENA_H
+#define CAPTURE_ARENA_H
+
+#include <Arduino.h>
+#include "config.h"
+
+class CaptureArena {
+public:
+    explicit CaptureArena(const char* name);
+
+    /**
+     * Allocate the backing block (PSRAM when available). Call once in setup().
+     */
+    bool begin(size_t capacity = CAPTURE_ARENA_SIZE);
+
+    /**
+     * Bump-allocate from the arena. Only succeeds for the owning task.
+     * @return nullptr when not owned by caller, not initialised or full.
+     */
+    void* alloc(size_t size, size_t align = 4);
+
+    /**
+     * @return true if ptr points into the arena block.
+     */
+    bool owns(const void* ptr) const;
+
+    // Claimed by the calling task (inside one of its ArenaScopes)
+    bool heldByCaller() const { return _owner && _owner == xTaskGetCurrentTaskHandle(); }
+    const char* name() const { return _name; }
+
+    size_t capacity() const { return _capacity; }
+    size_t used() const { return _offset; }
+    size_t highWater() const { return _highWater; }
+    uint32_t fallbacks() const { return _fallbacks; }
+    void countFallback() { _fallbacks++; }
+
+private:
+    friend class ArenaScope;
+
+    const char* _name;
+    uint8_t* _base;
+    size_t _capacity;
+    size_t _offset;
+    size_t _highWater;
+    volatile uint32_t _fallbacks;     // Allocations served by the heap instead
+    TaskHandle_t _owner;
+    uint8_t _depth;                   // Nested scopes of the owning task
+    SemaphoreHandle_t _lock;
+
+    bool claim();
+    void release(size_t mark);
+};
+
+/**
+ * RAII claim of the arena. Nested scopes in the same task rewind to their
+ * own mark; the outermost scope resets the arena to empty.
+ */
+class ArenaScope {
+public:
+    explicit ArenaScope(CaptureArena& arena);
+    ~ArenaScope();
+    bool active() const { return _active; }
+
+private:
+    CaptureArena& _arena;
+    size_t _mark;
+    bool _active;
+};
+
+extern CaptureArena captureArena;
+extern CaptureArena netArena;
+
+/**
+ * Allocation from whichever arena the calling task holds, with heap
+ * fallback (counted on that arena and logged). Release with arenaFree().
+ */
+void* arenaAlloc(size_t size);
+void arenaFree(void* ptr);
+bool arenaOwns(const void* ptr);
+
+/**
+ * ArduinoJson allocator backed by the capture arena (heap fallback).
+ */
+struct ArenaJsonAllocator {
+    void* allocate(size_t size) { return arenaAlloc(size); }
+    void deallocate(void* ptr) { arenaFree(ptr); }
+    void* reallocate(void* ptr, size_t newSize) {
+        // ArduinoJson only shrinks (shrinkToFit); arena blocks stay in place
+        if (arenaOwns(ptr)) {
+            return ptr;
+        }
+        return realloc(ptr, newSize);
+    }
+};
+
+#endif // CAPTURE_ARENA_H
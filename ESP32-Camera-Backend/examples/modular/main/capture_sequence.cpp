@@ -0,0 +1,88 @@
+/**
+ * capture_sequence.cpp - Monotonic capture id implementation
+ */
+
+#include <Preferences.h>
+#include <esp_system.h>
+#include "capture_sequence.h"
+
+static const uint32_t RTC_SEQ_MAGIC = 0x5E0C1D5A;
+
+// Survive deep sleep, not a reset (then the NVS counter moves on instead)
+RTC_DATA_ATTR static uint32_t rtcMagic = 0;
+RTC_DATA_ATTR static uint32_t rtcBoot = 0;
+RTC_DATA_ATTR static uint32_t rtcSeq = 0;
+
+CaptureSequence captureSeq;
+
+CaptureSequence::CaptureSequence() : _boot(0) {
+    _mux = portMUX_INITIALIZER_UNLOCKED;
+}
+
+void CaptureSequence::begin() {
+    if (esp_reset_reason() == ESP_RST_DEEPSLEEP && rtcMagic == RTC_SEQ_MAGIC) {
+        _boot = rtcBoot;
+        Serial.printf("[SEQ] Wake in boot %lu, next seq %lu\n",
+                      (unsigned long)_boot, (unsigned long)rtcSeq + 1);
+        return;
+    }
+
+    Preferences prefs;
+    if (prefs.begin("capture", false)) {
+        _boot = prefs.getUInt("boot", 0) + 1;
+        prefs.putUInt("boot", _boot);
+        prefs.end();
+    } else {
+        Serial.println("[SEQ] NVS unavailable - ids restart at boot 0");
+        _boot = 0;
+    }
+    rtcBoot = _boot;
+    rtcSeq = 0;
+    rtcMagic = RTC_SEQ_MAGIC;
+    Serial.printf("[SEQ] Boot %lu\n", (unsigned long)_boot);
+}
+
+void CaptureSequence::startClock() {
+    configTime(0, 0, NTP_SERVER);
+    Serial.printf("[SEQ] SNTP started (%s)\n", NTP_SERVER);
+}
+
+time_t CaptureSequence::wallClock() {
+    time_t now = time(nullptr);
+    return now >= CLOCK_VALID_AFTER ? now : 0;
+}
+
+bool CaptureSequence::clockSynced() const {
+    return wallClock() != 0;
+}
+
+CaptureRecord CaptureSequence::next() {
+    CaptureRecord rec;
+    portENTER_CRITICAL(&_mux);
+    rec.seq = ++rtcSeq;
+    portEXIT_CRITICAL(&_mux);
+    rec.boot = _boot;
+    rec.capturedAt = wallClock();
+    format(rec.boot, rec.seq, rec.id, sizeof(rec.id));
+    return rec;
+}
+
+uint32_t CaptureSequence::lastSeq() const {
+    return rtcSeq;
+}
+
+void CaptureSequence::format(uint32_t boot, uint32_t seq, char* out, size_t outSize) {
+    snprintf(out, outSize, "%06lu-%08lu", (unsigned long)boot, (unsigned long)seq);
+}
+
+bool CaptureSequence::parse(const char* id, uint32_t& boot, uint32_t& seq) {
+    unsigned long b = 0, s = 0;
+    int used = 0;
+    if (!id || sscanf(id, "%6lu-%8lu%n", &b, &s, &used) != 2 ||
+        used != 15 || id[used] != '\0' || id[6] != '-') {
+        return false;
+    }
+    boot = (uint32_t)b;
+    seq = (uint32_t)s;
+    return true;
+}
@@ -0,0 +1,79 @@
+/**
+ * capture_sequence.h - Monotonic capture ids
+ *
+ * Every capture gets "<boot>-<seq>", zero padded ("000042-00000317"):
+ *   boot  NVS counter, bumped once per power-on or reset. A deep-sleep wake
+ *         keeps the boot number from RTC memory, so flash is not written per
+ *         motion event.
+ *   seq   per boot, from 1, kept in RTC memory across deep sleep
+ *
+ * Ids never repeat on a camera and sort as strings in capture order. The SD
+ * queue is named by them (storage_manager.h), so the backlog replays
+ * oldest-first by walking ids, and the backend orders and dedupes on
+ * (deviceId, boot, seq) without trusting the clock.
+ *
+ * Wall-clock time comes from SNTP once startClock() has run. Until then
+ * records carry capturedAt = 0 and only the id orders them.
+ */
+
+#ifndef CAPTURE_SEQUENCE_H
+#define CAPTURE_SEQUENCE_H
+
+#include <Arduino.h>
+#include <time.h>
+#include "config.h"
+
+struct CaptureRecord {
+    uint32_t boot;
+    uint32_t seq;
+    time_t capturedAt;          // Unix seconds, 0 when the clock is not set
+    char id[CAPTURE_ID_LEN];
+};
+
+class CaptureSequence {
+public:
+    CaptureSequence();
+
+    /**
+     * Load the boot counter (bumping it unless this is a deep-sleep wake).
+     * Call once, early in setup(); next() before this uses boot 0.
+     */
+    void begin();
+
+    /**
+     * Start SNTP against NTP_SERVER. Call after WiFi is up; lwIP keeps the
+     * clock in sync from then on.
+     */
+    void startClock();
+
+    bool clockSynced() const;
+
+    /**
+     * Unix seconds now, or 0 while the clock is not set.
+     */
+    static time_t wallClock();
+
+    /**
+     * Issue the next id. Safe from any task.
+     */
+    CaptureRecord next();
+
+    uint32_t boot() const { return _boot; }
+    uint32_t lastSeq() const;      // Last seq issued this boot (0 = none)
+
+    static void format(uint32_t boot, uint32_t seq, char* out, size_t outSize);
+
+    /**
+     * Split an id back into boot and seq.
+     * @return false for names that are not "<boot>-<seq>" (older queue files).
+     */
+    static bool parse(const char* id, uint32_t& boot, uint32_t& seq);
+
+private:
+    uint32_t _boot;
+    portMUX_TYPE _mux;
+};
+
+extern CaptureSequence captureSeq;
+
+#endif // CAPTURE_SEQUENCE_H
@@ -0,0 +1,289 @@
+/**
+ * command_manager.cpp - Binary remote-tuning command dispatch
+ */
+
+#include "command_manager.h"
+#include "config.h"
+#include "camera_manager.h"
+#include "stream_manager.h"
+#include "mqtt_manager.h"
+#include "storage_manager.h"
+#include "auth_manager.h"
+#include "upload_manager.h"
+#include "motion_roi.h"
+#include "sd_writer.h"
+#include "network_task.h"
+#include "esp_timer.h"
+
+extern CameraManager cameraMgr;
+extern MQTTManager mqttMgr;
+extern StorageManager storageMgr;
+extern AuthManager authMgr;
+extern UploadManager uploadMgr;
+
+static bool rebootPending = false;
+
+// Dispatch table: opcode, min/max param length, handler
+const CommandManager::Entry CommandManager::_table[] = {
+    { CMD_CAPTURE,          0, 0, CommandManager::onCapture },
+    { CMD_STREAM_ON,        0, 0, CommandManager::onStreamOn },
+    { CMD_STREAM_OFF,       0, 0, CommandManager::onStreamOff },
+    { CMD_REBOOT,           0, 0, CommandManager::onReboot },
+    { CMD_SYNC_SD,          0, 0, CommandManager::onSyncSd },
+    { CMD_FETCH_FULL,       1, 31, CommandManager::onFetchFull },
+    { CMD_SET_JPEG_QUALITY, 1, 1, CommandManager::onSetJpegQuality },
+    { CMD_SET_FRAMESIZE,    1, 1, CommandManager::onSetFrameSize },
+    { CMD_SET_COOLDOWN,     4, 4, CommandManager::onSetCooldown },
+    { CMD_SET_CHUNK_SIZE,   2, 2, CommandManager::onSetChunkSize },
+    { CMD_SET_STREAM_FPS,   1, 1, CommandManager::onSetStreamFps },
+    { CMD_SET_ROI,          0, 8, CommandManager::onSetRoi },
+};
+const size_t CommandManager::_tableSize = sizeof(_table) / sizeof(_table[0]);
+
+// Legacy text verbs kept for the dashboard and manual mosquitto_pub use
+struct TextVerb {
+    const char* verb;
+    uint8_t opcode;
+};
+
+static const TextVerb TEXT_VERBS[] = {
+    { "capture",    CMD_CAPTURE },
+    { "stream_on",  CMD_STREAM_ON },
+    { "stream_off", CMD_STREAM_OFF },
+    { "reboot",     CMD_REBOOT },
+    { "sync_sd",    CMD_SYNC_SD },
+};
+
+static inline uint16_t readU16(const uint8_t* p) {
+    return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
+}
+
+static inline uint32_t readU32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void writeU16(uint8_t* p, uint16_t v) {
+    p[0] = v & 0xFF;
+    p[1] = v >> 8;
+}
+
+static inline void writeU32(uint8_t* p, uint32_t v) {
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = v >> 24;
+}
+
+CommandManager::CommandManager() {
+    memset(_ack, 0, sizeof(_ack));
+}
+
+const CommandManager::Entry* CommandManager::find(uint8_t opcode) const {
+    for (size_t i = 0; i < _tableSize; i++) {
+        if (_table[i].opcode == opcode) {
+            return &_table[i];
+        }
+    }
+    return nullptr;
+}
+
+CommandResult CommandManager::execute(uint8_t opcode, const uint8_t* params, uint8_t len,
+                                      int32_t& value, uint32_t& latencyUs) {
+    int64_t start = esp_timer_get_time();
+    CommandResult result;
+
+    const Entry* entry = find(opcode);
+    if (!entry) {
+        result = CMD_ERR_UNKNOWN;
+    } else if (len < entry->minLen || len > entry->maxLen) {
+        result = CMD_ERR_LENGTH;
+    } else {
+        result = entry->handler(params, len, value);
+    }
+
+    latencyUs = (uint32_t)(esp_timer_get_time() - start);
+    return result;
+}
+
+bool CommandManager::handle(const uint8_t* payload, unsigned int length) {
+    if (!payload || length == 0) {
+        return false;
+    }
+
+    int32_t value = 0;
+    uint32_t latencyUs = 0;
+
+    if (length >= CMD_HEADER_LEN && payload[0] == CMD_MAGIC) {
+        uint8_t opcode = payload[2];
+        uint16_t seq = readU16(payload + 4);
+        uint8_t paramLen = payload[6];
+        CommandResult result;
+
+        if (payload[1] != CMD_VERSION || CMD_HEADER_LEN + (unsigned int)paramLen > length) {
+            result = CMD_ERR_LENGTH;
+        } else {
+            result = execute(opcode, payload + CMD_HEADER_LEN, paramLen, value, latencyUs);
+        }
+
+        Serial.printf("🛠️ Command 0x%02x seq=%u -> %u (%luus)\n",
+                      opcode, seq, result, (unsigned long)latencyUs);
+        sendAck(opcode, seq, result, latencyUs, value);
+    } else {
+        const TextVerb* match = nullptr;
+        for (size_t i = 0; i < sizeof(TEXT_VERBS) / sizeof(TEXT_VERBS[0]); i++) {
+            size_t verbLen = strlen(TEXT_VERBS[i].verb);
+            if (verbLen == length && memcmp(payload, TEXT_VERBS[i].verb, length) == 0) {
+                match = &TEXT_VERBS[i];
+                break;
+            }
+        }
+        if (!match) {
+            return false;
+        }
+        execute(match->opcode, nullptr, 0, value, latencyUs);
+    }
+
+    if (rebootPending) {
+        delay(100); // Let the ack leave the socket
+        sdWriter.drain(SD_DRAIN_TIMEOUT_MS);
+        ESP.restart();
+    }
+    return true;
+}
+
+void CommandManager::sendAck(uint8_t opcode, uint16_t seq, CommandResult result,
+                             uint32_t latencyUs, int32_t value) {
+    _ack[0] = ACK_MAGIC;
+    _ack[1] = CMD_VERSION;
+    _ack[2] = opcode;
+    _ack[3] = result;
+    writeU16(_ack + 4, seq);
+    writeU32(_ack + 6, latencyUs);
+    writeU32(_ack + 10, (uint32_t)value);
+    mqttMgr.publishAck(_ack, sizeof(_ack));
+}
+
+// ===== Handlers =====
+
+CommandResult CommandManager::onCapture(const uint8_t* p, uint8_t len, int32_t& value) {
+    Serial.println("📸 Command: CAPTURE");
+    // Executed by loop(); latency covers acceptance only
+    return netTask.postAppEvent(APP_EVENT_CAPTURE) ? CMD_OK : CMD_ERR_BUSY;
+}
+
+CommandResult CommandManager::onStreamOn(const uint8_t* p, uint8_t len, int32_t& value) {
+    Serial.println("🎥 Command: STREAM ON");
+    // Camera init runs on loop(), which owns the camera outside /stream
+    return netTask.postAppEvent(APP_EVENT_STREAM_ON) ? CMD_OK : CMD_ERR_BUSY;
+}
+
+CommandResult CommandManager::onStreamOff(const uint8_t* p, uint8_t len, int32_t& value) {
+    Serial.println("🎥 Command: STREAM OFF");
+    return netTask.postAppEvent(APP_EVENT_STREAM_OFF) ? CMD_OK : CMD_ERR_BUSY;
+}
+
+CommandResult CommandManager::onReboot(const uint8_t* p, uint8_t len, int32_t& value) {
+    Serial.println("🔁 Command: REBOOT");
+    rebootPending = true;
+    return CMD_OK;
+}
+
+// Runs inside mqttCallback on net_task: queue the work, the backlog pass sends it
+CommandResult CommandManager::onSyncSd(const uint8_t* p, uint8_t len, int32_t& value) {
+    Serial.println("🔄 Command: SYNC SD CARD");
+    if (!storageMgr.isReady()) {
+        return CMD_ERR_FAILED;
+    }
+    netTask.requestSync();
+    value = (int32_t)storageMgr.pendingCount();     // Files the pass will send
+    return CMD_OK;
+}
+
+CommandResult CommandManager::onFetchFull(const uint8_t* p, uint8_t len, int32_t& value) {
+    // Capture ids are file names; reject anything that could leave the queue folders
+    char captureId[32];
+    for (uint8_t i = 0; i < len; i++) {
+        char c = (char)p[i];
+        if (!isalnum((unsigned char)c) && c != '_' && c != '-') {
+            return CMD_ERR_VALUE;
+        }
+        captureId[i] = c;
+    }
+    captureId[len] = '\0';
+
+    Serial.printf("📥 Command: FETCH FULL %s\n", captureId);
+    String path;
+    if (!storageMgr.findCapture(captureId, path)) {
+        return CMD_ERR_VALUE;
+    }
+    // Uploaded by the next backlog round; the ack means "queued"
+    return netTask.requestFullUpload(captureId) ? CMD_OK : CMD_ERR_BUSY;
+}
+
+CommandResult CommandManager::onSetJpegQuality(const uint8_t* p, uint8_t len, int32_t& value) {
+    uint8_t quality = p[0];
+    if (quality < 4 || quality > 63) {
+        return CMD_ERR_VALUE;
+    }
+    // Sensor access belongs to loop(); the ack means "queued"
+    if (!netTask.postAppEvent(APP_EVENT_SET_QUALITY, quality)) {
+        return CMD_ERR_BUSY;
+    }
+    value = quality;
+    return CMD_OK;
+}
+
+CommandResult CommandManager::onSetFrameSize(const uint8_t* p, uint8_t len, int32_t& value) {
+    uint8_t size = p[0];
+    if (size >= FRAMESIZE_INVALID) {
+        return CMD_ERR_VALUE;
+    }
+    // May re-init the camera: loop() does it under the camera lock
+    if (!netTask.postAppEvent(APP_EVENT_SET_FRAMESIZE, size)) {
+        return CMD_ERR_BUSY;
+    }
+    value = size;
+    return CMD_OK;
+}
+
+CommandResult CommandManager::onSetCooldown(const uint8_t* p, uint8_t len, int32_t& value) {
+    uint32_t cooldownMs = readU32(p);
+    if (cooldownMs > 3600000UL) {
+        return CMD_ERR_VALUE;
+    }
+    motionCooldownMs = cooldownMs;
+    value = (int32_t)cooldownMs;
+    return CMD_OK;
+}
+
+CommandResult CommandManager::onSetChunkSize(const uint8_t* p, uint8_t len, int32_t& value) {
+    uint16_t chunkSize = readU16(p);
+    if (!mqttMgr.setChunkSize(chunkSize)) {
+        return CMD_ERR_VALUE;
+    }
+    value = mqttMgr.getChunkSize();
+    return CMD_OK;
+}
+
+CommandResult CommandManager::onSetStreamFps(const uint8_t* p, uint8_t len, int32_t& value) {
+    StreamManager::setMaxFps(p[0]);
+    value = p[0];
+    return CMD_OK;
+}
+
+CommandResult CommandManager::onSetRoi(const uint8_t* p, uint8_t len, int32_t& value) {
+    if (len == 0) {
+        motionRoi.setAuto();
+    } else if (len == 8) {
+        RoiBox box = { readU16(p), readU16(p + 2), readU16(p + 4), readU16(p + 6) };
+        if (box.w == 0 || box.h == 0) {
+            motionRoi.disable();
+        } else {
+            motionRoi.setFixed(box);
+        }
+    } else {
+        return CMD_ERR_LENGTH;
+    }
+    value = motionRoi.mode();
+    return CMD_OK;
+}
@@ -0,0 +1,100 @@
+/**
+ * command_manager.h - Binary remote-tuning command protocol
+ *
+ * Command frame (cam/<id>/command, cam/group/<group>/command or
+ * cam/all/command; little-endian):
+ *   [0] CMD_MAGIC  [1] CMD_VERSION  [2] opcode  [3] flags (reserved)
+ *   [4..5] seq     [6] param length N          [7..7+N) params
+ *
+ * Ack frame (cam/<id>/ack: the topic names the device, seq the command):
+ *   [0] ACK_MAGIC  [1] CMD_VERSION  [2] opcode  [3] result
+ *   [4..5] seq     [6..9] execution latency (us)  [10..13] value (int32)
+ *
+ * Legacy text verbs ("capture", "stream_on", ...) map onto the same
+ * opcodes and are executed without an ack.
+ */
+
+#ifndef COMMAND_MANAGER_H
+#define COMMAND_MANAGER_H
+
+#include <Arduino.h>
+
+#define CMD_MAGIC         0xC7
+#define ACK_MAGIC         0xA7
+#define CMD_VERSION       1
+#define CMD_HEADER_LEN    7
+#define ACK_FRAME_LEN     14
+
+enum CommandOpcode : uint8_t {
+    CMD_CAPTURE          = 0x01,
+    CMD_STREAM_ON        = 0x02,
+    CMD_STREAM_OFF       = 0x03,
+    CMD_REBOOT           = 0x04,
+    CMD_SYNC_SD          = 0x05,
+    CMD_FETCH_FULL       = 0x06,  // str capture id (1..31 chars): upload full image from SD
+
+    CMD_SET_JPEG_QUALITY = 0x10,  // u8  (4..63, lower = better)
+    CMD_SET_FRAMESIZE    = 0x11,  // u8  framesize_t
+    CMD_SET_COOLDOWN     = 0x12,  // u32 motion cooldown in ms
+    CMD_SET_CHUNK_SIZE   = 0x13,  // u16 MQTT chunk size in bytes
+    CMD_SET_STREAM_FPS   = 0x14,  // u8  stream fps cap (0 = unlimited)
+    CMD_SET_ROI          = 0x15   // none = auto (motion), 4 x u16 x,y,w,h = fixed box, w or h 0 = off
+};
+
+enum CommandResult : uint8_t {
+    CMD_OK          = 0,
+    CMD_ERR_UNKNOWN = 1,   // Opcode not in dispatch table
+    CMD_ERR_LENGTH  = 2,   // Param length outside [minLen, maxLen]
+    CMD_ERR_VALUE   = 3,   // Value out of range
+    CMD_ERR_BUSY    = 4,   // Cannot apply right now (e.g. while streaming)
+    CMD_ERR_FAILED  = 5
+};
+
+class CommandManager {
+public:
+    CommandManager();
+
+    /**
+     * Decode and execute one MQTT command payload (binary frame or text verb).
+     * Does not allocate; the ack is built in a fixed member buffer.
+     * Runs on the network task (mqttCallback); camera actions are handed to
+     * loop() as AppEvents (network_task.h).
+     * @return true when the payload was recognised as a command.
+     */
+    bool handle(const uint8_t* payload, unsigned int length);
+
+private:
+    typedef CommandResult (*Handler)(const uint8_t* params, uint8_t len, int32_t& value);
+
+    struct Entry {
+        uint8_t opcode;
+        uint8_t minLen;
+        uint8_t maxLen;
+        Handler handler;
+    };
+
+    static const Entry _table[];
+    static const size_t _tableSize;
+    uint8_t _ack[ACK_FRAME_LEN];
+
+    const Entry* find(uint8_t opcode) const;
+    CommandResult execute(uint8_t opcode, const uint8_t* params, uint8_t len,
+                          int32_t& value, uint32_t& latencyUs);
+    void sendAck(uint8_t opcode, uint16_t seq, CommandResult result,
+                 uint32_t latencyUs, int32_t value);
+
+    static CommandResult onCapture(const uint8_t* p, uint8_t len, int32_t& value);
+    static CommandResult onStreamOn(const uint8_t* p, uint8_t len, int32_t& value);
+    static CommandResult onStreamOff(const uint8_t* p, uint8_t len, int32_t& value);
+    static CommandResult onReboot(const uint8_t* p, uint8_t len, int32_t& value);
+    static CommandResult onSyncSd(const uint8_t* p, uint8_t len, int32_t& value);
+    static CommandResult onFetchFull(const uint8_t* p, uint8_t len, int32_t& value);
+    static CommandResult onSetJpegQuality(const uint8_t* p, uint8_t len, int32_t& value);
+    static CommandResult onSetFrameSize(const uint8_t* p, uint8_t len, int32_t& value);
+    static CommandResult onSetCooldown(const uint8_t* p, uint8_t len, int32_t& value);
+    static CommandResult onSetChunkSize(const uint8_t* p, uint8_t len, int32_t& value);
+    static CommandResult onSetStreamFps(const uint8_t* p, uint8_t len, int32_t& value);
+    static CommandResult onSetRoi(const uint8_t* p, uint8_t len, int32_t& value);
+};
+
+#endif // COMMAND_MANAGER_H
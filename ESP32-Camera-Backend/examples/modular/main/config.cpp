@@ -1,6 +1,22 @@
+#include <Arduino.h>
+#include "esp_mac.h"
 #include "config.h"
 
 // Define global variables declared in config.h
-volatile bool pauseStreamForCapture = false;
-volatile bool captureRequested = false;
+volatile uint32_t motionCooldownMs = MOTION_COOLDOWN_MS;
 // isStreaming is defined in stream_manager.cpp
+
+const char* deviceId() {
+    static char id[24] = "";
+    if (!id[0]) {
+        if (MQTT_CLIENT_ID[0]) {
+            strncpy(id, MQTT_CLIENT_ID, sizeof(id) - 1);
+        } else {
+            uint8_t mac[6] = {0};
+            esp_efuse_mac_get_default(mac);
+            snprintf(id, sizeof(id), "cam-%02x%02x%02x%02x%02x%02x",
+                     mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+        }
+    }
+    return id;
+}
@@ -5,6 +5,8 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include <atomic>
+
 // ===== WIFI & SERVER =====
 #define WIFI_SSID "..."
 #define WIFI_PASSWORD "20041610"
@@ -13,6 +15,10 @@
 #define SERVER_HOSTNAME_MDNS "esp32-server" // Hostname to search for via mDNS
 extern char serverIP[16];                   // Global variable to store resolved IP
 
+// Stable device id: MQTT_CLIENT_ID, or "cam-" + the 12 hex digits of the base MAC.
+// Names the MQTT client and topics and goes out as X-Device-Id on HTTP uploads.
+const char* deviceId();
+
 #define SERVER_PORT 3000
 #define SERVER_API_PATH "/api"
 
@@ -29,21 +35,72 @@ extern char serverIP[16];                   // Global variable to store resolved
 #define MQTT_PORT 8883
 #define MQTT_USERNAME "esp32-cam"
 #define MQTT_PASSWORD "Khueqp123"
-#define MQTT_CLIENT_ID "ESP32-CAM-001"
-#define MQTT_TOPIC_IMAGE "esp32/camera/image"
-#define MQTT_TOPIC_STATUS "esp32/camera/status"
-#define MQTT_TOPIC_COMMAND "esp32/camera/command" // New command topic
+#define MQTT_CLIENT_ID ""                         // Empty: "cam-<MAC>" from deviceId()
+
+// MQTT over TLS (tls_client.h). Pins: SHA-256 (hex) of the broker's leaf key or
+// of a CA the chain verifies to, comma-separated (`node test-tls.js` prints them).
+// "" refuses to connect unless MQTT_TLS_INSECURE (dev builds only: like setInsecure)
+#define MQTT_TLS_PINS ""
+#define MQTT_TLS_INSECURE   false
+#define TLS_MAX_PINS        4
+#define TLS_SPKI_MAX        600     // Largest public key DER to hash (RSA-4096 ~550 B)
+#define TLS_SESSION_MAX     2048    // Serialized session + leaf cert, kept in RTC memory
+#define TLS_SESSION_NVS     true    // Also keep new sessions in NVS (resume after power loss)
+
+// Topic layout: every device publishes and listens under MQTT_TOPIC_ROOT/<id>/,
+// so one broker serves a fleet and backends can use $share/<group>/cam/+/<leaf>
+#define MQTT_TOPIC_ROOT "cam"
+#define MQTT_GROUP "default"                      // Also takes commands on cam/group/<group>/command
+#define MQTT_TOPIC_IMAGE "image"                  // cam/<id>/image
+#define MQTT_TOPIC_STATUS "status"                // cam/<id>/status
+#define MQTT_TOPIC_COMMAND "command"              // cam/<id>/command, group and cam/all/command
+#define MQTT_TOPIC_ACK "ack"                      // Binary command acks (see command_manager.h)
+#define MQTT_TOPIC_TASKS "tasks"                  // Task CPU/stack report (see task_monitor.h)
+#define MQTT_TOPIC_RATE "rate"                    // cam/<id>/rate and cam/all/rate, retained (rate_limiter.h)
+#define MQTT_TOPIC_XFER "xfer"                    // cam/<id>/xfer: backend acks received image chunks
+#define MQTT_TOPIC_DISCOVERY "camera/server-ip"   // Fleet-wide, retained by the backend
+#define MQTT_TOPIC_MAX 64
+#define MQTT_BUFFER_SIZE 8192                     // PubSubClient packet buffer
+#define MQTT_CHUNK_SIZE_DEFAULT 3072              // Raw bytes per image chunk (multiple of 3)
+
+// Windowed image transfer (MQTTManager::publishImageChunked)
+#define XFER_WINDOW         8       // Chunks in flight past the first unacked one
+#define XFER_MAX_CHUNKS     1024    // Larger images go over HTTP
+#define XFER_REORDER_MS     250     // Hole below an acked chunk for this long: resend it
+#define XFER_RTO_MS         1500    // No ack progress: resend unacked chunks older than this
+#define XFER_TIMEOUT_MS     20000   // Give up on the image (it stays queued on SD)
+
+// Reconnect backoff (non-blocking, runs from MQTTManager::loop)
+#define MQTT_BACKOFF_MIN_MS     1000    // First retry delay
+#define MQTT_BACKOFF_MAX_MS     60000   // Cap for exponential growth
+#define MQTT_CONNECT_TIMEOUT_S  10      // TCP/TLS handshake timeout inside worker task
+#define MQTT_SETUP_WAIT_MS      8000    // How long setup() waits for the first connect
+#define MQTT_RECONNECT_SPREAD_MS 15000  // After a drop, first retry anywhere in [0, spread): no fleet stampede
+
+// Telemetry heartbeat (CBOR on MQTT_TOPIC_STATUS, see telemetry_manager.h)
+#define TELEMETRY_INTERVAL_MS     30000
+#define TELEMETRY_KEYFRAME_EVERY  10      // Absolute gauges every Nth frame
+
+// Task CPU/stack report (JSON on MQTT_TOPIC_TASKS, see task_monitor.h)
+#define TASK_STATS_INTERVAL_MS    60000
+#define TASK_STACK_WARN_BYTES     512     // Log when any task has less headroom
 
 // ===== STREAMING CONFIG =====
 // Set to true to enable MJPEG streaming (DISABLES DEEP SLEEP)
 #define ENABLE_STREAMING_MODE true  
 #define STREAM_PORT 81
+#define CONTROL_PORT 80                     // /capture and /status (stays responsive while /stream runs)
+#define FRAME_CACHE_SLOT_SIZE  (128 * 1024) // Per-slot PSRAM for the latest-frame cache
+#define FRAME_CACHE_MAX_AGE_MS 1000         // Older cached frames trigger a fresh capture
+#define STREAM_MAX_FPS         30           // Upper bound for /stream?fps=
+#define STREAM_PACING_SLACK_US 2000         // Frames this early still count as on time
 
 // ===== HARDWARE PINS =====
 #define USE_PIR         true    // Set to false to disable PIR sensor logic completely
 #define PIR_PIN         0       // GPIO 0
 #define WS2812_PIN      48
 #define WS2812_COUNT    1
+#define LED_QUEUE_DEPTH 8       // Status patterns waiting in led_anim; more are dropped
 
 #define STATUS_LED_PIN          20
 #define STATUS_LED_ACTIVE_LOW   0
@@ -80,11 +137,93 @@ extern char serverIP[16];                   // Global variable to store resolved
 #define WIFI_MAX_ATTEMPTS 5
 #define WIFI_RETRY_DELAY_MS 2000
 #define PIR_WAKE_COOLDOWN_SECONDS 15
+#define MOTION_COOLDOWN_MS 15000        // Default; tunable at runtime via CMD_SET_COOLDOWN
 
 // ===== SHARED STATE =====
-extern volatile bool pauseStreamForCapture;
-extern volatile bool captureRequested; // New flag for stream-based capture
-extern volatile bool isStreaming;      // Track streaming state globally
+// Capture hand-off to the stream task and network work go through queues
+// (StreamManager::requestCapture, network_task.h), not shared flags
+extern std::atomic<bool> isStreaming;  // Track streaming state globally
+extern volatile uint32_t motionCooldownMs; // Runtime motion cooldown (remote-tunable)
+
+// ===== NETWORK TASK (see network_task.h) =====
+#define NET_PRODUCERS       3                // Tasks that may post jobs (loop, stream, spare)
+#define NET_INBOX_DEPTH     4                // Jobs queued per producer (power of two)
+#define NET_EVENT_DEPTH     8                // Command -> loop() events (power of two)
+#define NET_IDLE_MS         10               // MQTT poll period when no job is posted
+#define NET_FETCH_DEPTH     4                // fetch_full requests waiting for the backlog pass
+
+// ===== MEMORY =====
+#define CAPTURE_ARENA_SIZE  (768 * 1024)   // PSRAM bump arena, reset after each processCapture
+#define NET_ARENA_SIZE      (768 * 1024)   // net_task's own arena: per job / backlog file (file + HTTP body)
+#define HEAP_SAMPLE_INTERVAL_MS 1000       // Fragmentation sampling period
+
+// ===== SD WRITE-BEHIND (see sd_writer.h) =====
+#define SD_WRITE_SLOTS      2                // Records buffered while the card is busy
+#define SD_WRITE_SLOT_SIZE  (320 * 1024)     // Larger frames are written synchronously
+#define SD_WRITE_BLOCK      4096             // Bytes per write, at block-aligned offsets
+#define SD_DRAIN_TIMEOUT_MS 3000             // Max wait for queued writes before reboot
+
+// ===== CAPTURE PIPELINE (see frame_pipeline.h) =====
+#define ANALYTICS_PLANE_ENABLED true         // 1/8-scale grayscale plane per streamed frame
+#define PIPELINE_JPEG_POOL      2            // Encode buffers for non-JPEG sensor formats
+#define PIPELINE_JPEG_BUF_SIZE  (160 * 1024)
+#define PIPELINE_GRAY_POOL      3            // In flight + retained latest plane
+#define PIPELINE_GRAY_MAX       (200 * 150)  // 1/8 of UXGA
+#define PIPELINE_JPEG_QUALITY   80           // frame2jpg scale (1-100)
+
+// ===== THUMBNAIL-FIRST DELIVERY =====
+#define THUMBNAIL_FIRST         true         // Send a preview per capture; full image stays on SD
+#define THUMB_MAX_WIDTH         320          // Scaled decode picks 1/2..1/8 to fit
+#define THUMB_JPEG_QUALITY      70           // fmt2jpg scale (1-100)
+#define THUMB_MAX_BYTES         (48 * 1024)
+#define FULL_UPLOAD_INTERVAL_MS 60000        // Background upload of queued full images
+#define FULL_UPLOAD_BATCH       2            // Files per background pass
+#define FULL_UPLOAD_START_JITTER_MS 30000    // First pass after boot / MQTT reconnect: random in [0, jitter)
+
+// ===== FLEET RATE CONTROL (see rate_limiter.h) =====
+#define RATE_DEFAULT_RETRY_S    30           // 429/503 without Retry-After
+#define RATE_HOLD_JITTER_PCT    50           // Hold up to this much longer than asked
+#define RATE_MAX_WAIT_MS        2000         // Longest single pacing wait on the network task
+#define RATE_WAIT_SLICE_MS      20           // MQTT is serviced between slices of that wait
+
+// ===== MOTION ROI CROPS (see motion_roi.h) =====
+#define ROI_UPLOAD_ENABLED  true             // Send a crop of the changed region instead of a thumbnail
+#define ROI_DIFF_THRESHOLD  24               // Luma delta per 1/8-scale cell
+#define ROI_MIN_CELLS       6                // Fewer changed cells = sensor noise
+#define ROI_MAX_AREA_PCT    60               // Larger changes fall back to the thumbnail
+#define ROI_MARGIN_PCT      15               // Padding around the changed cells
+#define ROI_BG_WEIGHT       8                // Background model: new plane counts 1/N
+#define ROI_BG_SAMPLE_MS    500              // Fold a streamed analytics plane in at most this often
+#define ROI_BG_MAX_AGE_MS   30000            // Older background = no AUTO crop, reseed instead
+#define ROI_MAX_PIXELS      (120 * 1024)     // Larger crops are decoded at 1/2..1/8 scale
+#define ROI_MAX_BYTES       (96 * 1024)
+#define ROI_JPEG_QUALITY    90               // fmt2jpg scale (1-100)
+
+// ===== ON-DEVICE DETECTOR (see detector_manager.h) =====
+#define DETECTOR_ENABLED        true         // Runs only when the model file is on the SD card
+#define DETECTOR_MODEL_PATH     "/models/detector.bin"
+#define DETECTOR_MODEL_MAX      (512 * 1024) // Larger model files are refused
+#define DETECTOR_MAX_LAYERS     32
+#define DETECTOR_MAX_CLASSES    4
+#define DETECTOR_USE_ESP_NN     true         // ESP32-S3 SIMD kernels when the core ships esp-nn
+#define DETECTOR_SELF_TEST      true         // Fast vs reference kernels once at boot; mismatch = reference only
+#define DETECTOR_MIN_CONFIDENCE 70           // % before "background" may hold back an upload
+#define DETECTOR_UPLOAD_POLICY  DETECT_UPLOAD_DEFER // ALL: label only, DEFER: background waits for the backlog pass,
+                                             // LOCAL: background stays on SD (fetch_full still works)
+
+// ===== CAPTURE IDS & CLOCK (see capture_sequence.h) =====
+#define CAPTURE_ID_LEN      24               // "<boot>-<seq>" plus terminator, with room to spare
+#define NTP_SERVER          "pool.ntp.org"   // SNTP once WiFi is up; ids do not depend on it
+#define CLOCK_VALID_AFTER   1700000000       // time() below this = clock not set yet
+#define REPLAY_MAX_PROBES   16               // Missing ids walked before rescanning /pending
+
+// ===== RESUMABLE UPLOADS (queued files, see UploadManager::uploadResumable) =====
+#define RESUMABLE_UPLOADS         true
+#define RESUMABLE_MIN_BYTES       (32 * 1024)    // Smaller files go out in one multipart POST
+#define RESUMABLE_CHUNK_BYTES     (16 * 1024)    // Bytes per PATCH
+#define RESUMABLE_CHUNK_TIMEOUT   10000          // ms per PATCH
+#define RESUMABLE_MAX_RESUMES     4              // Drops tolerated per file before giving up this pass
+#define RESUMABLE_RETRY_DELAY_MS  500            // Multiplied by the resume count
 
 // ===== IMAGE QUALITY =====
 // Optimized for smoother streaming (VGA 640x480)
@@ -92,6 +231,20 @@ extern volatile bool isStreaming;      // Track streaming state globally
 #define JPEG_QUALITY_HIGH   20
 #define FB_COUNT_HIGH       2
 
+// Still profile: sensor switched up in place for single captures (PSRAM only)
+#define FRAME_SIZE_STILL        FRAMESIZE_UXGA
+#define JPEG_QUALITY_STILL      10
+#define STILL_SWITCH_MAX_FRAMES 6      // Give up waiting for the new size after this many frames
+#define STILL_COPY_SIZE         (512 * 1024) // PSRAM slot a streamed still is copied into for loop()
+#define CAMERA_LOCK_WAIT_MS     3000   // Wait for another task's camera init/capture/deinit (see CameraLock)
+
+// Exposure settling: captures wait for the sensor's AE/AGC instead of a fixed delay
+#define EXPOSURE_SETTLE_ENABLED     true
+#define EXPOSURE_SETTLE_TIMEOUT_MS  1200   // Take the latest frame after this long
+#define EXPOSURE_STABLE_FRAMES      2      // Consecutive steady readings that count as converged
+#define EXPOSURE_TOLERANCE_PCT      5      // Exposure x gain change still counted as steady
+#define EXPOSURE_LUMA_TOLERANCE     3      // Mean brightness change (0-255), sensors read by luminance
+
 #define FRAME_SIZE_STD      FRAMESIZE_VGA
 #define JPEG_QUALITY_STD    20
 #define FB_COUNT_STD        1
@@ -0,0 +1,171 @@
+/**
+ * detector_manager.cpp - Model loading, inference and the upload policy
+ */
+
+#include <SD_MMC.h>
+#include <esp32-hal-psram.h>
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "capture_arena.h"
+#include "frame_pipeline.h"
+#include "detector_manager.h"
+
+DetectorManager detectorMgr;
+
+// Internal RAM left for WiFi/TLS before the arena moves to PSRAM
+static const size_t INTERNAL_HEADROOM = 64 * 1024;
+static const size_t ARENA_ALIGN = 16;
+
+DetectorManager::DetectorManager()
+    : _blob(nullptr), _arena(nullptr), _ready(false), _arenaInternal(false), _path(KERNELS_FAST),
+      _backgroundClass(-1), _lastUs(0), _inferences(0) {}
+
+bool DetectorManager::loadModel() {
+    File file = SD_MMC.open(DETECTOR_MODEL_PATH, FILE_READ);
+    if (!file) {
+        Serial.printf("[DETECT] No model at %s - uploads stay unfiltered\n", DETECTOR_MODEL_PATH);
+        return false;
+    }
+    size_t size = file.size();
+    if (size == 0 || size > DETECTOR_MODEL_MAX) {
+        Serial.printf("[DETECT] Model is %u B (max %u) - detector off\n",
+                      (unsigned)size, (unsigned)DETECTOR_MODEL_MAX);
+        file.close();
+        return false;
+    }
+
+    _blob = (uint8_t*)ps_malloc(size);
+    size_t got = _blob ? file.read(_blob, size) : 0;
+    file.close();
+    if (got != size) {
+        Serial.printf("[DETECT] Could not read the model (%u of %u B)\n", (unsigned)got, (unsigned)size);
+        free(_blob);
+        _blob = nullptr;
+        return false;
+    }
+    if (!_model.parse(_blob, size)) {
+        Serial.printf("[DETECT] %s: %s - detector off\n", DETECTOR_MODEL_PATH, _model.error());
+        free(_blob);
+        _blob = nullptr;
+        return false;
+    }
+    return true;
+}
+
+bool DetectorManager::begin() {
+    if (!DETECTOR_ENABLED || _ready) {
+        return _ready;
+    }
+    if (!loadModel()) {
+        return false;
+    }
+
+    size_t bytes = _model.arenaBytes();
+    if (heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT) >= bytes + INTERNAL_HEADROOM) {
+        _arena = (uint8_t*)heap_caps_aligned_alloc(ARENA_ALIGN, bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    }
+    _arenaInternal = _arena != nullptr;
+    if (!_arena) {
+        _arena = (uint8_t*)heap_caps_aligned_alloc(ARENA_ALIGN, bytes, MALLOC_CAP_SPIRAM);
+    }
+    if (!_arena) {
+        Serial.printf("[DETECT] Arena allocation failed (%u B) - detector off\n", (unsigned)bytes);
+        free(_blob);
+        _blob = nullptr;
+        return false;
+    }
+
+    for (uint16_t i = 0; i < _model.classCount(); i++) {
+        if (strcmp(_model.label(i), "background") == 0) {
+            _backgroundClass = i;
+        }
+    }
+    _ready = true;
+
+    Serial.printf("✅ [DETECT] %u layers, %u classes, %ux%u input, %lu MACs, weights %u B, "
+                  "arena %u B (%s), kernels %s\n",
+                  _model.layerCount(), _model.classCount(), _model.inputW(), _model.inputH(),
+                  (unsigned long)_model.macs(), (unsigned)_model.weightBytes(), (unsigned)bytes,
+                  _arenaInternal ? "internal" : "PSRAM", int8KernelBackend());
+    if (_backgroundClass < 0) {
+        Serial.println("[DETECT] Model has no \"background\" class - captures are labelled, never held back");
+    }
+    if (DETECTOR_SELF_TEST) {
+        selfTest();
+    }
+    return true;
+}
+
+// The fast kernels must agree with the reference bit for bit; on a mismatch
+// (e.g. an esp-nn build with a different API) only the reference runs
+void DetectorManager::selfTest() {
+    const uint16_t w = 64, h = 48;
+    uint8_t* plane = (uint8_t*)ps_malloc(w * h);
+    if (!plane) {
+        return;
+    }
+    for (uint16_t y = 0; y < h; y++) {
+        for (uint16_t x = 0; x < w; x++) {
+            plane[y * w + x] = (uint8_t)(x * 4 + y * 3 + (((x >> 3) ^ (y >> 3)) & 1) * 64);
+        }
+    }
+
+    Detection ref, fast;
+    int64_t t0 = esp_timer_get_time();
+    _model.run(plane, w, h, _arena, KERNELS_REFERENCE, ref);
+    int64_t t1 = esp_timer_get_time();
+    _model.run(plane, w, h, _arena, KERNELS_FAST, fast);
+    int64_t t2 = esp_timer_get_time();
+    free(plane);
+
+    bool same = memcmp(ref.logits, fast.logits, sizeof(ref.logits)) == 0;
+    _path = same ? KERNELS_FAST : KERNELS_REFERENCE;
+    Serial.printf("%s [DETECT] Self-test: reference %lu us, fast %lu us (%s), %s\n",
+                  same ? "✅" : "⚠️", (unsigned long)(t1 - t0), (unsigned long)(t2 - t1),
+                  int8KernelBackend(), same ? "bit-exact" : "MISMATCH - using reference kernels");
+}
+
+bool DetectorManager::classify(const camera_fb_t* fb, Detection& out) {
+    if (!_ready || !fb || fb->format != PIXFORMAT_JPEG) {
+        return false;
+    }
+    uint8_t* plane = (uint8_t*)captureArena.alloc(PIPELINE_GRAY_MAX);
+    if (!plane) {
+        Serial.println("[DETECT] No arena memory for the plane - capture left unlabelled");
+        return false;
+    }
+
+    int64_t start = esp_timer_get_time();
+    uint16_t w = 0, h = 0;
+    if (!framePipeline.grayFromJpeg(fb->buf, fb->len, plane, PIPELINE_GRAY_MAX, &w, &h) || !w || !h) {
+        Serial.println("[DETECT] Plane decode failed - capture left unlabelled");
+        return false;
+    }
+    int64_t decoded = esp_timer_get_time();
+    _model.run(plane, w, h, _arena, _path, out);
+    _lastUs = (uint32_t)(esp_timer_get_time() - decoded);
+    _inferences++;
+
+    Serial.printf("🔎 [DETECT] #%lu %s %u%% (", (unsigned long)_inferences, out.name, out.confidence);
+    for (uint16_t i = 0; i < _model.classCount(); i++) {
+        Serial.printf("%s%s %u%%", i ? ", " : "", _model.label(i), out.scores[i]);
+    }
+    Serial.printf("): %ux%u plane in %lu us, inference %lu us (%s), arena %u B\n",
+                  w, h, (unsigned long)(decoded - start), (unsigned long)_lastUs,
+                  _path == KERNELS_FAST ? int8KernelBackend() : "reference", (unsigned)arenaBytes());
+    return true;
+}
+
+UploadAction DetectorManager::actionFor(const Detection& d) const {
+    if (d.label != _backgroundClass || d.confidence < DETECTOR_MIN_CONFIDENCE) {
+        return UPLOAD_NOW;
+    }
+    switch (DETECTOR_UPLOAD_POLICY) {
+        case DETECT_UPLOAD_DEFER:
+            return UPLOAD_LATER;
+        case DETECT_UPLOAD_LOCAL:
+            return UPLOAD_NEVER;
+        default:
+            return UPLOAD_NOW;
+    }
+}
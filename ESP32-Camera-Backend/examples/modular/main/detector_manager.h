@@ -0,0 +1,86 @@
+/**
+ * detector_manager.h - On-device person/vehicle detector gating uploads
+ *
+ * Loads DETECTOR_MODEL_PATH (format in detector_model.h) from the SD card,
+ * classifies each still from its 1/8-scale grayscale plane and tells
+ * processCapture() what to do with it:
+ *   - person / vehicle / unsure: upload now, labelled (X-Detection or the
+ *     chunk envelope's "detection")
+ *   - background with >= DETECTOR_MIN_CONFIDENCE: per DETECTOR_UPLOAD_POLICY
+ *     upload anyway, leave it on the SD queue for the backlog pass, or keep
+ *     it on SD only
+ * Without a model file (or with DETECTOR_ENABLED false) every capture goes
+ * out as before, unlabelled.
+ *
+ * Activations and kernel scratch live in one buffer allocated at begin(),
+ * in internal RAM when it fits; the frame's plane comes from the capture
+ * arena. Every inference logs its time and the buffer size.
+ */
+
+#ifndef DETECTOR_MANAGER_H
+#define DETECTOR_MANAGER_H
+
+#include <Arduino.h>
+#include "esp_camera.h"
+#include "config.h"
+#include "detector_model.h"
+
+// What DETECTOR_UPLOAD_POLICY does with confident background captures
+enum DetectUploadPolicy : uint8_t {
+    DETECT_UPLOAD_ALL   = 0,
+    DETECT_UPLOAD_DEFER = 1,
+    DETECT_UPLOAD_LOCAL = 2
+};
+
+enum UploadAction : uint8_t {
+    UPLOAD_NOW   = 0,
+    UPLOAD_LATER = 1,   // Stays in /pending for NetworkTask's backlog pass
+    UPLOAD_NEVER = 2    // Moved to /sent without uploading
+};
+
+class DetectorManager {
+public:
+    DetectorManager();
+
+    /**
+     * Load the model and allocate its buffer. Call after the SD card is
+     * mounted. With DETECTOR_SELF_TEST, one synthetic frame runs through
+     * both kernel paths; a mismatch leaves only the reference kernels on.
+     * @return false (detector off) when there is no usable model
+     */
+    bool begin();
+
+    bool isReady() const { return _ready; }
+
+    /**
+     * Classify a JPEG still. Must run inside processCapture()'s ArenaScope.
+     * @return false when the detector is off or the frame could not be decoded
+     */
+    bool classify(const camera_fb_t* fb, Detection& out);
+
+    /**
+     * Upload decision for a classified capture (DETECTOR_UPLOAD_POLICY).
+     */
+    UploadAction actionFor(const Detection& d) const;
+
+    uint32_t lastInferenceUs() const { return _lastUs; }
+    size_t arenaBytes() const { return _model.arenaBytes(); }
+
+private:
+    DetectorModel _model;
+    uint8_t* _blob;
+    uint8_t* _arena;
+    bool _ready;
+    bool _arenaInternal;
+    KernelPath _path;
+    int8_t _backgroundClass;    // -1 when the model has no "background" label
+    uint32_t _lastUs;
+    uint32_t _inferences;
+
+    bool loadModel();
+    void selfTest();
+};
+
+extern DetectorManager detectorMgr;
+
+#endif // DETECTOR_MANAGER_H
@@ -0,0 +1,299 @@
+/**
+ * detector_model.cpp - Model file parsing and int8 inference
+ */
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "detector_model.h"
+
+static const size_t MODEL_HEADER_BYTES = 72;
+static const size_t LAYER_HEADER_BYTES = 20;
+
+template <typename T>
+static T readField(const uint8_t* p) {
+    T v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static size_t align4(size_t n) {
+    return (n + 3) & ~(size_t)3;
+}
+
+static size_t align16(size_t n) {
+    return (n + 15) & ~(size_t)15;
+}
+
+// TFLite output size and leading padding for one dimension
+static bool convDimension(uint16_t in, uint8_t kernel, uint8_t stride, bool same,
+                          uint16_t& out, uint8_t& padBefore) {
+    if (same) {
+        out = (in + stride - 1) / stride;
+        int total = (out - 1) * stride + kernel - in;
+        padBefore = total > 0 ? total / 2 : 0;
+        return out > 0;
+    }
+    if (in < kernel) {
+        return false;
+    }
+    out = (in - kernel) / stride + 1;
+    padBefore = 0;
+    return true;
+}
+
+void formatDetection(const Detection& d, char* out, size_t outSize) {
+    snprintf(out, outSize, "%s,%u", d.name, d.confidence);
+}
+
+DetectorModel::DetectorModel()
+    : _layerCount(0), _input({0, 0, 0}), _classCount(0), _outputScale(0), _outputZeroPoint(0),
+      _activationBytes(0), _scratchBytes(0), _weightBytes(0), _macs(0), _error("no model") {
+    memset(_labels, 0, sizeof(_labels));
+}
+
+bool DetectorModel::fail(const char* why) {
+    _layerCount = 0;
+    _error = why;
+    return false;
+}
+
+bool DetectorModel::parse(const uint8_t* blob, size_t len) {
+    _layerCount = 0;
+    if (((uintptr_t)blob & 3) != 0) {
+        return fail("model buffer not 4-byte aligned");
+    }
+    if (len < MODEL_HEADER_BYTES || readField<uint32_t>(blob) != DETECTOR_MODEL_MAGIC) {
+        return fail("not a DET1 model");
+    }
+    if (readField<uint16_t>(blob + 4) != 1) {
+        return fail("unsupported model version");
+    }
+    uint16_t layers = readField<uint16_t>(blob + 6);
+    _input = { readField<uint16_t>(blob + 10), readField<uint16_t>(blob + 8), 1 };
+    _classCount = readField<uint16_t>(blob + 12);
+    _outputScale = readField<float>(blob + 16);
+    _outputZeroPoint = readField<int32_t>(blob + 20);
+    if (layers == 0 || layers > DETECTOR_MAX_LAYERS) {
+        return fail("layer count out of range");
+    }
+    if (_classCount < 2 || _classCount > DETECTOR_MAX_CLASSES) {
+        return fail("class count out of range");
+    }
+    if (_input.w == 0 || _input.h == 0 || !(_outputScale > 0)) {
+        return fail("bad input size or output scale");
+    }
+    for (uint16_t i = 0; i < _classCount; i++) {
+        memcpy(_labels[i], blob + 24 + i * DETECTOR_LABEL_LEN, DETECTOR_LABEL_LEN);
+        _labels[i][DETECTOR_LABEL_LEN] = '\0';
+        // Labels go into HTTP headers and JSON unescaped; the server takes [A-Za-z0-9_-]
+        for (char* c = _labels[i]; *c; c++) {
+            if (!isalnum((uint8_t)*c) && *c != '-') {
+                *c = '_';
+            }
+        }
+    }
+
+    size_t pos = MODEL_HEADER_BYTES;
+    TensorShape shape = _input;
+    size_t largest = shape.size();
+    _scratchBytes = 0;
+    _weightBytes = 0;
+    _macs = 0;
+
+    for (uint16_t i = 0; i < layers; i++) {
+        if (pos + LAYER_HEADER_BYTES > len) {
+            return fail("truncated layer header");
+        }
+        const uint8_t* p = blob + pos;
+        DetectorLayer& layer = _layers[i];
+        memset(&layer, 0, sizeof(layer));
+        layer.type = (DetectorLayerType)p[0];
+        uint8_t kernelH = p[1];
+        uint8_t kernelW = p[2];
+        uint8_t stride = p[3];
+        bool same = p[4] == 1;
+        layer.quant.actMin = (int8_t)p[5];
+        layer.quant.actMax = (int8_t)p[6];
+        uint16_t outChannels = readField<uint16_t>(p + 8);
+        layer.quant.inputOffset = readField<int32_t>(p + 12);
+        layer.quant.outputOffset = readField<int32_t>(p + 16);
+        pos += LAYER_HEADER_BYTES;
+
+        if (layer.quant.actMin > layer.quant.actMax ||
+            layer.quant.inputOffset < -127 || layer.quant.inputOffset > 128 ||
+            layer.quant.outputOffset < -128 || layer.quant.outputOffset > 127) {
+            return fail("bad layer quantisation");
+        }
+
+        layer.in = shape;
+        size_t weights = 0;
+        switch (layer.type) {
+            case LAYER_CONV:
+            case LAYER_DEPTHWISE: {
+                if (kernelH == 0 || kernelW == 0 || stride == 0) {
+                    return fail("bad kernel geometry");
+                }
+                layer.geometry = { kernelH, kernelW, stride, stride, 0, 0 };
+                if (!convDimension(shape.h, kernelH, stride, same, layer.out.h, layer.geometry.padTop) ||
+                    !convDimension(shape.w, kernelW, stride, same, layer.out.w, layer.geometry.padLeft)) {
+                    return fail("kernel larger than its input");
+                }
+                if (layer.type == LAYER_CONV) {
+                    layer.out.c = outChannels;
+                    weights = (size_t)outChannels * kernelH * kernelW * shape.c;
+                    layer.macs = (uint32_t)(layer.out.size() * kernelH * kernelW * shape.c);
+                    layer.scratch = conv2dScratchBytes(shape, layer.geometry, layer.out);
+                } else {
+                    layer.out.c = shape.c;
+                    weights = (size_t)kernelH * kernelW * shape.c;
+                    layer.macs = (uint32_t)(layer.out.size() * kernelH * kernelW);
+                    layer.scratch = depthwiseConvScratchBytes(shape, layer.geometry, layer.out);
+                }
+                break;
+            }
+            case LAYER_FC:
+                layer.out = { 1, 1, outChannels };
+                weights = shape.size() * outChannels;
+                layer.macs = (uint32_t)weights;
+                layer.scratch = fullyConnectedScratchBytes(shape.size());
+                break;
+            case LAYER_AVGPOOL:
+                layer.out = { 1, 1, shape.c };
+                break;
+            default:
+                return fail("unknown layer type");
+        }
+        if (layer.out.c == 0) {
+            return fail("layer without output channels");
+        }
+
+        if (layer.type != LAYER_AVGPOOL) {
+            size_t channels = layer.out.c;
+            size_t arrays = 3 * channels * sizeof(int32_t) + align4(weights);
+            if (pos + arrays > len) {
+                return fail("truncated layer weights");
+            }
+            layer.bias = (const int32_t*)(blob + pos);
+            layer.quant.multiplier = layer.bias + channels;
+            layer.quant.shift = layer.quant.multiplier + channels;
+            layer.weights = (const int8_t*)(layer.quant.shift + channels);
+            for (size_t c = 0; c < channels; c++) {
+                if (layer.quant.multiplier[c] < 0 || layer.quant.shift[c] < -31 || layer.quant.shift[c] > 30) {
+                    return fail("bad requantisation parameters");
+                }
+            }
+            pos += arrays;
+            _weightBytes += arrays;
+        }
+
+        shape = layer.out;
+        largest = largest > shape.size() ? largest : shape.size();
+        _scratchBytes = _scratchBytes > layer.scratch ? _scratchBytes : layer.scratch;
+        _macs += layer.macs;
+    }
+
+    if (shape.size() != _classCount) {
+        return fail("last layer does not produce one logit per class");
+    }
+    _activationBytes = align16(largest);
+    _scratchBytes = align16(_scratchBytes);
+    _layerCount = layers;
+    _error = nullptr;
+    return true;
+}
+
+// Bilinear resize with 8-bit weights, then uint8 -> int8
+void DetectorModel::resizeInput(const uint8_t* gray, uint16_t w, uint16_t h, int8_t* dst) const {
+    for (uint16_t dy = 0; dy < _input.h; dy++) {
+        // Pixel centres: src = (dst + 0.5) * h / H - 0.5, in 16.16
+        int64_t sy = ((int64_t)(2 * dy + 1) * h << 16) / (2 * _input.h) - 32768;
+        sy = sy < 0 ? 0 : sy;
+        uint32_t y0 = (uint32_t)(sy >> 16);
+        uint32_t y1 = y0 + 1 < h ? y0 + 1 : h - 1;
+        uint32_t fy = (uint32_t)(sy >> 8) & 0xFF;
+        const uint8_t* row0 = gray + (size_t)y0 * w;
+        const uint8_t* row1 = gray + (size_t)y1 * w;
+        for (uint16_t dx = 0; dx < _input.w; dx++) {
+            int64_t sx = ((int64_t)(2 * dx + 1) * w << 16) / (2 * _input.w) - 32768;
+            sx = sx < 0 ? 0 : sx;
+            uint32_t x0 = (uint32_t)(sx >> 16);
+            uint32_t x1 = x0 + 1 < w ? x0 + 1 : w - 1;
+            uint32_t fx = (uint32_t)(sx >> 8) & 0xFF;
+            uint32_t top = row0[x0] * (256 - fx) + row0[x1] * fx;
+            uint32_t bottom = row1[x0] * (256 - fx) + row1[x1] * fx;
+            uint32_t v = (top * (256 - fy) + bottom * fy + 32768) >> 16;
+            *dst++ = (int8_t)((int)v - 128);
+        }
+    }
+}
+
+void DetectorModel::run(const uint8_t* gray, uint16_t w, uint16_t h, uint8_t* arena, KernelPath path,
+                        Detection& out) const {
+    int8_t* src = (int8_t*)arena;
+    int8_t* dst = src + _activationBytes;
+    void* scratch = arena + 2 * _activationBytes;
+    resizeInput(gray, w, h, src);
+
+    bool fast = path == KERNELS_FAST;
+    for (uint16_t i = 0; i < _layerCount; i++) {
+        const DetectorLayer& l = _layers[i];
+        switch (l.type) {
+            case LAYER_CONV:
+                if (fast) {
+                    conv2dFast(src, l.in, l.weights, l.bias, l.geometry, l.quant, dst, l.out, scratch);
+                } else {
+                    conv2dRef(src, l.in, l.weights, l.bias, l.geometry, l.quant, dst, l.out);
+                }
+                break;
+            case LAYER_DEPTHWISE:
+                if (fast) {
+                    depthwiseConvFast(src, l.in, l.weights, l.bias, l.geometry, l.quant, dst, l.out, scratch);
+                } else {
+                    depthwiseConvRef(src, l.in, l.weights, l.bias, l.geometry, l.quant, dst, l.out);
+                }
+                break;
+            case LAYER_FC:
+                if (fast) {
+                    fullyConnectedFast(src, l.in.size(), l.weights, l.bias, l.quant, dst, l.out.c, scratch);
+                } else {
+                    fullyConnectedRef(src, l.in.size(), l.weights, l.bias, l.quant, dst, l.out.c);
+                }
+                break;
+            case LAYER_AVGPOOL:
+                averagePoolGlobal(src, l.in, l.quant.actMin, l.quant.actMax, dst);
+                break;
+        }
+        int8_t* t = src;
+        src = dst;
+        dst = t;
+    }
+
+    // Softmax over the dequantised logits
+    float logits[DETECTOR_MAX_CLASSES];
+    float top = -INFINITY;
+    for (uint16_t i = 0; i < _classCount; i++) {
+        out.logits[i] = src[i];
+        logits[i] = (src[i] - _outputZeroPoint) * _outputScale;
+        top = logits[i] > top ? logits[i] : top;
+    }
+    float sum = 0;
+    for (uint16_t i = 0; i < _classCount; i++) {
+        logits[i] = expf(logits[i] - top);
+        sum += logits[i];
+    }
+    out.label = 0;
+    for (uint16_t i = 0; i < _classCount; i++) {
+        out.scores[i] = (uint8_t)(logits[i] * 100 / sum + 0.5f);
+        if (src[i] > src[out.label]) {
+            out.label = i;
+        }
+    }
+    for (uint16_t i = _classCount; i < DETECTOR_MAX_CLASSES; i++) {
+        out.scores[i] = 0;
+        out.logits[i] = 0;
+    }
+    out.confidence = out.scores[out.label];
+    out.name = _labels[out.label];
+}
@@ -0,0 +1,119 @@
+/**
+ * detector_model.h - int8 person/vehicle classifier over a grayscale frame
+ *
+ * Parses a model file and runs it with int8_kernels.h. Plain C++ (no
+ * Arduino or SD): DetectorManager loads the file on the device,
+ * detector_bench/ on a PC.
+ *
+ * Model file (little-endian, arrays 4-byte aligned, blob loaded 4-aligned):
+ *   header, 72 bytes
+ *     "DET1"  u16 version (1)  u16 layerCount  u16 inputW  u16 inputH
+ *     u16 classCount  u16 0  f32 outputScale  i32 outputZeroPoint
+ *     char labels[4][12]   e.g. "background", "person", "vehicle"
+ *   layerCount x layer
+ *     u8 type (DetectorLayerType)  u8 kernelH  u8 kernelW  u8 stride
+ *     u8 padding (0 VALID, 1 SAME)  i8 actMin  i8 actMax  u8 0
+ *     u16 outChannels (conv/FC; depthwise/pool: ignored)  u16 0
+ *     i32 inputOffset  i32 outputOffset
+ *     conv/depthwise/FC only: i32 bias[C], i32 multiplier[C], i32 shift[C],
+ *       i8 weights (conv OHWI, depthwise HWC, FC out x in), padded to 4
+ *
+ * The input is one channel, inputW x inputH, int8 = pixel - 128 (TFLite's
+ * uint8 -> int8 conversion); run() resizes the frame to it. The last layer
+ * must produce classCount logits; confidences are their softmax.
+ */
+
+#ifndef DETECTOR_MODEL_H
+#define DETECTOR_MODEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+#include "int8_kernels.h"
+
+#define DETECTOR_LABEL_LEN  12
+#define DETECTOR_MODEL_MAGIC 0x31544544u    // "DET1"
+
+enum DetectorLayerType : uint8_t {
+    LAYER_CONV      = 0,
+    LAYER_DEPTHWISE = 1,
+    LAYER_FC        = 2,
+    LAYER_AVGPOOL   = 3
+};
+
+enum KernelPath : uint8_t {
+    KERNELS_REFERENCE = 0,
+    KERNELS_FAST      = 1
+};
+
+struct Detection {
+    int8_t label;                           // Best class
+    uint8_t confidence;                     // Its softmax, percent
+    const char* name;                       // Its label (points into the model)
+    uint8_t scores[DETECTOR_MAX_CLASSES];   // Every class, percent
+    int8_t logits[DETECTOR_MAX_CLASSES];    // Raw output, for bit-exact comparisons
+};
+
+// "label,confidence" as sent in X-Detection / the chunk envelope ("person,87")
+void formatDetection(const Detection& d, char* out, size_t outSize);
+
+struct DetectorLayer {
+    DetectorLayerType type;
+    ConvGeometry geometry;
+    QuantParams quant;
+    const int32_t* bias;
+    const int8_t* weights;
+    TensorShape in;
+    TensorShape out;
+    size_t scratch;             // Fast-kernel scratch bytes
+    uint32_t macs;
+};
+
+class DetectorModel {
+public:
+    DetectorModel();
+
+    /**
+     * Check blob and point the layers into it (nothing is copied: blob must
+     * stay valid and 4-byte aligned).
+     * @return false with error() set when the file is not a usable model
+     */
+    bool parse(const uint8_t* blob, size_t len);
+    const char* error() const { return _error; }
+
+    /**
+     * Classify an 8-bit grayscale plane (any size). arena holds arenaBytes().
+     */
+    void run(const uint8_t* gray, uint16_t w, uint16_t h, uint8_t* arena, KernelPath path,
+             Detection& out) const;
+
+    // Activations (two ping-pong buffers) plus the largest kernel scratch
+    size_t arenaBytes() const { return 2 * _activationBytes + _scratchBytes; }
+    size_t weightBytes() const { return _weightBytes; }
+    uint32_t macs() const { return _macs; }
+    uint16_t layerCount() const { return _layerCount; }
+    const DetectorLayer& layer(uint16_t i) const { return _layers[i]; }
+    uint16_t inputW() const { return _input.w; }
+    uint16_t inputH() const { return _input.h; }
+    uint16_t classCount() const { return _classCount; }
+    const char* label(uint16_t i) const { return _labels[i]; }
+
+private:
+    DetectorLayer _layers[DETECTOR_MAX_LAYERS];
+    uint16_t _layerCount;
+    TensorShape _input;
+    uint16_t _classCount;
+    float _outputScale;
+    int32_t _outputZeroPoint;
+    char _labels[DETECTOR_MAX_CLASSES][DETECTOR_LABEL_LEN + 1];
+    size_t _activationBytes;    // Largest tensor, rounded up to 16
+    size_t _scratchBytes;
+    size_t _weightBytes;
+    uint32_t _macs;
+    const char* _error;
+
+    bool fail(const char* why);
+    void resizeInput(const uint8_t* gray, uint16_t w, uint16_t h, int8_t* dst) const;
+};
+
+#endif // DETECTOR_MODEL_H
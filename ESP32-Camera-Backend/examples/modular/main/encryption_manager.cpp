@@ -4,6 +4,7 @@
 
 #include "encryption_manager.h"
 #include "config.h"
+#include "capture_arena.h"
 
 #include <mbedtls/aes.h>
 #include <mbedtls/base64.h>
@@ -19,7 +20,7 @@ bool EncryptionManager::encrypt(const uint8_t* input, size_t len, EncryptionResu
 
     const size_t blockSize = 16;
     size_t paddedLen = ((len / blockSize) + 1) * blockSize;
-    uint8_t* buffer = (uint8_t*)malloc(paddedLen);
+    uint8_t* buffer = (uint8_t*)arenaAlloc(paddedLen);
     if (!buffer) {
         return false;
     }
@@ -41,7 +42,7 @@ bool EncryptionManager::encrypt(const uint8_t* input, size_t len, EncryptionResu
     int rc = mbedtls_aes_setkey_enc(&aes, key, 128);
     if (rc != 0) {
         mbedtls_aes_free(&aes);
-        free(buffer);
+        arenaFree(buffer);
         return false;
     }
 
@@ -51,12 +52,12 @@ bool EncryptionManager::encrypt(const uint8_t* input, size_t len, EncryptionResu
     mbedtls_aes_free(&aes);
 
     if (rc != 0) {
-        free(buffer);
+        arenaFree(buffer);
         return false;
     }
 
     if (!base64Encode(iv, blockSize, result.ivBase64, sizeof(result.ivBase64))) {
-        free(buffer);
+        arenaFree(buffer);
         return false;
     }
 
@@ -67,7 +68,7 @@ bool EncryptionManager::encrypt(const uint8_t* input, size_t len, EncryptionResu
 
 void EncryptionManager::freeResult(EncryptionResult& result) {
     if (result.data) {
-        free(result.data);
+        arenaFree(result.data);
         result.data = nullptr;
     }
     result.length = 0;
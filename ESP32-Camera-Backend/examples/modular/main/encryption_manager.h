@@ -9,7 +9,7 @@
 #include "config.h"
 
 struct EncryptionResult {
-    uint8_t* data;
+    uint8_t* data;      // Capture arena when inside an ArenaScope, heap otherwise
     size_t length;
     char ivBase64[25];
 
@@ -0,0 +1,105 @@
+/**
+ * frame_cache.cpp - Latest-frame cache implementation
+ */
+
+#include <esp32-hal-psram.h>
+#include "esp_timer.h"
+#include "frame_cache.h"
+
+FrameCache frameCache;
+
+FrameCache::FrameCache()
+    : _slotSize(0), _latest(-1), _seq(0), _oversize(0) {
+    _mux = portMUX_INITIALIZER_UNLOCKED;
+    memset(_slots, 0, sizeof(_slots));
+}
+
+bool FrameCache::begin(size_t slotSize) {
+    if (_slotSize) {
+        return true;
+    }
+    for (int i = 0; i < FRAME_CACHE_SLOTS; i++) {
+        _slots[i].data = (uint8_t*)ps_malloc(slotSize);
+        if (!_slots[i].data) {
+            Serial.printf("[CACHE] Failed to allocate slot %d (%u bytes)\n", i, (unsigned)slotSize);
+            for (int j = 0; j < i; j++) {
+                free(_slots[j].data);
+                _slots[j].data = nullptr;
+            }
+            return false;
+        }
+    }
+    _slotSize = slotSize;
+    Serial.printf("[CACHE] %d x %u KB frame slots in PSRAM\n", FRAME_CACHE_SLOTS, (unsigned)(slotSize / 1024));
+    return true;
+}
+
+bool FrameCache::publish(const uint8_t* jpg, size_t len, uint16_t width, uint16_t height) {
+    if (!_slotSize) {
+        return false;
+    }
+    if (len > _slotSize) {
+        _oversize++;
+        return false;
+    }
+
+    // Pick a slot that is neither the latest nor pinned by a reader
+    int8_t slot = -1;
+    portENTER_CRITICAL(&_mux);
+    for (int8_t i = 0; i < FRAME_CACHE_SLOTS; i++) {
+        if (i != _latest && _slots[i].readers == 0) {
+            slot = i;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&_mux);
+
+    if (slot < 0) {
+        return false; // Every other slot is being sent right now
+    }
+
+    CachedFrame& f = _slots[slot];
+    memcpy(f.data, jpg, len);
+    f.len = len;
+    f.width = width;
+    f.height = height;
+    f.capturedAtUs = esp_timer_get_time();
+
+    portENTER_CRITICAL(&_mux);
+    f.seq = ++_seq;
+    _latest = slot;
+    portEXIT_CRITICAL(&_mux);
+    return true;
+}
+
+const CachedFrame* FrameCache::acquire(uint32_t maxAgeMs) {
+    const CachedFrame* frame = nullptr;
+    int64_t now = esp_timer_get_time();
+    portENTER_CRITICAL(&_mux);
+    if (_latest >= 0) {
+        CachedFrame& f = _slots[_latest];
+        if (now - f.capturedAtUs <= (int64_t)maxAgeMs * 1000) {
+            f.readers++;
+            frame = &f;
+        }
+    }
+    portEXIT_CRITICAL(&_mux);
+    return frame;
+}
+
+void FrameCache::release(const CachedFrame* frame) {
+    if (!frame) {
+        return;
+    }
+    portENTER_CRITICAL(&_mux);
+    _slots[frame - _slots].readers--;
+    portEXIT_CRITICAL(&_mux);
+}
+
+uint32_t FrameCache::ageMs() const {
+    int8_t latest = _latest;
+    if (latest < 0) {
+        return UINT32_MAX;
+    }
+    return (uint32_t)((esp_timer_get_time() - _slots[latest].capturedAtUs) / 1000);
+}
@@ -0,0 +1,66 @@
+/**
+ * frame_cache.h - Latest-frame cache shared between stream and snapshot
+ *
+ * The stream task copies every JPEG it sends into one of three PSRAM slots.
+ * Readers (e.g. /capture) pin the newest slot and send it without touching
+ * the camera driver. With three slots the writer always finds a slot that is
+ * neither the newest nor pinned by a reader, so it never blocks.
+ */
+
+#ifndef FRAME_CACHE_H
+#define FRAME_CACHE_H
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "config.h"
+
+#define FRAME_CACHE_SLOTS 3
+
+struct CachedFrame {
+    uint8_t* data;
+    size_t len;
+    uint16_t width;
+    uint16_t height;
+    uint32_t seq;
+    int64_t capturedAtUs;   // esp_timer_get_time() when published
+    uint8_t readers;        // Pins held by acquire()
+};
+
+class FrameCache {
+public:
+    FrameCache();
+
+    /**
+     * Allocate the slots (PSRAM). Call once in setup().
+     */
+    bool begin(size_t slotSize = FRAME_CACHE_SLOT_SIZE);
+
+    /**
+     * Copy a JPEG into a free slot and make it the latest frame.
+     * Frames larger than a slot are dropped (counted in oversize()).
+     */
+    bool publish(const uint8_t* jpg, size_t len, uint16_t width, uint16_t height);
+
+    /**
+     * Pin the latest frame if it is younger than maxAgeMs.
+     * @return nullptr when empty or stale; otherwise release() when done.
+     */
+    const CachedFrame* acquire(uint32_t maxAgeMs);
+    void release(const CachedFrame* frame);
+
+    uint32_t seq() const { return _seq; }
+    uint32_t ageMs() const;         // UINT32_MAX when nothing cached
+    uint32_t oversize() const { return _oversize; }
+
+private:
+    CachedFrame _slots[FRAME_CACHE_SLOTS];
+    size_t _slotSize;
+    volatile int8_t _latest;        // -1 = empty
+    volatile uint32_t _seq;
+    volatile uint32_t _oversize;
+    portMUX_TYPE _mux;
+};
+
+extern FrameCache frameCache;
+
+#endif // FRAME_CACHE_H
@@ -0,0 +1,453 @@
+/**
+ * frame_pipeline.cpp - Dual-format capture pipeline implementation
+ */
+
+#include <esp32-hal-psram.h>
+#include "img_converters.h"
+#include "esp_jpg_decode.h"
+#include "frame_pipeline.h"
+#include "capture_arena.h"
+
+FramePipeline framePipeline;
+
+// ===== BufferPool =====
+
+BufferPool::BufferPool() : _count(0), _size(0), _inUse(0), _exhausted(0) {
+    _mux = portMUX_INITIALIZER_UNLOCKED;
+    memset(_bufs, 0, sizeof(_bufs));
+}
+
+bool BufferPool::begin(uint8_t count, size_t size) {
+    if (_size) {
+        return true;
+    }
+    if (count > PIPELINE_MAX_POOL) {
+        count = PIPELINE_MAX_POOL;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        _bufs[i] = (uint8_t*)ps_malloc(size);
+        if (!_bufs[i]) {
+            for (uint8_t j = 0; j < i; j++) {
+                free(_bufs[j]);
+                _bufs[j] = nullptr;
+            }
+            return false;
+        }
+    }
+    _count = count;
+    _size = size;
+    return true;
+}
+
+uint8_t* BufferPool::acquire() {
+    uint8_t* buf = nullptr;
+    portENTER_CRITICAL(&_mux);
+    for (uint8_t i = 0; i < _count; i++) {
+        if (!(_inUse & (1 << i))) {
+            _inUse |= (1 << i);
+            buf = _bufs[i];
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&_mux);
+    if (!buf) {
+        _exhausted++;
+    }
+    return buf;
+}
+
+void BufferPool::release(uint8_t* buf) {
+    if (!buf) {
+        return;
+    }
+    portENTER_CRITICAL(&_mux);
+    for (uint8_t i = 0; i < _count; i++) {
+        if (_bufs[i] == buf) {
+            _inUse &= ~(1 << i);
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&_mux);
+}
+
+// ===== Encoder / decoder callbacks =====
+
+struct JpegSink {
+    uint8_t* buf;
+    size_t cap;
+    size_t len;
+};
+
+static size_t jpegSinkWrite(void* arg, size_t index, const void* data, size_t len) {
+    JpegSink* sink = (JpegSink*)arg;
+    if (!data) {
+        return 0;
+    }
+    if (index + len > sink->cap) {
+        return 0; // Aborts the encoder
+    }
+    memcpy(sink->buf + index, data, len);
+    sink->len = index + len;
+    return len;
+}
+
+// esp_jpg_decode passes one arg to both callbacks; every sink starts with the source
+struct DecodeSink {
+    const uint8_t* src;
+};
+
+static size_t decodeSourceRead(void* arg, size_t index, uint8_t* buf, size_t len) {
+    DecodeSink* sink = (DecodeSink*)arg;
+    if (buf) {
+        memcpy(buf, sink->src + index, len);
+    }
+    return len;
+}
+
+struct GraySink : DecodeSink {
+    uint8_t* out;
+    size_t cap;
+    uint16_t w;
+    uint16_t h;
+};
+
+static inline uint8_t luma(uint8_t r, uint8_t g, uint8_t b) {
+    return (uint8_t)((77 * r + 150 * g + 29 * b) >> 8);
+}
+
+// Receives decoded RGB888 blocks; a null block announces the output size
+static bool graySinkWrite(void* arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t* data) {
+    GraySink* sink = (GraySink*)arg;
+    if (!data) {
+        if (x == 0 && y == 0) {
+            if ((size_t)w * h > sink->cap) {
+                return false;
+            }
+            sink->w = w;
+            sink->h = h;
+        }
+        return true;
+    }
+    for (uint16_t row = 0; row < h; row++) {
+        uint8_t* dst = sink->out + (size_t)(y + row) * sink->w + x;
+        for (uint16_t col = 0; col < w; col++) {
+            *dst++ = luma(data[0], data[1], data[2]);
+            data += 3;
+        }
+    }
+    return true;
+}
+
+struct RgbSink : DecodeSink {
+    uint8_t* out;
+    uint16_t w;
+    uint16_t h;
+};
+
+// esp32-camera RGB888 buffers are BGR ordered (see fmt2rgb888)
+static bool rgbSinkWrite(void* arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t* data) {
+    RgbSink* sink = (RgbSink*)arg;
+    if (!data) {
+        // Start/end markers; output size was fixed by the caller
+        return !(x == 0 && y == 0) || (w == sink->w && h == sink->h);
+    }
+    for (uint16_t row = 0; row < h; row++) {
+        uint8_t* dst = sink->out + ((size_t)(y + row) * sink->w + x) * 3;
+        for (uint16_t col = 0; col < w; col++) {
+            dst[0] = data[2];
+            dst[1] = data[1];
+            dst[2] = data[0];
+            dst += 3;
+            data += 3;
+        }
+    }
+    return true;
+}
+
+struct CropSink : DecodeSink {
+    uint8_t* out;
+    RoiBox box;             // In decoded (scaled) coordinates
+    bool complete;          // Box filled; the decode was stopped on purpose
+};
+
+// Keeps only the part of each decoded block that falls inside the box. Blocks
+// arrive in raster order, so once the bottom-right one is in, returning false
+// stops the decoder: nothing below the box is decoded. Everything above it
+// still is - baseline JPEG has no random access to a block without decoding
+// the entropy-coded data before it
+static bool cropSinkWrite(void* arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t* data) {
+    CropSink* sink = (CropSink*)arg;
+    if (!data) {
+        return true;
+    }
+    const RoiBox& b = sink->box;
+    if (y >= b.y + b.h) {
+        sink->complete = true;
+        return false;
+    }
+    uint16_t x0 = max(x, b.x);
+    uint16_t y0 = max(y, b.y);
+    uint16_t x1 = min((uint16_t)(x + w), (uint16_t)(b.x + b.w));
+    uint16_t y1 = min((uint16_t)(y + h), (uint16_t)(b.y + b.h));
+    for (uint16_t row = y0; row < y1; row++) {
+        const uint8_t* src = data + ((size_t)(row - y) * w + (x0 - x)) * 3;
+        uint8_t* dst = sink->out + ((size_t)(row - b.y) * b.w + (x0 - b.x)) * 3;
+        for (uint16_t col = x0; col < x1; col++) {
+            dst[0] = src[2];
+            dst[1] = src[1];
+            dst[2] = src[0];
+            dst += 3;
+            src += 3;
+        }
+    }
+    if (y + h >= b.y + b.h && x + w >= b.x + b.w) {
+        sink->complete = true;
+        return false;
+    }
+    return true;
+}
+
+// ===== FramePipeline =====
+
+FramePipeline::FramePipeline()
+    : _latestGray(nullptr), _latestW(0), _latestH(0), _graySeq(0), _encodeFailures(0),
+      _latestLock(nullptr) {}
+
+bool FramePipeline::begin() {
+    _latestLock = xSemaphoreCreateMutex();
+    bool ok = _jpgPool.begin(PIPELINE_JPEG_POOL, PIPELINE_JPEG_BUF_SIZE);
+    ok = _grayPool.begin(PIPELINE_GRAY_POOL, PIPELINE_GRAY_MAX) && _latestLock && ok;
+    if (!ok) {
+        Serial.println("[PIPELINE] Buffer pool allocation failed");
+        return false;
+    }
+    Serial.printf("[PIPELINE] %d x %u KB JPEG + %d x %u B analytics buffers\n",
+                  PIPELINE_JPEG_POOL, (unsigned)(PIPELINE_JPEG_BUF_SIZE / 1024),
+                  PIPELINE_GRAY_POOL, (unsigned)PIPELINE_GRAY_MAX);
+    return true;
+}
+
+bool FramePipeline::encodeJpeg(camera_fb_t* fb, PipelineFrame& out) {
+    if (fb->format == PIXFORMAT_JPEG) {
+        out.jpg = fb->buf;
+        out.jpgLen = fb->len;
+        return true;
+    }
+    out.jpgBuf = _jpgPool.acquire();
+    if (!out.jpgBuf) {
+        return false;
+    }
+    JpegSink sink = { out.jpgBuf, _jpgPool.bufferSize(), 0 };
+    if (!frame2jpg_cb(fb, PIPELINE_JPEG_QUALITY, jpegSinkWrite, &sink)) {
+        _jpgPool.release(out.jpgBuf);
+        out.jpgBuf = nullptr;
+        return false;
+    }
+    out.jpg = out.jpgBuf;
+    out.jpgLen = sink.len;
+    return true;
+}
+
+bool FramePipeline::buildGray(camera_fb_t* fb, PipelineFrame& out) {
+    uint8_t* plane = _grayPool.acquire();
+    if (!plane) {
+        return false;
+    }
+
+    if (fb->format == PIXFORMAT_JPEG) {
+        if (!grayFromJpeg(fb->buf, fb->len, plane, _grayPool.bufferSize(), &out.grayW, &out.grayH)) {
+            _grayPool.release(plane);
+            return false;
+        }
+    } else {
+        uint16_t w = fb->width / 8;
+        uint16_t h = fb->height / 8;
+        if ((size_t)w * h > _grayPool.bufferSize()) {
+            _grayPool.release(plane);
+            return false;
+        }
+        uint8_t* dst = plane;
+        for (uint16_t y = 0; y < h; y++) {
+            const uint8_t* row = fb->buf + (size_t)y * 8 * fb->width * (fb->format == PIXFORMAT_GRAYSCALE ? 1 : 2);
+            for (uint16_t x = 0; x < w; x++) {
+                switch (fb->format) {
+                    case PIXFORMAT_GRAYSCALE:
+                        *dst++ = row[x * 8];
+                        break;
+                    case PIXFORMAT_YUV422:
+                        *dst++ = row[x * 16];   // Y0 U Y1 V
+                        break;
+                    case PIXFORMAT_RGB565: {
+                        uint16_t px = (row[x * 16] << 8) | row[x * 16 + 1];
+                        *dst++ = luma((px >> 8) & 0xF8, (px >> 3) & 0xFC, (px << 3) & 0xF8);
+                        break;
+                    }
+                    default:
+                        _grayPool.release(plane);
+                        return false;
+                }
+            }
+        }
+        out.grayW = w;
+        out.grayH = h;
+    }
+    out.gray = plane;
+    return true;
+}
+
+bool FramePipeline::grayFromJpeg(const uint8_t* jpg, size_t len, uint8_t* out, size_t cap,
+                                 uint16_t* w, uint16_t* h) {
+    // 1/8 scale only needs the DC coefficients - far cheaper than a full decode
+    GraySink sink = { { jpg }, out, cap, 0, 0 };
+    if (esp_jpg_decode(len, JPG_SCALE_8X, decodeSourceRead, graySinkWrite, &sink) != ESP_OK) {
+        return false;
+    }
+    *w = sink.w;
+    *h = sink.h;
+    return true;
+}
+
+uint8_t FramePipeline::cropJpeg(const uint8_t* jpg, size_t len, const RoiBox& box,
+                                uint8_t** out, size_t* outLen) {
+    *out = nullptr;
+    *outLen = 0;
+
+    // Full resolution when the crop fits, otherwise the smallest downscale that does
+    jpg_scale_t scale = JPG_SCALE_NONE;
+    uint8_t divisor = 1;
+    while ((uint32_t)(box.w / divisor) * (box.h / divisor) > ROI_MAX_PIXELS && scale < JPG_SCALE_8X) {
+        scale = (jpg_scale_t)(scale + 1);
+        divisor *= 2;
+    }
+    RoiBox scaled = { (uint16_t)(box.x / divisor), (uint16_t)(box.y / divisor),
+                      (uint16_t)(box.w / divisor), (uint16_t)(box.h / divisor) };
+    if (scaled.w == 0 || scaled.h == 0) {
+        return 0;
+    }
+
+    uint8_t* rgb = (uint8_t*)arenaAlloc((size_t)scaled.w * scaled.h * 3);
+    uint8_t* dst = (uint8_t*)arenaAlloc(ROI_MAX_BYTES);
+    if (!rgb || !dst) {
+        arenaFree(rgb);
+        arenaFree(dst);
+        return 0;
+    }
+
+    // Stopping early makes esp_jpg_decode report (and log) an interrupted decode
+    CropSink cropSink = { { jpg }, rgb, scaled, false };
+    bool ok = esp_jpg_decode(len, scale, decodeSourceRead, cropSinkWrite, &cropSink) == ESP_OK ||
+              cropSink.complete;
+
+    JpegSink sink = { dst, ROI_MAX_BYTES, 0 };
+    ok = ok && fmt2jpg_cb(rgb, (size_t)scaled.w * scaled.h * 3, scaled.w, scaled.h, PIXFORMAT_RGB888,
+                          ROI_JPEG_QUALITY, jpegSinkWrite, &sink);
+    arenaFree(rgb);
+    if (!ok) {
+        arenaFree(dst);
+        return 0;
+    }
+
+    *out = dst;
+    *outLen = sink.len;
+    return divisor;
+}
+
+bool FramePipeline::makeThumbnail(const uint8_t* jpg, size_t len, uint16_t width, uint16_t height,
+                                  uint8_t** out, size_t* outLen, uint16_t* outW, uint16_t* outH) {
+    *out = nullptr;
+    *outLen = 0;
+
+    jpg_scale_t scale = JPG_SCALE_2X;
+    uint8_t divisor = 2;
+    while (width / divisor > THUMB_MAX_WIDTH && scale < JPG_SCALE_8X) {
+        scale = (jpg_scale_t)(scale + 1);
+        divisor *= 2;
+    }
+    uint16_t w = width / divisor;
+    uint16_t h = height / divisor;
+
+    uint8_t* rgb = (uint8_t*)arenaAlloc((size_t)w * h * 3);
+    uint8_t* dst = (uint8_t*)arenaAlloc(THUMB_MAX_BYTES);
+    if (!rgb || !dst) {
+        arenaFree(rgb);
+        arenaFree(dst);
+        return false;
+    }
+
+    RgbSink rgbSink = { { jpg }, rgb, w, h };
+    bool ok = esp_jpg_decode(len, scale, decodeSourceRead, rgbSinkWrite, &rgbSink) == ESP_OK;
+
+    JpegSink sink = { dst, THUMB_MAX_BYTES, 0 };
+    ok = ok && fmt2jpg_cb(rgb, (size_t)w * h * 3, w, h, PIXFORMAT_RGB888, THUMB_JPEG_QUALITY,
+                          jpegSinkWrite, &sink);
+    arenaFree(rgb);
+    if (!ok) {
+        arenaFree(dst);
+        return false;
+    }
+
+    *out = dst;
+    *outLen = sink.len;
+    *outW = w;
+    *outH = h;
+    return true;
+}
+
+bool FramePipeline::process(camera_fb_t* fb, PipelineFrame& out, bool wantGray) {
+    memset(&out, 0, sizeof(out));
+    out.fb = fb;
+    if (!fb) {
+        return false;
+    }
+    if (!encodeJpeg(fb, out)) {
+        _encodeFailures++;
+        release(out);
+        return false;
+    }
+    if (wantGray) {
+        buildGray(fb, out); // Best effort; JPEG output does not depend on it
+    }
+    return true;
+}
+
+void FramePipeline::release(PipelineFrame& frame) {
+    if (frame.jpgBuf) {
+        _jpgPool.release(frame.jpgBuf);
+    }
+    if (frame.gray) {
+        // Newest plane replaces the retained one
+        uint8_t* old = frame.gray;
+        if (_latestLock && xSemaphoreTake(_latestLock, portMAX_DELAY) == pdTRUE) {
+            old = _latestGray;
+            _latestGray = frame.gray;
+            _latestW = frame.grayW;
+            _latestH = frame.grayH;
+            _graySeq++;
+            xSemaphoreGive(_latestLock);
+        }
+        _grayPool.release(old);
+    }
+    if (frame.fb) {
+        esp_camera_fb_return(frame.fb);
+    }
+    memset(&frame, 0, sizeof(frame));
+}
+
+bool FramePipeline::copyLatestGray(uint8_t* dst, size_t cap, uint16_t* w, uint16_t* h, uint32_t* seq) {
+    bool ok = false;
+    if (!_latestLock || xSemaphoreTake(_latestLock, portMAX_DELAY) != pdTRUE) {
+        return false;
+    }
+    size_t len = (size_t)_latestW * _latestH;
+    if (_latestGray && len <= cap) {
+        memcpy(dst, _latestGray, len);
+        *w = _latestW;
+        *h = _latestH;
+        if (seq) {
+            *seq = _graySeq;
+        }
+        ok = true;
+    }
+    xSemaphoreGive(_latestLock);
+    return ok;
+}
@@ -0,0 +1,141 @@
+/**
+ * frame_pipeline.h - Dual-format capture pipeline (JPEG + grayscale plane)
+ *
+ * process() turns a driver framebuffer into:
+ *   - a JPEG: zero-copy for JPEG sensors, otherwise encoded with
+ *     frame2jpg_cb into a pooled PSRAM buffer (no per-frame malloc)
+ *   - a small 8-bit grayscale analytics plane at 1/8 scale: DC-only JPEG
+ *     decode (JPG_SCALE_8X), or point-sampled from raw/YUV frames
+ *
+ * makeThumbnail() and cropJpeg() reuse the scaled decoder to produce small
+ * previews and region-of-interest crops.
+ *
+ * The most recent plane is retained after release() so analytics code can
+ * read pixels without decoding anything itself (see copyLatestGray()).
+ */
+
+#ifndef FRAME_PIPELINE_H
+#define FRAME_PIPELINE_H
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_camera.h"
+#include "config.h"
+
+#define PIPELINE_MAX_POOL 4
+
+/**
+ * Fixed set of equally sized PSRAM buffers handed out without locking the
+ * allocator. acquire() returns nullptr when all buffers are in use.
+ */
+class BufferPool {
+public:
+    BufferPool();
+    bool begin(uint8_t count, size_t size);
+    uint8_t* acquire();
+    void release(uint8_t* buf);
+    size_t bufferSize() const { return _size; }
+    uint32_t exhausted() const { return _exhausted; }
+
+private:
+    uint8_t* _bufs[PIPELINE_MAX_POOL];
+    uint8_t _count;
+    size_t _size;
+    uint8_t _inUse;             // Bitmask over _bufs
+    volatile uint32_t _exhausted;
+    portMUX_TYPE _mux;
+};
+
+// Rectangle in full-frame pixel coordinates
+struct RoiBox {
+    uint16_t x;
+    uint16_t y;
+    uint16_t w;
+    uint16_t h;
+};
+
+struct PipelineFrame {
+    camera_fb_t* fb;            // Source frame, returned to the driver by release()
+    const uint8_t* jpg;
+    size_t jpgLen;
+    uint8_t* gray;              // Analytics plane, nullptr when not produced
+    uint16_t grayW;
+    uint16_t grayH;
+    uint8_t* jpgBuf;            // Pooled buffer backing jpg (nullptr = zero-copy)
+};
+
+class FramePipeline {
+public:
+    FramePipeline();
+
+    /**
+     * Allocate the JPEG and analytics pools (PSRAM). Call once in setup().
+     */
+    bool begin();
+
+    /**
+     * Produce the JPEG (and optionally the analytics plane) for fb.
+     * On success out owns fb; hand it back with release().
+     * @return false if no JPEG could be produced (fb is still released).
+     */
+    bool process(camera_fb_t* fb, PipelineFrame& out, bool wantGray);
+
+    /**
+     * Return pooled buffers and the framebuffer. The analytics plane becomes
+     * the "latest" plane until a newer one is released.
+     */
+    void release(PipelineFrame& frame);
+
+    /**
+     * Copy the latest analytics plane into dst. Holds the plane's mutex (not a
+     * spinlock) for the copy, so release() on the stream task waits at most
+     * one plane copy and interrupts stay enabled.
+     * @return false when no plane is available or dst is too small.
+     */
+    bool copyLatestGray(uint8_t* dst, size_t cap, uint16_t* w, uint16_t* h, uint32_t* seq);
+
+    /**
+     * Thumbnail via scaled decode (1/2..1/8 so width <= THUMB_MAX_WIDTH) and
+     * re-encode. Scratch and output come from the capture arena; release
+     * *out with arenaFree().
+     */
+    bool makeThumbnail(const uint8_t* jpg, size_t len, uint16_t width, uint16_t height,
+                       uint8_t** out, size_t* outLen, uint16_t* outW, uint16_t* outH);
+
+    /**
+     * 1/8-scale grayscale plane of a JPEG into caller memory.
+     */
+    bool grayFromJpeg(const uint8_t* jpg, size_t len, uint8_t* out, size_t cap,
+                      uint16_t* w, uint16_t* h);
+
+    /**
+     * Decode down to the last block row of box (rows below it are skipped; rows
+     * above it are not) and re-encode the box at ROI_JPEG_QUALITY.
+     * Crops larger than ROI_MAX_PIXELS are decoded at 1/2..1/8 scale to fit.
+     * Output comes from the capture arena; release *out with arenaFree().
+     * @return decode scale divisor used (1 = full resolution), 0 on failure.
+     */
+    uint8_t cropJpeg(const uint8_t* jpg, size_t len, const RoiBox& box,
+                     uint8_t** out, size_t* outLen);
+
+    uint32_t graySeq() const { return _graySeq; }
+    uint32_t encodeFailures() const { return _encodeFailures; }
+
+private:
+    BufferPool _jpgPool;
+    BufferPool _grayPool;
+    uint8_t* _latestGray;       // Retained pool buffer
+    uint16_t _latestW;
+    uint16_t _latestH;
+    volatile uint32_t _graySeq;
+    volatile uint32_t _encodeFailures;
+    SemaphoreHandle_t _latestLock;  // _latestGray and its size, held across reader copies
+
+    bool encodeJpeg(camera_fb_t* fb, PipelineFrame& out);
+    bool buildGray(camera_fb_t* fb, PipelineFrame& out);
+};
+
+extern FramePipeline framePipeline;
+
+#endif // FRAME_PIPELINE_H
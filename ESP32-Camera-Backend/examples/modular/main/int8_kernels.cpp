@@ -0,0 +1,313 @@
+/**
+ * int8_kernels.cpp - Reference and fast int8 layers
+ */
+
+#include <string.h>
+#include "int8_kernels.h"
+
+#if DETECTOR_USE_ESP_NN && defined(__has_include)
+#if __has_include(<esp_nn.h>)
+#include <esp_nn.h>
+#define INT8_KERNELS_ESP_NN 1
+#endif
+#endif
+#ifndef INT8_KERNELS_ESP_NN
+#define INT8_KERNELS_ESP_NN 0
+#endif
+
+const char* int8KernelBackend() {
+    return INT8_KERNELS_ESP_NN ? "esp-nn" : "portable";
+}
+
+// ---------------------------------------------------------------------------
+// Reference: the TFLite loops, one output value at a time
+
+void conv2dRef(const int8_t* in, const TensorShape& inShape, const int8_t* filter, const int32_t* bias,
+               const ConvGeometry& g, const QuantParams& q, int8_t* out, const TensorShape& outShape) {
+    for (int oy = 0; oy < outShape.h; oy++) {
+        for (int ox = 0; ox < outShape.w; ox++) {
+            for (int oc = 0; oc < outShape.c; oc++) {
+                int32_t acc = 0;
+                for (int ky = 0; ky < g.kernelH; ky++) {
+                    int iy = oy * g.strideH - g.padTop + ky;
+                    for (int kx = 0; kx < g.kernelW; kx++) {
+                        int ix = ox * g.strideW - g.padLeft + kx;
+                        // Padding contributes nothing (it is the input zero point)
+                        if (iy < 0 || iy >= inShape.h || ix < 0 || ix >= inShape.w) {
+                            continue;
+                        }
+                        for (int ic = 0; ic < inShape.c; ic++) {
+                            int32_t x = in[((size_t)iy * inShape.w + ix) * inShape.c + ic];
+                            int32_t w = filter[(((size_t)oc * g.kernelH + ky) * g.kernelW + kx) * inShape.c + ic];
+                            acc += (x + q.inputOffset) * w;
+                        }
+                    }
+                }
+                if (bias) {
+                    acc += bias[oc];
+                }
+                out[((size_t)oy * outShape.w + ox) * outShape.c + oc] = requantize(acc, q, oc);
+            }
+        }
+    }
+}
+
+void depthwiseConvRef(const int8_t* in, const TensorShape& inShape, const int8_t* filter,
+                      const int32_t* bias, const ConvGeometry& g, const QuantParams& q,
+                      int8_t* out, const TensorShape& outShape) {
+    for (int oy = 0; oy < outShape.h; oy++) {
+        for (int ox = 0; ox < outShape.w; ox++) {
+            for (int c = 0; c < outShape.c; c++) {
+                int32_t acc = 0;
+                for (int ky = 0; ky < g.kernelH; ky++) {
+                    int iy = oy * g.strideH - g.padTop + ky;
+                    for (int kx = 0; kx < g.kernelW; kx++) {
+                        int ix = ox * g.strideW - g.padLeft + kx;
+                        if (iy < 0 || iy >= inShape.h || ix < 0 || ix >= inShape.w) {
+                            continue;
+                        }
+                        int32_t x = in[((size_t)iy * inShape.w + ix) * inShape.c + c];
+                        int32_t w = filter[((size_t)ky * g.kernelW + kx) * inShape.c + c];
+                        acc += (x + q.inputOffset) * w;
+                    }
+                }
+                if (bias) {
+                    acc += bias[c];
+                }
+                out[((size_t)oy * outShape.w + ox) * outShape.c + c] = requantize(acc, q, c);
+            }
+        }
+    }
+}
+
+void fullyConnectedRef(const int8_t* in, size_t inLen, const int8_t* filter, const int32_t* bias,
+                       const QuantParams& q, int8_t* out, size_t outLen) {
+    for (size_t o = 0; o < outLen; o++) {
+        int32_t acc = 0;
+        for (size_t i = 0; i < inLen; i++) {
+            acc += ((int32_t)in[i] + q.inputOffset) * filter[o * inLen + i];
+        }
+        if (bias) {
+            acc += bias[o];
+        }
+        out[o] = requantize(acc, q, o);
+    }
+}
+
+void averagePoolGlobal(const int8_t* in, const TensorShape& inShape, int32_t actMin, int32_t actMax,
+                       int8_t* out) {
+    int32_t count = (int32_t)inShape.h * inShape.w;
+    for (int c = 0; c < inShape.c; c++) {
+        int32_t sum = 0;
+        for (int32_t i = 0; i < count; i++) {
+            sum += in[(size_t)i * inShape.c + c];
+        }
+        // TFLite rounds half away from zero
+        int32_t avg = sum > 0 ? (sum + count / 2) / count : (sum - count / 2) / count;
+        avg = avg < actMin ? actMin : avg;
+        avg = avg > actMax ? actMax : avg;
+        out[c] = (int8_t)avg;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Fast: offset once, then tight loops the compiler can unroll / vectorise
+
+static inline int32_t dot16x8(const int16_t* a, const int8_t* b, size_t n) {
+    int32_t acc = 0;
+    for (size_t i = 0; i < n; i++) {
+        acc += a[i] * b[i];
+    }
+    return acc;
+}
+
+size_t conv2dScratchBytes(const TensorShape& in, const ConvGeometry& g, const TensorShape& out) {
+    // One im2col patch
+    size_t bytes = (size_t)g.kernelH * g.kernelW * in.c * sizeof(int16_t);
+#if INT8_KERNELS_ESP_NN
+    data_dims_t inDims = { in.w, in.h, in.c, 1 };
+    data_dims_t filterDims = { g.kernelW, g.kernelH, 0, 0 };
+    data_dims_t outDims = { out.w, out.h, out.c, 1 };
+    conv_params_t params = {};
+    params.stride = { g.strideW, g.strideH };
+    params.padding = { g.padLeft, g.padTop };
+    int espNn = esp_nn_get_conv_scratch_size(&inDims, &filterDims, &outDims, &params);
+    bytes = espNn > (int)bytes ? espNn : bytes;
+#else
+    (void)out;
+#endif
+    return bytes;
+}
+
+void conv2dFast(const int8_t* in, const TensorShape& inShape, const int8_t* filter, const int32_t* bias,
+                const ConvGeometry& g, const QuantParams& q, int8_t* out, const TensorShape& outShape,
+                void* scratch) {
+#if INT8_KERNELS_ESP_NN
+    data_dims_t inDims = { inShape.w, inShape.h, inShape.c, 1 };
+    data_dims_t filterDims = { g.kernelW, g.kernelH, 0, 0 };
+    data_dims_t outDims = { outShape.w, outShape.h, outShape.c, 1 };
+    conv_params_t params = {};
+    params.in_offset = q.inputOffset;
+    params.out_offset = q.outputOffset;
+    params.stride = { g.strideW, g.strideH };
+    params.padding = { g.padLeft, g.padTop };
+    params.activation = { q.actMin, q.actMax };
+    quant_data_t quant = { (int32_t*)q.shift, (int32_t*)q.multiplier };
+    esp_nn_set_conv_scratch_buf(scratch);
+    esp_nn_conv_s8(&inDims, in, &filterDims, filter, bias, &outDims, out, &params, &quant);
+#else
+    int16_t* patch = (int16_t*)scratch;
+    size_t rowLen = (size_t)inShape.c;
+    size_t patchLen = (size_t)g.kernelH * g.kernelW * rowLen;
+    bool pointwise = g.kernelH == 1 && g.kernelW == 1 && g.padTop == 0 && g.padLeft == 0;
+
+    for (int oy = 0; oy < outShape.h; oy++) {
+        for (int ox = 0; ox < outShape.w; ox++) {
+            // im2col: padded taps stay 0, i.e. contribute nothing, as in conv2dRef
+            if (pointwise) {
+                const int8_t* src = in + ((size_t)oy * g.strideH * inShape.w + (size_t)ox * g.strideW) * rowLen;
+                for (size_t i = 0; i < rowLen; i++) {
+                    patch[i] = (int16_t)(src[i] + q.inputOffset);
+                }
+            } else {
+                int16_t* dst = patch;
+                for (int ky = 0; ky < g.kernelH; ky++) {
+                    int iy = oy * g.strideH - g.padTop + ky;
+                    for (int kx = 0; kx < g.kernelW; kx++, dst += rowLen) {
+                        int ix = ox * g.strideW - g.padLeft + kx;
+                        if (iy < 0 || iy >= inShape.h || ix < 0 || ix >= inShape.w) {
+                            memset(dst, 0, rowLen * sizeof(int16_t));
+                            continue;
+                        }
+                        const int8_t* src = in + ((size_t)iy * inShape.w + ix) * rowLen;
+                        for (size_t i = 0; i < rowLen; i++) {
+                            dst[i] = (int16_t)(src[i] + q.inputOffset);
+                        }
+                    }
+                }
+            }
+
+            int8_t* dst = out + ((size_t)oy * outShape.w + ox) * outShape.c;
+            int oc = 0;
+            // Four filters per pass over the patch: each patch load feeds four MACs
+            for (; oc + 4 <= outShape.c; oc += 4) {
+                const int8_t* w0 = filter + (size_t)oc * patchLen;
+                const int8_t* w1 = w0 + patchLen;
+                const int8_t* w2 = w1 + patchLen;
+                const int8_t* w3 = w2 + patchLen;
+                int32_t acc0 = 0, acc1 = 0, acc2 = 0, acc3 = 0;
+                for (size_t i = 0; i < patchLen; i++) {
+                    int32_t x = patch[i];
+                    acc0 += x * w0[i];
+                    acc1 += x * w1[i];
+                    acc2 += x * w2[i];
+                    acc3 += x * w3[i];
+                }
+                if (bias) {
+                    acc0 += bias[oc];
+                    acc1 += bias[oc + 1];
+                    acc2 += bias[oc + 2];
+                    acc3 += bias[oc + 3];
+                }
+                dst[oc] = requantize(acc0, q, oc);
+                dst[oc + 1] = requantize(acc1, q, oc + 1);
+                dst[oc + 2] = requantize(acc2, q, oc + 2);
+                dst[oc + 3] = requantize(acc3, q, oc + 3);
+            }
+            for (; oc < outShape.c; oc++) {
+                int32_t acc = dot16x8(patch, filter + (size_t)oc * patchLen, patchLen) + (bias ? bias[oc] : 0);
+                dst[oc] = requantize(acc, q, oc);
+            }
+        }
+    }
+#endif
+}
+
+size_t depthwiseConvScratchBytes(const TensorShape& in, const ConvGeometry& g, const TensorShape& out) {
+    // Accumulators for one output pixel
+    size_t bytes = (size_t)in.c * sizeof(int32_t);
+#if INT8_KERNELS_ESP_NN
+    data_dims_t inDims = { in.w, in.h, in.c, 1 };
+    data_dims_t filterDims = { g.kernelW, g.kernelH, 0, 0 };
+    data_dims_t outDims = { out.w, out.h, out.c, 1 };
+    dw_conv_params_t params = {};
+    params.ch_mult = 1;
+    params.stride = { g.strideW, g.strideH };
+    params.padding = { g.padLeft, g.padTop };
+    int espNn = esp_nn_get_depthwise_conv_scratch_size(&inDims, &filterDims, &outDims, &params);
+    bytes = espNn > (int)bytes ? espNn : bytes;
+#else
+    (void)g;
+    (void)out;
+#endif
+    return bytes;
+}
+
+void depthwiseConvFast(const int8_t* in, const TensorShape& inShape, const int8_t* filter,
+                       const int32_t* bias, const ConvGeometry& g, const QuantParams& q,
+                       int8_t* out, const TensorShape& outShape, void* scratch) {
+#if INT8_KERNELS_ESP_NN
+    data_dims_t inDims = { inShape.w, inShape.h, inShape.c, 1 };
+    data_dims_t filterDims = { g.kernelW, g.kernelH, 0, 0 };
+    data_dims_t outDims = { outShape.w, outShape.h, outShape.c, 1 };
+    dw_conv_params_t params = {};
+    params.in_offset = q.inputOffset;
+    params.out_offset = q.outputOffset;
+    params.ch_mult = 1;
+    params.stride = { g.strideW, g.strideH };
+    params.padding = { g.padLeft, g.padTop };
+    params.activation = { q.actMin, q.actMax };
+    quant_data_t quant = { (int32_t*)q.shift, (int32_t*)q.multiplier };
+    esp_nn_set_depthwise_conv_scratch_buf(scratch);
+    esp_nn_depthwise_conv_s8(&inDims, in, &filterDims, filter, bias, &outDims, out, &params, &quant);
+#else
+    int32_t* acc = (int32_t*)scratch;
+    int channels = inShape.c;
+
+    for (int oy = 0; oy < outShape.h; oy++) {
+        for (int ox = 0; ox < outShape.w; ox++) {
+            for (int c = 0; c < channels; c++) {
+                acc[c] = bias ? bias[c] : 0;
+            }
+            // Whole pixels at a time: input and filter rows are both channel-contiguous
+            for (int ky = 0; ky < g.kernelH; ky++) {
+                int iy = oy * g.strideH - g.padTop + ky;
+                if (iy < 0 || iy >= inShape.h) {
+                    continue;
+                }
+                for (int kx = 0; kx < g.kernelW; kx++) {
+                    int ix = ox * g.strideW - g.padLeft + kx;
+                    if (ix < 0 || ix >= inShape.w) {
+                        continue;
+                    }
+                    const int8_t* src = in + ((size_t)iy * inShape.w + ix) * channels;
+                    const int8_t* w = filter + ((size_t)ky * g.kernelW + kx) * channels;
+                    for (int c = 0; c < channels; c++) {
+                        acc[c] += (src[c] + q.inputOffset) * w[c];
+                    }
+                }
+            }
+            int8_t* dst = out + ((size_t)oy * outShape.w + ox) * channels;
+            for (int c = 0; c < channels; c++) {
+                dst[c] = requantize(acc[c], q, c);
+            }
+        }
+    }
+#endif
+}
+
+size_t fullyConnectedScratchBytes(size_t inLen) {
+    return inLen * sizeof(int16_t);
+}
+
+void fullyConnectedFast(const int8_t* in, size_t inLen, const int8_t* filter, const int32_t* bias,
+                        const QuantParams& q, int8_t* out, size_t outLen, void* scratch) {
+    int16_t* x = (int16_t*)scratch;
+    for (size_t i = 0; i < inLen; i++) {
+        x[i] = (int16_t)(in[i] + q.inputOffset);
+    }
+    for (size_t o = 0; o < outLen; o++) {
+        int32_t acc = dot16x8(x, filter + o * inLen, inLen) + (bias ? bias[o] : 0);
+        out[o] = requantize(acc, q, o);
+    }
+}
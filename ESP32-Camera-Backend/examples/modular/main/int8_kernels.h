@@ -0,0 +1,131 @@
+/**
+ * int8_kernels.h - Quantised int8 layers for the on-device detector
+ *
+ * TensorFlow Lite int8 semantics: NHWC activations, symmetric int8 weights
+ * (OHWI for conv, HWC for depthwise), int32 bias, per-output-channel
+ * requantisation (Q31 multiplier + power-of-two shift) and a fused
+ * activation clamp. A model trained and converted with TFLite therefore runs
+ * bit-for-bit the same here.
+ *
+ * Every layer has two versions:
+ *   - *Ref:  the TFLite reference loops, kept simple on purpose; the
+ *            specification the fast versions are tested against
+ *   - *Fast: input offset applied once per patch into int16 scratch, then
+ *            straight dot products (conv/FC) or channel-contiguous
+ *            accumulation (depthwise). On an ESP32-S3 whose core ships
+ *            esp-nn (DETECTOR_USE_ESP_NN), conv and depthwise go to its
+ *            SIMD kernels instead.
+ * Integer results must be identical; detector_bench/ checks that on random
+ * layers and times both. Plain C++ on top of config.h, like xfer_sender.h.
+ */
+
+#ifndef INT8_KERNELS_H
+#define INT8_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "config.h"
+
+struct TensorShape {
+    uint16_t h;
+    uint16_t w;
+    uint16_t c;
+
+    size_t size() const { return (size_t)h * w * c; }
+};
+
+// Kernel window; padding is top/left, bottom/right follow from the output size
+struct ConvGeometry {
+    uint8_t kernelH;
+    uint8_t kernelW;
+    uint8_t strideH;
+    uint8_t strideW;
+    uint8_t padTop;
+    uint8_t padLeft;
+};
+
+// Requantisation of one layer's output
+struct QuantParams {
+    const int32_t* multiplier;  // Q31, one per output channel
+    const int32_t* shift;       // > 0 left, < 0 right, one per output channel
+    int32_t inputOffset;        // -(input zero point)
+    int32_t outputOffset;       // Output zero point
+    int32_t actMin;             // Fused activation, in output int8 units
+    int32_t actMax;
+};
+
+// gemmlowp fixed point, exactly as TFLite does it
+inline int32_t saturatingRoundingDoublingHighMul(int32_t a, int32_t b) {
+    if (a == b && a == INT32_MIN) {
+        return INT32_MAX;
+    }
+    int64_t ab = (int64_t)a * b;
+    int32_t nudge = ab >= 0 ? (1 << 30) : (1 - (1 << 30));
+    return (int32_t)((ab + nudge) / (1LL << 31));
+}
+
+inline int32_t roundingDivideByPOT(int32_t x, int exponent) {
+    int32_t mask = (int32_t)((1LL << exponent) - 1);
+    int32_t remainder = x & mask;
+    int32_t threshold = (mask >> 1) + (x < 0 ? 1 : 0);
+    return (x >> exponent) + (remainder > threshold ? 1 : 0);
+}
+
+inline int32_t multiplyByQuantizedMultiplier(int32_t x, int32_t multiplier, int shift) {
+    int left = shift > 0 ? shift : 0;
+    int right = shift > 0 ? 0 : -shift;
+    return roundingDivideByPOT(saturatingRoundingDoublingHighMul(x * (1 << left), multiplier), right);
+}
+
+// Accumulator -> int8 output for channel c
+inline int8_t requantize(int32_t acc, const QuantParams& q, int c) {
+    acc = multiplyByQuantizedMultiplier(acc, q.multiplier[c], q.shift[c]) + q.outputOffset;
+    acc = acc < q.actMin ? q.actMin : acc;
+    acc = acc > q.actMax ? q.actMax : acc;
+    return (int8_t)acc;
+}
+
+// "esp-nn" or "portable": what the *Fast kernels run on this build
+const char* int8KernelBackend();
+
+// Scratch the *Fast kernels need for one layer (0 = none)
+size_t conv2dScratchBytes(const TensorShape& in, const ConvGeometry& g, const TensorShape& out);
+size_t depthwiseConvScratchBytes(const TensorShape& in, const ConvGeometry& g, const TensorShape& out);
+size_t fullyConnectedScratchBytes(size_t inLen);
+
+/**
+ * Convolution. filter: out.c x kernelH x kernelW x in.c; bias may be nullptr.
+ */
+void conv2dRef(const int8_t* in, const TensorShape& inShape, const int8_t* filter, const int32_t* bias,
+               const ConvGeometry& g, const QuantParams& q, int8_t* out, const TensorShape& outShape);
+void conv2dFast(const int8_t* in, const TensorShape& inShape, const int8_t* filter, const int32_t* bias,
+                const ConvGeometry& g, const QuantParams& q, int8_t* out, const TensorShape& outShape,
+                void* scratch);
+
+/**
+ * Depthwise convolution, depth multiplier 1 (out.c == in.c).
+ * filter: kernelH x kernelW x in.c.
+ */
+void depthwiseConvRef(const int8_t* in, const TensorShape& inShape, const int8_t* filter,
+                      const int32_t* bias, const ConvGeometry& g, const QuantParams& q,
+                      int8_t* out, const TensorShape& outShape);
+void depthwiseConvFast(const int8_t* in, const TensorShape& inShape, const int8_t* filter,
+                       const int32_t* bias, const ConvGeometry& g, const QuantParams& q,
+                       int8_t* out, const TensorShape& outShape, void* scratch);
+
+/**
+ * Fully connected. filter: outLen x inLen.
+ */
+void fullyConnectedRef(const int8_t* in, size_t inLen, const int8_t* filter, const int32_t* bias,
+                       const QuantParams& q, int8_t* out, size_t outLen);
+void fullyConnectedFast(const int8_t* in, size_t inLen, const int8_t* filter, const int32_t* bias,
+                        const QuantParams& q, int8_t* out, size_t outLen, void* scratch);
+
+/**
+ * Mean over H x W per channel (output quantised like the input), one
+ * version: it is a few hundred additions.
+ */
+void averagePoolGlobal(const int8_t* in, const TensorShape& inShape, int32_t actMin, int32_t actMax,
+                       int8_t* out);
+
+#endif // INT8_KERNELS_H
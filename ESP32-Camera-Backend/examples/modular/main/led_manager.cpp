@@ -4,13 +4,27 @@
 
 #include <Arduino.h>
 #include "led_manager.h"
+#include "task_plan.h"
 
-LEDManager::LEDManager() : _pixels(WS2812_COUNT, WS2812_PIN, NEO_GRB + NEO_KHZ800) {
+LEDManager::LEDManager()
+    : _pixels(WS2812_COUNT, WS2812_PIN, NEO_GRB + NEO_KHZ800), _awakeIndicatorOn(false),
+      _queue(nullptr), _lock(nullptr), _task(nullptr), _color(0), _flashOn(false), _dropped(0) {
 }
 
 void LEDManager::init() {
+    if (_task) {
+        return;
+    }
     _pixels.begin();
-    clear();
+    _lock = xSemaphoreCreateMutex();
+    _queue = xQueueCreate(LED_QUEUE_DEPTH, sizeof(LedPattern));
+    if (!_lock || !_queue ||
+        xTaskCreatePinnedToCore(taskEntry, "led_anim", TASK_LED_STACK, this,
+                                TASK_LED_PRIO, &_task, TASK_LED_CORE) != pdPASS) {
+        _task = nullptr;
+        Serial.println("[LED] Animation task failed - status patterns disabled");
+    }
+    show(0);
 }
 
 uint8_t LEDManager::dim(uint8_t value) {
@@ -18,108 +32,149 @@ uint8_t LEDManager::dim(uint8_t value) {
     return (uint8_t)(value * 0.3);
 }
 
+uint32_t LEDManager::dimmed(uint8_t r, uint8_t g, uint8_t b) {
+    return _pixels.Color(dim(r), dim(g), dim(b));
+}
+
+// Never blocks: a full queue drops the pattern
+void LEDManager::post(uint32_t color, uint16_t onMs, uint16_t offMs, int repeats, LedPatternKind kind) {
+    if (!_queue || repeats <= 0) {
+        return;
+    }
+    LedPattern p = { color, onMs, offMs, (uint8_t)(repeats > 255 ? 255 : repeats), kind };
+    if (xQueueSend(_queue, &p, 0) != pdTRUE) {
+        _dropped++;
+    }
+}
+
+void LEDManager::show(uint32_t color) {
+    if (_lock) {
+        xSemaphoreTake(_lock, portMAX_DELAY);
+    }
+    _color = color;
+    if (!_flashOn) {
+        _pixels.setPixelColor(0, color);
+        _pixels.show();
+    }
+    if (_lock) {
+        xSemaphoreGive(_lock);
+    }
+}
+
+static void waitMs(uint32_t ms) {
+    TickType_t ticks = pdMS_TO_TICKS(ms);
+    vTaskDelay(ticks ? ticks : 1);
+}
+
+void LEDManager::play(const LedPattern& p) {
+    switch (p.kind) {
+        case LED_HOLD:
+            show(p.color);
+            if (p.onMs) {
+                waitMs(p.onMs);
+            }
+            break;
+
+        case LED_PULSE: {
+            uint8_t r = (p.color >> 16) & 0xFF, g = (p.color >> 8) & 0xFF, b = p.color & 0xFF;
+            for (int c = 0; c < p.repeats; c++) {
+                // Fade in, then out, in 5% steps
+                for (int i = -100; i <= 100; i += 5) {
+                    int level = 100 - abs(i);
+                    show(_pixels.Color(r * level / 100, g * level / 100, b * level / 100));
+                    waitMs(p.onMs);
+                }
+            }
+            show(0);
+            break;
+        }
+
+        default:
+            for (int i = 0; i < p.repeats; i++) {
+                show(p.color);
+                waitMs(p.onMs);
+                show(0);
+                if (i < p.repeats - 1) {
+                    waitMs(p.offMs);
+                }
+            }
+            break;
+    }
+}
+
+void LEDManager::taskEntry(void* arg) {
+    LEDManager* self = static_cast<LEDManager*>(arg);
+    LedPattern p;
+    for (;;) {
+        if (xQueueReceive(self->_queue, &p, portMAX_DELAY) == pdTRUE) {
+            self->play(p);
+        }
+    }
+}
+
 void LEDManager::flash(uint32_t ms, uint8_t r, uint8_t g, uint8_t b) {
-    _pixels.setPixelColor(0, _pixels.Color(dim(r), dim(g), dim(b)));
-    _pixels.show();
-    delay(ms);
-    clear();
+    post(dimmed(r, g, b), (uint16_t)(ms > 0xFFFF ? 0xFFFF : ms), 0, 1);
 }
 
 void LEDManager::blinkError(int times) {
-    for (int i = 0; i < times; i++) {
-        flashRed(200);
-        delay(200);
-    }
+    post(dimmed(255, 0, 0), 200, 200, times);
 }
 
 void LEDManager::clear() {
-    _pixels.clear();
-    _pixels.show();
+    if (_queue) {
+        xQueueReset(_queue);
+    }
+    show(0);
 }
 
 void LEDManager::flashGreen(int times) {
-    for (int i = 0; i < times; i++) {
-        flash(200, 0, 255, 0);
-        if (i < times - 1) delay(200);
-    }
+    post(dimmed(0, 255, 0), 200, 200, times);
 }
 
 void LEDManager::flashRed(int times) {
-    for (int i = 0; i < times; i++) {
-        flash(200, 255, 0, 0);
-        if (i < times - 1) delay(200);
-    }
+    post(dimmed(255, 0, 0), 200, 200, times);
 }
 
 void LEDManager::flashBlue(int times) {
-    for (int i = 0; i < times; i++) {
-        flash(300, 0, 0, 255);
-        if (i < times - 1) delay(200);
-    }
+    post(dimmed(0, 0, 255), 300, 200, times);
 }
 
 void LEDManager::flashWhite(int times) {
-    for (int i = 0; i < times; i++) {
-        flash(150, 255, 255, 255);
-        if (i < times - 1) delay(150);
-    }
+    post(dimmed(255, 255, 255), 150, 150, times);
 }
 
 void LEDManager::flashYellow(int times) {
-    for (int i = 0; i < times; i++) {
-        flash(200, 255, 255, 0);
-        if (i < times - 1) delay(200);
-    }
+    post(dimmed(255, 255, 0), 200, 200, times);
 }
 
+// Immediate, not queued: on exactly while the caller takes frames
 void LEDManager::setFlash(bool on) {
-    if (on) {
-        // Turn on full brightness white for camera flash
-        _pixels.setPixelColor(0, _pixels.Color(255, 255, 255)); // Không dùng dim()
-        _pixels.show();
-    } else {
-        clear();
+    if (_lock) {
+        xSemaphoreTake(_lock, portMAX_DELAY);
+    }
+    _flashOn = on;
+    // Full brightness white for camera flash - Không dùng dim()
+    _pixels.setPixelColor(0, on ? _pixels.Color(255, 255, 255) : _color);
+    _pixels.show();
+    if (_lock) {
+        xSemaphoreGive(_lock);
     }
 }
 
 void LEDManager::setStatusColor(uint8_t r, uint8_t g, uint8_t b) {
-    _pixels.setPixelColor(0, _pixels.Color(dim(r), dim(g), dim(b)));
-    _pixels.show();
+    post(dimmed(r, g, b), 0, 0, 1, LED_HOLD);
 }
 
 void LEDManager::showStatusColor(uint8_t r, uint8_t g, uint8_t b, uint16_t durationMs, bool hold) {
-    setStatusColor(r, g, b);
-    delay(durationMs);
-    if (!hold) {
-        clear();
-    }
+    post(dimmed(r, g, b), durationMs, 0, 1, hold ? LED_HOLD : LED_BLINK);
 }
 
 void LEDManager::gentlePulse(uint8_t r, uint8_t g, uint8_t b, uint8_t cycles, uint16_t stepDelayMs) {
-    for (int c = 0; c < cycles; c++) {
-        // Fade in
-        for (int i = 0; i <= 100; i += 5) {
-            float factor = i / 100.0;
-            _pixels.setPixelColor(0, _pixels.Color(dim(r * factor), dim(g * factor), dim(b * factor)));
-            _pixels.show();
-            delay(stepDelayMs / 20);
-        }
-        // Fade out
-        for (int i = 100; i >= 0; i -= 5) {
-            float factor = i / 100.0;
-            _pixels.setPixelColor(0, _pixels.Color(dim(r * factor), dim(g * factor), dim(b * factor)));
-            _pixels.show();
-            delay(stepDelayMs / 20);
-        }
-    }
-    clear();
+    post(dimmed(r, g, b), stepDelayMs / 20, 0, cycles, LED_PULSE);
 }
 
 void LEDManager::indicateSdTransfer(uint8_t cycles) {
-    for (int i = 0; i < cycles; i++) {
-        flash(100, 255, 0, 255); // Magenta
-        if (i < cycles - 1) delay(100);
-    }
+    post(dimmed(255, 0, 255), 100, 100, cycles); // Magenta
 }
 
 void LEDManager::setAwakeIndicator(bool on) {
@@ -131,15 +186,11 @@ void LEDManager::updateAuxLed(bool on) {
     // Placeholder for auxiliary LED control if needed
 }
 
+// Queued like any status pattern; for a flash synced to a frame use setFlash()
 void LEDManager::captureFlash(uint16_t durationMs) {
-    setFlash(true);
-    delay(durationMs);
-    setFlash(false);
+    post(_pixels.Color(255, 255, 255), durationMs, 0, 1);
 }
 
 void LEDManager::flashAmber(int times) {
-    for (int i = 0; i < times; i++) {
-        flash(200, 255, 191, 0);
-        if (i < times - 1) delay(200);
-    }
+    post(dimmed(255, 191, 0), 200, 200, times);
 }
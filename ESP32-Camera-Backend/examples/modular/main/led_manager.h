@@ -1,21 +1,47 @@
 /**
  * led_manager.h - LED flash and status indicators
+ *
+ * Status patterns (blinks, pulses, held colours) are queued to the led_anim
+ * task and played there one after another, so every helper returns at once
+ * and status indications never add latency to capture or upload. Patterns
+ * that do not fit in the queue (LED_QUEUE_DEPTH) are dropped.
+ *
+ * The camera flash is not queued: setFlash() drives the pixel directly, so it
+ * is on exactly while frames are taken. The animation keeps its timing
+ * underneath and its colour comes back when the flash goes off.
  */
 
 #ifndef LED_MANAGER_H
 #define LED_MANAGER_H
 
 #include <Adafruit_NeoPixel.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "config.h"
 
+enum LedPatternKind : uint8_t {
+    LED_BLINK,      // repeats x (onMs lit, then off; offMs between repeats)
+    LED_PULSE,      // repeats x fade in/out, onMs per brightness step
+    LED_HOLD        // Lit for onMs, then stays lit until the next pattern
+};
+
+struct LedPattern {
+    uint32_t color;     // Final pixel colour (dim() already applied)
+    uint16_t onMs;
+    uint16_t offMs;
+    uint8_t repeats;
+    LedPatternKind kind;
+};
+
 class LEDManager {
 public:
     LEDManager();
-    void init();
+    void init();        // Pixel + led_anim task; call early in setup()
     void setAwakeIndicator(bool on);
     void flash(uint32_t ms, uint8_t r, uint8_t g, uint8_t b);
     void blinkError(int times);
-    void clear();
+    void clear();       // Drop queued patterns and turn the pixel off
     void setFlash(bool on);
     void captureFlash(uint16_t durationMs = FLASH_DURATION_MS);
 
@@ -32,11 +58,26 @@ public:
     void flashYellow(int times = 1);
     void flashAmber(int times = 1);
 
+    uint32_t dropped() const { return _dropped; }
+
 private:
     Adafruit_NeoPixel _pixels;
     uint8_t dim(uint8_t value); // Giảm độ sáng
     bool _awakeIndicatorOn;
     void updateAuxLed(bool on);
+
+    QueueHandle_t _queue;
+    SemaphoreHandle_t _lock;    // Pixel writes: led_anim vs setFlash()
+    TaskHandle_t _task;
+    uint32_t _color;            // What the animation shows (under the flash, too)
+    bool _flashOn;
+    volatile uint32_t _dropped; // Patterns that found the queue full
+
+    uint32_t dimmed(uint8_t r, uint8_t g, uint8_t b);
+    void post(uint32_t color, uint16_t onMs, uint16_t offMs, int repeats, LedPatternKind kind = LED_BLINK);
+    void show(uint32_t color);
+    void play(const LedPattern& p);
+    static void taskEntry(void* arg);
 };
 
 #endif // LED_MANAGER_H
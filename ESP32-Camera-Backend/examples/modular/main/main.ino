@@ -24,6 +24,17 @@
 #include "mqtt_manager.h" // Include MQTT Manager
 #include "stream_manager.h" // Include Stream Manager
 #include "storage_manager.h" // Re-include Storage Manager
+#include "command_manager.h" // Binary remote-tuning commands
+#include "telemetry_manager.h" // CBOR heartbeat (telemetryMgr)
+#include "capture_arena.h" // Per-capture PSRAM scratch (captureArena)
+#include "frame_cache.h" // Latest stream frame for /capture (frameCache)
+#include "frame_pipeline.h" // Pooled JPEG encode + analytics plane (framePipeline)
+#include "motion_roi.h" // Changed-region crops (motionRoi)
+#include "task_monitor.h" // Per-task CPU/stack report (task_plan.h)
+#include "network_task.h" // Owns MQTT + uploads (netTask)
+#include "rate_limiter.h" // Backend upload rate hints (rateLimiter)
+#include "capture_sequence.h" // Boot counter + per-boot capture ids (captureSeq)
+#include "detector_manager.h" // int8 person/vehicle detector (detectorMgr)
 
 // Manager instances
 WiFiManager wifiMgr;
@@ -34,67 +45,70 @@ UploadManager uploadMgr;
 MQTTManager mqttMgr(MQTT_BROKER, MQTT_PORT, MQTT_CLIENT_ID, MQTT_USERNAME, MQTT_PASSWORD); // Initialize MQTT Manager
 StreamManager streamMgr;
 StorageManager storageMgr; // Re-instantiate Storage Manager
+CommandManager commandMgr;
 
 // Global Server IP (Default fallback)
 char serverIP[16] = "192.168.58.24";
 bool serverIpUpdated = false; // Flag to track if IP was received via MQTT
 
-// Command flags
+// Capture request (PIR or APP_EVENT_CAPTURE); loop() only
 bool shouldCapture = false;
-// volatile bool isStreaming = false; // REMOVED: Defined in stream_manager.cpp
-// volatile bool pauseStreamForCapture = false; // REMOVED: Defined in config.cpp
-// volatile bool captureRequested = false; // REMOVED: Defined in config.cpp
+unsigned long motionDetectedAt = 0; // For motion -> capture latency logging
+// isStreaming is defined in stream_manager.cpp
 
 // Forward declaration
 void processCapture(camera_fb_t* fb);
+bool sendThumbnail(camera_fb_t* fb, const char* detection);
+bool sendRoiCrop(camera_fb_t* fb, const RoiBox& roi, const char* detection, bool& delivered);
+
+// Find needle in a non NUL-terminated payload
+static const uint8_t* findBytes(const uint8_t* hay, size_t hayLen, const char* needle) {
+    size_t needleLen = strlen(needle);
+    for (size_t i = 0; i + needleLen <= hayLen; i++) {
+        if (memcmp(hay + i, needle, needleLen) == 0) {
+            return hay + i;
+        }
+    }
+    return nullptr;
+}
 
 void mqttCallback(char* topic, byte* payload, unsigned int length) {
-    String msg = "";
-    for (int i = 0; i < length; i++) {
-        msg += (char)payload[i];
+    // Chunk acks arrive while publishImageChunked runs: keep them quiet and first
+    if (mqttMgr.isXferTopic(topic)) {
+        mqttMgr.handleXferAck(payload, length);
+        return;
     }
-    Serial.printf("📩 MQTT Message [%s]: %s\n", topic, msg.c_str());
+
+    Serial.printf("📩 MQTT Message [%s]: %u bytes\n", topic, length);
 
     // Handle Server IP Discovery
-    if (String(topic) == "camera/server-ip") {
+    if (strcmp(topic, MQTT_TOPIC_DISCOVERY) == 0) {
         // Parse JSON: {"ip":"192.168.x.x", ...}
-        int ipStart = msg.indexOf("\"ip\":\"");
-        if (ipStart != -1) {
-            int ipEnd = msg.indexOf("\"", ipStart + 6);
-            String newIP = msg.substring(ipStart + 6, ipEnd);
-            Serial.printf("📡 Received Server IP from MQTT: %s\n", newIP.c_str());
-            strcpy(serverIP, newIP.c_str());
-            serverIpUpdated = true; // Mark as updated
+        const char* key = "\"ip\":\"";
+        const uint8_t* ipStart = findBytes(payload, length, key);
+        if (ipStart) {
+            ipStart += strlen(key);
+            const uint8_t* end = payload + length;
+            const uint8_t* ipEnd = (const uint8_t*)memchr(ipStart, '"', end - ipStart);
+            size_t ipLen = ipEnd ? (size_t)(ipEnd - ipStart) : 0;
+            if (ipLen > 0 && ipLen < sizeof(serverIP)) {
+                memcpy(serverIP, ipStart, ipLen);
+                serverIP[ipLen] = '\0';
+                Serial.printf("📡 Received Server IP from MQTT: %s\n", serverIP);
+                serverIpUpdated = true; // Mark as updated
+            }
         }
         return;
     }
 
-    if (String(topic) == MQTT_TOPIC_COMMAND) {
-        if (msg == "capture") {
-            Serial.println("📸 Command: CAPTURE");
-            shouldCapture = true;
-        } else if (msg == "stream_on") {
-            Serial.println("🎥 Command: STREAM ON");
-            isStreaming = true;
-            if (!cameraMgr.isInitialized()) {
-                cameraMgr.init();
-            }
-        } else if (msg == "stream_off") {
-            Serial.println("🎥 Command: STREAM OFF");
-            isStreaming = false;
-            // Only deinit if not capturing
-            if (!shouldCapture) {
-                cameraMgr.deinit();
-            }
-        } else if (msg == "reboot") {
-            ESP.restart();
-        } else if (msg == "sync_sd") {
-            Serial.println("🔄 Command: SYNC SD CARD");
-            // Trigger sync logic
-            if (storageMgr.isReady()) {
-                size_t flushed = storageMgr.flushPendingQueue(authMgr.getToken(), uploadMgr);
-                Serial.printf("Synced %d files\n", flushed);
-            }
+    if (mqttMgr.isRateTopic(topic)) {
+        rateLimiter.applyHint(payload, length);
+        return;
+    }
+
+    if (mqttMgr.isCommandTopic(topic)) {
+        if (!commandMgr.handle(payload, length)) {
+            Serial.println("⚠️ Unknown command payload");
         }
     }
 }
@@ -107,6 +121,17 @@ void setup() {
     Serial.println("ESP32 Always-On Camera Starting");
     Serial.println("=================================");
 
+    // Status patterns play on the led_anim task from here on
+    ledMgr.init();
+
+    // 0. Reserve per-capture scratch arena before the heap gets fragmented
+    captureArena.begin();
+    netArena.begin(NET_ARENA_SIZE);
+    frameCache.begin();
+    framePipeline.begin();
+    motionRoi.begin();
+    captureSeq.begin();
+
     // 1. Init Camera - DEFERRED (Save Power)
     // Serial.println("[1/4] Initializing camera...");
     // if (!cameraMgr.init()) { ... }
@@ -124,6 +149,7 @@ void setup() {
         // Retry logic could be added here
     } else {
         ledMgr.flashBlue(2); // WiFi thành công
+        captureSeq.startClock();
     }
 
     // 3. MQTT Setup & Discovery (PRIORITY)
@@ -131,7 +157,7 @@ void setup() {
     Serial.println("[3/4] Connecting to MQTT & Discovering Server...");
     if (USE_MQTT) {
         mqttMgr.setCallback(mqttCallback);
-        if (mqttMgr.connect()) {
+        if (mqttMgr.waitConnected(MQTT_SETUP_WAIT_MS)) {
              Serial.println("✅ MQTT Connected. Waiting for Server IP...");
              // Wait for IP from 'camera/server-ip' (handled in callback)
              unsigned long startWait = millis();
@@ -140,7 +166,7 @@ void setup() {
                  delay(100);
              }
         } else {
-             Serial.println("[WARN] MQTT connect failed");
+             Serial.println("[WARN] MQTT not connected yet - retrying in background");
         }
     }
 
@@ -174,11 +200,13 @@ void setup() {
 
     // 5. Start Stream Server
     Serial.println("[5/5] Starting Stream Server...");
-    streamMgr.setCaptureCallback(processCapture); // Register callback
     streamMgr.startWebServer();
     Serial.print("Stream Ready at http://");
     Serial.print(WiFi.localIP());
     Serial.printf(":%d/stream\n", STREAM_PORT);
+    Serial.print("Snapshot/Status at http://");
+    Serial.print(WiFi.localIP());
+    Serial.printf(":%d/capture, /status\n", CONTROL_PORT);
     
     // 5. Init SD Card
     Serial.println("[5/5] Mounting SD Card...");
@@ -187,6 +215,8 @@ void setup() {
     } else {
         Serial.println("⚠️ SD Card Failed");
     }
+    // Model lives on the card
+    detectorMgr.begin();
 
     pinMode(PIR_PIN, INPUT_PULLDOWN);
     
@@ -197,71 +227,232 @@ void setup() {
         Serial.println("   Connect the pin to GND to stop auto-capture.");
         
         // Indicate warning with Orange LED (R=255, G=165, B=0)
-        ledMgr.setStatusColor(255, 165, 0);
-        delay(3000); // Hold orange for 3 seconds
+        ledMgr.showStatusColor(255, 165, 0, 3000, false); // Cam 3 giây, không chặn setup
     } else {
         ledMgr.flashGreen(3);
     }
 
+    // 6. Hand MQTT and uploads to their owner task
+    netTask.begin();
+
     Serial.println("✅ System Ready. Loop started.");
 }
 
+// Encode and send a thumbnail for the capture just saved to SD
+bool sendThumbnail(camera_fb_t* fb, const char* detection) {
+    unsigned long start = millis();
+    char captureId[32];
+    StorageManager::captureIdFromPath(storageMgr.getLastPath(), captureId, sizeof(captureId));
+
+    uint8_t* thumb = nullptr;
+    size_t thumbLen = 0;
+    uint16_t w = 0, h = 0;
+    if (!framePipeline.makeThumbnail(fb->buf, fb->len, fb->width, fb->height, &thumb, &thumbLen, &w, &h)) {
+        Serial.println("[THUMB] Encode failed - full image stays queued on SD");
+        return false;
+    }
+    unsigned long encodeMs = millis() - start;
+
+    NetJob job = { thumb, thumbLen, nullptr, captureId, "thumb", nullptr };
+    job.capturedAt = storageMgr.lastRecord().capturedAt;
+    job.detection = detection;
+    bool ok = netTask.deliver(job);
+    arenaFree(thumb);
+
+    Serial.printf("[THUMB] %s %ux%u: %u B vs full %u B (%u%%), encode %lu ms, preview %s in %lu ms\n",
+                  captureId, w, h, (unsigned)thumbLen, (unsigned)fb->len,
+                  (unsigned)(thumbLen * 100 / fb->len), encodeMs,
+                  ok ? "sent" : "failed", millis() - start);
+    return ok;
+}
+
+// Crop the region of interest at full quality and send it in place of the thumbnail.
+// Returns false if no crop could be produced; delivered reports the upload result.
+bool sendRoiCrop(camera_fb_t* fb, const RoiBox& roi, const char* detection, bool& delivered) {
+    unsigned long start = millis();
+    char captureId[32];
+    StorageManager::captureIdFromPath(storageMgr.getLastPath(), captureId, sizeof(captureId));
+
+    uint8_t* crop = nullptr;
+    size_t cropLen = 0;
+    uint8_t divisor = framePipeline.cropJpeg(fb->buf, fb->len, roi, &crop, &cropLen);
+    if (!divisor) {
+        Serial.println("[ROI] Crop failed - falling back to thumbnail");
+        return false;
+    }
+    unsigned long cropMs = millis() - start;
+
+    char roiStr[48];
+    snprintf(roiStr, sizeof(roiStr), "%u,%u,%u,%u,%u,%u",
+             roi.x, roi.y, roi.w, roi.h, (unsigned)fb->width, (unsigned)fb->height);
+
+    unsigned long uploadStart = millis();
+    NetJob job = { crop, cropLen, nullptr, captureId, "roi", roiStr };
+    job.capturedAt = storageMgr.lastRecord().capturedAt;
+    job.detection = detection;
+    delivered = netTask.deliver(job);
+    unsigned long uploadMs = max(1UL, millis() - uploadStart);
+    arenaFree(crop);
+
+    // Benchmark: CPU spent cropping vs uplink time the full frame would have needed
+    unsigned long fullMs = (unsigned long)((uint64_t)fb->len * uploadMs / max<size_t>(cropLen, 1));
+    Serial.printf("[ROI] %s %ux%u @ (%u,%u) 1/%u: crop+encode %lu ms, %u B vs full %u B (%u%%), "
+                  "upload %lu ms -> full ~%lu ms, saved ~%ld ms\n",
+                  captureId, roi.w, roi.h, roi.x, roi.y, divisor, cropMs,
+                  (unsigned)cropLen, (unsigned)fb->len, (unsigned)(cropLen * 100 / fb->len),
+                  uploadMs, fullMs, (long)fullMs - (long)(uploadMs + cropMs));
+    return true;
+}
+
 // Extracted function to process a captured frame
 void processCapture(camera_fb_t* fb) {
     if (!fb) return;
+
+    // Everything allocated below comes from the PSRAM arena and is reset on return
+    ArenaScope arenaScope(captureArena);
     
     Serial.println("🖼️ Processing captured frame...");
+    telemetryMgr.recordCapture();
+    if (motionDetectedAt) {
+        // Should stay flat even while the broker is unreachable
+        Serial.printf("⏱️ Motion -> capture latency: %lums (MQTT %s)\n",
+                      millis() - motionDetectedAt, netTask.mqttConnected() ? "up" : "down");
+        motionDetectedAt = 0;
+    }
     ledMgr.flashWhite(1);
     
-    // Always save to SD first (Backup)
-    if (storageMgr.isReady()) {
-        storageMgr.savePendingFrame(fb);
+    // Always save to SD (backup) - written behind, in parallel with delivery
+    uint32_t saveTicket = storageMgr.isReady() ? storageMgr.savePendingFrameAsync(fb) : 0;
+    bool saved = saveTicket != 0;
+
+    // On-device detector: label travels with the upload, background may wait
+    Detection detection;
+    char detectionStr[DETECTOR_LABEL_LEN + 8];
+    const char* label = nullptr;
+    UploadAction action = UPLOAD_NOW;
+    if (detectorMgr.classify(fb, detection)) {
+        formatDetection(detection, detectionStr, sizeof(detectionStr));
+        label = detectionStr;
+        // Without the SD copy there is nothing to upload later
+        action = saved ? detectorMgr.actionFor(detection) : UPLOAD_NOW;
     }
 
     bool uploadSuccess = false;
-    if (USE_MQTT && mqttMgr.isConnected()) {
-        uploadSuccess = mqttMgr.publishImageChunked(fb->buf, fb->len);
+    if (action != UPLOAD_NOW) {
+        if (action == UPLOAD_NEVER) {
+            storageMgr.markDelivered(saveTicket, storageMgr.getLastPath());
+        }
+        Serial.printf("🙈 [DETECT] %s %u%% - %s\n", detection.name, detection.confidence,
+                      action == UPLOAD_LATER ? "left for the backlog pass" : "kept on SD only");
+    } else if (THUMBNAIL_FIRST && saved && fb->format == PIXFORMAT_JPEG) {
+        // Preview now; the full image stays queued on SD for the scheduler / fetch_full
+        RoiBox roi;
+        if (!(motionRoi.locate(fb, roi) && sendRoiCrop(fb, roi, label, uploadSuccess))) {
+            uploadSuccess = sendThumbnail(fb, label);
+        }
     } else {
-        // Fallback to HTTP
-        uploadSuccess = uploadMgr.upload(fb, authMgr.getToken());
+        // MQTT when connected, otherwise HTTP (raw body)
+        NetJob job = { fb->buf, fb->len, fb, nullptr, nullptr, nullptr };
+        if (saved) {
+            job.captureId = storageMgr.lastRecord().id;
+            job.capturedAt = storageMgr.lastRecord().capturedAt;
+        }
+        job.detection = label;
+        uploadSuccess = netTask.deliver(job);
+        // Move file from 'pending' to 'sent' folder once it is on the card
+        if (uploadSuccess && saved) {
+            storageMgr.markDelivered(saveTicket, storageMgr.getLastPath());
+        }
     }
     
-    if (uploadSuccess) {
+    if (action != UPLOAD_NOW) {
+        ledMgr.flashBlue(1); // Giữ lại trên thẻ SD
+    } else if (uploadSuccess) {
         Serial.println("✅ Upload complete");
         ledMgr.flashGreen(1); // Gửi ảnh thành công
-        // Move file from 'pending' to 'sent' folder on SD
-        if (storageMgr.isReady()) {
-            storageMgr.moveToSent(storageMgr.getLastPath());
-        }
     } else {
         Serial.println("❌ Upload failed - Saved to SD for later");
         ledMgr.flashRed(1); // Gửi ảnh thất bại
     }
+
+    Serial.printf("[ARENA] used %u / high-water %u bytes\n",
+                  (unsigned)captureArena.used(), (unsigned)captureArena.highWater());
+    telemetryMgr.sampleHeap();
 }
 
 void loop() {
-    // 1. Maintain MQTT
-    if (USE_MQTT) {
-        // Prevent race condition: Don't run MQTT loop if Stream Task is uploading
-        if (!captureRequested) {
-            if (!mqttMgr.isConnected()) {
-                 static unsigned long lastReconnectAttempt = 0;
-                 unsigned long now = millis();
-                 if (now - lastReconnectAttempt > 5000) {
-                     lastReconnectAttempt = now;
-                     if (mqttMgr.connect()) {
-                         lastReconnectAttempt = 0;
-                     }
-                 }
-            } else {
-                mqttMgr.loop();
+    // 1. Camera work requested by MQTT commands (decoded on the network task)
+    AppEvent event;
+    uint8_t arg;
+    while (netTask.takeAppEvent(event, arg)) {
+        switch (event) {
+            case APP_EVENT_CAPTURE:
+                shouldCapture = true;
+                break;
+            case APP_EVENT_STREAM_ON: {
+                CameraLock camLock(cameraMgr, CAMERA_LOCK_WAIT_MS);
+                if (!camLock.held()) {
+                    Serial.println("⚠️ Camera busy - stream_on ignored");
+                    break;
+                }
+                // Warm up only: the /stream handler takes the camera (isStreaming)
+                // once a client connects, and captures until then are taken directly
+                if (!cameraMgr.isInitialized() && !cameraMgr.init()) {
+                    Serial.println("❌ Camera init failed for stream");
+                }
+                break;
+            }
+            case APP_EVENT_STREAM_OFF: {
+                CameraLock camLock(cameraMgr, CAMERA_LOCK_WAIT_MS);
+                if (!camLock.held()) {
+                    Serial.println("⚠️ Camera busy - stream_off ignored");
+                    break;
+                }
+                if (StreamManager::clientActive()) {
+                    // The stream task owns the camera: it stops and deinits on its way out
+                    StreamManager::requestStop();
+                    break;
+                }
+                // Only deinit if not capturing
+                if (!shouldCapture) {
+                    cameraMgr.deinit();
+                }
+                break;
+            }
+            case APP_EVENT_SET_QUALITY: {
+                CameraLock camLock(cameraMgr, CAMERA_LOCK_WAIT_MS);
+                if (!camLock.held() || !cameraMgr.setJpegQuality(arg)) {
+                    Serial.printf("⚠️ JPEG quality %u not applied\n", arg);
+                }
+                break;
+            }
+            case APP_EVENT_SET_FRAMESIZE: {
+                CameraLock camLock(cameraMgr, CAMERA_LOCK_WAIT_MS);
+                if (!camLock.held() || !cameraMgr.setFrameSize((framesize_t)arg)) {
+                    // Larger than the framebuffers while streaming needs a re-init
+                    Serial.printf("⚠️ Framesize %u not applied (camera busy)\n", arg);
+                }
+                break;
             }
         }
     }
 
-    // 2. Check Motion
+    // 2. MQTT, telemetry and background uploads run on the network task
+
+    // Keep the motion-crop background current from the stream's analytics planes
+    motionRoi.observe();
+
+    // A still the stream task copied out: the stream is already running again
+    camera_fb_t* still = StreamManager::takeStill();
+    if (still) {
+        unsigned long start = millis();
+        processCapture(still);
+        StreamManager::releaseStill();
+        Serial.printf("[STILL] Processed off the stream task in %lu ms\n", millis() - start);
+    }
+
+    // 3. Check Motion
     static unsigned long lastMotionTime = 0;
-    const unsigned long MOTION_COOLDOWN = 15000; // 15s cooldown
 
     bool motionDetected = false;
 
@@ -278,23 +469,34 @@ void loop() {
     // Control External LED: ON when motion detected, OFF otherwise
     digitalWrite(STATUS_LED_PIN, motionDetected ? HIGH : LOW);
     
-    if (motionDetected && (millis() - lastMotionTime > MOTION_COOLDOWN)) {
+    if (motionDetected && (millis() - lastMotionTime > motionCooldownMs)) {
         Serial.println("🏃 Motion Detected (Stable Signal)!");
         shouldCapture = true;
         lastMotionTime = millis();
+        motionDetectedAt = lastMotionTime;
     }
 
-    // 3. Handle Capture (from Motion or MQTT)
+    // 4. Handle Capture (from Motion or MQTT)
     if (shouldCapture) {
         shouldCapture = false;
         Serial.println("📸 Capture requested...");
-        
+
+        // Held through init, capture, delivery and deinit: /capture and /stream wait for us
+        CameraLock camLock(cameraMgr, CAMERA_LOCK_WAIT_MS);
+        if (!camLock.held()) {
+            Serial.println("⚠️ Camera busy (HTTP capture) - capture skipped");
+            telemetryMgr.recordError();
+            return;
+        }
         bool wasInitialized = cameraMgr.isInitialized();
         
-        // If streaming, delegate capture to the stream task
-        if (isStreaming && wasInitialized) {
+        // If a client is streaming, delegate capture to the stream task (it drains
+        // requests until it clears clientActive under this lock)
+        if (StreamManager::clientActive()) {
             Serial.println("🔄 Delegating capture to Stream Task...");
-            captureRequested = true;
+            if (!StreamManager::requestCapture()) {
+                Serial.println("⚠️ Stream Task already has captures queued - dropped");
+            }
             // We don't block here; the stream task will pick it up
         } else {
             // Standard capture flow (when not streaming)
@@ -307,18 +509,19 @@ void loop() {
 
             // Flash ON (Simulated with RGB)
             ledMgr.setFlash(true);
-            delay(150); // Wait for light to stabilize
 
-            camera_fb_t* fb = esp_camera_fb_get();
+            // First frame with converged exposure (replaces a fixed 150 ms wait)
+            camera_fb_t* fb = cameraMgr.captureStill(true);
             
             // Flash OFF
             ledMgr.setFlash(false);
 
             if (fb) {
                 processCapture(fb);
-                esp_camera_fb_return(fb);
+                cameraMgr.endStill(fb);
             } else {
                 Serial.println("❌ Camera capture failed");
+                telemetryMgr.recordError();
             }
 
             // Turn off camera if not streaming
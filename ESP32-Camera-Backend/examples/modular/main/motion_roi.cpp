@@ -0,0 +1,162 @@
+/**
+ * motion_roi.cpp - Frame-differencing region of interest
+ */
+
+#include <esp32-hal-psram.h>
+#include "motion_roi.h"
+
+MotionRoi motionRoi;
+
+static const uint16_t ROI_ALIGN = 16;
+
+MotionRoi::MotionRoi()
+    : _mode(ROI_UPLOAD_ENABLED ? ROI_AUTO : ROI_OFF), _fixed({0, 0, 0, 0}),
+      _bg(nullptr), _cur(nullptr), _bgW(0), _bgH(0), _bgAt(0), _bgSeq(0), _lastObserve(0),
+      _hasBg(false), _lock(nullptr) {}
+
+bool MotionRoi::begin() {
+    if (_bg) {
+        return true;
+    }
+    _bg = (uint16_t*)ps_malloc(PIPELINE_GRAY_MAX * sizeof(uint16_t));
+    _cur = (uint8_t*)ps_malloc(PIPELINE_GRAY_MAX);
+    _lock = xSemaphoreCreateMutex();
+    if (!_bg || !_cur || !_lock) {
+        free(_bg);
+        free(_cur);
+        _bg = nullptr;
+        _cur = nullptr;
+        _mode = ROI_OFF;
+        Serial.println("[ROI] Plane allocation failed - crops disabled");
+        return false;
+    }
+    return true;
+}
+
+// Call with _lock held
+void MotionRoi::fold(const uint8_t* plane, uint16_t w, uint16_t h, uint32_t now) {
+    if (!bgFresh(now)) {
+        // Seed on this plane's grid; later planes (stream or still size) are mapped onto it
+        _bgW = w;
+        _bgH = h;
+        for (size_t i = 0; i < (size_t)w * h; i++) {
+            _bg[i] = (uint16_t)plane[i] << 8;
+        }
+    } else {
+        for (uint16_t y = 0; y < _bgH; y++) {
+            const uint8_t* srcRow = plane + (size_t)(y * h / _bgH) * w;
+            uint16_t* bgRow = _bg + (size_t)y * _bgW;
+            for (uint16_t x = 0; x < _bgW; x++) {
+                int32_t target = (int32_t)srcRow[x * w / _bgW] << 8;
+                bgRow[x] += (target - (int32_t)bgRow[x]) / ROI_BG_WEIGHT;
+            }
+        }
+    }
+    _bgAt = now;
+    _hasBg = true;
+}
+
+void MotionRoi::observe() {
+    uint32_t now = millis();
+    if (_mode != ROI_AUTO || !_lock || now - _lastObserve < ROI_BG_SAMPLE_MS) {
+        return;
+    }
+    _lastObserve = now;
+    uint32_t seq = framePipeline.graySeq();
+    if (seq == _bgSeq || xSemaphoreTake(_lock, 0) != pdTRUE) {
+        return; // No new plane, or a capture is being located right now
+    }
+    uint16_t w = 0, h = 0;
+    if (framePipeline.copyLatestGray(_cur, PIPELINE_GRAY_MAX, &w, &h, &seq) && w && h) {
+        fold(_cur, w, h, now);
+        _bgSeq = seq;
+    }
+    xSemaphoreGive(_lock);
+}
+
+bool MotionRoi::clampToFrame(RoiBox& box, uint16_t frameW, uint16_t frameH) const {
+    // Pad, then snap outwards to the MCU grid so the crop edges stay clean
+    uint32_t mx = (uint32_t)box.w * ROI_MARGIN_PCT / 100;
+    uint32_t my = (uint32_t)box.h * ROI_MARGIN_PCT / 100;
+    int32_t x0 = (int32_t)box.x - mx;
+    int32_t y0 = (int32_t)box.y - my;
+    int32_t x1 = (int32_t)box.x + box.w + mx;
+    int32_t y1 = (int32_t)box.y + box.h + my;
+
+    x0 = max<int32_t>(0, x0) / ROI_ALIGN * ROI_ALIGN;
+    y0 = max<int32_t>(0, y0) / ROI_ALIGN * ROI_ALIGN;
+    x1 = min<int32_t>(frameW, (x1 + ROI_ALIGN - 1) / ROI_ALIGN * ROI_ALIGN);
+    y1 = min<int32_t>(frameH, (y1 + ROI_ALIGN - 1) / ROI_ALIGN * ROI_ALIGN);
+    if (x1 <= x0 || y1 <= y0) {
+        return false;
+    }
+    box = { (uint16_t)x0, (uint16_t)y0, (uint16_t)(x1 - x0), (uint16_t)(y1 - y0) };
+    return true;
+}
+
+bool MotionRoi::locate(const camera_fb_t* fb, RoiBox& box) {
+    if (!fb || fb->format != PIXFORMAT_JPEG || _mode == ROI_OFF) {
+        return false;
+    }
+
+    if (_mode == ROI_FIXED) {
+        box = _fixed;
+        if (box.x >= fb->width || box.y >= fb->height) {
+            return false;
+        }
+        box.w = min<uint16_t>(box.w, fb->width - box.x);
+        box.h = min<uint16_t>(box.h, fb->height - box.y);
+        return box.w > 0 && box.h > 0;
+    }
+
+    if (!_cur || !_lock) {
+        return false;
+    }
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    uint16_t w = 0, h = 0;
+    if (!framePipeline.grayFromJpeg(fb->buf, fb->len, _cur, PIPELINE_GRAY_MAX, &w, &h) || !w || !h) {
+        xSemaphoreGive(_lock);
+        return false;
+    }
+
+    bool found = false;
+    uint32_t now = millis();
+    if (!bgFresh(now)) {
+        Serial.println("[ROI] No recent background - reseeding, no crop this time");
+    } else {
+        // Background may be on a different grid (stream size): map cells by nearest neighbour
+        uint16_t minX = w, minY = h, maxX = 0, maxY = 0;
+        uint32_t changed = 0;
+        for (uint16_t y = 0; y < h; y++) {
+            const uint16_t* bgRow = _bg + (size_t)(y * _bgH / h) * _bgW;
+            const uint8_t* curRow = _cur + (size_t)y * w;
+            for (uint16_t x = 0; x < w; x++) {
+                int diff = (int)curRow[x] - (int)(bgRow[x * _bgW / w] >> 8);
+                if (diff > ROI_DIFF_THRESHOLD || diff < -ROI_DIFF_THRESHOLD) {
+                    changed++;
+                    minX = min(minX, x);
+                    maxX = max(maxX, x);
+                    minY = min(minY, y);
+                    maxY = max(maxY, y);
+                }
+            }
+        }
+
+        if (changed >= ROI_MIN_CELLS) {
+            uint32_t boxCells = (uint32_t)(maxX - minX + 1) * (maxY - minY + 1);
+            if (boxCells * 100 <= (uint32_t)w * h * ROI_MAX_AREA_PCT) {
+                uint16_t sx = fb->width / w;
+                uint16_t sy = fb->height / h;
+                box = { (uint16_t)(minX * sx), (uint16_t)(minY * sy),
+                        (uint16_t)((maxX - minX + 1) * sx), (uint16_t)((maxY - minY + 1) * sy) };
+                found = clampToFrame(box, fb->width, fb->height);
+            }
+            Serial.printf("[ROI] %lu cells changed, box %u%% of frame\n",
+                          (unsigned long)changed, (unsigned)(boxCells * 100 / ((uint32_t)w * h)));
+        }
+    }
+
+    fold(_cur, w, h, now);
+    xSemaphoreGive(_lock);
+    return found;
+}
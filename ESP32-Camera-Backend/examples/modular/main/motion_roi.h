@@ -0,0 +1,79 @@
+/**
+ * motion_roi.h - Region of interest for crop uploads
+ *
+ * AUTO:  difference each capture's 1/8-scale grayscale plane against a
+ *        running background and box the cells that changed. The background
+ *        is an average of recent planes: the stream's analytics planes
+ *        (observe(), every ROI_BG_SAMPLE_MS) and the captures themselves. If
+ *        nothing refreshed it for ROI_BG_MAX_AGE_MS, it is reseeded from the
+ *        capture instead of diffed against.
+ * FIXED: a box supplied by command (CMD_SET_ROI), e.g. a doorway.
+ *
+ * Boxes are padded by ROI_MARGIN_PCT and aligned to 16 px (JPEG MCUs).
+ */
+
+#ifndef MOTION_ROI_H
+#define MOTION_ROI_H
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "esp_camera.h"
+#include "frame_pipeline.h"
+#include "config.h"
+
+enum RoiMode : uint8_t {
+    ROI_OFF   = 0,
+    ROI_AUTO  = 1,
+    ROI_FIXED = 2
+};
+
+class MotionRoi {
+public:
+    MotionRoi();
+
+    /**
+     * Allocate the background/current planes (PSRAM). Call once in setup().
+     */
+    bool begin();
+
+    void setAuto() { _mode = ROI_AUTO; _hasBg = false; }
+    void setFixed(const RoiBox& box) { _fixed = box; _mode = ROI_FIXED; }
+    void disable() { _mode = ROI_OFF; }
+    RoiMode mode() const { return _mode; }
+
+    /**
+     * Fold the latest stream analytics plane into the background (AUTO only).
+     * Call from loop(); cheap when there is no new plane, never waits.
+     */
+    void observe();
+
+    /**
+     * Region worth uploading for this capture, in frame pixels.
+     * In AUTO mode the capture's plane is folded into the background.
+     * @return false when the background is missing or stale, nothing changed,
+     *         or the change covers most of the frame (a crop would not save much).
+     */
+    bool locate(const camera_fb_t* fb, RoiBox& box);
+
+private:
+    RoiMode _mode;
+    RoiBox _fixed;
+    uint16_t* _bg;              // Luma << 8, so slow drifts still move it
+    uint8_t* _cur;
+    uint16_t _bgW;
+    uint16_t _bgH;
+    uint32_t _bgAt;             // millis() of the last plane folded in
+    uint32_t _bgSeq;            // framePipeline.graySeq() last folded in
+    uint32_t _lastObserve;
+    bool _hasBg;
+    SemaphoreHandle_t _lock;    // locate() runs on loop or the stream task
+
+    bool bgFresh(uint32_t now) const { return _hasBg && now - _bgAt <= ROI_BG_MAX_AGE_MS; }
+    void fold(const uint8_t* plane, uint16_t w, uint16_t h, uint32_t now);
+    bool clampToFrame(RoiBox& box, uint16_t frameW, uint16_t frameH) const;
+};
+
+extern MotionRoi motionRoi;
+
+#endif // MOTION_ROI_H
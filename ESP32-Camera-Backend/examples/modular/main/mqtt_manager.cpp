@@ -6,64 +6,170 @@
 #include <WiFi.h> // Added for WiFi.localIP()
 #include "mqtt_manager.h"
 #include "config.h"
-#include <base64.h> // Requires base64 library
+#include "telemetry_manager.h"
+#include "capture_arena.h"
+#include "task_plan.h"
+#include "rate_limiter.h"
+#include "capture_sequence.h"
+#include "xfer_sender.h"
 
 MQTTManager::MQTTManager(const char* brokerAddr, int brokerPort, const char* id, const char* user, const char* pass)
     : broker(brokerAddr), port(brokerPort), clientId(id), username(user), password(pass), mqttClient(wifiClient) {
-    topicImage = MQTT_TOPIC_IMAGE;
-    topicStatus = MQTT_TOPIC_STATUS;
-    topicCommand = MQTT_TOPIC_COMMAND;
+    if (!clientId || !clientId[0]) {
+        clientId = deviceId();
+    }
+    snprintf(topicImage, sizeof(topicImage), "%s/%s/%s", MQTT_TOPIC_ROOT, clientId, MQTT_TOPIC_IMAGE);
+    snprintf(topicStatus, sizeof(topicStatus), "%s/%s/%s", MQTT_TOPIC_ROOT, clientId, MQTT_TOPIC_STATUS);
+    snprintf(topicCommand, sizeof(topicCommand), "%s/%s/%s", MQTT_TOPIC_ROOT, clientId, MQTT_TOPIC_COMMAND);
+    snprintf(topicAck, sizeof(topicAck), "%s/%s/%s", MQTT_TOPIC_ROOT, clientId, MQTT_TOPIC_ACK);
+    snprintf(topicTasks, sizeof(topicTasks), "%s/%s/%s", MQTT_TOPIC_ROOT, clientId, MQTT_TOPIC_TASKS);
+    snprintf(topicGroupCommand, sizeof(topicGroupCommand), "%s/group/%s/%s",
+             MQTT_TOPIC_ROOT, MQTT_GROUP, MQTT_TOPIC_COMMAND);
+    snprintf(topicAllCommand, sizeof(topicAllCommand), "%s/all/%s", MQTT_TOPIC_ROOT, MQTT_TOPIC_COMMAND);
+    snprintf(topicRate, sizeof(topicRate), "%s/%s/%s", MQTT_TOPIC_ROOT, clientId, MQTT_TOPIC_RATE);
+    snprintf(topicAllRate, sizeof(topicAllRate), "%s/all/%s", MQTT_TOPIC_ROOT, MQTT_TOPIC_RATE);
+    snprintf(topicXfer, sizeof(topicXfer), "%s/%s/%s", MQTT_TOPIC_ROOT, clientId, MQTT_TOPIC_XFER);
+    _chunkSize = MQTT_CHUNK_SIZE_DEFAULT;
+
+    _state = MQTT_STATE_IDLE;
+    _attemptDone = false;
+    _attemptResult = false;
+    _connectTask = NULL;
+    _nextAttemptAt = 0;
+    _backoffMs = MQTT_BACKOFF_MIN_MS;
+    _attempt = 0;
+    _attemptStartedAt = 0;
+    _maxLoopUs = 0;
     
     // Set buffer size for images
     // Note: PubSubClient has limits on message size
     // Reduced to 8KB to save heap (since we use chunking now)
-    mqttClient.setBufferSize(8192); 
+    mqttClient.setBufferSize(MQTT_BUFFER_SIZE);
     mqttClient.setSocketTimeout(30);  // 30 second timeout for large messages
     
-    // Allow insecure TLS (skip certificate validation) for HiveMQ Cloud
-    wifiClient.setInsecure();
+    // Broker checked against MQTT_TLS_PINS; sessions resumed across reconnects
+    wifiClient.setHandshakeTimeout(MQTT_CONNECT_TIMEOUT_S);
 }
 
 bool MQTTManager::connect() {
-    Serial.println("🔌 Connecting to MQTT broker...");
-    Serial.printf("Broker: %s:%d\n", broker, port);
-    
-    mqttClient.setServer(broker, port);
-    mqttClient.setKeepAlive(60);
-    
-    // Try to connect with retry
-    int retries = 0;
-    while (!mqttClient.connected() && retries < 5) {
-        Serial.printf("Attempt %d/5...\n", retries + 1);
-        
-        bool connected = false;
-        if (username && password) {
-             connected = mqttClient.connect(clientId, username, password);
-        } else {
-             connected = mqttClient.connect(clientId);
-        }
+    // Arm the state machine; the actual attempt runs from loop()
+    if (_state == MQTT_STATE_IDLE) {
+        Serial.println("🔌 Connecting to MQTT broker...");
+        Serial.printf("Broker: %s:%d as %s (topics %s/%s/#)\n", broker, port, clientId,
+                      MQTT_TOPIC_ROOT, clientId);
+        mqttClient.setServer(broker, port);
+        mqttClient.setKeepAlive(60);
+        wifiClient.begin();
+        _state = MQTT_STATE_BACKOFF;
+        _nextAttemptAt = millis(); // First attempt immediately
+    }
+    loop();
+    return isConnected();
+}
 
-        if (connected) {
-            Serial.println("✅ MQTT connected!");
-            
-            // Publish rich status with IP and Stream URL
-            String ip = WiFi.localIP().toString();
-            String streamUrl = "http://" + ip + ":" + String(STREAM_PORT) + "/stream";
-            String payload = "{\"status\":\"online\",\"ip\":\"" + ip + "\",\"streamUrl\":\"" + streamUrl + "\"}";
-            
-            publishStatus(payload.c_str());
-            mqttClient.subscribe(topicCommand); // Auto subscribe to command topic
-            mqttClient.subscribe("camera/server-ip"); // Subscribe to Server IP discovery
-            return true;
-        }
-        
-        Serial.printf("❌ Failed, rc=%d. Retry in 2s...\n", mqttClient.state());
-        delay(2000);
-        retries++;
+bool MQTTManager::waitConnected(uint32_t timeoutMs) {
+    connect();
+    unsigned long start = millis();
+    while (!isConnected() && millis() - start < timeoutMs) {
+        loop();
+        delay(50);
+    }
+    return isConnected();
+}
+
+void MQTTManager::connectTaskEntry(void* arg) {
+    MQTTManager* self = static_cast<MQTTManager*>(arg);
+
+    // Blocking TCP + TLS + MQTT CONNECT, isolated from the caller's task
+    bool connected;
+    if (self->username && self->password) {
+        connected = self->mqttClient.connect(self->clientId, self->username, self->password);
+    } else {
+        connected = self->mqttClient.connect(self->clientId);
+    }
+
+    self->_attemptResult = connected;
+    self->_attemptDone = true;
+    self->_connectTask = NULL;
+    vTaskDelete(NULL);
+}
+
+void MQTTManager::startAttempt() {
+    _attempt++;
+    _attemptDone = false;
+    _attemptResult = false;
+    _attemptStartedAt = millis();
+    Serial.printf("🔌 MQTT attempt %u (loop stall max since last: %lu us)\n",
+                  _attempt, (unsigned long)_maxLoopUs);
+    _maxLoopUs = 0;
+
+    // mbedTLS handshake needs a generous stack
+    _state = MQTT_STATE_CONNECTING;
+    if (xTaskCreatePinnedToCore(connectTaskEntry, "mqtt_connect", TASK_MQTT_CONNECT_STACK, this,
+                                TASK_MQTT_CONNECT_PRIO, &_connectTask, TASK_MQTT_CONNECT_CORE) != pdPASS) {
+        Serial.println("❌ Failed to start MQTT connect task");
+        _connectTask = NULL;
+        finishAttempt(false);
+    }
+}
+
+void MQTTManager::finishAttempt(bool connected) {
+    if (connected) {
+        const TlsHandshakeStats& tls = wifiClient.lastHandshake();
+        Serial.printf("✅ MQTT connected! (attempt %u, %lums, TLS %s %lums)\n",
+                      _attempt, millis() - _attemptStartedAt,
+                      tls.resumed ? "resumed" : "full", (unsigned long)tls.tlsMs);
+        _state = MQTT_STATE_CONNECTED;
+        _attempt = 0;
+        _backoffMs = MQTT_BACKOFF_MIN_MS;
+        onConnected();
+    } else {
+        Serial.printf("❌ MQTT connect failed, rc=%d\n", mqttClient.state());
+        scheduleRetry();
     }
+}
+
+void MQTTManager::scheduleRetry() {
+    // Exponential backoff with full jitter: wait in [0, backoff), so cameras
+    // that lost the broker together do not come back together
+    uint32_t wait = esp_random() % _backoffMs;
+    _nextAttemptAt = millis() + wait;
+    _state = MQTT_STATE_BACKOFF;
+    Serial.printf("⏳ MQTT retry in %lums\n", (unsigned long)wait);
+
+    _backoffMs = _backoffMs * 2;
+    if (_backoffMs > MQTT_BACKOFF_MAX_MS) {
+        _backoffMs = MQTT_BACKOFF_MAX_MS;
+    }
+}
+
+void MQTTManager::onConnected() {
+    // Publish rich status with IP and Stream URL
+    String ip = WiFi.localIP().toString();
+    String streamUrl = "http://" + ip + ":" + String(STREAM_PORT) + "/stream";
+    String payload = "{\"status\":\"online\",\"ip\":\"" + ip + "\",\"streamUrl\":\"" + streamUrl + "\"}";
     
-    Serial.println("❌ MQTT connection failed!");
-    return false;
+    publishStatus(payload.c_str());
+    mqttClient.subscribe(topicCommand); // This camera only
+    mqttClient.subscribe(topicGroupCommand); // Cameras in MQTT_GROUP
+    mqttClient.subscribe(topicAllCommand); // Whole fleet
+    mqttClient.subscribe(topicRate); // Upload rate hints (retained)
+    mqttClient.subscribe(topicAllRate);
+    mqttClient.subscribe(topicXfer); // Image chunk acks
+    mqttClient.subscribe(MQTT_TOPIC_DISCOVERY); // Subscribe to Server IP discovery
+}
+
+bool MQTTManager::isRateTopic(const char* topic) const {
+    return strcmp(topic, topicRate) == 0 || strcmp(topic, topicAllRate) == 0;
+}
+
+bool MQTTManager::isXferTopic(const char* topic) const {
+    return strcmp(topic, topicXfer) == 0;
+}
+
+bool MQTTManager::isCommandTopic(const char* topic) const {
+    return strcmp(topic, topicCommand) == 0 || strcmp(topic, topicGroupCommand) == 0 ||
+           strcmp(topic, topicAllCommand) == 0;
 }
 
 void MQTTManager::setCallback(MQTT_CALLBACK_SIGNATURE) {
@@ -84,11 +190,9 @@ bool MQTTManager::publishImage(const uint8_t* imageData, size_t imageSize) {
         return false; // Force HTTP fallback
     }
     
-    if (!mqttClient.connected()) {
-        Serial.println("⚠️ MQTT not connected, attempting reconnect...");
-        if (!connect()) {
-            return false;
-        }
+    if (!isConnected()) {
+        Serial.println("⚠️ MQTT not connected (reconnect runs in background)");
+        return false;
     }
     
     Serial.printf("📤 Publishing image (%d bytes) to MQTT...\n", imageSize);
@@ -106,59 +210,111 @@ bool MQTTManager::publishImage(const uint8_t* imageData, size_t imageSize) {
     return success;
 }
 
-bool MQTTManager::publishImageChunked(const uint8_t* imageData, size_t imageSize) {
-    if (!mqttClient.connected()) {
-        if (!connect()) return false;
+bool MQTTManager::publishImageChunked(const uint8_t* imageData, size_t imageSize,
+                                      const char* captureId, const char* kind, const char* roi,
+                                      time_t capturedAt, const char* detection) {
+    if (!isConnected()) {
+        return false;
     }
 
-    // 1. Encode entire image to Base64
-    // Note: This requires significant RAM. If image is too large, this might fail.
-    // For 40KB image -> ~54KB Base64 string
-    // String base64Image = base64::encode(imageData, imageSize);
-    // int totalLen = base64Image.length();
-    
-    // 2. Calculate chunks
-    const int CHUNK_SIZE = 3072; // Multiple of 3 for valid Base64 chunks
-    int totalLen = (imageSize + 2) / 3 * 4; // Base64 length
-    int totalChunks = (imageSize + CHUNK_SIZE - 1) / CHUNK_SIZE;
-    String imageId = String(millis()); // Simple unique ID
+    // 1. Calculate chunks
+    const size_t CHUNK_SIZE = _chunkSize; // Multiple of 3 for valid Base64 chunks
+    size_t totalLen = (imageSize + 2) / 3 * 4; // Base64 length
+    size_t totalChunks = XferSender::chunkCount(imageSize, CHUNK_SIZE);
+    if (totalChunks == 0) {
+        Serial.printf("⚠️ Image needs %u chunks (max %u) - use HTTP\n",
+                      (unsigned)((imageSize + CHUNK_SIZE - 1) / CHUNK_SIZE), (unsigned)XFER_MAX_CHUNKS);
+        return false;
+    }
+    // Reassembly key: unique per camera across reboots (capture_sequence.h)
+    char imageId[CAPTURE_ID_LEN + 8];
+    if (captureId) {
+        snprintf(imageId, sizeof(imageId), "%s.%s", captureId, kind ? kind : "full");
+    } else {
+        snprintf(imageId, sizeof(imageId), "%s", captureSeq.next().id);
+    }
     
-    Serial.printf("📦 Chunking image: %d bytes -> %d Base64 chars (%d chunks)\n", 
-                  imageSize, totalLen, totalChunks);
-
-    // 3. Send chunks
-    for (int i = 0; i < totalChunks; i++) {
-        int start = i * CHUNK_SIZE;
-        int len = (start + CHUNK_SIZE > imageSize) ? (imageSize - start) : CHUNK_SIZE;
-        
-        // Encode just this chunk
-        String chunkData = base64::encode(imageData + start, len);
-
-        // Create JSON payload manually to save memory
-        String payload = "{";
-        payload += "\"id\":\"" + imageId + "\",";
-        payload += "\"index\":" + String(i) + ",";
-        payload += "\"total\":" + String(totalChunks) + ",";
-        payload += "\"data\":\"" + chunkData + "\",";
-        payload += "\"userId\":\"" + String(USERNAME) + "\""; // From config.h
-        payload += "}";
-
-        // Publish
-        if (!mqttClient.publish(topicImage, payload.c_str())) {
-            Serial.printf("❌ Failed to send chunk %d/%d\n", i+1, totalChunks);
+    Serial.printf("📦 Chunking image: %u bytes -> %u Base64 chars (%u chunks, window %u)\n",
+                  (unsigned)imageSize, (unsigned)totalLen, (unsigned)totalChunks, XFER_WINDOW);
+
+    // 2. One payload buffer for all chunks plus the ack bitmap and send times
+    //    (capture arena, heap fallback)
+    char* payload = (char*)arenaAlloc(XferSender::payloadCapacity(CHUNK_SIZE));
+    uint8_t* acked = (uint8_t*)arenaAlloc(XferSender::bitmapBytes(totalChunks));
+    uint16_t* sentAt = (uint16_t*)arenaAlloc(totalChunks * sizeof(uint16_t));
+    if (!payload || !acked || !sentAt) {
+        Serial.println("❌ No memory for chunk payload");
+        arenaFree(sentAt);
+        arenaFree(acked);
+        arenaFree(payload);
+        return false;
+    }
+
+    // Publish (paced by the backend's rate hint)
+    auto publish = [&](const char* chunk, size_t len) -> bool {
+        rateLimiter.pace(len);
+        if (!mqttClient.publish(topicImage, (const uint8_t*)chunk, len)) {
+            Serial.printf("❌ Failed to send chunk of %s\n", imageId);
+            telemetryMgr.recordMqttFailure();
             return false;
         }
-        
-        Serial.printf("📤 Sent chunk %d/%d\n", i+1, totalChunks);
-        delay(50); // Small delay to prevent network congestion
+        return true;
+    };
+
+    // 3. Sliding window (xfer_sender.h): keep XFER_WINDOW chunks past cumAck in
+    //    flight, resend holes the backend reports and anything unacked for XFER_RTO_MS
+    XferMeta meta = { USERNAME, captureId, kind, roi, capturedAt, detection }; // USERNAME from config.h
+    unsigned long startedAt = millis();
+    _xfer.begin(imageData, imageSize, CHUNK_SIZE, imageId, meta, payload, acked, sentAt, startedAt);
+    bool ok = true;
+    while (!_xfer.complete()) {
+        if (!_xfer.fillWindow(millis(), publish)) {
+            ok = false;
+            break;
+        }
+
+        // Acks arrive through the callback (main.ino -> handleXferAck)
+        mqttClient.loop();
+        if (!mqttClient.connected()) {
+            ok = false;
+            break;
+        }
+        bool progress = _xfer.progressed();
+        unsigned long now = millis();
+        if (!_xfer.complete() && !_xfer.resendLost(now, publish)) {
+            ok = false;
+            break;
+        }
+        if (!_xfer.complete() && _xfer.timedOut(now)) {
+            ok = false;
+            break;
+        }
+        if (!progress) {
+            vTaskDelay(1);  // Nothing new: let the socket fill
+        }
+    }
+    _xfer.end();
+
+    arenaFree(sentAt);
+    arenaFree(acked);
+    arenaFree(payload);
+    telemetryMgr.recordUpload(ok ? imageSize : 0, ok);
+    uint32_t sends = _xfer.sends();
+    Serial.printf("[XFER] %s: %s, %u chunks in %u sends (%u resent), %u timeouts, %lu ms\n",
+                  imageId, ok ? "acked" : "FAILED", (unsigned)totalChunks, (unsigned)sends,
+                  (unsigned)(sends - min<uint32_t>(sends, _xfer.sent())), _xfer.timeouts(),
+                  millis() - startedAt);
+    return ok;
+}
+
+void MQTTManager::handleXferAck(const uint8_t* frame, size_t len) {
+    if (!_xfer.handleAck(frame, len)) {
+        Serial.println("⚠️ Invalid chunk ack frame");
     }
-    
-    Serial.println("✅ All chunks sent successfully!");
-    return true;
 }
 
 bool MQTTManager::publishStatus(const char* status) {
-    if (!mqttClient.connected()) {
+    if (!isConnected()) {
         return false;
     }
     
@@ -166,18 +322,99 @@ bool MQTTManager::publishStatus(const char* status) {
     return mqttClient.publish(topicStatus, status);
 }
 
+bool MQTTManager::publishAck(const uint8_t* frame, size_t len) {
+    if (!isConnected()) {
+        return false;
+    }
+    return mqttClient.publish(topicAck, frame, len);
+}
+
+bool MQTTManager::publishTelemetry(const uint8_t* frame, size_t len) {
+    if (!isConnected()) {
+        return false;
+    }
+    return mqttClient.publish(topicStatus, frame, len);
+}
+
+bool MQTTManager::publishTaskStats(const char* json, size_t len) {
+    if (!isConnected()) {
+        return false;
+    }
+    return mqttClient.publish(topicTasks, (const uint8_t*)json, len);
+}
+
+bool MQTTManager::setChunkSize(uint16_t bytes) {
+    // Base64 grows 4/3; keep room for the JSON envelope inside the 8KB buffer
+    const uint16_t maxChunk = (MQTT_BUFFER_SIZE - 256) / 4 * 3;
+    if (bytes < 768 || bytes > maxChunk || bytes % 3 != 0) {
+        return false;
+    }
+    _chunkSize = bytes;
+    return true;
+}
+
 bool MQTTManager::isConnected() {
-    return mqttClient.connected();
+    // Never touch the client while the worker task owns it
+    return _state == MQTT_STATE_CONNECTED && mqttClient.connected();
 }
 
 void MQTTManager::loop() {
-    mqttClient.loop();
+    unsigned long startUs = micros();
+
+    switch (_state) {
+        case MQTT_STATE_IDLE:
+            break;
+
+        case MQTT_STATE_BACKOFF:
+            if ((long)(millis() - _nextAttemptAt) >= 0) {
+                if (WiFi.status() == WL_CONNECTED) {
+                    startAttempt();
+                } else {
+                    scheduleRetry(); // No link yet; keep backing off
+                }
+            }
+            break;
+
+        case MQTT_STATE_CONNECTING:
+            if (_attemptDone) {
+                finishAttempt(_attemptResult);
+            }
+            break;
+
+        case MQTT_STATE_CONNECTED:
+            if (!mqttClient.connected()) {
+                Serial.printf("⚠️ MQTT connection lost, rc=%d\n", mqttClient.state());
+                // Probably a broker restart that hit the whole fleet: spread the first retry wide
+                _backoffMs = MQTT_RECONNECT_SPREAD_MS;
+                scheduleRetry();
+            } else {
+                mqttClient.loop();
+            }
+            break;
+    }
+
+    uint32_t elapsed = micros() - startUs;
+    if (elapsed > _maxLoopUs) {
+        _maxLoopUs = elapsed;
+    }
+}
+
+// Dispatch whatever arrived (commands, chunk acks) from inside a long
+// operation. Unlike loop() it leaves the connection state alone, so a
+// transfer in progress never races a reconnect.
+void MQTTManager::pump() {
+    if (_state == MQTT_STATE_CONNECTED && mqttClient.connected()) {
+        mqttClient.loop();
+    }
 }
 
 void MQTTManager::disconnect() {
-    if (mqttClient.connected()) {
+    if (isConnected()) {
         publishStatus("offline");
         mqttClient.disconnect();
         Serial.println("🔌 MQTT disconnected");
     }
+    if (_state != MQTT_STATE_CONNECTING) {
+        _state = MQTT_STATE_IDLE;
+    }
 }
@@ -7,32 +7,100 @@
 #define MQTT_MANAGER_H
 
 #include <PubSubClient.h>
-#include <WiFiClientSecure.h>
+#include "tls_client.h"
+#include "xfer_sender.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "config.h"
+
+// Connection state machine driven by loop()
+enum MqttConnState {
+    MQTT_STATE_IDLE,        // connect() not called yet
+    MQTT_STATE_BACKOFF,     // waiting for next attempt
+    MQTT_STATE_CONNECTING,  // TCP/TLS + MQTT CONNECT running in worker task
+    MQTT_STATE_CONNECTED
+};
 
 class MQTTManager {
 private:
-    WiFiClientSecure wifiClient;
+    TlsClient wifiClient;           // Resumes TLS sessions, checks MQTT_TLS_PINS
     PubSubClient mqttClient;
     const char* broker;
     int port;
     const char* clientId;
     const char* username; // New
     const char* password; // New
-    const char* topicImage;
-    const char* topicStatus;
-    const char* topicCommand;
+    // MQTT_TOPIC_ROOT/<id>/<leaf>, built once in the constructor
+    char topicImage[MQTT_TOPIC_MAX];
+    char topicStatus[MQTT_TOPIC_MAX];
+    char topicCommand[MQTT_TOPIC_MAX];
+    char topicAck[MQTT_TOPIC_MAX];
+    char topicTasks[MQTT_TOPIC_MAX];
+    char topicGroupCommand[MQTT_TOPIC_MAX];   // MQTT_TOPIC_ROOT/group/<MQTT_GROUP>/command
+    char topicAllCommand[MQTT_TOPIC_MAX];     // MQTT_TOPIC_ROOT/all/command
+    char topicRate[MQTT_TOPIC_MAX];           // Rate hints for this camera / the fleet
+    char topicAllRate[MQTT_TOPIC_MAX];
+    char topicXfer[MQTT_TOPIC_MAX];           // Chunk acks for this camera's images
+    uint16_t _chunkSize;            // Raw bytes per chunk in publishImageChunked
+
+    // Reconnect state machine
+    volatile MqttConnState _state;
+    volatile bool _attemptDone;     // Set by worker task when connect() returns
+    volatile bool _attemptResult;
+    TaskHandle_t _connectTask;
+    unsigned long _nextAttemptAt;
+    uint32_t _backoffMs;
+    uint16_t _attempt;
+    unsigned long _attemptStartedAt;
+    uint32_t _maxLoopUs;            // Longest loop() call since last connect attempt
+
+    // Image in flight in publishImageChunked, updated by handleXferAck
+    XferSender _xfer;
+
+    static void connectTaskEntry(void* arg);
+    void startAttempt();
+    void finishAttempt(bool connected);
+    void scheduleRetry();
+    void onConnected();
 
 public:
+    // id empty or NULL: use deviceId()
     MQTTManager(const char* brokerAddr, int brokerPort, const char* id, const char* user = NULL, const char* pass = NULL);
-    bool connect();
+    bool connect();                              // Non-blocking: starts/keeps the state machine running
+    bool waitConnected(uint32_t timeoutMs);      // Blocking helper for setup()
     void setCallback(MQTT_CALLBACK_SIGNATURE); // New callback setter
     bool subscribe(const char* topic); // New subscribe method
     bool publishImage(const uint8_t* imageData, size_t imageSize);
-    bool publishImageChunked(const uint8_t* imageData, size_t imageSize); // New chunked method
+    bool publishImageChunked(const uint8_t* imageData, size_t imageSize,
+                             const char* captureId = nullptr, const char* kind = nullptr,
+                             const char* roi = nullptr, time_t capturedAt = 0,
+                             const char* detection = nullptr); // New chunked method
     bool publishStatus(const char* status);
+    bool publishAck(const uint8_t* frame, size_t len);  // Binary command ack
+    bool publishTelemetry(const uint8_t* frame, size_t len); // CBOR heartbeat on status topic
+    bool publishTaskStats(const char* json, size_t len);     // task_monitor.h report
+    bool setChunkSize(uint16_t bytes);                  // Remote tuning; multiple of 3, fits buffer
+    uint16_t getChunkSize() const { return _chunkSize; }
     bool isConnected();
+    void pump();                                    // Read pending messages; never (re)connects
+    const TlsClient& tls() const { return wifiClient; }
+    bool isCommandTopic(const char* topic) const;  // Device, group or fleet-wide command
+    bool isRateTopic(const char* topic) const;     // rate_limiter.h hint
+    bool isXferTopic(const char* topic) const;     // Chunk acks (handleXferAck)
+
+    /**
+     * Chunk ack from the backend (binary, little-endian):
+     *   [0] 0xB7 magic  [1] version 1  [2] flags (bit 0 = image complete)
+     *   [3] idLen  [4..] image id
+     *   then u16 total, u16 cumAck (all chunks below it arrived),
+     *   u8 rangeCount, rangeCount x (u16 start, u16 end) received ranges above cumAck
+     * Acks for another image id are ignored.
+     */
+    void handleXferAck(const uint8_t* frame, size_t len);
+    const char* getClientId() const { return clientId; }
+    MqttConnState getState() const { return _state; }
     void disconnect();
-    void loop(); // Add loop method
+    void loop(); // Drives reconnects and PubSubClient; never blocks on the network
 };
 
 #endif
@@ -0,0 +1,255 @@
+/**
+ * network_task.cpp - Network owner task implementation
+ */
+
+#include <WiFi.h>
+#include "network_task.h"
+#include "task_plan.h"
+#include "mqtt_manager.h"
+#include "upload_manager.h"
+#include "auth_manager.h"
+#include "storage_manager.h"
+#include "telemetry_manager.h"
+#include "task_monitor.h"
+#include "rate_limiter.h"
+#include "capture_arena.h"
+
+extern MQTTManager mqttMgr;
+extern UploadManager uploadMgr;
+extern AuthManager authMgr;
+extern StorageManager storageMgr;
+
+NetworkTask netTask;
+
+NetworkTask::NetworkTask()
+    : _task(nullptr), _mqttUp(false), _rejected(0), _nextFullUploadAt(0), _fullBudget(0),
+      _syncPass(false), _fetchHead(0), _fetchCount(0) {
+    for (int i = 0; i < NET_PRODUCERS; i++) {
+        _inboxes[i].owner.store(nullptr);
+    }
+}
+
+bool NetworkTask::begin() {
+    if (_task) {
+        return true;
+    }
+    scheduleBacklog(esp_random() % FULL_UPLOAD_START_JITTER_MS);
+    // Pacing waits run on this task: keep MQTT moving through them
+    rateLimiter.onWait([]() { mqttMgr.pump(); });
+    if (xTaskCreatePinnedToCore(taskEntry, "net_task", TASK_NET_STACK, this,
+                                TASK_NET_PRIO, &_task, TASK_NET_CORE) != pdPASS) {
+        _task = nullptr;
+        Serial.println("[NET] Task start failed - network work stays on the callers");
+        return false;
+    }
+    Serial.printf("[NET] Network task on core %d (prio %d), %d inboxes x %d jobs\n",
+                  TASK_NET_CORE, TASK_NET_PRIO, NET_PRODUCERS, NET_INBOX_DEPTH);
+    return true;
+}
+
+void NetworkTask::taskEntry(void* arg) {
+    static_cast<NetworkTask*>(arg)->run();
+}
+
+NetworkTask::Inbox* NetworkTask::inboxFor(TaskHandle_t producer) {
+    for (int i = 0; i < NET_PRODUCERS; i++) {
+        TaskHandle_t owner = _inboxes[i].owner.load(std::memory_order_acquire);
+        if (owner == producer) {
+            return &_inboxes[i];
+        }
+        // Free slot: claim it (another producer may win the race, then keep looking)
+        if (!owner && _inboxes[i].owner.compare_exchange_strong(owner, producer)) {
+            return &_inboxes[i];
+        }
+    }
+    return nullptr;
+}
+
+bool NetworkTask::deliver(NetJob& job) {
+    TaskHandle_t self = xTaskGetCurrentTaskHandle();
+    if (!_task || self == _task) {
+        execute(job);
+        return job.ok;
+    }
+
+    Inbox* inbox = inboxFor(self);
+    job.waiter = self;
+    job.ok = false;
+    if (!inbox || !inbox->jobs.push(&job)) {
+        _rejected.fetch_add(1, std::memory_order_relaxed);
+        Serial.printf("[NET] %s inbox full - job dropped\n", pcTaskGetName(self));
+        return false;
+    }
+    xTaskNotifyGive(_task);
+
+    // Upload timeouts bound every job, and job points at the caller's memory:
+    // wait for the result rather than giving up on it
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    return job.ok;
+}
+
+bool NetworkTask::postAppEvent(AppEvent event, uint8_t arg) {
+    return _events.push((uint16_t)((uint8_t)event | (uint16_t)arg << 8));
+}
+
+bool NetworkTask::takeAppEvent(AppEvent& event, uint8_t& arg) {
+    uint16_t raw;
+    if (!_events.pop(raw)) {
+        return false;
+    }
+    event = (AppEvent)(raw & 0xFF);
+    arg = (uint8_t)(raw >> 8);
+    return true;
+}
+
+void NetworkTask::requestSync() {
+    _syncPass = true;
+    if (_fullBudget == 0) {
+        _nextFullUploadAt = millis();   // Start the pass now instead of at the next interval
+    }
+}
+
+bool NetworkTask::requestFullUpload(const char* captureId) {
+    for (uint8_t i = 0; i < _fetchCount; i++) {
+        if (strcmp(_fetchIds[(_fetchHead + i) % NET_FETCH_DEPTH], captureId) == 0) {
+            return true;    // Already queued
+        }
+    }
+    if (_fetchCount == NET_FETCH_DEPTH) {
+        return false;
+    }
+    char* slot = _fetchIds[(_fetchHead + _fetchCount) % NET_FETCH_DEPTH];
+    strncpy(slot, captureId, sizeof(_fetchIds[0]) - 1);
+    slot[sizeof(_fetchIds[0]) - 1] = '\0';
+    _fetchCount++;
+    return true;
+}
+
+// Oldest fetch_full request; the file is looked up again, it may have moved to /sent
+void NetworkTask::uploadRequested() {
+    const char* captureId = _fetchIds[_fetchHead];
+    String path;
+    if (!storageMgr.findCapture(captureId, path)) {
+        Serial.printf("[NET] fetch_full %s: capture no longer on the card\n", captureId);
+    } else if (!storageMgr.uploadCapture(path, authMgr.getToken(), uploadMgr)) {
+        if (uploadMgr.retryRemainingMs()) {
+            return;     // Dropped mid-file: stays at the head until the resume
+        }
+        Serial.printf("[NET] fetch_full %s: upload failed (file stays queued)\n", captureId);
+    }
+    _fetchHead = (_fetchHead + 1) % NET_FETCH_DEPTH;
+    _fetchCount--;
+}
+
+void NetworkTask::execute(NetJob& job) {
+    if (USE_MQTT && mqttMgr.isConnected()) {
+        job.ok = mqttMgr.publishImageChunked(job.data, job.len, job.captureId, job.kind, job.roi,
+                                             job.capturedAt, job.detection);
+    } else if (job.fb) {
+        job.ok = uploadMgr.upload(job.fb, authMgr.getToken(), nullptr, job.captureId, job.capturedAt,
+                                  job.detection);
+    } else {
+        job.ok = uploadMgr.uploadImage(job.data, job.len, authMgr.getToken(), job.captureId,
+                                       job.kind, job.roi, nullptr, job.capturedAt, job.detection);
+    }
+}
+
+void NetworkTask::pumpMqtt() {
+    if (USE_MQTT) {
+        // Non-blocking: reconnects run with backoff in a worker task
+        mqttMgr.loop();
+        bool up = mqttMgr.isConnected();
+        if (up && !_mqttUp.load(std::memory_order_relaxed)) {
+            // Back after an outage, probably together with the rest of the fleet
+            scheduleBacklog(esp_random() % FULL_UPLOAD_START_JITTER_MS);
+        }
+        _mqttUp.store(up, std::memory_order_relaxed);
+    }
+}
+
+bool NetworkTask::drainInboxes() {
+    bool any = false;
+    for (int i = 0; i < NET_PRODUCERS; i++) {
+        NetJob* job;
+        while (_inboxes[i].jobs.pop(job)) {
+            TaskHandle_t waiter = job->waiter;
+            {
+                // The producer may hold captureArena while it waits: upload scratch comes from ours
+                ArenaScope jobScope(netArena);
+                execute(*job);
+            }
+            xTaskNotifyGive(waiter);    // job may be gone after this
+            pumpMqtt();                 // Keepalive and commands between jobs
+            any = true;
+        }
+    }
+    return any;
+}
+
+void NetworkTask::scheduleBacklog(uint32_t delayMs) {
+    _nextFullUploadAt = millis() + delayMs;
+    _fullBudget = 0;
+}
+
+void NetworkTask::backgroundUpload() {
+    // Deferred full-resolution images, one file per round so MQTT is pumped in between
+    if (WiFi.status() != WL_CONNECTED) {
+        return;
+    }
+    // Images the backend asked for come first
+    if (_fetchCount) {
+        if (!rateLimiter.holdRemainingMs() && !uploadMgr.retryRemainingMs()) {
+            uploadRequested();
+        }
+        return;
+    }
+    if (!THUMBNAIL_FIRST && !_syncPass) {
+        return;
+    }
+    if (_fullBudget == 0) {
+        if (storageMgr.pendingCount() == 0) {
+            _syncPass = false;
+            return;
+        }
+        if ((long)(millis() - _nextFullUploadAt) < 0) {
+            return;
+        }
+        // Interval +-50% so cameras started together drift apart
+        scheduleBacklog(FULL_UPLOAD_INTERVAL_MS / 2 + esp_random() % FULL_UPLOAD_INTERVAL_MS);
+        if (!rateLimiter.backlogAllowed()) {
+            return;     // Held, over budget, or not our turn this pass (a sync waits for the next)
+        }
+        size_t pending = storageMgr.pendingCount();
+        _fullBudget = _syncPass ? (uint16_t)min<size_t>(pending, 0xFFFF) : FULL_UPLOAD_BATCH;
+        _syncPass = false;
+    }
+    if (rateLimiter.holdRemainingMs()) {
+        _fullBudget = 0;    // Server pushed back mid-pass
+        return;
+    }
+    if (uploadMgr.retryRemainingMs()) {
+        return;             // A dropped resumable upload waits for its slot
+    }
+    _fullBudget--;
+    if (storageMgr.flushPendingQueue(authMgr.getToken(), uploadMgr, 1) == 0) {
+        // Dropped mid-file: same file again once the resume is due; otherwise next interval
+        _fullBudget = uploadMgr.retryRemainingMs() ? _fullBudget + 1 : 0;
+    }
+}
+
+void NetworkTask::run() {
+    for (;;) {
+        pumpMqtt();
+        drainInboxes();
+        if (USE_MQTT) {
+            telemetryMgr.loop();
+            taskMonitor.loop();
+        }
+        backgroundUpload();
+
+        // Woken early by deliver(); otherwise poll the MQTT socket
+        if ((_fullBudget == 0 && _fetchCount == 0) || uploadMgr.retryRemainingMs()) {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(NET_IDLE_MS));
+        }
+    }
+}
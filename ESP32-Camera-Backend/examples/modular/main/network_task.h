@@ -0,0 +1,122 @@
+/**
+ * network_task.h - Single owner of the MQTT client and HTTP uploads
+ *
+ * One task (task_plan.h: net_task) drives mqttMgr.loop(), telemetry, the task
+ * report, the background full-image pass and every capture delivery. MQTT
+ * commands are therefore decoded and acked on this task too. Nothing else
+ * touches mqttMgr or uploadMgr once begin() has run.
+ *
+ * Other tasks talk to it through bounded lock-free queues (spsc_queue.h):
+ *   - one job inbox per producer task, claimed on first use; deliver()
+ *     blocks only the caller until its job is done, so the job may point at
+ *     capture-arena memory and the still framebuffer
+ *   - an app-event outbox read by loop(): camera work requested by commands
+ *     (capture, stream on/off) runs on the task that owns the camera
+ *
+ * The task wakes on a notification per posted job and otherwise every
+ * NET_IDLE_MS, so MQTT keepalive and command latency do not depend on what
+ * the capture side is doing.
+ *
+ * Backlog passes start at a random point in FULL_UPLOAD_START_JITTER_MS after
+ * boot or an MQTT reconnect and then every FULL_UPLOAD_INTERVAL_MS +-50%, and
+ * only when rate_limiter.h allows it. The sync_sd and fetch_full commands only
+ * queue work for this pass (still one file per round, MQTT pumped between):
+ * fetch_full ids go first, sync_sd starts a pass now that runs until the
+ * queue is empty. Both wait out a server hold like the rest of the backlog.
+ */
+
+#ifndef NETWORK_TASK_H
+#define NETWORK_TASK_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_camera.h"
+#include "spsc_queue.h"
+#include "config.h"
+
+// One image to send (MQTT chunks when connected, otherwise HTTP)
+struct NetJob {
+    const uint8_t* data;
+    size_t len;
+    camera_fb_t* fb;            // Set for a full frame: raw HTTP body via UploadManager::upload
+    const char* captureId;      // Optional X-Capture-Id / chunk header fields
+    const char* kind;
+    const char* roi;
+    TaskHandle_t waiter;        // Notified when done (filled in by deliver())
+    bool ok;                    // Result, valid once deliver() returns
+    time_t capturedAt;          // Wall clock of captureId (0 = unknown), set after the initializer
+    const char* detection;      // On-device label "person,87" (nullptr = none), likewise
+};
+
+// Camera work requested from the network side, executed by loop()
+enum AppEvent : uint8_t {
+    APP_EVENT_CAPTURE       = 1,
+    APP_EVENT_STREAM_ON     = 2,
+    APP_EVENT_STREAM_OFF    = 3,
+    APP_EVENT_SET_QUALITY   = 4,    // arg: JPEG quality
+    APP_EVENT_SET_FRAMESIZE = 5     // arg: framesize_t
+};
+
+class NetworkTask {
+public:
+    NetworkTask();
+
+    /**
+     * Start the task. Before this, deliver() runs jobs on the caller.
+     */
+    bool begin();
+
+    /**
+     * Hand job to the network task and wait for the result.
+     * Runs inline when called before begin() or from the network task.
+     * @return job.ok; false without sending if the caller's inbox is full.
+     */
+    bool deliver(NetJob& job);
+
+    // Network task -> loop(). false when the outbox is full.
+    bool postAppEvent(AppEvent event, uint8_t arg = 0);
+    bool takeAppEvent(AppEvent& event, uint8_t& arg);
+
+    // Commands (run on this task): served by backgroundUpload(), one file per round
+    void requestSync();
+    bool requestFullUpload(const char* captureId);     // false when the queue is full
+
+    // Cached after every mqttMgr.loop(); safe from any task
+    bool mqttConnected() const { return _mqttUp.load(std::memory_order_relaxed); }
+    bool isRunning() const { return _task != nullptr; }
+    uint32_t rejected() const { return _rejected.load(std::memory_order_relaxed); }
+
+private:
+    struct Inbox {
+        std::atomic<TaskHandle_t> owner;    // Producer task, claimed once
+        SpscQueue<NetJob*, NET_INBOX_DEPTH> jobs;
+    };
+
+    Inbox _inboxes[NET_PRODUCERS];
+    SpscQueue<uint16_t, NET_EVENT_DEPTH> _events;  // event | arg << 8
+    TaskHandle_t _task;
+    std::atomic<bool> _mqttUp;
+    std::atomic<uint32_t> _rejected;
+    unsigned long _nextFullUploadAt;        // millis() of the next backlog pass
+    uint16_t _fullBudget;                   // Background uploads left in this pass
+    bool _syncPass;                         // Next pass drains the whole queue (sync_sd)
+    char _fetchIds[NET_FETCH_DEPTH][32];    // fetch_full capture ids, oldest at _fetchHead
+    uint8_t _fetchHead;
+    uint8_t _fetchCount;
+
+    static void taskEntry(void* arg);
+    void run();
+    Inbox* inboxFor(TaskHandle_t producer);
+    void execute(NetJob& job);
+    bool drainInboxes();
+    void backgroundUpload();
+    void uploadRequested();
+    void scheduleBacklog(uint32_t delayMs);
+    void pumpMqtt();
+};
+
+extern NetworkTask netTask;
+
+#endif // NETWORK_TASK_H
@@ -0,0 +1,109 @@
+/**
+ * rate_limiter.cpp - Server-driven upload pacing implementation
+ */
+
+#include <ArduinoJson.h>
+#include "rate_limiter.h"
+
+RateLimiter rateLimiter;
+
+RateLimiter::RateLimiter()
+    : _bps(0), _burst(0), _tokens(0), _refilledAt(0), _maxConcurrent(0), _devices(0), _holdUntil(0),
+      _service(nullptr) {}
+
+bool RateLimiter::applyHint(const uint8_t* payload, size_t len) {
+    StaticJsonDocument<256> doc;
+    if (deserializeJson(doc, payload, len)) {
+        Serial.println("[RATE] Ignoring malformed hint");
+        return false;
+    }
+
+    _bps = doc["bps"] | _bps;
+    _burst = doc["burst"] | (_burst ? _burst : (int32_t)max<uint32_t>(_bps, RESUMABLE_CHUNK_BYTES));
+    if (_tokens > _burst) {
+        _tokens = _burst;
+    }
+    _maxConcurrent = doc["maxConcurrent"] | _maxConcurrent;
+    _devices = doc["devices"] | _devices;
+    uint32_t retryAfter = doc["retryAfterS"] | 0;
+    if (retryAfter) {
+        holdFor(retryAfter);
+    }
+
+    Serial.printf("[RATE] Hint: %lu B/s (burst %ld), backlog slots %u/%u, hold %lu ms\n",
+                  (unsigned long)_bps, (long)_burst, _maxConcurrent, _devices,
+                  (unsigned long)holdRemainingMs());
+    return true;
+}
+
+void RateLimiter::holdFor(uint32_t seconds) {
+    uint32_t ms = seconds * 1000;
+    uint32_t extra = ms * RATE_HOLD_JITTER_PCT / 100;
+    if (extra) {
+        ms += esp_random() % extra;
+    }
+    // A later, shorter hint does not cut an existing hold short
+    if (ms > holdRemainingMs()) {
+        _holdUntil = millis() + ms;
+        if (!_holdUntil) {
+            _holdUntil = 1;
+        }
+    }
+    Serial.printf("[RATE] Holding uploads for %lu ms\n", (unsigned long)holdRemainingMs());
+}
+
+uint32_t RateLimiter::holdRemainingMs() const {
+    if (!_holdUntil) {
+        return 0;
+    }
+    long left = (long)(_holdUntil - millis());
+    return left > 0 ? (uint32_t)left : 0;
+}
+
+void RateLimiter::refill() {
+    unsigned long now = millis();
+    if (_bps) {
+        int64_t tokens = (int64_t)_tokens + (int64_t)(now - _refilledAt) * _bps / 1000;
+        _tokens = (int32_t)min<int64_t>(tokens, _burst);
+    }
+    _refilledAt = now;
+}
+
+bool RateLimiter::backlogAllowed() {
+    if (holdRemainingMs()) {
+        return false;
+    }
+    refill();
+    if (_bps && _tokens < 0) {
+        return false;
+    }
+    // Random admission: on average maxConcurrent cameras upload their backlog at once
+    if (_maxConcurrent && _devices > _maxConcurrent) {
+        return esp_random() % _devices < _maxConcurrent;
+    }
+    return true;
+}
+
+void RateLimiter::pace(size_t bytes) {
+    if (!_bps) {
+        return;
+    }
+    refill();
+    unsigned long startedAt = millis();
+    while (_tokens < 0) {
+        uint32_t waited = millis() - startedAt;
+        if (waited >= RATE_MAX_WAIT_MS) {
+            break;
+        }
+        uint32_t waitMs = (uint32_t)((int64_t)-_tokens * 1000 / _bps);
+        waitMs = min<uint32_t>(waitMs, RATE_MAX_WAIT_MS - waited);
+        vTaskDelay(pdMS_TO_TICKS(max<uint32_t>(min<uint32_t>(waitMs, RATE_WAIT_SLICE_MS), 1)));
+        if (_service) {
+            _service();
+        }
+        refill();
+    }
+    // Debt is capped at a minute of budget so one huge body cannot stall the backlog for long
+    int64_t tokens = (int64_t)_tokens - (int64_t)bytes;
+    _tokens = (int32_t)max<int64_t>(tokens, -(int64_t)_bps * 60);
+}
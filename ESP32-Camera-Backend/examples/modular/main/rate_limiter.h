@@ -0,0 +1,80 @@
+/**
+ * rate_limiter.h - Server-driven upload pacing
+ *
+ * The backend publishes retained JSON hints on cam/all/rate (fleet) and
+ * cam/<id>/rate (this camera):
+ *
+ *   {"bps":24000,"burst":65536,"maxConcurrent":4,"devices":40,"retryAfterS":0}
+ *
+ *   bps / burst     token bucket for image bytes (MQTT chunks and HTTP bodies);
+ *                   0 = unlimited
+ *   maxConcurrent   fleet-wide backlog uploads the server wants at once; each
+ *                   pass starts with probability maxConcurrent / devices, so
+ *                   the fleet converges on it without coordination
+ *   retryAfterS     hold the backlog (and HTTP uploads) this long, plus a
+ *                   random extra so the fleet does not return in step
+ *
+ * HTTP 429/503 responses feed holdFor() with their Retry-After header.
+ * Used from the network task only (network_task.h): no locking.
+ */
+
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+class RateLimiter {
+public:
+    RateLimiter();
+
+    /**
+     * Apply a hint payload (MQTT). Fields that are missing keep their value.
+     * @return false if the payload is not valid JSON.
+     */
+    bool applyHint(const uint8_t* payload, size_t len);
+
+    /**
+     * Stop HTTP uploads and the backlog for seconds (+ up to RATE_HOLD_JITTER_PCT).
+     */
+    void holdFor(uint32_t seconds);
+    uint32_t holdRemainingMs() const;
+
+    /**
+     * Whether a backlog pass may start now (not held, bucket not in debt,
+     * and this camera drew a maxConcurrent slot).
+     */
+    bool backlogAllowed();
+
+    /**
+     * Wait until the bucket is out of debt (at most RATE_MAX_WAIT_MS), then
+     * charge bytes. The bucket may go negative so a large body is paid for
+     * by waiting before the next one. The wait runs in RATE_WAIT_SLICE_MS
+     * slices with the onWait() service called between them.
+     */
+    void pace(size_t bytes);
+
+    /**
+     * Called between wait slices (the network task pumps MQTT here, so
+     * commands and chunk acks are not held up by pacing). nullptr = sleep only.
+     */
+    void onWait(void (*service)()) { _service = service; }
+
+    uint32_t bytesPerSec() const { return _bps; }
+
+private:
+    uint32_t _bps;
+    int32_t _burst;
+    int32_t _tokens;
+    unsigned long _refilledAt;
+    uint16_t _maxConcurrent;        // 0 = no fleet limit
+    uint16_t _devices;
+    unsigned long _holdUntil;       // millis(); 0 = not held
+    void (*_service)();
+
+    void refill();
+};
+
+extern RateLimiter rateLimiter;
+
+#endif // RATE_LIMITER_H
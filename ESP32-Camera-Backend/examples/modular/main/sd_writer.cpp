@@ -0,0 +1,203 @@
+/**
+ * sd_writer.cpp - Write-behind SD persistence implementation
+ */
+
+#include <SD_MMC.h>
+#include <esp32-hal-psram.h>
+#include <mbedtls/sha256.h>
+#include "esp_heap_caps.h"
+#include "sd_writer.h"
+#include "task_plan.h"
+
+SdWriter sdWriter;
+
+SdWriter::SdWriter()
+    : _block(nullptr), _queue(nullptr), _done(nullptr), _task(nullptr),
+      _nextTicket(0), _lastDone(0), _failedMask(0), _busyFallbacks(0) {
+    _mux = portMUX_INITIALIZER_UNLOCKED;
+    memset(_slots, 0, sizeof(_slots));
+}
+
+bool SdWriter::begin() {
+    if (_task) {
+        return true;
+    }
+    _block = (uint8_t*)heap_caps_aligned_alloc(4, SD_WRITE_BLOCK, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    for (int i = 0; i < SD_WRITE_SLOTS; i++) {
+        _slots[i].data = (uint8_t*)ps_malloc(SD_WRITE_SLOT_SIZE);
+    }
+    _queue = xQueueCreate(SD_WRITE_SLOTS, sizeof(uint8_t));
+    _done = xSemaphoreCreateBinary();
+
+    bool ok = _block && _queue && _done;
+    for (int i = 0; i < SD_WRITE_SLOTS; i++) {
+        ok = ok && _slots[i].data;
+    }
+    if (ok && xTaskCreatePinnedToCore(taskEntry, "sd_writer", TASK_SD_WRITER_STACK, this,
+                                      TASK_SD_WRITER_PRIO, &_task, TASK_SD_WRITER_CORE) != pdPASS) {
+        _task = nullptr;
+        ok = false;
+    }
+    if (!ok) {
+        Serial.println("[SDW] Init failed - SD writes stay synchronous");
+        heap_caps_free(_block);
+        _block = nullptr;
+        for (int i = 0; i < SD_WRITE_SLOTS; i++) {
+            free(_slots[i].data);
+            _slots[i].data = nullptr;
+        }
+        return false;
+    }
+    Serial.printf("[SDW] Write-behind ready: %d x %u KB slots, %u B blocks\n",
+                  SD_WRITE_SLOTS, (unsigned)(SD_WRITE_SLOT_SIZE / 1024), (unsigned)SD_WRITE_BLOCK);
+    return true;
+}
+
+uint32_t SdWriter::submit(const char* path, const uint8_t* data, size_t len,
+                          SdDurableCallback cb, void* ctx) {
+    if (!_task || !path || !data || len == 0 || len > SD_WRITE_SLOT_SIZE ||
+        strlen(path) + 6 > SD_WRITER_PATH_MAX) {   // room for ".part"
+        return 0;
+    }
+
+    int8_t index = -1;
+    uint32_t ticket = 0;
+    portENTER_CRITICAL(&_mux);
+    for (int8_t i = 0; i < SD_WRITE_SLOTS; i++) {
+        if (!_slots[i].busy) {
+            index = i;
+            _slots[i].busy = true;
+            ticket = ++_nextTicket;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&_mux);
+
+    if (index < 0) {
+        _busyFallbacks++;
+        return 0;
+    }
+
+    Slot& slot = _slots[index];
+    memcpy(slot.data, data, len);
+    slot.len = len;
+    slot.ticket = ticket;
+    strncpy(slot.path, path, sizeof(slot.path) - 1);
+    slot.path[sizeof(slot.path) - 1] = '\0';
+    slot.cb = cb;
+    slot.ctx = ctx;
+
+    uint8_t msg = (uint8_t)index;
+    xQueueSend(_queue, &msg, portMAX_DELAY);   // Never blocks: queue depth == slot count
+    return ticket;
+}
+
+uint8_t SdWriter::inFlight() const {
+    uint8_t n = 0;
+    for (int i = 0; i < SD_WRITE_SLOTS; i++) {
+        n += _slots[i].busy ? 1 : 0;
+    }
+    return n;
+}
+
+bool SdWriter::waitDurable(uint32_t ticket, uint32_t timeoutMs) {
+    if (ticket == 0) {
+        return false;
+    }
+    uint32_t start = millis();
+    while (_lastDone < ticket) {
+        uint32_t elapsed = millis() - start;
+        if (elapsed >= timeoutMs) {
+            return false;
+        }
+        xSemaphoreTake(_done, pdMS_TO_TICKS(min<uint32_t>(timeoutMs - elapsed, 50)));
+    }
+    return !(_failedMask & (1UL << (ticket % 32)));
+}
+
+bool SdWriter::drain(uint32_t timeoutMs) {
+    uint32_t last = _nextTicket;
+    if (!_task || last == 0) {
+        return true;
+    }
+    waitDurable(last, timeoutMs);
+    return _lastDone >= last;
+}
+
+void SdWriter::taskEntry(void* arg) {
+    SdWriter* self = static_cast<SdWriter*>(arg);
+    uint8_t index;
+    while (true) {
+        if (xQueueReceive(self->_queue, &index, portMAX_DELAY) == pdTRUE) {
+            self->writeSlot(self->_slots[index]);
+        }
+    }
+}
+
+void SdWriter::writeSlot(Slot& slot) {
+    uint32_t start = millis();
+    SdWriteResult result;
+    result.ticket = slot.ticket;
+    result.path = slot.path;
+    result.len = slot.len;
+    result.ok = false;
+    result.sha256[0] = '\0';
+
+    char partPath[SD_WRITER_PATH_MAX];
+    snprintf(partPath, sizeof(partPath), "%s.part", slot.path);
+
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+
+    File file = SD_MMC.open(partPath, FILE_WRITE);
+    size_t written = 0;
+    if (file) {
+        // Block-aligned offsets: every write but the last covers whole sectors
+        while (written < slot.len) {
+            size_t n = min((size_t)SD_WRITE_BLOCK, slot.len - written);
+            memcpy(_block, slot.data + written, n);
+            mbedtls_sha256_update(&sha, _block, n);
+            size_t w = file.write(_block, n);
+            written += w;
+            if (w != n) {
+                break;
+            }
+        }
+        file.close();
+    }
+
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&sha, digest);
+    mbedtls_sha256_free(&sha);
+
+    if (written == slot.len) {
+        SD_MMC.remove(slot.path);   // Stale copy from an earlier boot
+        result.ok = SD_MMC.rename(partPath, slot.path);
+    }
+    if (result.ok) {
+        static const char hex[] = "0123456789abcdef";
+        for (int i = 0; i < 32; i++) {
+            result.sha256[i * 2] = hex[digest[i] >> 4];
+            result.sha256[i * 2 + 1] = hex[digest[i] & 0x0F];
+        }
+        result.sha256[64] = '\0';
+    } else {
+        Serial.printf("[SDW] Write failed: %s (%u / %u bytes)\n",
+                      slot.path, (unsigned)written, (unsigned)slot.len);
+        SD_MMC.remove(partPath);
+    }
+    result.writeMs = millis() - start;
+
+    if (slot.cb) {
+        slot.cb(result, slot.ctx);
+    }
+
+    uint32_t bit = 1UL << (slot.ticket % 32);
+    portENTER_CRITICAL(&_mux);
+    _failedMask = result.ok ? (_failedMask & ~bit) : (_failedMask | bit);
+    _lastDone = slot.ticket;
+    portEXIT_CRITICAL(&_mux);
+    slot.busy = false;
+    xSemaphoreGive(_done);
+}
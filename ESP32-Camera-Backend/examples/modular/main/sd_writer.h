@@ -0,0 +1,98 @@
+/**
+ * sd_writer.h - Write-behind SD persistence
+ *
+ * submit() copies a record into one of two PSRAM slots and returns at once;
+ * a worker task writes it while the caller gets on with delivery. The task
+ * stages 4 KB blocks in an internal, DMA-capable buffer and writes them at
+ * block-aligned file offsets, so FATFS hands whole sectors to the SDMMC driver
+ * (no per-sector bounce through PSRAM, no read-modify-write).
+ *
+ * Records are written to "<path>.part" and renamed when complete; the
+ * durability callback runs on the writer task after the rename, with the
+ * SHA-256 computed while writing.
+ */
+
+#ifndef SD_WRITER_H
+#define SD_WRITER_H
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "config.h"
+
+#define SD_WRITER_PATH_MAX 64
+
+struct SdWriteResult {
+    uint32_t ticket;
+    const char* path;           // Final path (valid during the callback only)
+    size_t len;
+    bool ok;
+    uint32_t writeMs;           // Open + blocks + close + rename
+    char sha256[65];            // Hex digest of the bytes written ("" on failure)
+};
+
+// Runs on the writer task: keep it short and do not touch the capture arena
+typedef void (*SdDurableCallback)(const SdWriteResult& result, void* ctx);
+
+class SdWriter {
+public:
+    SdWriter();
+
+    /**
+     * Allocate the record slots and bounce buffer, start the task.
+     */
+    bool begin();
+
+    /**
+     * Queue data for path. The data is copied, so the caller may release it.
+     * @return ticket (> 0), or 0 when both slots are busy / record too large
+     *         (the caller should then write synchronously).
+     */
+    uint32_t submit(const char* path, const uint8_t* data, size_t len,
+                    SdDurableCallback cb, void* ctx);
+
+    /**
+     * Block until ticket has been written (or failed).
+     * @return true if the record is on the card.
+     */
+    bool waitDurable(uint32_t ticket, uint32_t timeoutMs);
+
+    /**
+     * Wait for every queued record (before reboot / deep sleep).
+     */
+    bool drain(uint32_t timeoutMs);
+
+    bool isRunning() const { return _task != nullptr; }
+    uint8_t inFlight() const;
+    uint32_t slotsBusyFallbacks() const { return _busyFallbacks; }
+
+private:
+    struct Slot {
+        uint8_t* data;
+        size_t len;
+        uint32_t ticket;
+        char path[SD_WRITER_PATH_MAX];
+        SdDurableCallback cb;
+        void* ctx;
+        volatile bool busy;
+    };
+
+    Slot _slots[SD_WRITE_SLOTS];
+    uint8_t* _block;            // Internal RAM, DMA-capable, SD_WRITE_BLOCK bytes
+    QueueHandle_t _queue;       // Slot indices, FIFO
+    SemaphoreHandle_t _done;    // Given after every record
+    TaskHandle_t _task;
+    uint32_t _nextTicket;
+    volatile uint32_t _lastDone;       // Highest ticket completed (FIFO order)
+    volatile uint32_t _failedMask;     // Bit (ticket % 32) set = that record failed
+    volatile uint32_t _busyFallbacks;
+    portMUX_TYPE _mux;
+
+    static void taskEntry(void* arg);
+    void writeSlot(Slot& slot);
+};
+
+extern SdWriter sdWriter;
+
+#endif // SD_WRITER_H
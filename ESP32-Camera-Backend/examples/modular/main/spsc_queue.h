@@ -0,0 +1,60 @@
+/**
+ * spsc_queue.h - Bounded lock-free single-producer / single-consumer ring
+ *
+ * One task pushes, one task pops; neither ever blocks or takes a lock, so it
+ * is safe between tasks on different cores and at any priority. head is only
+ * written by the consumer, tail only by the producer; acquire/release ordering
+ * publishes the slot contents with the index.
+ *
+ * N must be a power of two. Capacity is N (indices run free and wrap).
+ */
+
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <Arduino.h>
+#include <atomic>
+
+template <typename T, uint32_t N>
+class SpscQueue {
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "SpscQueue size must be a power of two");
+
+public:
+    SpscQueue() : _head(0), _tail(0) {}
+
+    // Producer side. false when full (the item is not queued).
+    bool push(const T& item) {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _head.load(std::memory_order_acquire) >= N) {
+            return false;
+        }
+        _items[tail & (N - 1)] = item;
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. false when empty.
+    bool pop(T& out) {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        out = _items[head & (N - 1)];
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Approximate when called from a third task
+    uint32_t size() const {
+        return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);
+    }
+    bool empty() const { return size() == 0; }
+    static constexpr uint32_t capacity() { return N; }
+
+private:
+    T _items[N];
+    std::atomic<uint32_t> _head;    // Next slot to pop (consumer-owned)
+    std::atomic<uint32_t> _tail;    // Next slot to push (producer-owned)
+};
+
+#endif // SPSC_QUEUE_H
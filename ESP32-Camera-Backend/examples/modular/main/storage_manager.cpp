@@ -8,14 +8,44 @@
 #include <string.h>
 #include <stdio.h>
 #include <esp32-hal-psram.h>
+#include <mbedtls/sha256.h>
 #include "storage_manager.h"
+#include "capture_arena.h"
 
 // Base folders to keep pending and sent images separate.
 static const char* BASE_DIR = "/esp32cam";
 static const char* PENDING_DIR = "/esp32cam/pending";
 static const char* SENT_DIR = "/esp32cam/sent";
+static const char* META_DIR = "/esp32cam/meta";   // <captureId>.sha content hashes
 
-StorageManager::StorageManager() : _sdReady(false) {}
+static const size_t HASH_WRITE_CHUNK = 4096;        // SD write + hash update granularity
+
+static void hashToHex(const uint8_t digest[32], char* out) {
+    static const char hex[] = "0123456789abcdef";
+    for (int i = 0; i < 32; i++) {
+        out[i * 2] = hex[digest[i] >> 4];
+        out[i * 2 + 1] = hex[digest[i] & 0x0F];
+    }
+    out[CONTENT_HASH_HEX_LEN] = '\0';
+}
+
+StorageManager::StorageManager()
+    : _sdReady(false), _pendingCount(0), _lastTicket(0),
+      _replayBoot(0), _replaySeq(0), _replayValid(false) {
+    _lastHash[0] = '\0';
+    memset(&_lastRecord, 0, sizeof(_lastRecord));
+    _mux = portMUX_INITIALIZER_UNLOCKED;
+    memset(_inFlight, 0, sizeof(_inFlight));
+}
+
+static bool hasSuffix(const char* path, const char* suffix) {
+    size_t len = strlen(path), n = strlen(suffix);
+    return len > n && strcmp(path + len - n, suffix) == 0;
+}
+
+static bool isQueuedImage(const char* path) {
+    return hasSuffix(path, ".jpg");
+}
 
 bool StorageManager::begin() {
     Serial.println("\n[0/6] Mounting SD card...");
@@ -38,6 +68,12 @@ bool StorageManager::begin() {
             uint8_t cardType = SD_MMC.cardType();
             uint64_t sizeMB = SD_MMC.cardSize() / (1024ULL * 1024ULL);
             Serial.printf("[SD] Type=%u Size=%lluMB\n", cardType, sizeMB);
+            size_t pending = countPending();
+            portENTER_CRITICAL(&_mux);
+            _pendingCount = pending;
+            portEXIT_CRITICAL(&_mux);
+            Serial.printf("[SD] Pending queue: %u files\n", (unsigned)_pendingCount);
+            sdWriter.begin();
         }
     } else {
         Serial.println("[WARN] SD mount failed - offline queue disabled");
@@ -63,46 +99,214 @@ bool StorageManager::ensureDirectories() {
         Serial.println("[WARN] Unable to create sent directory");
         return false;
     }
+    if (!SD_MMC.exists(META_DIR) && !SD_MMC.mkdir(META_DIR)) {
+        Serial.println("[WARN] Unable to create meta directory");
+        return false;
+    }
     Serial.println("[OK] SD ready for offline queue");
     return true;
 }
 
-String StorageManager::buildPendingPath() const {
-    time_t now = time(nullptr);
-    char filename[32];
-    if (now > 0) {
-        strftime(filename, sizeof(filename), "%Y%m%d_%H%M%S.jpg", localtime(&now));
-    } else {
-        snprintf(filename, sizeof(filename), "capture_%lu.jpg", millis());
-    }
-    String path = String(PENDING_DIR) + "/" + filename;
-    return path;
+String StorageManager::buildPendingPath(const char* captureId) const {
+    return String(PENDING_DIR) + "/" + captureId + ".jpg";
 }
 
 bool StorageManager::savePendingFrame(const camera_fb_t* fb) {
     if (!_sdReady || !fb || !fb->buf || fb->len == 0) {
         return false;
     }
+    return writePendingFrame(fb, captureSeq.next());
+}
 
-    String path = buildPendingPath();
+bool StorageManager::writePendingFrame(const camera_fb_t* fb, const CaptureRecord& rec) {
+    String path = buildPendingPath(rec.id);
     File file = SD_MMC.open(path, FILE_WRITE);
     if (!file) {
         Serial.println("[WARN] Failed to open pending file for write");
         return false;
     }
 
-    size_t written = file.write(fb->buf, fb->len);
+    // Hash exactly the bytes that reach the card, chunk by chunk
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    size_t written = 0;
+    while (written < fb->len) {
+        size_t n = min(HASH_WRITE_CHUNK, fb->len - written);
+        size_t w = file.write(fb->buf + written, n);
+        mbedtls_sha256_update(&sha, fb->buf + written, w);
+        written += w;
+        if (w != n) {
+            break;
+        }
+    }
     file.close();
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&sha, digest);
+    mbedtls_sha256_free(&sha);
 
     if (written == fb->len) {
-        Serial.printf("[QUEUE] Saved image: %s (%u bytes)\n",
-                      path.c_str(), fb->len);
+        hashToHex(digest, _lastHash);
+        writeHash(path, _lastHash);
+        Serial.printf("[QUEUE] Saved image: %s (%u bytes, sha256 %.12s)\n",
+                      path.c_str(), fb->len, _lastHash);
         _lastPath = path; // Store path
+        _lastRecord = rec;
+        adjustPending(1);
         return true;
     }
     return false;
 }
 
+uint32_t StorageManager::savePendingFrameAsync(const camera_fb_t* fb) {
+    if (!_sdReady || !fb || !fb->buf || fb->len == 0) {
+        return 0;
+    }
+
+    CaptureRecord rec = captureSeq.next();
+    String path = buildPendingPath(rec.id);
+
+    // Initialise the record before the writer can call onDurable() for it
+    InFlightRecord* flight = nullptr;
+    portENTER_CRITICAL(&_mux);
+    for (int i = 0; i < SD_WRITE_SLOTS; i++) {
+        if (!_inFlight[i].used) {
+            flight = &_inFlight[i];
+            *flight = { this, 0, true, false };
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&_mux);
+
+    uint32_t ticket = flight ? sdWriter.submit(path.c_str(), fb->buf, fb->len, onDurable, flight) : 0;
+    if (ticket == 0) {
+        if (flight) {
+            portENTER_CRITICAL(&_mux);
+            flight->used = false;
+            portEXIT_CRITICAL(&_mux);
+        }
+        Serial.println("[SDW] No write slot free - saving synchronously");
+        return writePendingFrame(fb, rec) ? SAVE_TICKET_SYNC : 0;
+    }
+
+    // Already durable (and released) if the writer beat us here: markDelivered()
+    // then finds no record and moves the file itself
+    portENTER_CRITICAL(&_mux);
+    if (flight->used) {
+        flight->ticket = ticket;
+    }
+    portEXIT_CRITICAL(&_mux);
+    _lastPath = path;
+    _lastRecord = rec;
+    _lastHash[0] = '\0';
+    _lastTicket = ticket;
+    return ticket;
+}
+
+void StorageManager::onDurable(const SdWriteResult& result, void* ctx) {
+    InFlightRecord* flight = static_cast<InFlightRecord*>(ctx);
+    StorageManager* self = flight->owner;
+    if (!result.ok) {
+        portENTER_CRITICAL(&self->_mux);
+        flight->used = false;
+        portEXIT_CRITICAL(&self->_mux);
+        Serial.printf("[SDW] %s NOT saved - only the preview/upload exists\n", result.path);
+        return;
+    }
+    self->writeHash(result.path, result.sha256);
+    if (result.ticket == self->_lastTicket) {
+        memcpy(self->_lastHash, result.sha256, sizeof(self->_lastHash));
+    }
+
+    self->adjustPending(1);
+    bool delivered;
+    portENTER_CRITICAL(&self->_mux);
+    delivered = flight->delivered;
+    flight->used = false;
+    flight->ticket = 0;
+    portEXIT_CRITICAL(&self->_mux);
+
+    Serial.printf("[SDW] %s durable: %u B in %lu ms (sha256 %.12s)\n",
+                  result.path, (unsigned)result.len, (unsigned long)result.writeMs, result.sha256);
+    if (delivered) {
+        self->moveToSent(String(result.path));
+    }
+}
+
+void StorageManager::markDelivered(uint32_t ticket, const String& path) {
+    if (ticket == 0) {
+        return;
+    }
+    bool durable = true;
+    if (ticket != SAVE_TICKET_SYNC) {
+        portENTER_CRITICAL(&_mux);
+        for (int i = 0; i < SD_WRITE_SLOTS; i++) {
+            if (_inFlight[i].used && _inFlight[i].ticket == ticket) {
+                _inFlight[i].delivered = true;   // onDurable() moves it
+                durable = false;
+                break;
+            }
+        }
+        portEXIT_CRITICAL(&_mux);
+    }
+    if (durable) {
+        moveToSent(path);
+    }
+}
+
+String StorageManager::hashPath(const String& path) const {
+    char captureId[32];
+    captureIdFromPath(path, captureId, sizeof(captureId));
+    return String(META_DIR) + "/" + captureId + ".sha";
+}
+
+bool StorageManager::writeHash(const String& path, const char* hex) {
+    File meta = SD_MMC.open(hashPath(path), FILE_WRITE);
+    if (!meta) {
+        Serial.println("[WARN] Failed to write content hash sidecar");
+        return false;
+    }
+    size_t written = meta.write((const uint8_t*)hex, CONTENT_HASH_HEX_LEN);
+    meta.close();
+    return written == CONTENT_HASH_HEX_LEN;
+}
+
+bool StorageManager::contentHash(const String& path, char* out) {
+    if (!_sdReady) {
+        return false;
+    }
+    File meta = SD_MMC.open(hashPath(path), FILE_READ);
+    if (meta) {
+        size_t readBytes = meta.read((uint8_t*)out, CONTENT_HASH_HEX_LEN);
+        meta.close();
+        if (readBytes == CONTENT_HASH_HEX_LEN) {
+            out[CONTENT_HASH_HEX_LEN] = '\0';
+            return true;
+        }
+    }
+
+    // Queued before hashes existed (or sidecar lost): hash the file once
+    File file = SD_MMC.open(path, FILE_READ);
+    if (!file) {
+        return false;
+    }
+    uint8_t chunk[512];
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    size_t n;
+    while ((n = file.read(chunk, sizeof(chunk))) > 0) {
+        mbedtls_sha256_update(&sha, chunk, n);
+    }
+    file.close();
+    uint8_t digest[32];
+    mbedtls_sha256_finish(&sha, digest);
+    mbedtls_sha256_free(&sha);
+    hashToHex(digest, out);
+    writeHash(path, out);
+    return true;
+}
+
 // New method to move file from pending to sent
 bool StorageManager::moveToSent(const String& pendingPath) {
     if (!_sdReady) return false;
@@ -112,6 +316,7 @@ bool StorageManager::moveToSent(const String& pendingPath) {
     
     if (SD_MMC.rename(pendingPath, sentPath)) {
         Serial.printf("[SD] Moved to sent: %s\n", sentPath.c_str());
+        adjustPending(-1);
         return true;
     } else {
         Serial.println("[SD] Failed to move file to sent");
@@ -119,6 +324,63 @@ bool StorageManager::moveToSent(const String& pendingPath) {
     }
 }
 
+void StorageManager::adjustPending(int delta) {
+    portENTER_CRITICAL(&_mux);
+    if (delta > 0) {
+        _pendingCount += delta;
+    } else if (_pendingCount >= (size_t)-delta) {
+        _pendingCount -= (size_t)-delta;
+    } else {
+        _pendingCount = 0;
+    }
+    portEXIT_CRITICAL(&_mux);
+}
+
+// Called at boot only: every leftover .part is a write cut short by a reset.
+// Other files are counted if queued images and otherwise left alone
+size_t StorageManager::countPending() {
+    // One per write slot normally; rescan if a card somehow holds more
+    size_t count = 0;
+    for (int pass = 0; pass < 8; pass++) {
+        File dir = SD_MMC.open(PENDING_DIR);
+        if (!dir) {
+            return 0;
+        }
+        count = 0;
+        String interrupted[SD_WRITE_SLOTS];     // Removed once the directory is closed
+        int found = 0;
+        bool more = false;
+        File entry = dir.openNextFile();
+        while (entry) {
+            if (!entry.isDirectory()) {
+                if (isQueuedImage(entry.path())) {
+                    count++;
+                } else if (hasSuffix(entry.path(), ".part")) {
+                    if (found < SD_WRITE_SLOTS) {
+                        interrupted[found++] = entry.path();
+                    } else {
+                        more = true;
+                    }
+                }
+            }
+            entry.close();
+            entry = dir.openNextFile();
+        }
+        dir.close();
+        for (int i = 0; i < found; i++) {
+            Serial.printf("[SD] Removing interrupted write %s\n", interrupted[i].c_str());
+            if (!SD_MMC.remove(interrupted[i])) {
+                Serial.printf("[WARN] Failed to remove %s\n", interrupted[i].c_str());
+                more = false;
+            }
+        }
+        if (!more) {
+            break;
+        }
+    }
+    return count;
+}
+
 bool StorageManager::hasPending() {
     if (!_sdReady) return false;
     File root = SD_MMC.open(PENDING_DIR);
@@ -164,7 +426,7 @@ bool StorageManager::getPendingSummary(PendingSummary& summary) {
 
     File entry = dir.openNextFile();
     while (entry) {
-        if (!entry.isDirectory()) {
+        if (!entry.isDirectory() && isQueuedImage(entry.path())) {
             summary.count++;
             String path = String(entry.path());
             time_t ts = entry.getLastWrite();
@@ -187,103 +449,247 @@ bool StorageManager::getPendingSummary(PendingSummary& summary) {
     return summary.count > 0;
 }
 
-size_t StorageManager::flushPendingQueue(const String& token,
-                                         UploadManager& uploader,
-                                         size_t maxFiles,
-                                         PendingUploadCallback onFileStart) {
-    if (!_sdReady || maxFiles == 0) {
-        return 0;
-    }
+bool StorageManager::scanOldestPending(String& path) {
     File dir = SD_MMC.open(PENDING_DIR);
     if (!dir) {
         Serial.println("[WARN] Cannot open pending directory");
-        return 0;
+        return false;
     }
 
-    Serial.println("[QUEUE] Checking pending files on SD...");
-    size_t uploadedCount = 0;
+    // One pass, no sort: the smallest id wins; older timestamp-named files go first
+    String oldest;
+    String legacy;
+    uint32_t bestBoot = UINT32_MAX, bestSeq = UINT32_MAX;
     File entry = dir.openNextFile();
     while (entry) {
-        if (uploadedCount >= maxFiles) {
-            entry.close();
-            break;
+        if (!entry.isDirectory() && isQueuedImage(entry.path())) {
+            char id[32];
+            captureIdFromPath(entry.path(), id, sizeof(id));
+            uint32_t boot, seq;
+            if (!CaptureSequence::parse(id, boot, seq)) {
+                if (legacy.length() == 0) {
+                    legacy = entry.path();
+                }
+            } else if (boot < bestBoot || (boot == bestBoot && seq < bestSeq)) {
+                bestBoot = boot;
+                bestSeq = seq;
+                oldest = entry.path();
+            }
         }
+        entry.close();
+        entry = dir.openNextFile();
+    }
+    dir.close();
 
-        if (!entry.isDirectory()) {
-            size_t size = entry.size();
-            String path = String(entry.path());
-            Serial.printf("[QUEUE] Retrying file: %s (%u bytes)\n",
-                          path.c_str(), (unsigned)size);
-
-            if (size == 0) {
-                Serial.println("[QUEUE] Removing zero-byte pending file");
-                entry.close();
-                SD_MMC.remove(path);
-                entry = dir.openNextFile();
-                continue;
-            }
+    if (legacy.length()) {
+        path = legacy;
+        _replayValid = false;       // Rescan after it; there are only a few
+        return true;
+    }
+    if (oldest.length() == 0) {
+        _replayValid = false;
+        return false;
+    }
+    _replayBoot = bestBoot;
+    _replaySeq = bestSeq;
+    _replayValid = true;
+    path = oldest;
+    return true;
+}
 
-            if (onFileStart) {
-                onFileStart(uploadedCount, path);
+bool StorageManager::nextPending(String& path) {
+    // Ids are issued in order, so the oldest pending file is found by walking
+    // ids from the last one replayed. Gaps (captures delivered live, writes
+    // still in flight) cost one lookup each; a long gap, the end of a boot or
+    // the live tail falls back to a directory scan.
+    if (_replayValid) {
+        char candidate[80];
+        char id[CAPTURE_ID_LEN];
+        for (int probe = 0; probe < REPLAY_MAX_PROBES; probe++) {
+            if (_replayBoot == captureSeq.boot() && _replaySeq > captureSeq.lastSeq()) {
+                break;
+            }
+            CaptureSequence::format(_replayBoot, _replaySeq, id, sizeof(id));
+            snprintf(candidate, sizeof(candidate), "%s/%s.jpg", PENDING_DIR, id);
+            if (SD_MMC.exists(candidate)) {
+                path = candidate;
+                return true;
             }
+            _replaySeq++;
+        }
+    }
+    return scanOldestPending(path);
+}
 
-            entry.close();
+void StorageManager::skipPending() {
+    // Leave a file that cannot be read for the next rescan
+    if (_replayValid) {
+        _replaySeq++;
+    }
+}
 
-            File fileToUpload = SD_MMC.open(path, FILE_READ);
-            if (!fileToUpload) {
-                Serial.println("[WARN] Failed to re-open file for upload");
-                entry = dir.openNextFile();
-                continue;
-            }
+time_t StorageManager::fileCapturedAt(File& file) {
+    // FATFS stamps files from the system clock, which is only meaningful once SNTP set it
+    time_t written = file.getLastWrite();
+    return written >= CLOCK_VALID_AFTER ? written : 0;
+}
 
-            size_t fileSize = fileToUpload.size();
-            if (fileSize == 0) {
-                Serial.println("[WARN] Pending file empty after reopen - deleting");
-                fileToUpload.close();
-                SD_MMC.remove(path);
-                entry = dir.openNextFile();
-                continue;
-            }
+size_t StorageManager::flushPendingQueue(const String& token,
+                                         UploadManager& uploader,
+                                         size_t maxFiles,
+                                         PendingUploadCallback onFileStart) {
+    if (!_sdReady || maxFiles == 0) {
+        return 0;
+    }
 
-            uint8_t* buffer = (uint8_t*)ps_malloc(fileSize);
-            if (!buffer) {
-                buffer = (uint8_t*)malloc(fileSize);
-            }
+    Serial.println("[QUEUE] Checking pending files on SD...");
+    size_t uploadedCount = 0;
+    // Every file is looked at once at most, even if it keeps being skipped
+    size_t budget = _pendingCount + 1;
+    String path;
+    while (uploadedCount < maxFiles && budget-- > 0 && nextPending(path)) {
+        File fileToUpload = SD_MMC.open(path, FILE_READ);
+        if (!fileToUpload) {
+            Serial.println("[WARN] Failed to re-open file for upload");
+            skipPending();
+            continue;
+        }
 
-            if (!buffer) {
-                Serial.println("[WARN] Insufficient memory to upload pending file");
-                fileToUpload.close();
-                // Stop processing more files; try next wake when memory available
-                break;
-            }
+        size_t fileSize = fileToUpload.size();
+        time_t capturedAt = fileCapturedAt(fileToUpload);
+        Serial.printf("[QUEUE] Retrying file: %s (%u bytes)\n",
+                      path.c_str(), (unsigned)fileSize);
+        if (fileSize == 0) {
+            Serial.println("[QUEUE] Removing zero-byte pending file");
+            fileToUpload.close();
+            if (SD_MMC.remove(path)) adjustPending(-1);
+            continue;
+        }
+
+        if (onFileStart) {
+            onFileStart(uploadedCount, path);
+        }
 
-            size_t readBytes = fileToUpload.read(buffer, fileSize);
+        // Uploaded before a reboot / failed rename: one round trip, no body
+        char hash[CONTENT_HASH_HEX_LEN + 1];
+        bool haveHash = contentHash(path, hash);
+        if (haveHash && uploader.hasUpload(hash, token)) {
+            Serial.println("[QUEUE] Server already has this file - moving to /sent");
             fileToUpload.close();
+            moveToSent(path);
+            uploadedCount++;
+            continue;
+        }
 
-            if (readBytes != fileSize) {
-                Serial.println("[WARN] Failed to read full pending file into memory");
-                free(buffer);
-                entry = dir.openNextFile();
-                continue;
-            }
+        // Per-file arena scope: buffer and upload scratch are released together
+        ArenaScope fileScope(netArena);
+        uint8_t* buffer = (uint8_t*)arenaAlloc(fileSize);
+
+        if (!buffer) {
+            Serial.println("[WARN] Insufficient memory to upload pending file");
+            fileToUpload.close();
+            // Stop processing more files; try next wake when memory available
+            break;
+        }
 
-            bool uploaded = uploader.uploadImage(buffer, fileSize, token);
-            free(buffer);
+        size_t readBytes = fileToUpload.read(buffer, fileSize);
+        fileToUpload.close();
 
-            if (uploaded) {
-                Serial.println("[OK] Pending file uploaded (streamed) - moving to /sent");
-                moveToSent(path);
-                uploadedCount++;
-            } else {
-                Serial.println("[WARN] Upload failed (streamed) - keeping file in queue");
-                // Stop retrying further files this wake to save power
-                break;
-            }
+        if (readBytes != fileSize) {
+            Serial.println("[WARN] Failed to read full pending file into memory");
+            arenaFree(buffer);
+            skipPending();
+            continue;
+        }
+
+        // Full image for a thumbnail sent earlier (backend pairs them by id)
+        char captureId[32];
+        captureIdFromPath(path, captureId, sizeof(captureId));
+        bool uploaded = uploadStored(uploader, buffer, fileSize, token, captureId,
+                                     haveHash ? hash : nullptr, capturedAt);
+        arenaFree(buffer);
+
+        if (uploaded) {
+            Serial.println("[OK] Pending file uploaded (streamed) - moving to /sent");
+            moveToSent(path);
+            uploadedCount++;
         } else {
-            entry.close();
+            Serial.println("[WARN] Upload failed (streamed) - keeping file in queue");
+            // Stop retrying further files this wake to save power
+            break;
         }
-        entry = dir.openNextFile();
     }
-    dir.close();
     return uploadedCount;
 }
+
+bool StorageManager::uploadStored(UploadManager& uploader, const uint8_t* buf, size_t len,
+                                  const String& token, const char* captureId, const char* hash,
+                                  time_t capturedAt) {
+    // Large backlog files go out in ranges so a drop near the end costs little
+    if (RESUMABLE_UPLOADS && hash && len >= RESUMABLE_MIN_BYTES) {
+        return uploader.uploadResumable(buf, len, token, hash, captureId, "full", capturedAt);
+    }
+    return uploader.uploadImage(buf, len, token, captureId, "full", nullptr, hash, capturedAt);
+}
+
+void StorageManager::captureIdFromPath(const String& path, char* out, size_t outSize) {
+    const char* name = path.c_str();
+    const char* base = strrchr(name, '/');
+    base = base ? base + 1 : name;
+    const char* dot = strrchr(base, '.');
+    size_t len = dot ? (size_t)(dot - base) : strlen(base);
+    if (len >= outSize) {
+        len = outSize - 1;
+    }
+    memcpy(out, base, len);
+    out[len] = '\0';
+}
+
+bool StorageManager::findCapture(const char* captureId, String& path) {
+    if (!_sdReady || !captureId || !*captureId) {
+        return false;
+    }
+    char candidate[80];
+    snprintf(candidate, sizeof(candidate), "%s/%s.jpg", PENDING_DIR, captureId);
+    if (SD_MMC.exists(candidate)) {
+        path = candidate;
+        return true;
+    }
+    snprintf(candidate, sizeof(candidate), "%s/%s.jpg", SENT_DIR, captureId);
+    if (SD_MMC.exists(candidate)) {
+        path = candidate;
+        return true;
+    }
+    return false;
+}
+
+bool StorageManager::uploadCapture(const String& path, const String& token, UploadManager& uploader) {
+    File file = SD_MMC.open(path, FILE_READ);
+    if (!file) {
+        return false;
+    }
+    size_t fileSize = file.size();
+    time_t capturedAt = fileCapturedAt(file);
+
+    ArenaScope fileScope(netArena);
+    uint8_t* buffer = fileSize ? (uint8_t*)arenaAlloc(fileSize) : nullptr;
+    size_t readBytes = buffer ? file.read(buffer, fileSize) : 0;
+    file.close();
+    if (!buffer || readBytes != fileSize) {
+        arenaFree(buffer);
+        return false;
+    }
+
+    char captureId[32];
+    captureIdFromPath(path, captureId, sizeof(captureId));
+    char hash[CONTENT_HASH_HEX_LEN + 1];
+    bool haveHash = contentHash(path, hash);
+    bool uploaded = uploadStored(uploader, buffer, fileSize, token, captureId,
+                                 haveHash ? hash : nullptr, capturedAt);
+    arenaFree(buffer);
+
+    if (uploaded && path.startsWith(PENDING_DIR)) {
+        moveToSent(path);
+    }
+    return uploaded;
+}
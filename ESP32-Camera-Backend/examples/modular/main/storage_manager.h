@@ -11,6 +11,11 @@
 #include <time.h>
 #include "esp_camera.h"
 #include "upload_manager.h"
+#include "sd_writer.h"
+#include "capture_sequence.h"
+
+#define CONTENT_HASH_HEX_LEN 64   // SHA-256 as lowercase hex
+#define SAVE_TICKET_SYNC UINT32_MAX   // savePendingFrameAsync() wrote synchronously
 
 typedef void (*PendingUploadCallback)(size_t index, const String& path);
 
@@ -36,11 +41,30 @@ public:
     bool isReady() const;
 
     /**
-     * Persist the provided framebuffer into /pending with a timestamped name.
+     * Persist the provided framebuffer into /pending as "<captureId>.jpg",
+     * with a fresh id from capture_sequence.h (see lastRecord()).
      * Used when uploads fail so the image can be retried later.
+     * The SHA-256 of the file is computed while writing and kept in a
+     * sidecar under /meta (see lastHash()).
      */
     bool savePendingFrame(const camera_fb_t* fb);
 
+    /**
+     * Same as savePendingFrame(), but through the write-behind task so the
+     * upload can start while the card is busy. getLastPath() is valid at once;
+     * lastHash() once the record is durable. Falls back to a synchronous write
+     * when no write slot is free.
+     * @return ticket for markDelivered(), SAVE_TICKET_SYNC if already on the
+     *         card, 0 on failure.
+     */
+    uint32_t savePendingFrameAsync(const camera_fb_t* fb);
+
+    /**
+     * The record behind ticket has been delivered: it moves to /sent as soon
+     * as it is durable (immediately if it already is).
+     */
+    void markDelivered(uint32_t ticket, const String& path);
+
     /**
      * @return true if there are any files waiting in /pending.
      */
@@ -58,7 +82,8 @@ public:
     bool getPendingSummary(PendingSummary& summary);
 
     /**
-     * Iterate files in /pending, attempt upload, move to /sent on success.
+     * Upload files in /pending oldest-first (capture id order), moving each
+     * to /sent on success. Stops at the first failure.
      * Returns number of files uploaded during this pass.
      */
     size_t flushPendingQueue(const String& token,
@@ -71,18 +96,94 @@ public:
      */
     String getLastPath() const { return _lastPath; }
 
+    /**
+     * @return id and wall-clock time of the last saved capture.
+     */
+    const CaptureRecord& lastRecord() const { return _lastRecord; }
+
+    /**
+     * @return hex SHA-256 of the last saved file ("" if none).
+     */
+    const char* lastHash() const { return _lastHash; }
+
+    /**
+     * Content hash of a stored capture from its sidecar; files queued
+     * without one are hashed from the card (and the sidecar is written).
+     * @param out buffer of at least CONTENT_HASH_HEX_LEN + 1 bytes
+     */
+    bool contentHash(const String& path, char* out);
+
     /**
      * Move a file from the pending folder to the sent folder.
      * @return true on success, false on failure.
      */
     bool moveToSent(const String& pendingPath);
 
+    /**
+     * Locate a capture by id (file name without .jpg) in /pending, then /sent.
+     * @return true and the full path when found.
+     */
+    bool findCapture(const char* captureId, String& path);
+
+    /**
+     * Upload one stored capture as the full-resolution image for captureId.
+     * Pending files are moved to /sent on success.
+     */
+    bool uploadCapture(const String& path, const String& token, UploadManager& uploader);
+
+    /**
+     * Capture id used by the backend to pair thumbnail and full image:
+     * the file name without directory and extension.
+     */
+    static void captureIdFromPath(const String& path, char* out, size_t outSize);
+
+    /**
+     * @return number of files in /pending (counted at begin(), then tracked).
+     */
+    size_t pendingCount() const { return _pendingCount; }
+
 private:
     bool _sdReady;
+    volatile size_t _pendingCount;     // Written under _mux only
+    size_t countPending();
+    void adjustPending(int delta);     // Under _mux: loop, net_task and the SD writer all update it
     String _lastPath; // Store last saved path
+    CaptureRecord _lastRecord;
+    char _lastHash[CONTENT_HASH_HEX_LEN + 1];
+
+    // Records between submit and durable; whichever of "delivered" and
+    // "durable" happens second moves the file to /sent. Reserved before
+    // submit() and handed to the writer as the callback context, so
+    // onDurable() never looks one up by a ticket it may not hold yet
+    struct InFlightRecord {
+        StorageManager* owner;
+        uint32_t ticket;    // 0 until submit() returns
+        bool used;
+        bool delivered;
+    };
+    InFlightRecord _inFlight[SD_WRITE_SLOTS];
+    volatile uint32_t _lastTicket;     // Ticket behind _lastPath
+    portMUX_TYPE _mux;
+
+    // Replay cursor: the next capture id expected in /pending
+    uint32_t _replayBoot;
+    uint32_t _replaySeq;
+    bool _replayValid;
+
+    static void onDurable(const SdWriteResult& result, void* ctx);
     bool ensureDirectories();
-    String buildPendingPath() const;
+    String buildPendingPath(const char* captureId) const;
+    bool writePendingFrame(const camera_fb_t* fb, const CaptureRecord& rec);
+    bool nextPending(String& path);
+    bool scanOldestPending(String& path);
+    void skipPending();
+    static time_t fileCapturedAt(File& file);
     time_t timestampFromFilename(const String& path) const;
+    String hashPath(const String& path) const;
+    bool writeHash(const String& path, const char* hex);
+    static bool uploadStored(UploadManager& uploader, const uint8_t* buf, size_t len,
+                             const String& token, const char* captureId, const char* hash,
+                             time_t capturedAt);
 };
 
 #endif // STORAGE_MANAGER_H
@@ -1,15 +1,29 @@
 #include "stream_manager.h"
 #include "Arduino.h"
 #include "camera_manager.h" 
+#include "telemetry_manager.h"
+#include "frame_cache.h"
+#include "frame_pipeline.h"
+#include "task_plan.h"
+#include "network_task.h"
+#include "storage_manager.h"
+#include <WiFi.h>
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
 
 extern CameraManager cameraMgr; 
-extern volatile bool captureRequested; 
-
+extern StorageManager storageMgr;
 // Define global streaming state here
-volatile bool isStreaming = false;
+std::atomic<bool> isStreaming(false);
 
-// Initialize static callback
-CaptureCallback StreamManager::captureCb = NULL;
+SpscQueue<uint8_t, 4> StreamManager::captureRequests;
+std::atomic<bool> StreamManager::capturing(false);
+uint8_t* StreamManager::stillBuf = NULL;
+camera_fb_t StreamManager::stillFrame;
+std::atomic<bool> StreamManager::stillReady(false);
+std::atomic<bool> StreamManager::active(false);
+std::atomic<bool> StreamManager::stopRequested(false);
+volatile uint8_t StreamManager::maxFps = 0;
 
 #define PART_BOUNDARY "123456789000000000000987654321"
 static const char* _STREAM_CONTENT_TYPE = "multipart/x-mixed-replace;boundary=" PART_BOUNDARY;
@@ -18,67 +32,228 @@ static const char* _STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %
 
 StreamManager::StreamManager() {
     stream_httpd = NULL;
+    control_httpd = NULL;
+    client.fd = -1;
+}
+
+bool StreamManager::requestCapture() {
+    return captureRequests.push(1);
+}
+
+bool StreamManager::capturePending() {
+    return capturing.load() || !captureRequests.empty();
+}
+
+camera_fb_t* StreamManager::takeStill() {
+    return stillReady.load() ? &stillFrame : NULL;
+}
+
+void StreamManager::releaseStill() {
+    stillReady = false;
+}
+
+// Runs on the stream task, which owns the camera while a client is connected.
+// Only the copy is made here: the sensor goes back to the stream profile
+// right away and loop() does the SD write, detection and upload.
+// Called only while stillReady is false.
+void StreamManager::handleCaptureRequest() {
+    capturing = true;
+    Serial.println("📸 Stream Task: Handling capture request...");
+    camera_fb_t* still = cameraMgr.captureStill();
+    if (!still) {
+        telemetryMgr.recordError();
+    } else if (!stillBuf || still->len > STILL_COPY_SIZE) {
+        Serial.printf("⚠️ Stream Task: still of %u bytes does not fit the %u byte slot - dropped\n",
+                      (unsigned)still->len, stillBuf ? (unsigned)STILL_COPY_SIZE : 0U);
+        telemetryMgr.recordError();
+    } else {
+        memcpy(stillBuf, still->buf, still->len);
+        stillFrame = *still;
+        stillFrame.buf = stillBuf;
+        stillReady = true;
+    }
+    cameraMgr.endStill(still);
+    capturing = false;
+}
+
+// Requests queued while the client was leaving still get their still
+void StreamManager::drainCaptureRequests() {
+    uint8_t request;
+    while (!captureRequests.empty()) {
+        if (stillReady) {
+            vTaskDelay(pdMS_TO_TICKS(10)); // loop() is processing the last one
+            continue;
+        }
+        captureRequests.pop(request);
+        handleCaptureRequest();
+    }
 }
 
-void StreamManager::setCaptureCallback(CaptureCallback cb) {
-    captureCb = cb;
+void StreamManager::setMaxFps(uint8_t fps) {
+    maxFps = fps;
+    Serial.printf("[STREAM] FPS cap: %u\n", fps);
+}
+
+StreamClientStats StreamManager::client;
+
+// One at a time: a second /stream waits in the stream server's accept queue
+StreamClientStats* StreamManager::claimClient(int fd, uint8_t fps, int quality) {
+    memset(&client, 0, sizeof(client));
+    client.fd = fd;
+    client.fpsCap = fps;
+    client.quality = quality;
+    client.startedAtUs = esp_timer_get_time();
+    return &client;
+}
+
+void StreamManager::releaseClient(StreamClientStats* c) {
+    if (c) {
+        c->fd = -1;
+    }
 }
 
 esp_err_t StreamManager::stream_handler(httpd_req_t *req) {
     camera_fb_t * fb = NULL;
     esp_err_t res = ESP_OK;
     size_t _jpg_buf_len = 0;
-    uint8_t * _jpg_buf = NULL;
+    const uint8_t * _jpg_buf = NULL;
     char * part_buf[64];
+    uint16_t frameW = 0, frameH = 0;
+    PipelineFrame frame = {};
+
+    // Per-client options: /stream?fps=5&quality=30
+    uint8_t clientFps = 0;
+    int clientQuality = -1;
+    char query[64];
+    char value[8];
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "fps", value, sizeof(value)) == ESP_OK) {
+            clientFps = constrain(atoi(value), 0, STREAM_MAX_FPS);
+        }
+        if (httpd_query_key_value(query, "quality", value, sizeof(value)) == ESP_OK) {
+            int q = atoi(value);
+            if (q >= 4 && q <= 63) {
+                clientQuality = q;
+            }
+        }
+    }
 
     res = httpd_resp_set_type(req, _STREAM_CONTENT_TYPE);
     if(res != ESP_OK){
         return res;
     }
 
-    // Auto-init camera if needed
-    if (!cameraMgr.isInitialized()) {
-        Serial.println("[STREAM] Auto-initializing camera...");
-        if (!cameraMgr.init()) {
-            return ESP_FAIL;
+    {
+        // Not while loop() or /capture is in the middle of init / capture / deinit
+        CameraLock camLock(cameraMgr, CAMERA_LOCK_WAIT_MS);
+        if (!camLock.held()) {
+            httpd_resp_set_status(req, "503 Service Unavailable");
+            httpd_resp_set_hdr(req, "Retry-After", "1");
+            return httpd_resp_send(req, NULL, 0);
         }
+        // Auto-init camera if needed
+        if (!cameraMgr.isInitialized()) {
+            Serial.println("[STREAM] Auto-initializing camera...");
+            if (!cameraMgr.init()) {
+                return ESP_FAIL;
+            }
+        }
+        isStreaming = true;
+        active = true;
+        stopRequested = false; // A stream_off before this client does not apply to it
+    }
+
+    // Held across stills (endStill re-applies it); the configured quality comes back after
+    if (clientQuality >= 0) {
+        cameraMgr.setStreamQualityOverride(clientQuality);
     }
 
-    isStreaming = true;
-    Serial.println("▶️ Stream started");
+    StreamClientStats* stats = claimClient(httpd_req_to_sockfd(req), clientFps, clientQuality);
 
+    Serial.printf("▶️ Stream started (fps=%u, quality=%d)\n", clientFps, clientQuality);
+
+    int64_t nextDueUs = esp_timer_get_time();
     while(true){
+        // stream_off: finish the response and hand the camera back
+        if (stopRequested) {
+            Serial.println("⏹️ Stream stop requested");
+            httpd_resp_send_chunk(req, NULL, 0);
+            break;
+        }
+
+        // Effective cap: the stricter of the client's ?fps= and the remote-tuned maxFps
+        uint8_t fps = clientFps;
+        if (maxFps > 0 && (fps == 0 || maxFps < fps)) {
+            fps = maxFps;
+        }
+        int64_t intervalUs = fps ? 1000000LL / fps : 0;
+
+        // Sleep until this client's next slot instead of pulling frames it will not use
+        if (intervalUs) {
+            int64_t waitUs = nextDueUs - esp_timer_get_time();
+            if (waitUs >= (int64_t)portTICK_PERIOD_MS * 1000) {
+                vTaskDelay((TickType_t)(waitUs / 1000 / portTICK_PERIOD_MS));
+            }
+        }
+
         fb = esp_camera_fb_get();
         if (!fb) {
             Serial.println("Camera capture failed");
+            telemetryMgr.recordError();
             res = ESP_FAIL;
         } else {
-            // Check for capture request
-            if (captureRequested) {
-                Serial.println("📸 Stream Task: Handling capture request...");
-                if (captureCb) {
-                    captureCb(fb); // Use callback
-                    Serial.println("✅ Stream Task: Capture handled via callback");
-                } else {
-                    Serial.println("⚠️ Stream Task: No capture callback registered!");
-                }
-                captureRequested = false; // Reset flag
-            }
+            frameW = fb->width;
+            frameH = fb->height;
 
-            if(fb->format != PIXFORMAT_JPEG){
-                bool jpeg_converted = frame2jpg(fb, 80, &_jpg_buf, &_jpg_buf_len);
+            // Check for capture request: grab a full-resolution still in place
+            // (the next one waits until loop() has taken the last copy)
+            uint8_t request;
+            if (!stillReady && captureRequests.pop(request)) {
                 esp_camera_fb_return(fb);
                 fb = NULL;
-                if(!jpeg_converted){
-                    Serial.println("JPEG compression failed");
-                    res = ESP_FAIL;
+                handleCaptureRequest();
+                continue;
+            }
+
+            int64_t now = esp_timer_get_time();
+            if (intervalUs) {
+                if (now < nextDueUs - STREAM_PACING_SLACK_US) {
+                    // Over the cap (tick rounding woke us early): hand it back untouched
+                    esp_camera_fb_return(fb);
+                    fb = NULL;
+                    if (stats) {
+                        stats->skipped++;
+                    }
+                    continue;
+                }
+                int64_t late = now - nextDueUs;
+                uint32_t jitterUs = (uint32_t)(late < 0 ? -late : late);
+                if (stats) {
+                    stats->jitterSumUs += jitterUs;
+                    if (jitterUs > stats->jitterMaxUs) {
+                        stats->jitterMaxUs = jitterUs;
+                    }
+                }
+                // Fixed schedule so lateness does not accumulate; resync after a long stall
+                nextDueUs += intervalUs;
+                if (now - nextDueUs > intervalUs) {
+                    nextDueUs = now;
                 }
+            }
+
+            // JPEG (zero-copy or pooled encode) plus the analytics plane
+            if (framePipeline.process(fb, frame, ANALYTICS_PLANE_ENABLED)) {
+                _jpg_buf = frame.jpg;
+                _jpg_buf_len = frame.jpgLen;
             } else {
-                _jpg_buf_len = fb->len;
-                _jpg_buf = fb->buf;
+                Serial.println("JPEG compression failed");
+                res = ESP_FAIL;
             }
+            fb = NULL; // Owned by frame now
         }
         if(res == ESP_OK){
+            // Share the frame with /capture; never blocks the stream
+            frameCache.publish(_jpg_buf, _jpg_buf_len, frameW, frameH);
             size_t hlen = snprintf((char *)part_buf, 64, _STREAM_PART, _jpg_buf_len);
             res = httpd_resp_send_chunk(req, (const char *)part_buf, hlen);
         }
@@ -88,28 +263,166 @@ esp_err_t StreamManager::stream_handler(httpd_req_t *req) {
         if(res == ESP_OK){
             res = httpd_resp_send_chunk(req, _STREAM_BOUNDARY, strlen(_STREAM_BOUNDARY));
         }
-        if(fb){
-            esp_camera_fb_return(fb);
-            fb = NULL;
-            _jpg_buf = NULL;
-        } else if(_jpg_buf){
-            free(_jpg_buf);
-            _jpg_buf = NULL;
+        if(res == ESP_OK){
+            telemetryMgr.recordFrame();
+            if (stats) {
+                stats->frames++;
+                stats->bytes += _jpg_buf_len;
+            }
         }
+        framePipeline.release(frame);
+        _jpg_buf = NULL;
         if(res != ESP_OK){
             break;
         }
         // Serial.printf("MJPEG: %uB\n",(uint32_t)(_jpg_buf_len));
     }
-    
-    isStreaming = false;
-    Serial.println("⏹️ Stream stopped");
+
+    if (clientQuality >= 0) {
+        cameraMgr.setStreamQualityOverride(-1);
+    }
+    drainCaptureRequests();
+    {
+        // loop() queues requests under the lock while we are active: take the
+        // stragglers too, then give the camera back (and power it down for stream_off)
+        CameraLock camLock(cameraMgr, CAMERA_LOCK_WAIT_MS);
+        drainCaptureRequests();
+        active = false;
+        isStreaming = false;
+        if (stopRequested) {
+            stopRequested = false;
+            if (camLock.held()) {
+                cameraMgr.deinit();
+                Serial.println("💤 Camera de-initialized (stream_off)");
+            } else {
+                Serial.println("⚠️ Camera busy - left initialized after stream_off");
+            }
+        }
+    }
+    if (stats) {
+        Serial.printf("⏹️ Stream stopped: %lu frames, %lu skipped, jitter avg %lu us / max %lu us\n",
+                      (unsigned long)stats->frames, (unsigned long)stats->skipped,
+                      stats->frames ? (unsigned long)(stats->jitterSumUs / stats->frames) : 0UL,
+                      (unsigned long)stats->jitterMaxUs);
+    } else {
+        Serial.println("⏹️ Stream stopped");
+    }
+    releaseClient(stats);
     return res;
 }
 
+esp_err_t StreamManager::capture_handler(httpd_req_t *req) {
+    char seqHdr[12];
+    char ageHdr[12];
+    httpd_resp_set_type(req, "image/jpeg");
+    httpd_resp_set_hdr(req, "Content-Disposition", "inline; filename=capture.jpg");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+
+    // Fast path: the stream task already encoded a fresh frame
+    const CachedFrame* cached = isStreaming ? frameCache.acquire(FRAME_CACHE_MAX_AGE_MS) : nullptr;
+    if (cached) {
+        snprintf(seqHdr, sizeof(seqHdr), "%lu", (unsigned long)cached->seq);
+        snprintf(ageHdr, sizeof(ageHdr), "%lu",
+                 (unsigned long)((esp_timer_get_time() - cached->capturedAtUs) / 1000));
+        httpd_resp_set_hdr(req, "X-Frame-Source", "cache");
+        httpd_resp_set_hdr(req, "X-Frame-Seq", seqHdr);
+        httpd_resp_set_hdr(req, "X-Frame-Age-Ms", ageHdr);
+        esp_err_t res = httpd_resp_send(req, (const char *)cached->data, cached->len);
+        frameCache.release(cached);
+        return res;
+    }
+
+    if (isStreaming) {
+        // Stream owns the camera but has not produced a frame recently
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    // Camera idle: single capture, leaving the camera as we found it. A PIR or
+    // MQTT capture on loop() holds the camera lock, so answer busy, not wait
+    CameraLock camLock(cameraMgr, 0);
+    if (!camLock.held() || isStreaming || capturePending()) {
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        httpd_resp_set_hdr(req, "Retry-After", "1");
+        return httpd_resp_send(req, NULL, 0);
+    }
+    bool wasInitialized = cameraMgr.isInitialized();
+    if (!wasInitialized && !cameraMgr.init()) {
+        return httpd_resp_send_500(req);
+    }
+    camera_fb_t* fb = esp_camera_fb_get();
+    esp_err_t res;
+    if (!fb) {
+        telemetryMgr.recordError();
+        res = httpd_resp_send_500(req);
+    } else {
+        httpd_resp_set_hdr(req, "X-Frame-Source", "camera");
+        res = httpd_resp_send(req, (const char *)fb->buf, fb->len);
+        esp_camera_fb_return(fb);
+    }
+    if (!wasInitialized && !isStreaming) {
+        cameraMgr.deinit();
+    }
+    return res;
+}
+
+esp_err_t StreamManager::status_handler(httpd_req_t *req) {
+    char json[1024];
+    uint32_t age = frameCache.ageMs();
+    int len = snprintf(json, sizeof(json),
+        "{\"streaming\":%s,\"camera\":%s,\"fpsCap\":%u,\"frameSize\":%d,\"quality\":%d,"
+        "\"cacheSeq\":%lu,\"cacheAgeMs\":%ld,\"heapFree\":%lu,\"heapLargest\":%lu,\"psramFree\":%lu,"
+        "\"rssi\":%d,\"uptimeS\":%lu,\"pending\":%u,\"mqtt\":%s,\"client\":",
+        isStreaming ? "true" : "false",
+        cameraMgr.isInitialized() ? "true" : "false",
+        (unsigned)maxFps, (int)cameraMgr.getFrameSize(), cameraMgr.getJpegQuality(),
+        (unsigned long)frameCache.seq(), age == UINT32_MAX ? -1L : (long)age,
+        (unsigned long)ESP.getFreeHeap(),
+        (unsigned long)heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT),
+        (unsigned long)ESP.getFreePsram(),
+        WiFi.status() == WL_CONNECTED ? (int)WiFi.RSSI() : 0,
+        (unsigned long)(millis() / 1000), (unsigned)storageMgr.pendingCount(),
+        netTask.mqttConnected() ? "true" : "false");
+
+    const StreamClientStats& c = client;
+    if (len > 0 && len < (int)sizeof(json) && c.fd >= 0) {
+        uint32_t elapsedMs = (uint32_t)((esp_timer_get_time() - c.startedAtUs) / 1000);
+        len += snprintf(json + len, sizeof(json) - len,
+            "{\"fps\":%u,\"quality\":%d,\"frames\":%lu,\"skipped\":%lu,"
+            "\"jitterAvgUs\":%lu,\"jitterMaxUs\":%lu,\"kbps\":%lu}}",
+            c.fpsCap, c.quality,
+            (unsigned long)c.frames, (unsigned long)c.skipped,
+            c.frames ? (unsigned long)(c.jitterSumUs / c.frames) : 0UL,
+            (unsigned long)c.jitterMaxUs,
+            elapsedMs ? (unsigned long)(c.bytes * 8 / elapsedMs) : 0UL);
+    } else if (len > 0 && len < (int)sizeof(json)) {
+        len += snprintf(json + len, sizeof(json) - len, "null}");
+    }
+    if (len < 0 || len >= (int)sizeof(json)) {
+        return httpd_resp_send_500(req);
+    }
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+    return httpd_resp_send(req, json, len);
+}
+
 void StreamManager::startWebServer() {
+    if (!stillBuf) {
+        stillBuf = (uint8_t*)ps_malloc(STILL_COPY_SIZE);
+        if (!stillBuf) {
+            Serial.println("⚠️ No PSRAM for the still slot - captures during a stream will fail");
+        }
+    }
+
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-    config.server_port = 81; // Use port 81 for streaming to avoid conflict if needed, or 80
+    config.server_port = STREAM_PORT;
+    config.ctrl_port = 32768 + STREAM_PORT;
+    config.core_id = TASK_STREAM_HTTPD_CORE;
+    config.task_priority = TASK_STREAM_HTTPD_PRIO;
+    config.stack_size = TASK_STREAM_HTTPD_STACK;
 
     httpd_uri_t stream_uri = {
         .uri       = "/stream",
@@ -117,9 +430,36 @@ void StreamManager::startWebServer() {
         .handler   = stream_handler,
         .user_ctx  = NULL
     };
+    httpd_uri_t capture_uri = {
+        .uri       = "/capture",
+        .method    = HTTP_GET,
+        .handler   = capture_handler,
+        .user_ctx  = NULL
+    };
+    httpd_uri_t status_uri = {
+        .uri       = "/status",
+        .method    = HTTP_GET,
+        .handler   = status_handler,
+        .user_ctx  = NULL
+    };
 
     Serial.printf("Starting web server on port: '%d'\n", config.server_port);
     if (httpd_start(&stream_httpd, &config) == ESP_OK) {
         httpd_register_uri_handler(stream_httpd, &stream_uri);
+        httpd_register_uri_handler(stream_httpd, &capture_uri);
+        httpd_register_uri_handler(stream_httpd, &status_uri);
+    }
+
+    // esp_http_server runs handlers on one task and /stream never returns while
+    // a client watches, so snapshots/status also get their own server
+    config.server_port = CONTROL_PORT;
+    config.ctrl_port = 32768 + CONTROL_PORT;
+    config.core_id = TASK_CTRL_HTTPD_CORE;
+    config.task_priority = TASK_CTRL_HTTPD_PRIO;
+    config.stack_size = TASK_CTRL_HTTPD_STACK;
+    Serial.printf("Starting control server on port: '%d'\n", config.server_port);
+    if (httpd_start(&control_httpd, &config) == ESP_OK) {
+        httpd_register_uri_handler(control_httpd, &capture_uri);
+        httpd_register_uri_handler(control_httpd, &status_uri);
     }
 }
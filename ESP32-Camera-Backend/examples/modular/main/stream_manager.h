@@ -3,9 +3,22 @@
 
 #include "esp_camera.h"
 #include "esp_http_server.h"
+#include "config.h"
+#include "spsc_queue.h"
 
-// Define callback type for capturing frames
-typedef void (*CaptureCallback)(camera_fb_t*);
+// Pacing stats for the /stream client (exposed via /status). The stream
+// server runs handlers on its one task, so there is at most one
+struct StreamClientStats {
+    int fd;                 // Socket, -1 = no client
+    uint8_t fpsCap;         // Requested ?fps= (0 = unlimited)
+    int8_t quality;         // Requested ?quality= (-1 = sensor default)
+    uint32_t frames;
+    uint32_t skipped;       // Frames returned before their slot, never copied
+    uint64_t jitterSumUs;   // |send time - scheduled time|
+    uint32_t jitterMaxUs;
+    uint64_t bytes;
+    int64_t startedAtUs;
+};
 
 class StreamManager {
 public:
@@ -13,13 +26,45 @@ public:
     void startWebServer();
     void handleClient(); 
     
-    // Register callback for processing captured frames
-    static void setCaptureCallback(CaptureCallback cb);
+    // Ask the streaming task for a full-resolution still (loop() only: single producer).
+    // false when requests are already queued.
+    static bool requestCapture();
+    // A requested still has not been handled yet
+    static bool capturePending();
+
+    // Still the stream task copied out before resuming the stream, for loop()
+    // to process (nullptr = none). Hand it back with releaseStill().
+    static camera_fb_t* takeStill();
+    static void releaseStill();
+
+    // A /stream client is being served (the stream task drains requestCapture())
+    static bool clientActive() { return active.load(); }
+    // End the running stream; the stream task deinits the camera on its way out
+    static void requestStop() { stopRequested = true; }
+
+    // Global stream frame-rate cap (0 = unlimited), remote-tunable
+    static void setMaxFps(uint8_t fps);
+    static uint8_t getMaxFps() { return maxFps; }
 
 private:
     httpd_handle_t stream_httpd = NULL;
+    httpd_handle_t control_httpd = NULL;   // /capture + /status on CONTROL_PORT
     static esp_err_t stream_handler(httpd_req_t *req);
-    static CaptureCallback captureCb; // Static member to be accessible from static handler
+    static esp_err_t capture_handler(httpd_req_t *req);  // Latest cached frame, or one-shot capture when idle
+    static esp_err_t status_handler(httpd_req_t *req);   // JSON device/stream state
+    static SpscQueue<uint8_t, 4> captureRequests; // loop() -> stream task
+    static std::atomic<bool> capturing;
+    static uint8_t* stillBuf;           // STILL_COPY_SIZE PSRAM slot behind stillFrame
+    static camera_fb_t stillFrame;      // Copy of the last still; buf points into stillBuf
+    static std::atomic<bool> stillReady; // stillFrame is loop()'s until releaseStill()
+    static std::atomic<bool> active;
+    static std::atomic<bool> stopRequested;
+    static volatile uint8_t maxFps;
+    static StreamClientStats client;
+    static StreamClientStats* claimClient(int fd, uint8_t fps, int quality);
+    static void releaseClient(StreamClientStats* c);
+    static void handleCaptureRequest();
+    static void drainCaptureRequests();
 };
 
 #endif // STREAM_MANAGER_H
@@ -0,0 +1,112 @@
+/**
+ * task_monitor.cpp - Task CPU/stack report implementation
+ */
+
+#include "task_monitor.h"
+#include "mqtt_manager.h"
+
+extern MQTTManager mqttMgr;
+
+TaskMonitor taskMonitor;
+
+TaskMonitor::TaskMonitor()
+    : _prevCount(0), _prevTotal(0), _lastSentAt(0), _lastSampleAt(0) {
+    memset(_prev, 0, sizeof(_prev));
+    _json[0] = '\0';
+}
+
+uint32_t TaskMonitor::previousRunTime(TaskHandle_t handle) const {
+    for (uint8_t i = 0; i < _prevCount; i++) {
+        if (_prev[i].handle == handle) {
+            return _prev[i].runTime;
+        }
+    }
+    return 0;   // New task: whole run time counts towards this interval
+}
+
+size_t TaskMonitor::buildReport() {
+#if configUSE_TRACE_FACILITY
+    static TaskStatus_t status[TASK_MONITOR_MAX_TASKS];
+    uint32_t total = 0;
+    UBaseType_t count = uxTaskGetSystemState(status, TASK_MONITOR_MAX_TASKS, &total);
+    if (count == 0) {
+        return 0;   // More tasks than TASK_MONITOR_MAX_TASKS
+    }
+
+    unsigned long now = millis();
+    uint32_t interval = _lastSampleAt ? now - _lastSampleAt : now;
+    uint32_t totalDelta = total - _prevTotal;
+
+    size_t len = snprintf(_json, sizeof(_json), "{\"uptimeS\":%lu,\"intervalMs\":%lu,\"tasks\":[",
+                          now / 1000, (unsigned long)interval);
+    const char* tightest = "";
+    uint32_t tightestBytes = UINT32_MAX;
+
+    for (UBaseType_t i = 0; i < count && len < sizeof(_json); i++) {
+        const TaskStatus_t& t = status[i];
+#ifdef CONFIG_FREERTOS_VTASKLIST_INCLUDE_COREID
+        int core = t.xCoreID == tskNO_AFFINITY ? -1 : (int)t.xCoreID;
+#else
+        int core = -1;
+#endif
+        // ESP-IDF stacks are byte-addressed: the high-water mark is in bytes
+        uint32_t headroom = (uint32_t)t.usStackHighWaterMark;
+        if (headroom < tightestBytes) {
+            tightestBytes = headroom;
+            tightest = t.pcTaskName;
+        }
+
+        len += snprintf(_json + len, sizeof(_json) - len, "%s{\"n\":\"%s\",\"c\":%d,\"p\":%u",
+                        i ? "," : "", t.pcTaskName, core, (unsigned)t.uxCurrentPriority);
+#if configGENERATE_RUN_TIME_STATS
+        if (len < sizeof(_json) && totalDelta) {
+            uint32_t delta = t.ulRunTimeCounter - previousRunTime(t.xHandle);
+            len += snprintf(_json + len, sizeof(_json) - len, ",\"cpuX10\":%lu",
+                            (unsigned long)((uint64_t)delta * 1000 / totalDelta));
+        }
+#endif
+        if (len < sizeof(_json)) {
+            len += snprintf(_json + len, sizeof(_json) - len, ",\"stack\":%lu}", (unsigned long)headroom);
+        }
+    }
+    if (len < sizeof(_json)) {
+        len += snprintf(_json + len, sizeof(_json) - len, "]}");
+    }
+    if (len >= sizeof(_json)) {
+        Serial.println("[TASKS] Report truncated");
+        return 0;
+    }
+
+    // Remember counters for the next delta
+    _prevCount = 0;
+    for (UBaseType_t i = 0; i < count; i++) {
+        _prev[_prevCount++] = { status[i].xHandle, status[i].ulRunTimeCounter };
+    }
+    _prevTotal = total;
+    _lastSampleAt = now;
+
+    if (tightestBytes < TASK_STACK_WARN_BYTES) {
+        Serial.printf("[TASKS] Low stack: %s has %lu bytes left\n", tightest, (unsigned long)tightestBytes);
+    }
+    return len;
+#else
+    return 0;
+#endif
+}
+
+void TaskMonitor::loop() {
+    unsigned long now = millis();
+    if (_lastSentAt && now - _lastSentAt < TASK_STATS_INTERVAL_MS) {
+        return;
+    }
+    if (!mqttMgr.isConnected()) {
+        return;
+    }
+    _lastSentAt = now;
+
+    size_t len = buildReport();
+    if (len == 0) {
+        return;
+    }
+    mqttMgr.publishTaskStats(_json, len);
+}
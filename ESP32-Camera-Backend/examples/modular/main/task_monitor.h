@@ -0,0 +1,62 @@
+/**
+ * task_monitor.h - Per-task CPU share and stack headroom over MQTT
+ *
+ * Every TASK_STATS_INTERVAL_MS the FreeRTOS task list is sampled
+ * (uxTaskGetSystemState, the data behind vTaskGetRunTimeStats) and the
+ * run-time deltas since the previous sample are published as JSON on
+ * MQTT_TOPIC_TASKS:
+ *
+ *   {"uptimeS":120,"intervalMs":60000,"tasks":[
+ *     {"n":"loopTask","c":1,"p":1,"cpuX10":143,"stack":3012}, ...]}
+ *
+ * cpuX10 is the share of one core in tenths of a percent (IDLE0 + IDLE1
+ * show what is left); stack is the high-water headroom in bytes. c is -1
+ * when the core id is not compiled into the task list. CPU figures need
+ * configGENERATE_RUN_TIME_STATS; without it only stacks are reported.
+ */
+
+#ifndef TASK_MONITOR_H
+#define TASK_MONITOR_H
+
+#include <Arduino.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "config.h"
+
+#define TASK_MONITOR_MAX_TASKS 24
+#define TASK_MONITOR_JSON_MAX  2048
+
+class TaskMonitor {
+public:
+    TaskMonitor();
+
+    /**
+     * Publish a report when TASK_STATS_INTERVAL_MS has elapsed. Call from loop().
+     */
+    void loop();
+
+    /**
+     * Sample now and build the JSON report into the internal buffer.
+     * @return length (0 if the task list is unavailable).
+     */
+    size_t buildReport();
+    const char* report() const { return _json; }
+
+private:
+    struct Prev {
+        TaskHandle_t handle;
+        uint32_t runTime;
+    };
+    Prev _prev[TASK_MONITOR_MAX_TASKS];
+    uint8_t _prevCount;
+    uint32_t _prevTotal;
+    unsigned long _lastSentAt;
+    unsigned long _lastSampleAt;
+    char _json[TASK_MONITOR_JSON_MAX];
+
+    uint32_t previousRunTime(TaskHandle_t handle) const;
+};
+
+extern TaskMonitor taskMonitor;
+
+#endif // TASK_MONITOR_H
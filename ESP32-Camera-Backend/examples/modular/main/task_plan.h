@@ -0,0 +1,58 @@
+/**
+ * task_plan.h - Which task runs where
+ *
+ * Core 0 (PRO) carries the WiFi driver and lwIP (priorities 18-23), so only
+ * work that blocks on I/O goes there. Core 1 (APP) does the CPU-heavy
+ * camera/JPEG work.
+ *
+ *   Task            Core  Prio  Stack  Work
+ *   ------------    ----  ----  -----  ---------------------------------------
+ *   wifi / tiT       0    18+    -     Driver + TCP/IP (ESP-IDF, fixed)
+ *   net_task         0     4    8192   Sole owner of MQTT + HTTP: commands,
+ *                                      acks, deliveries, telemetry, backlog
+ *   mqtt_connect     0     3    8192   TCP/TLS/MQTT CONNECT (short-lived)
+ *   ctrl_httpd       0     3    6144   /capture, /status (port 80)
+ *   sd_writer        0     2    6144   Write-behind SD persistence
+ *   led_anim         0     1    3072   Status LED patterns (sleeps between steps)
+ *   stream_httpd     1     5    8192   /stream: pipeline encode + send
+ *   loopTask         1     1    8192   PIR, capture, thumbnails / ROI crops
+ *                                      (Arduino core: CONFIG_ARDUINO_RUNNING_CORE)
+ *
+ * The stream task outranks loopTask on core 1 but blocks in send() and in
+ * its pacing delay, so captures still get the core between frames.
+ * Tasks hand images to net_task through per-producer lock-free queues
+ * (network_task.h) instead of calling the clients themselves.
+ * Per-task CPU share and stack headroom are published by task_monitor.h.
+ */
+
+#ifndef TASK_PLAN_H
+#define TASK_PLAN_H
+
+#define CORE_NET      0
+#define CORE_APP      1
+
+#define TASK_NET_CORE            CORE_NET
+#define TASK_NET_PRIO            4         // Above the httpd/SD workers: commands stay prompt
+#define TASK_NET_STACK           8192      // TLS writes, HTTPClient, upload JSON
+
+#define TASK_MQTT_CONNECT_CORE   CORE_NET
+#define TASK_MQTT_CONNECT_PRIO   3
+#define TASK_MQTT_CONNECT_STACK  8192      // mbedTLS handshake
+
+#define TASK_CTRL_HTTPD_CORE     CORE_NET
+#define TASK_CTRL_HTTPD_PRIO     3
+#define TASK_CTRL_HTTPD_STACK    6144
+
+#define TASK_SD_WRITER_CORE      CORE_NET
+#define TASK_SD_WRITER_PRIO      2
+#define TASK_SD_WRITER_STACK     6144      // SHA-256 context + FATFS
+
+#define TASK_LED_CORE            CORE_NET
+#define TASK_LED_PRIO            1         // Cosmetic: runs when nothing else needs core 0
+#define TASK_LED_STACK           3072
+
+#define TASK_STREAM_HTTPD_CORE   CORE_APP
+#define TASK_STREAM_HTTPD_PRIO   5
+#define TASK_STREAM_HTTPD_STACK  8192      // JPEG encode callbacks run on this stack
+
+#endif // TASK_PLAN_H
@@ -0,0 +1,213 @@
+/**
+ * telemetry_manager.cpp - CBOR telemetry heartbeat implementation
+ */
+
+#include <WiFi.h>
+#include "telemetry_manager.h"
+#include "mqtt_manager.h"
+#include "storage_manager.h"
+#include "capture_arena.h"
+#include "esp_heap_caps.h"
+
+extern MQTTManager mqttMgr;
+extern StorageManager storageMgr;
+
+TelemetryManager telemetryMgr;
+
+// CBOR major types
+static const uint8_t CBOR_UINT = 0;
+static const uint8_t CBOR_NEGINT = 1;
+static const uint8_t CBOR_MAP = 5;
+
+TelemetryManager::TelemetryManager()
+    : _len(0), _overflow(false), _seq(0), _lastSentAt(0), _forceKeyframe(true),
+      _minLargestBlock(UINT32_MAX), _lastHeapSampleAt(0) {
+    for (int i = 0; i < TC_COUNT; i++) {
+        _counters[i] = 0;
+        _lastCounters[i] = 0;
+    }
+    for (int i = 0; i < TG_COUNT; i++) {
+        _lastGauges[i] = 0;
+    }
+}
+
+void TelemetryManager::recordUpload(size_t bytes, bool ok) {
+    if (ok) {
+        _counters[TC_UPLOADS_OK]++;
+        _counters[TC_UPLOAD_BYTES] += bytes;
+    } else {
+        _counters[TC_UPLOADS_FAIL]++;
+    }
+}
+
+void TelemetryManager::sampleGauges(int32_t* out) {
+    out[TG_HEAP_FREE] = (int32_t)ESP.getFreeHeap();
+    out[TG_HEAP_MIN] = (int32_t)ESP.getMinFreeHeap();
+    // Internal RAM like heapFree; MALLOC_CAP_8BIT alone would report the PSRAM block
+    out[TG_HEAP_LARGEST] = (int32_t)heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    out[TG_PSRAM_FREE] = (int32_t)ESP.getFreePsram();
+    out[TG_RSSI] = WiFi.status() == WL_CONNECTED ? WiFi.RSSI() : 0;
+    out[TG_QUEUE_DEPTH] = (int32_t)storageMgr.pendingCount();
+    out[TG_LARGEST_MIN] = _minLargestBlock == UINT32_MAX ? out[TG_HEAP_LARGEST] : (int32_t)_minLargestBlock;
+    out[TG_ARENA_HIGH] = (int32_t)captureArena.highWater();
+}
+
+void TelemetryManager::sampleHeap() {
+    _lastHeapSampleAt = millis();
+    // Both figures from internal RAM, so largest <= free and frag stays in 0..100
+    const uint32_t caps = MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT;
+    uint32_t largest = heap_caps_get_largest_free_block(caps);
+    if (largest < _minLargestBlock) {
+        _minLargestBlock = largest;
+        uint32_t freeHeap = heap_caps_get_free_size(caps);
+        uint32_t frag = freeHeap > largest ? (uint32_t)(100 - (uint64_t)largest * 100 / freeHeap) : 0;
+        Serial.printf("[HEAP] New low largest block: %lu (free %lu, min free %lu, frag %lu%%)\n",
+                      (unsigned long)largest, (unsigned long)freeHeap,
+                      (unsigned long)heap_caps_get_minimum_free_size(caps), (unsigned long)frag);
+    }
+}
+
+void TelemetryManager::putHead(uint8_t major, uint32_t value) {
+    uint8_t tmp[5];
+    size_t n;
+    if (value < 24) {
+        tmp[0] = (major << 5) | value;
+        n = 1;
+    } else if (value <= 0xFF) {
+        tmp[0] = (major << 5) | 24;
+        tmp[1] = value;
+        n = 2;
+    } else if (value <= 0xFFFF) {
+        tmp[0] = (major << 5) | 25;
+        tmp[1] = value >> 8;
+        tmp[2] = value & 0xFF;
+        n = 3;
+    } else {
+        tmp[0] = (major << 5) | 26;
+        tmp[1] = value >> 24;
+        tmp[2] = (value >> 16) & 0xFF;
+        tmp[3] = (value >> 8) & 0xFF;
+        tmp[4] = value & 0xFF;
+        n = 5;
+    }
+    if (_len + n > sizeof(_buf)) {
+        _overflow = true;
+        return;
+    }
+    memcpy(_buf + _len, tmp, n);
+    _len += n;
+}
+
+void TelemetryManager::putInt(int32_t value) {
+    if (value >= 0) {
+        putHead(CBOR_UINT, (uint32_t)value);
+    } else {
+        putHead(CBOR_NEGINT, (uint32_t)(-1 - value));
+    }
+}
+
+void TelemetryManager::putKey(int key) {
+    putInt(key);
+}
+
+void TelemetryManager::putField(int key, int32_t value) {
+    putKey(key);
+    putInt(value);
+}
+
+size_t TelemetryManager::buildFrame(bool keyframe) {
+    static const uint8_t gaugeKeys[TG_COUNT] = {
+        TK_HEAP_FREE, TK_HEAP_MIN, TK_HEAP_LARGEST, TK_PSRAM_FREE, TK_RSSI, TK_QUEUE_DEPTH,
+        TK_LARGEST_MIN, TK_ARENA_HIGH
+    };
+    static const uint8_t counterKeys[TC_COUNT] = {
+        TK_FRAMES, TK_UPLOADS_OK, TK_UPLOADS_FAIL, TK_UPLOAD_BYTES, TK_ERRORS, TK_MQTT_FAIL, TK_CAPTURES,
+        TK_ARENA_FALLBACK
+    };
+
+    unsigned long now = millis();
+    uint32_t intervalMs = _lastSentAt ? (uint32_t)(now - _lastSentAt) : 0;
+
+    int32_t gauges[TG_COUNT];
+    sampleGauges(gauges);
+
+    _counters[TC_ARENA_FALLBACK] = captureArena.fallbacks() + netArena.fallbacks();
+
+    uint32_t deltas[TC_COUNT];
+    for (int i = 0; i < TC_COUNT; i++) {
+        uint32_t current = _counters[i].load();
+        deltas[i] = current - _lastCounters[i];
+        _lastCounters[i] = current;
+    }
+
+    _len = 1; // Map header patched below (field count always < 24)
+    _overflow = false;
+    uint8_t fields = 0;
+
+    putField(TK_VERSION, TELEMETRY_VERSION); fields++;
+    putField(TK_SEQ, (int32_t)_seq); fields++;
+    putField(TK_UPTIME_S, (int32_t)(now / 1000)); fields++;
+    putField(TK_INTERVAL_MS, (int32_t)intervalMs); fields++;
+
+    for (int i = 0; i < TG_COUNT; i++) {
+        if (keyframe) {
+            putField(gaugeKeys[i], gauges[i]);
+            fields++;
+        } else {
+            int32_t delta = gauges[i] - _lastGauges[i];
+            if (delta != 0) {
+                putField(-(int)gaugeKeys[i], delta);
+                fields++;
+            }
+        }
+        _lastGauges[i] = gauges[i];
+    }
+
+    for (int i = 0; i < TC_COUNT; i++) {
+        if (deltas[i] != 0) {
+            putField(-(int)counterKeys[i], (int32_t)deltas[i]);
+            fields++;
+        }
+    }
+
+    if (intervalMs > 0) {
+        putField(TK_FPS_X10, (int32_t)((uint64_t)deltas[TC_FRAMES] * 10000 / intervalMs)); fields++;
+        putField(TK_UPLOAD_BPS, (int32_t)((uint64_t)deltas[TC_UPLOAD_BYTES] * 1000 / intervalMs)); fields++;
+    }
+
+    if (_overflow) {
+        return 0;
+    }
+    _buf[0] = (CBOR_MAP << 5) | fields;
+    return _len;
+}
+
+void TelemetryManager::loop() {
+    unsigned long now = millis();
+    if (now - _lastHeapSampleAt >= HEAP_SAMPLE_INTERVAL_MS) {
+        sampleHeap();
+    }
+
+    if (_lastSentAt && now - _lastSentAt < TELEMETRY_INTERVAL_MS) {
+        return;
+    }
+    if (!mqttMgr.isConnected()) {
+        _forceKeyframe = true; // Backend may have missed frames
+        return;
+    }
+
+    bool keyframe = _forceKeyframe || (_seq % TELEMETRY_KEYFRAME_EVERY) == 0;
+    size_t len = buildFrame(keyframe);
+    _lastSentAt = now;
+    _seq++;
+
+    if (len == 0) {
+        Serial.println("[TELEMETRY] Frame overflow");
+        return;
+    }
+    if (mqttMgr.publishTelemetry(_buf, len)) {
+        _forceKeyframe = false;
+    } else {
+        _forceKeyframe = true;
+    }
+}
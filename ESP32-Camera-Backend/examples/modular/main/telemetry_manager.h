@@ -0,0 +1,127 @@
+/**
+ * telemetry_manager.h - Periodic CBOR telemetry heartbeat
+ *
+ * Frames are CBOR maps with small integer keys, built into a fixed buffer
+ * and published to MQTT_TOPIC_STATUS. Decoder: services/mqttService.js.
+ *
+ *   Positive key  = absolute value     Negative key = delta vs last frame
+ *
+ * Gauges (heap, RSSI, queue depth...) are absolute on keyframes and
+ * deltas otherwise. Counters are always deltas since the previous frame
+ * and are omitted when zero. Rates (fps, upload B/s) are computed on device.
+ */
+
+#ifndef TELEMETRY_MANAGER_H
+#define TELEMETRY_MANAGER_H
+
+#include <Arduino.h>
+#include <atomic>
+#include "config.h"
+
+#define TELEMETRY_VERSION        1
+#define TELEMETRY_MAX_FRAME      256
+
+// Map keys (keep in sync with TELEMETRY_KEYS in mqttService.js)
+enum TelemetryKey : uint8_t {
+    TK_VERSION        = 0,
+    TK_SEQ            = 1,
+    TK_UPTIME_S       = 2,
+    TK_INTERVAL_MS    = 3,
+
+    // Gauges
+    TK_HEAP_FREE      = 10,
+    TK_HEAP_MIN       = 11,
+    TK_HEAP_LARGEST   = 12,
+    TK_PSRAM_FREE     = 13,
+    TK_RSSI           = 14,
+    TK_QUEUE_DEPTH    = 15,
+    TK_LARGEST_MIN    = 16,   // Lowest largest-free-block seen since boot
+    TK_ARENA_HIGH     = 17,   // Capture arena high-water mark
+
+    // Counters (delta since previous frame)
+    TK_FRAMES         = 20,
+    TK_UPLOADS_OK     = 21,
+    TK_UPLOADS_FAIL   = 22,
+    TK_UPLOAD_BYTES   = 23,
+    TK_ERRORS         = 24,
+    TK_MQTT_FAIL      = 25,
+    TK_CAPTURES       = 26,
+    TK_ARENA_FALLBACK = 27,   // Arena allocations served by the heap
+
+    // Rates over the interval
+    TK_FPS_X10        = 30,
+    TK_UPLOAD_BPS     = 31
+};
+
+enum TelemetryGauge : uint8_t {
+    TG_HEAP_FREE, TG_HEAP_MIN, TG_HEAP_LARGEST, TG_PSRAM_FREE, TG_RSSI, TG_QUEUE_DEPTH,
+    TG_LARGEST_MIN, TG_ARENA_HIGH,
+    TG_COUNT
+};
+
+enum TelemetryCounter : uint8_t {
+    TC_FRAMES, TC_UPLOADS_OK, TC_UPLOADS_FAIL, TC_UPLOAD_BYTES, TC_ERRORS, TC_MQTT_FAIL, TC_CAPTURES,
+    TC_ARENA_FALLBACK,
+    TC_COUNT
+};
+
+class TelemetryManager {
+public:
+    TelemetryManager();
+
+    // Hot-path counters; safe to call from any task
+    void recordFrame() { _counters[TC_FRAMES]++; }
+    void recordCapture() { _counters[TC_CAPTURES]++; }
+    void recordUpload(size_t bytes, bool ok);
+    void recordMqttFailure() { _counters[TC_MQTT_FAIL]++; }
+    void recordError() { _counters[TC_ERRORS]++; }
+
+    /**
+     * Publish a heartbeat when TELEMETRY_INTERVAL_MS has elapsed.
+     * Call from loop(); returns immediately otherwise.
+     */
+    void loop();
+
+    /**
+     * Sample heap fragmentation (largest free block). Called periodically from
+     * loop() and after each capture; logs when a new low is reached.
+     */
+    void sampleHeap();
+
+    /**
+     * Force the next frame to carry absolute gauge values (e.g. after reconnect).
+     */
+    void requestKeyframe() { _forceKeyframe = true; }
+
+    /**
+     * Build one frame into the internal buffer.
+     * @return encoded length (0 on overflow).
+     */
+    size_t buildFrame(bool keyframe);
+    const uint8_t* frame() const { return _buf; }
+
+private:
+    std::atomic<uint32_t> _counters[TC_COUNT];
+    uint32_t _lastCounters[TC_COUNT];
+    int32_t _lastGauges[TG_COUNT];
+    uint8_t _buf[TELEMETRY_MAX_FRAME];
+    size_t _len;
+    bool _overflow;
+    uint32_t _seq;
+    unsigned long _lastSentAt;
+    bool _forceKeyframe;
+    uint32_t _minLargestBlock;
+    unsigned long _lastHeapSampleAt;
+
+    void sampleGauges(int32_t* out);
+
+    // Minimal CBOR writer over _buf
+    void putHead(uint8_t major, uint32_t value);
+    void putInt(int32_t value);
+    void putKey(int key);
+    void putField(int key, int32_t value);
+};
+
+extern TelemetryManager telemetryMgr;
+
+#endif // TELEMETRY_MANAGER_H
@@ -0,0 +1,471 @@
+/**
+ * tls_client.cpp - TLS client with session resumption and pinning
+ */
+
+#include <time.h>
+#include <Preferences.h>
+#include <esp_heap_caps.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/sha256.h>
+#include <mbedtls/x509_crt.h>
+#include "tls_client.h"
+
+static const uint32_t RTC_TLS_MAGIC = 0x7151E55A;
+
+// Working copy of the stored session: survives reconnects and deep sleep
+RTC_DATA_ATTR static uint32_t rtcSessionMagic = 0;
+RTC_DATA_ATTR static uint32_t rtcSessionHost = 0;
+RTC_DATA_ATTR static uint16_t rtcSessionLen = 0;
+RTC_DATA_ATTR static uint8_t rtcSession[TLS_SESSION_MAX];
+
+// FNV-1a of host:port, so a session is only offered to the broker that issued it
+static uint32_t hostHash(const char* host, uint16_t port) {
+    uint32_t hash = 0x811c9dc5;
+    for (const char* p = host; *p; p++) {
+        hash = (hash ^ (uint8_t)*p) * 0x01000193;
+    }
+    hash = (hash ^ (port & 0xFF)) * 0x01000193;
+    return (hash ^ (port >> 8)) * 0x01000193;
+}
+
+static int hexNibble(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+TlsClient::TlsClient()
+    : _ready(false), _open(false), _peeked(-1), _timeoutMs(MQTT_CONNECT_TIMEOUT_S * 1000),
+      _hostHash(0), _pinCount(0), _fullCount(0), _resumedCount(0) {
+    memset(&_stats, 0, sizeof(_stats));
+    mbedtls_ssl_init(&_ssl);
+    mbedtls_ssl_config_init(&_conf);
+    mbedtls_ctr_drbg_init(&_drbg);
+    mbedtls_entropy_init(&_entropy);
+}
+
+TlsClient::~TlsClient() {
+    close();
+    mbedtls_ssl_config_free(&_conf);
+    mbedtls_ctr_drbg_free(&_drbg);
+    mbedtls_entropy_free(&_entropy);
+}
+
+void TlsClient::begin() {
+    if (_ready) {
+        return;
+    }
+
+    // "hex,hex": colons and spaces inside a pin are ignored
+    const char* p = MQTT_TLS_PINS;
+    while (*p && _pinCount < TLS_MAX_PINS) {
+        uint8_t pin[32];
+        int nibbles = 0;
+        for (; *p && *p != ','; p++) {
+            int v = hexNibble(*p);
+            if (v < 0) {
+                continue;
+            }
+            if (nibbles < 64) {
+                pin[nibbles / 2] = (nibbles & 1) ? (pin[nibbles / 2] | v) : (v << 4);
+            }
+            nibbles++;
+        }
+        if (*p == ',') {
+            p++;
+        }
+        if (nibbles == 64) {
+            memcpy(_pins[_pinCount++], pin, 32);
+        } else if (nibbles) {
+            Serial.printf("[TLS] Ignoring pin with %d hex digits (need 64)\n", nibbles);
+        }
+    }
+
+    // Cold boot: the RTC copy is gone, fall back to the last session in NVS
+    if (TLS_SESSION_NVS && rtcSessionMagic != RTC_TLS_MAGIC) {
+        Preferences prefs;
+        if (prefs.begin("tls", true)) {
+            size_t len = prefs.getBytesLength("session");
+            if (len && len <= TLS_SESSION_MAX && prefs.getBytes("session", rtcSession, len) == len) {
+                rtcSessionLen = len;
+                rtcSessionHost = prefs.getUInt("host", 0);
+                rtcSessionMagic = RTC_TLS_MAGIC;
+            }
+            prefs.end();
+        }
+    }
+
+    int rc = mbedtls_ctr_drbg_seed(&_drbg, mbedtls_entropy_func, &_entropy,
+                                   (const unsigned char*)"mqtt-tls", 8);
+    if (!rc) {
+        rc = mbedtls_ssl_config_defaults(&_conf, MBEDTLS_SSL_IS_CLIENT,
+                                         MBEDTLS_SSL_TRANSPORT_STREAM, MBEDTLS_SSL_PRESET_DEFAULT);
+    }
+    if (rc) {
+        Serial.printf("[TLS] Setup failed: -0x%04x\n", -rc);
+        return;
+    }
+    // Trust comes from the pins, checked after the handshake (see pinMatches)
+    mbedtls_ssl_conf_authmode(&_conf, MBEDTLS_SSL_VERIFY_NONE);
+    mbedtls_ssl_conf_rng(&_conf, mbedtls_ctr_drbg_random, &_drbg);
+    mbedtls_ssl_conf_session_tickets(&_conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+    _ready = true;
+
+    Serial.printf("[TLS] %u pin(s), stored session: %s\n", _pinCount,
+                  rtcSessionMagic == RTC_TLS_MAGIC ? "yes" : "no");
+}
+
+int TlsClient::bioSend(void* ctx, const unsigned char* buf, size_t len) {
+    TlsClient* self = static_cast<TlsClient*>(ctx);
+    size_t sent = self->_tcp.write(buf, len);
+    return sent > 0 ? (int)sent : MBEDTLS_ERR_NET_SEND_FAILED;
+}
+
+int TlsClient::bioRecv(void* ctx, unsigned char* buf, size_t len) {
+    TlsClient* self = static_cast<TlsClient*>(ctx);
+    int avail = self->_tcp.available();
+    if (avail <= 0) {
+        return self->_tcp.connected() ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_CONN_RESET;
+    }
+    int got = self->_tcp.read(buf, min(len, (size_t)avail));
+    return got > 0 ? got : MBEDTLS_ERR_SSL_WANT_READ;
+}
+
+int TlsClient::connect(IPAddress ip, uint16_t port) {
+    return connect(ip.toString().c_str(), port);
+}
+
+int TlsClient::connect(const char* host, uint16_t port) {
+    begin();
+    close();
+    memset(&_stats, 0, sizeof(_stats));
+    if (!_ready) {
+        return 0;
+    }
+    if (!_pinCount && !MQTT_TLS_INSECURE) {
+        _stats.error = -1;
+        Serial.println("❌ [TLS] MQTT_TLS_PINS empty - refusing (MQTT_TLS_INSECURE allows it on dev builds)");
+        return 0;
+    }
+
+    unsigned long startedAt = millis();
+    if (!_tcp.connect(host, port, _timeoutMs)) {
+        Serial.printf("[TLS] TCP connect to %s:%u failed\n", host, port);
+        return 0;
+    }
+    _stats.tcpMs = millis() - startedAt;
+    _hostHash = hostHash(host, port);
+
+    // The record buffers are allocated here, so they count towards the peak
+    size_t heapBefore = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+    int rc = mbedtls_ssl_setup(&_ssl, &_conf);
+    if (!rc) {
+        rc = mbedtls_ssl_set_hostname(&_ssl, host);
+    }
+    bool full = false;
+    if (!rc) {
+        mbedtls_ssl_set_bio(&_ssl, this, bioSend, bioRecv, nullptr);
+        offerSession();
+        startedAt = millis();
+        rc = handshake(heapBefore, full);
+        _stats.tlsMs = millis() - startedAt;
+    }
+    if (rc) {
+        _stats.error = rc;
+        Serial.printf("[TLS] Handshake failed: -0x%04x after %lu ms\n", -rc, (unsigned long)_stats.tlsMs);
+        // Broker still there but refused us: do not offer the same session again
+        if (_stats.offered && rc != MBEDTLS_ERR_SSL_TIMEOUT && _tcp.connected()) {
+            forgetSession();
+        }
+        close();
+        return 0;
+    }
+
+    if (full && _pinCount && !pinMatches(host)) {
+        _stats.error = -1;
+        Serial.printf("❌ [TLS] %s: no pinned key on a verified chain - refusing\n", host);
+        mbedtls_ssl_close_notify(&_ssl);
+        close();
+        return 0;
+    }
+
+    if (full && !_pinCount) {
+        Serial.println("⚠️ [TLS] MQTT_TLS_INSECURE - broker is NOT verified");
+    }
+    _stats.resumed = !full;
+    if (full) {
+        _fullCount++;
+    } else {
+        _resumedCount++;
+    }
+    storeSession(full);
+    _open = true;
+    Serial.printf("[TLS] %s handshake %lu ms (tcp %lu ms), heap peak %lu B%s\n",
+                  full ? "Full" : "Resumed", (unsigned long)_stats.tlsMs, (unsigned long)_stats.tcpMs,
+                  (unsigned long)_stats.heapPeak,
+                  full && _stats.offered ? " - stored session refused" : "");
+    return 1;
+}
+
+int TlsClient::handshake(size_t heapBefore, bool& full) {
+    unsigned long startedAt = millis();
+    size_t lowest = heapBefore;
+    int rc = 0;
+
+    // Stepped by hand to sample the heap between messages; temporaries
+    // inside a step (bignum work) are not seen, so this is a lower bound
+    while (_ssl.state != MBEDTLS_SSL_HANDSHAKE_OVER) {
+        // A resumed session goes from ServerHello straight to ChangeCipherSpec
+        if (_ssl.state == MBEDTLS_SSL_SERVER_CERTIFICATE) {
+            full = true;
+        }
+        rc = mbedtls_ssl_handshake_step(&_ssl);
+        size_t freeNow = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
+        if (freeNow < lowest) {
+            lowest = freeNow;
+        }
+        if (rc == MBEDTLS_ERR_SSL_WANT_READ || rc == MBEDTLS_ERR_SSL_WANT_WRITE) {
+            if (millis() - startedAt >= _timeoutMs) {
+                rc = MBEDTLS_ERR_SSL_TIMEOUT;
+                break;
+            }
+            rc = 0;
+            vTaskDelay(1);
+        } else if (rc) {
+            break;
+        }
+    }
+    _stats.heapPeak = heapBefore - lowest;
+    return rc;
+}
+
+bool TlsClient::keyPinned(const mbedtls_x509_crt* crt) {
+    uint8_t der[TLS_SPKI_MAX];
+    // Written backwards from the end of der
+    int len = mbedtls_pk_write_pubkey_der(const_cast<mbedtls_pk_context*>(&crt->pk), der, sizeof(der));
+    if (len <= 0) {
+        return false;
+    }
+    uint8_t hash[32];
+    mbedtls_sha256(der + sizeof(der) - len, len, hash, 0);
+    for (uint8_t i = 0; i < _pinCount; i++) {
+        if (memcmp(hash, _pins[i], 32) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The chain from leaf must verify up to anchor alone: signatures, CA flags,
+// path length and, for a DNS name, the leaf's name
+bool TlsClient::chainVerifies(const mbedtls_x509_crt* leaf, const mbedtls_x509_crt* anchor, const char* host) {
+    mbedtls_x509_crt trusted;
+    mbedtls_x509_crt_init(&trusted);
+    uint32_t flags = 0;
+    int rc = mbedtls_x509_crt_parse_der(&trusted, anchor->raw.p, anchor->raw.len);
+    if (!rc) {
+        IPAddress ip;
+        bool byAddress = ip.fromString(host);
+        if (byAddress) {
+            // mbedTLS 2.28 cannot match IP SANs: the pinned CA must only sign this broker
+            Serial.println("⚠️ [TLS] Broker reached by IP - certificate name not checked");
+        }
+        rc = mbedtls_x509_crt_verify(const_cast<mbedtls_x509_crt*>(leaf), &trusted, nullptr,
+                                     byAddress ? nullptr : host, &flags, nullptr, nullptr);
+    }
+    mbedtls_x509_crt_free(&trusted);
+
+    // Before SNTP the clock says 1970 and validity dates mean nothing
+    const uint32_t dateFlags = MBEDTLS_X509_BADCERT_EXPIRED | MBEDTLS_X509_BADCERT_FUTURE;
+    if (rc == MBEDTLS_ERR_X509_CERT_VERIFY_FAILED && time(nullptr) < CLOCK_VALID_AFTER && !(flags & ~dateFlags)) {
+        Serial.println("[TLS] Clock not set - certificate dates not checked");
+        return true;
+    }
+    if (rc) {
+        Serial.printf("[TLS] Chain does not verify to the pinned key: -0x%04x, flags 0x%08lx\n",
+                      -rc, (unsigned long)flags);
+    }
+    return rc == 0;
+}
+
+/**
+ * A pinned leaf key is enough on its own: the handshake proved the broker
+ * holds its private key. A pinned key further up the chain only counts once
+ * the leaf verifies up to that certificate; otherwise anyone could send
+ * their own leaf followed by the (public) CA certificate.
+ */
+bool TlsClient::pinMatches(const char* host) {
+    // Chain as sent by the broker (needs MBEDTLS_SSL_KEEP_PEER_CERTIFICATE, the IDF default)
+    const mbedtls_x509_crt* leaf = mbedtls_ssl_get_peer_cert(&_ssl);
+    if (!leaf) {
+        Serial.println("[TLS] No peer certificate kept - cannot check pins");
+        return false;
+    }
+    for (const mbedtls_x509_crt* crt = leaf; crt; crt = crt->next) {
+        if (!keyPinned(crt)) {
+            continue;
+        }
+        if (crt == leaf || chainVerifies(leaf, crt, host)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void TlsClient::offerSession() {
+    if (rtcSessionMagic != RTC_TLS_MAGIC || rtcSessionHost != _hostHash || !rtcSessionLen) {
+        return;
+    }
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+    if (mbedtls_ssl_session_load(&session, rtcSession, rtcSessionLen) == 0 &&
+        mbedtls_ssl_set_session(&_ssl, &session) == 0) {
+        _stats.offered = true;
+    } else {
+        Serial.println("[TLS] Stored session unusable - dropped");
+        forgetSession();
+    }
+    mbedtls_ssl_session_free(&session);
+}
+
+void TlsClient::storeSession(bool full) {
+    mbedtls_ssl_session session;
+    mbedtls_ssl_session_init(&session);
+    size_t len = 0;
+    int rc = mbedtls_ssl_get_session(&_ssl, &session);
+    if (!rc) {
+        rc = mbedtls_ssl_session_save(&session, rtcSession, TLS_SESSION_MAX, &len);
+    }
+    mbedtls_ssl_session_free(&session);
+
+    if (rc) {
+        rtcSessionMagic = 0;
+        if (rc == MBEDTLS_ERR_SSL_BUFFER_TOO_SMALL) {
+            Serial.printf("[TLS] Session needs %u B > TLS_SESSION_MAX - not kept\n", (unsigned)len);
+        }
+        return;
+    }
+    rtcSessionLen = len;
+    rtcSessionHost = _hostHash;
+    rtcSessionMagic = RTC_TLS_MAGIC;
+
+    // Flash only on a new session; a resumed one may just carry a fresher ticket
+    if (TLS_SESSION_NVS && full) {
+        Preferences prefs;
+        if (prefs.begin("tls", false)) {
+            prefs.putBytes("session", rtcSession, len);
+            prefs.putUInt("host", _hostHash);
+            prefs.end();
+        }
+    }
+}
+
+void TlsClient::forgetSession() {
+    rtcSessionMagic = 0;
+    rtcSessionLen = 0;
+    if (TLS_SESSION_NVS) {
+        Preferences prefs;
+        if (prefs.begin("tls", false)) {
+            prefs.remove("session");
+            prefs.end();
+        }
+    }
+}
+
+void TlsClient::close() {
+    _tcp.stop();
+    mbedtls_ssl_free(&_ssl);
+    mbedtls_ssl_init(&_ssl);    // Safe to free again
+    _open = false;
+    _peeked = -1;
+}
+
+void TlsClient::stop() {
+    if (_open) {
+        mbedtls_ssl_close_notify(&_ssl);
+    }
+    close();
+}
+
+uint8_t TlsClient::connected() {
+    return _open && (_tcp.connected() || _peeked >= 0 || mbedtls_ssl_get_bytes_avail(&_ssl) > 0);
+}
+
+int TlsClient::available() {
+    if (!_open) {
+        return 0;
+    }
+    size_t pending = mbedtls_ssl_get_bytes_avail(&_ssl);
+    if (!pending && _tcp.available() > 0) {
+        // Decrypt the next record (WANT_READ while it is incomplete)
+        int rc = mbedtls_ssl_read(&_ssl, nullptr, 0);
+        if (rc < 0 && rc != MBEDTLS_ERR_SSL_WANT_READ && rc != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            close();
+            return 0;
+        }
+        pending = mbedtls_ssl_get_bytes_avail(&_ssl);
+    }
+    return (int)pending + (_peeked >= 0 ? 1 : 0);
+}
+
+int TlsClient::read(uint8_t* buf, size_t size) {
+    if (!_open || !size) {
+        return _open ? 0 : -1;
+    }
+    size_t got = 0;
+    if (_peeked >= 0) {
+        buf[got++] = (uint8_t)_peeked;
+        _peeked = -1;
+    }
+    // Never block: only ask mbedTLS when something is buffered or on the socket
+    if (got < size && (mbedtls_ssl_get_bytes_avail(&_ssl) > 0 || _tcp.available() > 0)) {
+        int rc = mbedtls_ssl_read(&_ssl, buf + got, size - got);
+        if (rc > 0) {
+            got += rc;
+        } else if (rc != MBEDTLS_ERR_SSL_WANT_READ && rc != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            close();    // close_notify (0) or error
+        }
+    }
+    return got ? (int)got : -1;
+}
+
+int TlsClient::read() {
+    uint8_t b;
+    return read(&b, 1) == 1 ? b : -1;
+}
+
+int TlsClient::peek() {
+    if (_peeked < 0) {
+        _peeked = read();
+    }
+    return _peeked;
+}
+
+size_t TlsClient::write(const uint8_t* buf, size_t size) {
+    size_t done = 0;
+    unsigned long startedAt = millis();
+    while (_open && done < size) {
+        int rc = mbedtls_ssl_write(&_ssl, buf + done, size - done);
+        if (rc > 0) {
+            done += rc;
+        } else if (rc == MBEDTLS_ERR_SSL_WANT_READ || rc == MBEDTLS_ERR_SSL_WANT_WRITE) {
+            if (millis() - startedAt >= _timeoutMs) {
+                break;
+            }
+            vTaskDelay(1);
+        } else {
+            Serial.printf("[TLS] Write failed: -0x%04x\n", -rc);
+            close();
+        }
+    }
+    return done;
+}
+
+size_t TlsClient::write(uint8_t b) {
+    return write(&b, 1);
+}
+
+void TlsClient::flush() {
+    // Records go out in write(); WiFiClient::flush() would drop received data
+}
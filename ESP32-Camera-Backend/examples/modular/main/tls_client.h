@@ -0,0 +1,112 @@
+/**
+ * tls_client.h - TLS client for the MQTT connection with session resumption
+ * and public-key pinning
+ *
+ * Drop-in Client for PubSubClient in place of WiFiClientSecure, which neither
+ * keeps a session across reconnects nor checks the broker unless given a CA.
+ *
+ * Resumption: after every handshake the session (ticket or id, plus the
+ * broker's leaf certificate) is serialized into RTC memory, so reconnects and
+ * deep-sleep wakes offer it and the broker can skip the key exchange and the
+ * certificate chain. With TLS_SESSION_NVS a new session is also written to NVS
+ * for the first connect after power loss. A broker that has forgotten the
+ * session answers with a full handshake; nothing else changes.
+ *
+ * Pinning: MQTT_TLS_PINS lists SHA-256 hashes (hex) of SubjectPublicKeyInfo.
+ * A connection is kept if the leaf's key is pinned (the handshake proves the
+ * broker holds it), or if the leaf verifies (mbedtls_x509_crt_verify, with
+ * the broker's host name) up to a pinned CA certificate in the chain. A CA
+ * pin survives leaf renewals, but pin a private CA or a leaf: a public CA
+ * signs for anyone, and a broker reached by IP has no name to check. An
+ * empty list refuses every connect, unless MQTT_TLS_INSECURE is set for a dev
+ * build: then it connects unverified, like setInsecure(), and says so on every
+ * full handshake. A resumed session was pinned when it was first established.
+ *
+ * Blocking on connect() (run from the mqtt_connect task); reads and writes
+ * follow WiFiClient semantics. Not thread safe: one owner at a time.
+ * Written against mbedTLS 2.28 (arduino-esp32 2.x, TLS 1.2).
+ */
+
+#ifndef TLS_CLIENT_H
+#define TLS_CLIENT_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include "config.h"
+
+// Cost of the last handshake (logged by MQTTManager, for full vs resumed)
+struct TlsHandshakeStats {
+    uint32_t tcpMs;         // TCP connect
+    uint32_t tlsMs;         // TLS handshake
+    uint32_t heapPeak;      // Internal heap taken at the low point (sampled per handshake step)
+    bool resumed;           // Broker accepted the stored session
+    bool offered;           // A stored session was offered
+    int error;              // mbedTLS error, 0 on success
+};
+
+class TlsClient : public Client {
+public:
+    TlsClient();
+    ~TlsClient();
+
+    /**
+     * Restore the stored session (RTC, else NVS) and parse MQTT_TLS_PINS.
+     * Optional: the first connect() does it.
+     */
+    void begin();
+    // Bounds the handshake and each write
+    void setHandshakeTimeout(uint32_t seconds) { _timeoutMs = seconds * 1000; }
+
+    // Drop the stored session everywhere (next connect is a full handshake)
+    void forgetSession();
+
+    const TlsHandshakeStats& lastHandshake() const { return _stats; }
+    uint32_t fullHandshakes() const { return _fullCount; }
+    uint32_t resumedHandshakes() const { return _resumedCount; }
+
+    // Client
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(const char* host, uint16_t port) override;
+    size_t write(uint8_t b) override;
+    size_t write(const uint8_t* buf, size_t size) override;
+    int available() override;
+    int read() override;
+    int read(uint8_t* buf, size_t size) override;
+    int peek() override;
+    void flush() override;
+    void stop() override;
+    uint8_t connected() override;
+    operator bool() override { return connected(); }
+
+private:
+    WiFiClient _tcp;
+    mbedtls_ssl_context _ssl;
+    mbedtls_ssl_config _conf;
+    mbedtls_ctr_drbg_context _drbg;
+    mbedtls_entropy_context _entropy;
+    bool _ready;            // begin() done: _conf and _drbg set up
+    bool _open;             // _ssl set up and handshake done
+    int _peeked;            // Byte held by peek(), -1 = none
+    uint32_t _timeoutMs;
+    uint32_t _hostHash;     // host:port of the current connection
+    uint8_t _pins[TLS_MAX_PINS][32];
+    uint8_t _pinCount;
+    TlsHandshakeStats _stats;
+    uint32_t _fullCount;
+    uint32_t _resumedCount;
+
+    static int bioSend(void* ctx, const unsigned char* buf, size_t len);
+    static int bioRecv(void* ctx, unsigned char* buf, size_t len);
+    int handshake(size_t heapBefore, bool& full);
+    bool pinMatches(const char* host);
+    bool keyPinned(const mbedtls_x509_crt* crt);
+    bool chainVerifies(const mbedtls_x509_crt* leaf, const mbedtls_x509_crt* anchor, const char* host);
+    void offerSession();
+    void storeSession(bool full);
+    void close();
+};
+
+#endif // TLS_CLIENT_H
@@ -1,98 +1,202 @@
 /**
  * upload_manager.cpp - Upload management implementation
+ *
+ * Request bodies and response parsing use the capture arena
+ * (capture_arena.h) so repeated uploads do not fragment the heap.
  */
 
 #include <Arduino.h>
 #include "upload_manager.h"
 #include "config.h" // Include config.h to access SERVER_BASE_URL
+#include "telemetry_manager.h"
+#include "capture_arena.h"
+#include "rate_limiter.h"
+#include "upload_request.h"
+
+static const char* RESPONSE_HEADERS[] = { "Upload-Offset", "Retry-After" };
 
 UploadManager::UploadManager() {
     _lastHttpCode = 0;
-    _lastResponse = "";
+    _lastResponse[0] = '\0';
+    _retryHash[0] = '\0';
+    _retryUrl[0] = '\0';
+    _retryResumes = 0;
+    _retryAt = 0;
+}
+
+void UploadManager::buildUrl(char* out, size_t outSize, const char* path) const {
+    snprintf(out, outSize, "http://%s:%d%s%s", serverIP, SERVER_PORT, SERVER_API_PATH, path);
+}
+
+// upload_request.h builders write their headers through this
+static auto headersOf(HTTPClient& http) {
+    return [&http](const char* name, const char* value) { http.addHeader(name, value); };
+}
+
+void UploadManager::addAuthHeader(HTTPClient& http, const String& token) const {
+    addAuthHeaders(headersOf(http), token.c_str(), deviceId());
+}
+
+bool UploadManager::throttled() const {
+    uint32_t left = rateLimiter.holdRemainingMs();
+    if (left) {
+        Serial.printf("[RATE] Server asked us to wait: upload skipped (%lu ms left)\n",
+                      (unsigned long)left);
+    }
+    return left > 0;
+}
+
+void UploadManager::noteRetryAfter(HTTPClient& http) {
+    if (_lastHttpCode != 429 && _lastHttpCode != 503) {
+        return;
+    }
+    // Retry-After in seconds; the HTTP-date form is not used by our server
+    long seconds = http.hasHeader("Retry-After") ? http.header("Retry-After").toInt() : 0;
+    rateLimiter.holdFor(seconds > 0 ? (uint32_t)seconds : RATE_DEFAULT_RETRY_S);
+}
+
+bool UploadManager::handleResponse(HTTPClient& http) {
+    bool success = false;
+    _lastResponse[0] = '\0';
+
+    if (_lastHttpCode <= 0) {
+        Serial.printf("HTTP Error: %s\n", http.errorToString(_lastHttpCode).c_str());
+        return false;
+    }
+    Serial.printf("HTTP %d\n", _lastHttpCode);
+
+    // Read body straight into the arena instead of http.getString()
+    int size = http.getSize();
+    size_t want = (size > 0 && size < UPLOAD_RESPONSE_MAX) ? (size_t)size : UPLOAD_RESPONSE_MAX;
+    char* body = (char*)arenaAlloc(want + 1);
+    size_t bodyLen = 0;
+    if (body) {
+        WiFiClient* stream = http.getStreamPtr();
+        if (stream) {
+            stream->setTimeout(2000);
+            bodyLen = stream->readBytes((uint8_t*)body, want);
+        }
+        body[bodyLen] = '\0';
+        strncpy(_lastResponse, body, sizeof(_lastResponse) - 1);
+        _lastResponse[sizeof(_lastResponse) - 1] = '\0';
+    }
+
+    if (_lastHttpCode == 200 || _lastHttpCode == 201) {
+        BasicJsonDocument<ArenaJsonAllocator> doc(1024);
+        DeserializationError error = body ? deserializeJson(doc, body, bodyLen)
+                                          : deserializeJson(doc, "");
+
+        if (!error && doc["success"]) {
+            const char* message = doc["message"] | "Success";
+            Serial.println(message);
+            success = true;
+        }
+    } else if (_lastHttpCode == 401) {
+        Serial.println("Token expired (401)");
+    } else {
+        Serial.printf("Response: %.200s\n", _lastResponse);
+    }
+
+    arenaFree(body);
+    return success;
 }
 
-bool UploadManager::upload(camera_fb_t* fb, const String& token) {
+bool UploadManager::upload(camera_fb_t* fb, const String& token, const char* contentHash,
+                           const char* captureId, time_t capturedAt, const char* detection) {
     if (!fb) {
         Serial.println("✗ Invalid frame buffer");
         return false;
     }
+    if (throttled()) {
+        return false;
+    }
     
     HTTPClient http;
-    String baseUrl = "http://" + String(serverIP) + ":" + String(SERVER_PORT) + SERVER_API_PATH;
-    String uploadUrl = baseUrl + "/upload-image";
+    char uploadUrl[96];
+    buildUrl(uploadUrl, sizeof(uploadUrl), "/upload-image");
     http.begin(uploadUrl);
-    http.addHeader("Authorization", "Bearer " + token);
+    addAuthHeader(http, token);
     http.addHeader("Content-Type", "image/jpeg");
+    addCaptureHeaders(headersOf(http), captureId, capturedAt);
+    addImageHeaders(headersOf(http), nullptr, nullptr, contentHash, detection);
+    http.collectHeaders(RESPONSE_HEADERS, 2);
     http.setTimeout(30000); // 30s timeout
     
     Serial.println("📤 Uploading to server...");
+    rateLimiter.pace(fb->len);
     _lastHttpCode = http.POST(fb->buf, fb->len);
+    noteRetryAfter(http);
     
-    bool success = false;
-    if (_lastHttpCode > 0) {
-        _lastResponse = http.getString();
-        Serial.printf("HTTP %d\n", _lastHttpCode);
-        
-        if (_lastHttpCode == 200 || _lastHttpCode == 201) {
-            DynamicJsonDocument doc(1024);
-            DeserializationError error = deserializeJson(doc, _lastResponse);
-            
-            if (!error && doc["success"]) {
-                const char* message = doc["message"] | "Success";
-                Serial.println(message);
-                success = true;
-            }
-        } else if (_lastHttpCode == 401) {
-            Serial.println("Token expired (401)");
-        }
-    } else {
-        Serial.printf("HTTP Error: %s\n", http.errorToString(_lastHttpCode).c_str());
-    }
-    
+    bool success = handleResponse(http);
+    telemetryMgr.recordUpload(fb->len, success);
     http.end();
     return success;
 }
 
+bool UploadManager::hasUpload(const char* contentHash, const String& token) {
+    if (!contentHash || !*contentHash) {
+        return false;
+    }
+
+    HTTPClient http;
+    char url[160];
+    char path[96];
+    snprintf(path, sizeof(path), "/upload-image/%s", contentHash);
+    buildUrl(url, sizeof(url), path);
+    http.begin(url);
+    addAuthHeader(http, token);
+    http.setTimeout(10000);
+
+    // 200 = stored, 404 = unknown; the body is not needed
+    _lastHttpCode = http.GET();
+    bool exists = _lastHttpCode == 200;
+    Serial.printf("[DEDUP] %.12s... -> HTTP %d (%s)\n", contentHash, _lastHttpCode,
+                  exists ? "already stored" : "upload needed");
+    http.end();
+    return exists;
+}
+
 int UploadManager::getLastHttpCode() {
     return _lastHttpCode;
 }
 
 String UploadManager::getLastResponse() {
-    return _lastResponse;
+    return String(_lastResponse);
 }
 
-bool UploadManager::uploadImage(const uint8_t* buf, size_t len, const String& token) {
+bool UploadManager::uploadImage(const uint8_t* buf, size_t len, const String& token,
+                                const char* captureId, const char* kind, const char* roi,
+                                const char* contentHash, time_t capturedAt, const char* detection) {
     if (!buf || len == 0) {
         Serial.println("✗ Invalid buffer");
         return false;
     }
+    if (throttled()) {
+        return false;
+    }
     
     HTTPClient http;
-    String baseUrl = "http://" + String(serverIP) + ":" + String(SERVER_PORT) + SERVER_API_PATH;
-    String uploadUrl = baseUrl + "/upload-image";
+    char uploadUrl[96];
+    buildUrl(uploadUrl, sizeof(uploadUrl), "/upload-image");
     http.begin(uploadUrl);
-    http.addHeader("Authorization", "Bearer " + token);
+    addAuthHeader(http, token);
+    addCaptureHeaders(headersOf(http), captureId, capturedAt);
+    addImageHeaders(headersOf(http), kind, roi, contentHash, detection);
+    http.collectHeaders(RESPONSE_HEADERS, 2);
     http.setTimeout(30000); // 30s timeout
     
-    Serial.println("📤 Uploading image to server...");
+    Serial.printf("📤 Uploading %s image to server...\n", kind ? kind : "full");
     
-    // Create multipart/form-data boundary
-    String boundary = "----ESP32Boundary" + String(millis());
-    String contentType = "multipart/form-data; boundary=" + boundary;
-    http.addHeader("Content-Type", contentType);
-    
-    // Build multipart body
-    String bodyStart = "--" + boundary + "\r\n";
-    bodyStart += "Content-Disposition: form-data; name=\"image\"; filename=\"capture.jpg\"\r\n";
-    bodyStart += "Content-Type: image/jpeg\r\n\r\n";
-    
-    String bodyEnd = "\r\n--" + boundary + "--\r\n";
+    // multipart/form-data framing (upload_request.h)
+    MultipartFraming multipart;
+    multipart.begin(millis());
+    http.addHeader("Content-Type", multipart.contentType);
     
     // Calculate total size
-    size_t totalLen = bodyStart.length() + len + bodyEnd.length();
+    size_t totalLen = multipart.bodyLength(len);
     
-    // Allocate buffer for complete body
-    uint8_t* fullBody = (uint8_t*)malloc(totalLen);
+    // Allocate buffer for complete body (arena, heap fallback)
+    uint8_t* fullBody = (uint8_t*)arenaAlloc(totalLen);
     if (!fullBody) {
         Serial.println("✗ Memory allocation failed");
         http.end();
@@ -100,37 +204,212 @@ bool UploadManager::uploadImage(const uint8_t* buf, size_t len, const String& to
     }
     
     // Copy parts into buffer
-    memcpy(fullBody, bodyStart.c_str(), bodyStart.length());
-    memcpy(fullBody + bodyStart.length(), buf, len);
-    memcpy(fullBody + bodyStart.length() + len, bodyEnd.c_str(), bodyEnd.length());
+    memcpy(fullBody, multipart.prologue, multipart.prologueLen);
+    memcpy(fullBody + multipart.prologueLen, buf, len);
+    memcpy(fullBody + multipart.prologueLen + len, multipart.epilogue, multipart.epilogueLen);
     
     // Send POST request
+    rateLimiter.pace(totalLen);
     _lastHttpCode = http.POST(fullBody, totalLen);
-    free(fullBody);
+    arenaFree(fullBody);
+    noteRetryAfter(http);
     
+    bool success = handleResponse(http);
+    telemetryMgr.recordUpload(len, success);
+    http.end();
+    return success;
+}
+
+bool UploadManager::openSession(size_t len, const String& token, const char* contentHash,
+                                const char* captureId, const char* kind, time_t capturedAt,
+                                char* sessionUrl, size_t urlSize, size_t* offset, bool* duplicate) {
+    HTTPClient http;
+    char url[96];
+    buildUrl(url, sizeof(url), "/uploads");
+    http.begin(url);
+    addAuthHeader(http, token);
+    addSessionHeaders(headersOf(http), len, contentHash);
+    addCaptureHeaders(headersOf(http), captureId, capturedAt);
+    addImageHeaders(headersOf(http), kind, nullptr, nullptr);
+    http.collectHeaders(RESPONSE_HEADERS, 2);
+    http.setTimeout(RESUMABLE_CHUNK_TIMEOUT);
+
+    _lastHttpCode = http.POST((uint8_t*)nullptr, 0);
+    noteRetryAfter(http);
+    if (_lastHttpCode != 200 && _lastHttpCode != 201) {
+        Serial.printf("[RESUME] Session open failed: HTTP %d\n", _lastHttpCode);
+        http.end();
+        return false;
+    }
+
+    WiFiClient* stream = http.getStreamPtr();
+    BasicJsonDocument<ArenaJsonAllocator> doc(512);
+    DeserializationError error = stream ? deserializeJson(doc, *stream)
+                                        : deserializeJson(doc, "");
+    http.end();
+    if (error || !doc["success"]) {
+        return false;
+    }
+
+    *duplicate = doc["data"]["duplicate"] | false;
+    if (*duplicate) {
+        return true;
+    }
+    const char* id = doc["data"]["id"] | "";
+    *offset = doc["data"]["offset"] | 0;
+    if (!*id || *offset > len) {
+        return false;
+    }
+    char path[64];
+    snprintf(path, sizeof(path), "/uploads/%s", id);
+    buildUrl(sessionUrl, urlSize, path);
+    return true;
+}
+
+bool UploadManager::queryOffset(const char* sessionUrl, const String& token, size_t* offset) {
+    HTTPClient http;
+    http.begin(sessionUrl);
+    addAuthHeader(http, token);
+    const char* keys[] = { "Upload-Offset" };
+    http.collectHeaders(keys, 1);
+    http.setTimeout(RESUMABLE_CHUNK_TIMEOUT);
+    _lastHttpCode = http.sendRequest("HEAD");
+    bool ok = _lastHttpCode == 200 && http.hasHeader("Upload-Offset");
+    if (ok) {
+        *offset = (size_t)http.header("Upload-Offset").toInt();
+    }
+    http.end();
+    return ok;
+}
+
+bool UploadManager::scheduleResume(const char* contentHash, const char* sessionUrl, uint8_t resumes,
+                                   size_t offset, size_t len) {
+    if (resumes > RESUMABLE_MAX_RESUMES) {
+        Serial.printf("[RESUME] Giving up at %u / %u bytes (HTTP %d)\n",
+                      (unsigned)offset, (unsigned)len, _lastHttpCode);
+        return false;
+    }
+    uint32_t delayMs = RESUMABLE_RETRY_DELAY_MS * resumes;
+    snprintf(_retryHash, sizeof(_retryHash), "%s", contentHash);
+    if (sessionUrl != _retryUrl) {
+        snprintf(_retryUrl, sizeof(_retryUrl), "%s", sessionUrl);
+    }
+    _retryResumes = resumes;
+    _retryAt = millis() + delayMs;
+    Serial.printf("[RESUME] Drop %u at %u / %u bytes (HTTP %d): retry in %lu ms\n",
+                  resumes, (unsigned)offset, (unsigned)len, _lastHttpCode, (unsigned long)delayMs);
+    return true;
+}
+
+uint32_t UploadManager::retryRemainingMs() const {
+    if (!_retryHash[0]) {
+        return 0;
+    }
+    long left = (long)(_retryAt - millis());
+    return left > 0 ? (uint32_t)left : 0;
+}
+
+bool UploadManager::uploadResumable(const uint8_t* buf, size_t len, const String& token,
+                                    const char* contentHash, const char* captureId,
+                                    const char* kind, time_t capturedAt) {
+    if (!buf || len == 0 || !contentHash) {
+        Serial.println("✗ Invalid buffer");
+        return false;
+    }
+    if (throttled()) {
+        return false;
+    }
+
+    char sessionUrl[128];
+    size_t offset = 0;
+    bool duplicate = false;
+    uint8_t resumes = 0;
+    bool resumed = false;
+    if (_retryHash[0] && strcmp(_retryHash, contentHash) == 0) {
+        // Scheduled resume after a drop: find out what arrived
+        resumes = _retryResumes;
+        snprintf(sessionUrl, sizeof(sessionUrl), "%s", _retryUrl);
+        resumed = queryOffset(sessionUrl, token, &offset) && offset <= len;
+        if (resumed) {
+            Serial.printf("[RESUME] Drop %u: server has %u / %u bytes\n",
+                          resumes, (unsigned)offset, (unsigned)len);
+        }
+    }
+    _retryHash[0] = '\0';
+    // New file, or the session expired (404) while we waited: (re)open it
+    if (!resumed && !openSession(len, token, contentHash, captureId, kind, capturedAt,
+                                 sessionUrl, sizeof(sessionUrl), &offset, &duplicate)) {
+        if (resumes) {
+            scheduleResume(contentHash, _retryUrl, resumes + 1, offset, len);
+        }
+        telemetryMgr.recordUpload(0, false);
+        return false;
+    }
+    if (duplicate) {
+        Serial.println("[RESUME] Server already has this file");
+        return true;
+    }
+    if (offset > 0) {
+        Serial.printf("[RESUME] Continuing at %u / %u bytes\n", (unsigned)offset, (unsigned)len);
+    }
+
+    size_t startOffset = offset;
+    size_t wireBytes = 0;
+    uint16_t chunks = 0;
     bool success = false;
-    if (_lastHttpCode > 0) {
-        _lastResponse = http.getString();
-        Serial.printf("HTTP %d\n", _lastHttpCode);
-        
+
+    while (true) {
+        size_t n = min((size_t)RESUMABLE_CHUNK_BYTES, len - offset);
+
+        HTTPClient http;
+        http.begin(sessionUrl);
+        addAuthHeader(http, token);
+        addRangeHeaders(headersOf(http), offset);
+        http.collectHeaders(RESPONSE_HEADERS, 2);
+        http.setTimeout(RESUMABLE_CHUNK_TIMEOUT);
+
+        rateLimiter.pace(n);
+        _lastHttpCode = http.sendRequest("PATCH", (uint8_t*)buf + offset, n);
+        wireBytes += n;
+        chunks++;
+
         if (_lastHttpCode == 200 || _lastHttpCode == 201) {
-            DynamicJsonDocument doc(1024);
-            DeserializationError error = deserializeJson(doc, _lastResponse);
-            
-            if (!error && doc["success"]) {
-                const char* message = doc["message"] | "Success";
-                Serial.println(message);
-                success = true;
-            }
-        } else if (_lastHttpCode == 401) {
-            Serial.println("Token expired (401)");
-        } else {
-            Serial.println("Response: " + _lastResponse.substring(0, 200));
+            // Last chunk: the server stored the image and answers like /upload-image
+            success = handleResponse(http);
+            http.end();
+            break;
         }
-    } else {
-        Serial.printf("HTTP Error: %s\n", http.errorToString(_lastHttpCode).c_str());
+
+        bool advanced = false;
+        if ((_lastHttpCode == 204 || _lastHttpCode == 409) && http.hasHeader("Upload-Offset")) {
+            size_t serverOffset = (size_t)http.header("Upload-Offset").toInt();
+            advanced = serverOffset > offset || (_lastHttpCode == 409 && serverOffset != offset);
+            offset = min(serverOffset, len);
+        }
+        noteRetryAfter(http);
+        http.end();
+        if (advanced) {
+            continue;
+        }
+        if (rateLimiter.holdRemainingMs()) {
+            // Server overloaded: keep the session, the next backlog pass resumes it
+            Serial.printf("[RESUME] Paused at %u / %u bytes (HTTP %d)\n",
+                          (unsigned)offset, (unsigned)len, _lastHttpCode);
+            break;
+        }
+
+        // Dropped connection or server error: resume later from net_task's loop
+        // (MQTT keeps running meanwhile), starting with the server's offset
+        scheduleResume(contentHash, sessionUrl, resumes + 1, offset, len);
+        resumes++;
+        break;
     }
-    
-    http.end();
+
+    // Bytes actually put on the wire vs the file; a restart from zero would
+    // have cost len for every failed attempt on top of the final one.
+    Serial.printf("[RESUME] %s: %u B file, %u B sent from offset %u in %u chunks, %u resumes\n",
+                  success ? "done" : "incomplete", (unsigned)len, (unsigned)wireBytes,
+                  (unsigned)startOffset, chunks, resumes);
+    telemetryMgr.recordUpload(wireBytes, success);
     return success;
 }
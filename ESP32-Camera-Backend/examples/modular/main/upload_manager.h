@@ -10,17 +10,61 @@
 #include "esp_camera.h"
 #include "config.h"
 
+#define UPLOAD_RESPONSE_MAX 1024   // Response bytes parsed (larger bodies are truncated)
+
 class UploadManager {
 public:
     UploadManager();
-    bool upload(camera_fb_t* fb, const String& token);
-    bool uploadImage(const uint8_t* buf, size_t len, const String& token);  // Added: direct buffer upload
+    bool upload(camera_fb_t* fb, const String& token, const char* contentHash = nullptr,
+                const char* captureId = nullptr, time_t capturedAt = 0,
+                const char* detection = nullptr);
+    // Direct buffer upload; captureId/kind ("thumb" | "roi" | "full") go out as
+    // X-Capture-Id / X-Image-Kind, roi ("x,y,w,h,frameW,frameH") as X-Roi,
+    // contentHash (hex SHA-256) as X-Content-SHA256, capturedAt (Unix seconds,
+    // 0 = clock not set) as X-Captured-At, detection ("person,87") as X-Detection
+    bool uploadImage(const uint8_t* buf, size_t len, const String& token,
+                     const char* captureId = nullptr, const char* kind = nullptr,
+                     const char* roi = nullptr, const char* contentHash = nullptr,
+                     time_t capturedAt = 0, const char* detection = nullptr);
+    // Ask the server whether an image with this hash is already stored.
+    // false on any error, so the caller falls back to a normal upload.
+    bool hasUpload(const char* contentHash, const String& token);
+    // Resumable upload (POST /uploads, HEAD offset, PATCH ranges). The session
+    // is keyed by contentHash, so a later call for the same bytes continues
+    // from the last offset the server stored, even after a reboot.
+    // A dropped PATCH does not wait in here: it returns false and schedules
+    // the resume (retryRemainingMs()); the next call for the same file picks
+    // up the session and its drop count.
+    bool uploadResumable(const uint8_t* buf, size_t len, const String& token,
+                         const char* contentHash, const char* captureId = nullptr,
+                         const char* kind = nullptr, time_t capturedAt = 0);
+    // > 0 while a dropped resumable upload waits for its retry slot
+    uint32_t retryRemainingMs() const;
     int getLastHttpCode();
     String getLastResponse();
 
 private:
     int _lastHttpCode;
-    String _lastResponse;
+    char _lastResponse[UPLOAD_RESPONSE_MAX / 4];   // Head of last response (for diagnostics)
+
+    // Resume scheduled after a drop ("" hash = none)
+    char _retryHash[65];
+    char _retryUrl[128];
+    uint8_t _retryResumes;
+    uint32_t _retryAt;
+    bool scheduleResume(const char* contentHash, const char* sessionUrl, uint8_t resumes,
+                        size_t offset, size_t len);
+
+    void buildUrl(char* out, size_t outSize, const char* path) const;
+    void addAuthHeader(HTTPClient& http, const String& token) const;
+    bool handleResponse(HTTPClient& http);
+    // Fleet rate control (rate_limiter.h): refuse while held, hold on 429/503
+    bool throttled() const;
+    void noteRetryAfter(HTTPClient& http);
+    bool openSession(size_t len, const String& token, const char* contentHash,
+                     const char* captureId, const char* kind, time_t capturedAt,
+                     char* sessionUrl, size_t urlSize, size_t* offset, bool* duplicate);
+    bool queryOffset(const char* sessionUrl, const String& token, size_t* offset);
 };
 
 #endif // UPLOAD_MANAGER_H
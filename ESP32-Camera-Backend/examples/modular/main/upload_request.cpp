@@ -0,0 +1,15 @@
+/**
+ * upload_request.cpp - Multipart framing for UploadManager::uploadImage
+ */
+
+#include "upload_request.h"
+
+void MultipartFraming::begin(unsigned long seed) {
+    snprintf(boundary, sizeof(boundary), "----ESP32Boundary%lu", seed);
+    snprintf(contentType, sizeof(contentType), "multipart/form-data; boundary=%s", boundary);
+    prologueLen = snprintf(prologue, sizeof(prologue),
+                           "--%s\r\n"
+                           "Content-Disposition: form-data; name=\"image\"; filename=\"capture.jpg\"\r\n"
+                           "Content-Type: image/jpeg\r\n\r\n", boundary);
+    epilogueLen = snprintf(epilogue, sizeof(epilogue), "\r\n--%s--\r\n", boundary);
+}
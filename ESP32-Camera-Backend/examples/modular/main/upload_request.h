@@ -0,0 +1,94 @@
+/**
+ * upload_request.h - Headers and multipart framing of UploadManager requests
+ *
+ * What goes on the wire, without HTTPClient: UploadManager hands these an
+ * addHeader that forwards to HTTPClient, the load simulator (loadsim/) one
+ * that appends to its request buffer. Plain C++ on top of config.h.
+ *
+ * addHeader is any callable taking (const char* name, const char* value);
+ * values are only valid during the call.
+ */
+
+#ifndef UPLOAD_REQUEST_H
+#define UPLOAD_REQUEST_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include <time.h>
+#include "config.h"
+
+// Authorization and X-Device-Id, on every request
+template <typename AddHeader>
+void addAuthHeaders(AddHeader addHeader, const char* token, const char* device) {
+    char auth[512]; // JWTs are a few hundred bytes
+    snprintf(auth, sizeof(auth), "Bearer %s", token);
+    addHeader("Authorization", auth);
+    addHeader("X-Device-Id", device); // Fleet: which camera sent this
+}
+
+// X-Capture-Id / X-Captured-At (Unix seconds, 0 = clock not set)
+template <typename AddHeader>
+void addCaptureHeaders(AddHeader addHeader, const char* captureId, time_t capturedAt) {
+    if (captureId) {
+        addHeader("X-Capture-Id", captureId);
+    }
+    if (capturedAt > 0) {
+        char at[24];
+        snprintf(at, sizeof(at), "%lu", (unsigned long)capturedAt);
+        addHeader("X-Captured-At", at);
+    }
+}
+
+// X-Image-Kind, X-Roi, X-Content-SHA256, X-Detection (each left out when nullptr)
+template <typename AddHeader>
+void addImageHeaders(AddHeader addHeader, const char* kind, const char* roi, const char* contentHash,
+                     const char* detection = nullptr) {
+    if (kind) {
+        addHeader("X-Image-Kind", kind);
+    }
+    if (roi) {
+        addHeader("X-Roi", roi);
+    }
+    if (contentHash) {
+        addHeader("X-Content-SHA256", contentHash);
+    }
+    if (detection) {
+        addHeader("X-Detection", detection);
+    }
+}
+
+// POST /uploads: Upload-Length and the hash the session is keyed by
+template <typename AddHeader>
+void addSessionHeaders(AddHeader addHeader, size_t length, const char* contentHash) {
+    char lengthStr[12];
+    snprintf(lengthStr, sizeof(lengthStr), "%u", (unsigned)length);
+    addHeader("Upload-Length", lengthStr);
+    addHeader("X-Content-SHA256", contentHash);
+}
+
+// PATCH /uploads/:id at offset
+template <typename AddHeader>
+void addRangeHeaders(AddHeader addHeader, size_t offset) {
+    char offsetStr[12];
+    snprintf(offsetStr, sizeof(offsetStr), "%u", (unsigned)offset);
+    addHeader("Content-Type", "application/offset+octet-stream");
+    addHeader("Upload-Offset", offsetStr);
+}
+
+/**
+ * One-part multipart/form-data body around an image ("image" field):
+ * prologue + image + epilogue. seed makes the boundary (millis() on the device).
+ */
+struct MultipartFraming {
+    char boundary[40];
+    char contentType[80];
+    char prologue[192];
+    char epilogue[48];
+    int prologueLen;
+    int epilogueLen;
+
+    void begin(unsigned long seed);
+    size_t bodyLength(size_t imageLen) const { return prologueLen + imageLen + epilogueLen; }
+};
+
+#endif // UPLOAD_REQUEST_H
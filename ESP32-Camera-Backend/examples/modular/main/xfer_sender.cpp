@@ -0,0 +1,151 @@
+/**
+ * xfer_sender.cpp - Sliding-window chunk sender
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "xfer_sender.h"
+
+static const char BASE64_ALPHABET[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+// Padded Base64 of len bytes into out; returns the characters written.
+// Local rather than mbedtls_base64_encode so this file also builds on a PC.
+static size_t base64Encode(const uint8_t* in, size_t len, char* out) {
+    char* p = out;
+    size_t i = 0;
+    for (; i + 3 <= len; i += 3) {
+        uint32_t v = (in[i] << 16) | (in[i + 1] << 8) | in[i + 2];
+        *p++ = BASE64_ALPHABET[v >> 18];
+        *p++ = BASE64_ALPHABET[(v >> 12) & 0x3F];
+        *p++ = BASE64_ALPHABET[(v >> 6) & 0x3F];
+        *p++ = BASE64_ALPHABET[v & 0x3F];
+    }
+    if (i < len) {
+        uint32_t v = in[i] << 16;
+        if (i + 1 < len) {
+            v |= in[i + 1] << 8;
+        }
+        *p++ = BASE64_ALPHABET[v >> 18];
+        *p++ = BASE64_ALPHABET[(v >> 12) & 0x3F];
+        *p++ = i + 1 < len ? BASE64_ALPHABET[(v >> 6) & 0x3F] : '=';
+        *p++ = '=';
+    }
+    return p - out;
+}
+
+size_t XferSender::chunkCount(size_t imageSize, size_t chunkSize) {
+    size_t chunks = (imageSize + chunkSize - 1) / chunkSize;
+    return chunks <= XFER_MAX_CHUNKS ? chunks : 0;
+}
+
+XferSender::XferSender() : _imageId(nullptr), _total(0), _complete(false), _progress(false) {}
+
+void XferSender::begin(const uint8_t* image, size_t imageSize, size_t chunkSize, const char* imageId,
+                       const XferMeta& meta, char* payload, uint8_t* acked, uint16_t* sentAt,
+                       uint32_t nowMs) {
+    _image = image;
+    _imageSize = imageSize;
+    _chunkSize = chunkSize;
+    _imageId = imageId;
+    _meta = meta;
+    _payload = payload;
+    _payloadCap = payloadCapacity(chunkSize);
+    _acked = acked;
+    _sentAt = sentAt;
+    _total = (uint16_t)chunkCount(imageSize, chunkSize);
+    memset(_acked, 0, bitmapBytes(_total));
+    _cumAck = 0;
+    _sackEnd = 0;
+    _next = 0;
+    _complete = false;
+    _progress = false;
+    _startedAt = _lastProgressAt = nowMs;
+    _sends = 0;
+    _timeouts = 0;
+}
+
+// One chunk: JSON envelope written around Base64 encoded in place
+size_t XferSender::build(size_t i, uint32_t nowMs) {
+    size_t start = i * _chunkSize;
+    size_t len = (start + _chunkSize > _imageSize) ? (_imageSize - start) : _chunkSize;
+    int headLen = snprintf(_payload, ENVELOPE_MAX,
+                           "{\"id\":\"%s\",\"index\":%u,\"total\":%u,\"win\":%u,\"data\":\"",
+                           _imageId, (unsigned)i, (unsigned)_total, XFER_WINDOW);
+    size_t pos = headLen + base64Encode(_image + start, len, _payload + headLen);
+    if (_meta.userId) {
+        pos += snprintf(_payload + pos, _payloadCap - pos, "\",\"userId\":\"%s\"", _meta.userId);
+    } else {
+        _payload[pos++] = '"';
+    }
+    if (_meta.captureId) {
+        pos += snprintf(_payload + pos, _payloadCap - pos, ",\"captureId\":\"%s\"", _meta.captureId);
+    }
+    if (_meta.kind) {
+        pos += snprintf(_payload + pos, _payloadCap - pos, ",\"kind\":\"%s\"", _meta.kind);
+    }
+    if (_meta.capturedAt > 0) {
+        pos += snprintf(_payload + pos, _payloadCap - pos, ",\"capturedAt\":%lu",
+                        (unsigned long)_meta.capturedAt);
+    }
+    if (_meta.roi) {
+        pos += snprintf(_payload + pos, _payloadCap - pos, ",\"roi\":\"%s\"", _meta.roi);
+    }
+    if (_meta.detection) {
+        pos += snprintf(_payload + pos, _payloadCap - pos, ",\"detection\":\"%s\"", _meta.detection);
+    }
+    _payload[pos++] = '}';
+
+    _sentAt[i] = (uint16_t)nowMs;
+    _sends++;
+    return pos;
+}
+
+void XferSender::mark(uint16_t from, uint16_t to) {
+    for (uint16_t i = from; i < to && i < _total; i++) {
+        uint8_t bit = 1 << (i & 7);
+        if (!(_acked[i >> 3] & bit)) {
+            _acked[i >> 3] |= bit;
+            _progress = true;
+        }
+    }
+}
+
+bool XferSender::handleAck(const uint8_t* frame, size_t len) {
+    if (len < 4 || frame[0] != 0xB7 || frame[1] != 1) {
+        return false;
+    }
+    size_t idLen = frame[3];
+    size_t pos = 4 + idLen;
+    if (len < pos + 5 || !_imageId ||
+        strlen(_imageId) != idLen || memcmp(frame + 4, _imageId, idLen) != 0) {
+        return true;    // Late ack for an earlier image
+    }
+
+    uint16_t total = frame[pos] | (frame[pos + 1] << 8);
+    uint16_t cumAck = frame[pos + 2] | (frame[pos + 3] << 8);
+    uint8_t ranges = frame[pos + 4];
+    pos += 5;
+    if (total != _total || cumAck > total) {
+        return true;
+    }
+
+    mark(0, cumAck);
+    for (uint8_t r = 0; r < ranges && pos + 4 <= len; r++, pos += 4) {
+        uint16_t start = frame[pos] | (frame[pos + 1] << 8);
+        uint16_t end = frame[pos + 2] | (frame[pos + 3] << 8);
+        mark(start, end);
+        if (end > _sackEnd) {
+            _sackEnd = end < _total ? end : _total;
+        }
+    }
+
+    // cumAck from the frame may lag our own view after reordering
+    while (_cumAck < _total && isAcked(_cumAck)) {
+        _cumAck++;
+    }
+    if ((frame[2] & 0x01) || _cumAck == _total) {
+        _complete = true;
+        _progress = true;
+    }
+    return true;
+}
@@ -0,0 +1,151 @@
+/**
+ * xfer_sender.h - Sliding-window sender for chunked MQTT images
+ *
+ * The transfer rules of MQTTManager::publishImageChunked without the
+ * transport: chunk envelopes, the window, hole and timeout resends, and ack
+ * parsing. Plain C++ on top of config.h (no Arduino, FreeRTOS or mbedTLS), so
+ * the fleet load simulator (loadsim/) builds this same file on Linux.
+ *
+ * The caller owns the buffers (capture arena on the device), the clock and
+ * the publish: fillWindow() / resendLost() hand it ready payloads.
+ *
+ *   sender.begin(...);
+ *   while (!sender.complete() && !sender.timedOut(now)) {
+ *       sender.fillWindow(now, publish);
+ *       ...deliver acks to handleAck()...
+ *       sender.resendLost(now, publish);
+ *   }
+ */
+
+#ifndef XFER_SENDER_H
+#define XFER_SENDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include "config.h"
+
+// Fields repeated in every chunk envelope (nullptr / 0 = left out)
+struct XferMeta {
+    const char* userId;
+    const char* captureId;
+    const char* kind;       // "thumb" | "roi" | "full"
+    const char* roi;        // "x,y,w,h,frameW,frameH"
+    time_t capturedAt;
+    const char* detection;  // "label,confidence" (detector_model.h)
+};
+
+class XferSender {
+public:
+    static const size_t ENVELOPE_MAX = 320;     // JSON around the Base64 data
+
+    // Chunks for an image; 0 if it cannot go in one transfer (over XFER_MAX_CHUNKS)
+    static size_t chunkCount(size_t imageSize, size_t chunkSize);
+    // Bytes for payload / acked / sentAt in begin()
+    static size_t payloadCapacity(size_t chunkSize) { return (chunkSize + 2) / 3 * 4 + ENVELOPE_MAX; }
+    static size_t bitmapBytes(size_t chunks) { return (chunks + 7) / 8; }
+
+    XferSender();
+
+    /**
+     * Start a transfer. imageId (reassembly key) and meta strings must stay
+     * valid until it ends; payload holds payloadCapacity(chunkSize) bytes,
+     * acked bitmapBytes(chunks), sentAt one entry per chunk.
+     */
+    void begin(const uint8_t* image, size_t imageSize, size_t chunkSize, const char* imageId,
+               const XferMeta& meta, char* payload, uint8_t* acked, uint16_t* sentAt, uint32_t nowMs);
+    void end() { _imageId = nullptr; }
+
+    /**
+     * Publish new chunks until XFER_WINDOW are in flight past cumAck.
+     * publish(const char* payload, size_t len) returns false on failure.
+     * @return false if a publish failed
+     */
+    template <typename Publish>
+    bool fillWindow(uint32_t nowMs, Publish publish) {
+        while (_next < _total && _next < (size_t)_cumAck + XFER_WINDOW) {
+            if (!isAcked(_next) && !publish(_payload, build(_next, nowMs))) {
+                return false;
+            }
+            _next++;
+        }
+        return true;
+    }
+
+    /**
+     * Resend holes below the highest acked range after XFER_REORDER_MS, and,
+     * after XFER_RTO_MS without ack progress, everything unacked that old.
+     * @return false if a publish failed
+     */
+    template <typename Publish>
+    bool resendLost(uint32_t nowMs, Publish publish) {
+        if (_progress) {
+            _lastProgressAt = nowMs;
+            _progress = false;
+        }
+        uint16_t now16 = (uint16_t)nowMs;
+        size_t holeEnd = _sackEnd < _next ? _sackEnd : _next;
+        for (size_t i = _cumAck; i < holeEnd; i++) {
+            if (!isAcked(i) && (uint16_t)(now16 - _sentAt[i]) >= XFER_REORDER_MS &&
+                !publish(_payload, build(i, nowMs))) {
+                return false;
+            }
+        }
+        if (nowMs - _lastProgressAt >= XFER_RTO_MS) {
+            _timeouts++;
+            _lastProgressAt = nowMs;
+            for (size_t i = _cumAck; i < _next; i++) {
+                if (!isAcked(i) && (uint16_t)(now16 - _sentAt[i]) >= XFER_RTO_MS &&
+                    !publish(_payload, build(i, nowMs))) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    /**
+     * Ack frame (format in mqtt_manager.h).
+     * @return false if it is malformed; acks for another image are ignored
+     */
+    bool handleAck(const uint8_t* frame, size_t len);
+
+    bool active() const { return _imageId != nullptr; }
+    bool complete() const { return _complete; }
+    bool timedOut(uint32_t nowMs) const { return nowMs - _startedAt >= XFER_TIMEOUT_MS; }
+    // New chunks acked since the last resendLost()
+    bool progressed() const { return _progress; }
+
+    const char* imageId() const { return _imageId; }
+    uint16_t total() const { return _total; }
+    size_t sent() const { return _next; }          // Distinct chunks sent at least once
+    uint32_t sends() const { return _sends; }      // Including resends
+    uint16_t timeouts() const { return _timeouts; }
+
+private:
+    const uint8_t* _image;
+    size_t _imageSize;
+    size_t _chunkSize;
+    const char* _imageId;       // nullptr = no transfer running
+    XferMeta _meta;
+    char* _payload;
+    size_t _payloadCap;
+    uint8_t* _acked;            // Bitmap, one bit per chunk
+    uint16_t* _sentAt;          // Low 16 bits of the send time, per chunk
+    uint16_t _total;
+    uint16_t _cumAck;           // Every chunk below this has arrived
+    uint16_t _sackEnd;          // End of the highest acked range
+    size_t _next;               // First chunk never sent
+    bool _complete;
+    bool _progress;
+    uint32_t _startedAt;
+    uint32_t _lastProgressAt;
+    uint32_t _sends;
+    uint16_t _timeouts;
+
+    bool isAcked(size_t i) const { return (_acked[i >> 3] >> (i & 7)) & 1; }
+    void mark(uint16_t from, uint16_t to);
+    size_t build(size_t i, uint32_t nowMs);
+};
+
+#endif // XFER_SENDER_H
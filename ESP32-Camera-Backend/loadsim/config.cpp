@@ -0,0 +1,103 @@
+/**
+ * config.cpp - Simulator settings from the environment
+ */
+
+#include <cstdlib>
+#include <ctime>
+#include "config.h"
+
+static std::string envString(const char* name, const char* fallback) {
+    const char* v = getenv(name);
+    return v && *v ? v : fallback;
+}
+
+static unsigned long envNumber(const char* name, unsigned long fallback) {
+    const char* v = getenv(name);
+    return v && *v ? strtoul(v, nullptr, 10) : fallback;
+}
+
+static double envReal(const char* name, double fallback) {
+    const char* v = getenv(name);
+    return v && *v ? strtod(v, nullptr) : fallback;
+}
+
+// scheme://host[:port][/...] -> host, port
+static void splitUrl(std::string url, const char* scheme, uint16_t defaultPort,
+                     std::string& host, uint16_t& port) {
+    size_t sep = url.find("://");
+    if (sep != std::string::npos) {
+        if (url.compare(0, sep, scheme) != 0) {
+            fprintf(stderr, "⚠️ [CONFIG] %s: only %s:// is supported, using it anyway\n",
+                    url.c_str(), scheme);
+        }
+        url = url.substr(sep + 3);
+    }
+    size_t slash = url.find('/');
+    if (slash != std::string::npos) {
+        url.resize(slash);
+    }
+    size_t colon = url.rfind(':');
+    host = url.substr(0, colon);
+    port = colon == std::string::npos ? defaultPort : (uint16_t)atoi(url.c_str() + colon + 1);
+}
+
+SimSettings SimSettings::fromEnv() {
+    SimSettings s;
+
+    splitUrl(envString("MQTT_BROKER", SIM_BROKER_DEFAULT), "mqtt", 1883, s.brokerHost, s.brokerPort);
+    s.mqttUser = envString("MQTT_USERNAME", "");
+    s.mqttPassword = envString("MQTT_PASSWORD", "");
+    splitUrl(envString("BASE_URL", SIM_BASE_URL_DEFAULT), "http", 80, s.httpHost, s.httpPort);
+
+    s.cameras = envNumber("CAMERAS", SIM_CAMERAS_DEFAULT);
+    s.durationS = envNumber("DURATION_S", SIM_DURATION_S_DEFAULT);
+    s.drainS = envNumber("DRAIN_S", SIM_DRAIN_S_DEFAULT);
+    s.eventsPerMin = envReal("EVENTS_PER_MIN", SIM_EVENTS_PER_MIN);
+    s.imageKbMedian = envReal("IMAGE_KB", SIM_IMAGE_KB_MEDIAN);
+    s.imageKbSigma = envReal("IMAGE_KB_SIGMA", SIM_IMAGE_KB_SIGMA);
+    s.imageKbMax = envNumber("IMAGE_KB_MAX", SIM_IMAGE_KB_MAX);
+    s.transport = envString("TRANSPORT", "mqtt") == "http" ? TRANSPORT_HTTP : TRANSPORT_MQTT;
+    s.chunkSize = envNumber("CHUNK_BYTES", MQTT_CHUNK_SIZE_DEFAULT) / 3 * 3;   // Whole Base64 groups
+
+    std::string outage = envString("OUTAGE", "none");
+    s.outage = outage == "broker" ? OUTAGE_BROKER : outage == "wifi" ? OUTAGE_WIFI : OUTAGE_NONE;
+    s.outageAtS = envNumber("OUTAGE_AT_S", 20);
+    s.outageForS = envNumber("OUTAGE_S", 15);
+    s.outageEveryS = envNumber("OUTAGE_EVERY_S", 0);
+    s.outageShare = envReal("OUTAGE_SHARE", 1.0);
+
+    s.backlogMax = envNumber("BACKLOG_MAX", SIM_BACKLOG_MAX);
+    s.backlogIntervalMs = envNumber("BACKLOG_INTERVAL_S", FULL_UPLOAD_INTERVAL_MS / 1000) * 1000;
+    s.backlogJitterMs = (uint64_t)FULL_UPLOAD_START_JITTER_MS * s.backlogIntervalMs / FULL_UPLOAD_INTERVAL_MS;
+    s.reportSeconds = envNumber("REPORT_S", SIM_REPORT_INTERVAL_S);
+    s.seed = envNumber("SEED", 1);
+    // Ids must not repeat between runs: the backend re-acks ids it has seen as done
+    s.boot = envNumber("BOOT", time(nullptr) % 1000000);
+
+    if (s.cameras == 0 || s.chunkSize == 0 || s.backlogIntervalMs == 0 || s.reportSeconds == 0) {
+        fprintf(stderr, "⚠️ [CONFIG] CAMERAS, CHUNK_BYTES, BACKLOG_INTERVAL_S and REPORT_S must be > 0\n");
+        exit(1);
+    }
+    if (s.imageKbMax < SIM_IMAGE_KB_MIN) {
+        s.imageKbMax = SIM_IMAGE_KB_MIN;
+    }
+    return s;
+}
+
+void SimSettings::print(FILE* out) const {
+    static const char* OUTAGES[] = { "none", "broker", "wifi" };
+    fprintf(out, "🎥 [SIM] %u cameras for %u s (+%u s drain), %.1f events/min each, "
+                 "images ~%.0f KB (sigma %.2f, max %u KB), live over %s\n",
+            cameras, durationS, drainS, eventsPerMin, imageKbMedian, imageKbSigma, imageKbMax,
+            transport == TRANSPORT_HTTP ? "HTTP" : "MQTT");
+    fprintf(out, "🎥 [SIM] MQTT %s:%u, HTTP %s:%u, backlog %zu images, pass every ~%u s\n",
+            brokerHost.c_str(), brokerPort, httpHost.c_str(), httpPort, backlogMax,
+            (unsigned)(backlogIntervalMs / 1000));
+    if (outage != OUTAGE_NONE) {
+        fprintf(out, "🎥 [SIM] Outage: %s for %u s at %u s", OUTAGES[outage], outageForS, outageAtS);
+        if (outageEveryS) {
+            fprintf(out, ", every %u s", outageEveryS);
+        }
+        fprintf(out, ", %.0f%% of cameras\n", outageShare * 100);
+    }
+}
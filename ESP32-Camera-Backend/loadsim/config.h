@@ -0,0 +1,89 @@
+/**
+ * config.h - Defaults for the fleet load simulator
+ *
+ * Every setting can be overridden from the environment; see
+ * SimSettings::fromEnv(). Transfer constants (XFER_*, RESUMABLE_*,
+ * FULL_UPLOAD_*, RATE_*, MQTT_CHUNK_SIZE_DEFAULT) are the firmware's own.
+ */
+
+#ifndef LOADSIM_CONFIG_H
+#define LOADSIM_CONFIG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include "../examples/modular/main/config.h"   // Firmware settings
+
+// ===== Targets =====
+#define SIM_BROKER_DEFAULT      "mqtt://localhost:1883"
+#define SIM_BASE_URL_DEFAULT    "http://localhost:3000"  // SERVER_API_PATH is appended
+#define SIM_DEVICE_PREFIX       "sim-"                   // sim-0001, sim-0002, ...
+
+// ===== Fleet and traffic =====
+#define SIM_CAMERAS_DEFAULT     100
+#define SIM_DURATION_S_DEFAULT  60          // Captures stop after this
+#define SIM_DRAIN_S_DEFAULT     120         // Then backlogs get this long to empty
+#define SIM_EVENTS_PER_MIN      2.0         // Motion events per camera (Poisson)
+#define SIM_IMAGE_KB_MEDIAN     60          // Image sizes are lognormal around this
+#define SIM_IMAGE_KB_SIGMA      0.5
+#define SIM_IMAGE_KB_MIN        4
+#define SIM_IMAGE_KB_MAX        400
+#define SIM_BOOT_SPREAD_MS      5000        // Cameras come up across this window
+#define SIM_BACKLOG_MAX         50          // SD queue per camera; the oldest image goes when full
+
+// ===== HTTP (UploadManager timeouts) =====
+#define SIM_UPLOAD_TIMEOUT_MS   30000       // POST /upload-image
+#define SIM_CHECK_TIMEOUT_MS    10000       // GET /upload-image/:hash
+#define SIM_HTTP_RESPONSE_MAX   (16 * 1024)
+
+// ===== Report =====
+#define SIM_REPORT_INTERVAL_S   10
+
+enum SimTransport : uint8_t {
+    TRANSPORT_MQTT,         // Live images chunked over MQTT, HTTP while it is down (firmware default)
+    TRANSPORT_HTTP          // Live images always multipart over HTTP
+};
+
+enum SimOutage : uint8_t {
+    OUTAGE_NONE,
+    OUTAGE_BROKER,          // MQTT unreachable, HTTP fine
+    OUTAGE_WIFI             // Camera fully offline
+};
+
+struct SimSettings {
+    std::string brokerHost;
+    uint16_t brokerPort;
+    std::string mqttUser;
+    std::string mqttPassword;
+    std::string httpHost;
+    uint16_t httpPort;
+
+    unsigned cameras;
+    unsigned durationS;
+    unsigned drainS;
+    double eventsPerMin;
+    double imageKbMedian;
+    double imageKbSigma;
+    unsigned imageKbMax;
+    SimTransport transport;
+    size_t chunkSize;           // MQTT_CHUNK_SIZE_DEFAULT unless CHUNK_BYTES is set
+
+    SimOutage outage;
+    unsigned outageAtS;
+    unsigned outageForS;
+    unsigned outageEveryS;      // 0 = once
+    double outageShare;         // Fraction of cameras hit, lowest ids first
+
+    size_t backlogMax;
+    uint32_t backlogIntervalMs; // FULL_UPLOAD_INTERVAL_MS unless BACKLOG_INTERVAL_S is set
+    uint32_t backlogJitterMs;   // FULL_UPLOAD_START_JITTER_MS, scaled with the interval
+    unsigned reportSeconds;
+    uint64_t seed;
+    uint32_t boot;              // Boot counter in capture ids (capture_sequence.h)
+
+    static SimSettings fromEnv();
+    void print(FILE* out) const;
+};
+
+#endif // LOADSIM_CONFIG_H
@@ -0,0 +1,114 @@
+/**
+ * delivery_stats.cpp - Fleet delivery statistics
+ */
+
+#include <algorithm>
+#include "delivery_stats.h"
+
+static const char* PATH_NAMES[VIA_COUNT] = { "mqtt", "http", "resumable", "already stored" };
+
+DeliveryStats::DeliveryStats()
+    : _captures(0), _capturedBytes(0), _delivered(0), _deliveredBytes(0), _wire{0, 0} {}
+
+void DeliveryStats::captured(size_t bytes) {
+    _captures++;
+    _capturedBytes += bytes;
+}
+
+void DeliveryStats::delivered(DeliveryPath path, size_t bytes, uint64_t latencyMs) {
+    _delivered++;
+    _deliveredBytes += bytes;
+    _latency[path].push_back((uint32_t)latencyMs);
+}
+
+void DeliveryStats::attemptFailed(const std::string& reason) {
+    _failures[reason]++;
+}
+
+void DeliveryStats::lost(const std::string& reason, uint64_t images) {
+    if (images) {
+        _lost[reason] += images;
+    }
+}
+
+void DeliveryStats::wire(bool mqtt, size_t bytes) {
+    _wire[mqtt ? 1 : 0] += bytes;
+}
+
+void DeliveryStats::progress(FILE* out, uint64_t elapsedMs, size_t backlog, size_t busy,
+                             size_t mqttUp, size_t cameras) {
+    uint64_t failed = 0;
+    for (const auto& entry : _failures) {
+        failed += entry.second;
+    }
+    fprintf(out, "[SIM] %5.0f s: %llu captured, %llu delivered (mqtt %zu http %zu resumable %zu), "
+                 "%llu failed attempts, %zu in backlog, %zu busy, MQTT up %zu/%zu\n",
+            elapsedMs / 1000.0, (unsigned long long)_captures, (unsigned long long)_delivered,
+            _latency[VIA_MQTT].size(), _latency[VIA_HTTP].size(), _latency[VIA_RESUMABLE].size(),
+            (unsigned long long)failed, backlog, busy, mqttUp, cameras);
+    fflush(out);
+}
+
+void DeliveryStats::printLatency(FILE* out, const char* label, std::vector<uint32_t>& samples,
+                                 uint64_t total) {
+    size_t n = samples.size();
+    if (!n) {
+        return;
+    }
+    std::sort(samples.begin(), samples.end());
+    auto pct = [&](double p) { return samples[std::min(n - 1, (size_t)(n * p))]; };
+    fprintf(out, "  %-16s %7zu (%5.1f%%)  latency p50 %6u  p95 %6u  p99 %6u  max %6u ms\n",
+            label, n, total ? 100.0 * n / total : 0.0, pct(0.5), pct(0.95), pct(0.99), samples[n - 1]);
+}
+
+void DeliveryStats::printReasons(FILE* out, const std::map<std::string, uint64_t>& reasons) {
+    const char* sep = ":";
+    for (const auto& entry : reasons) {
+        fprintf(out, "%s %s %llu", sep, entry.first.c_str(), (unsigned long long)entry.second);
+        sep = ",";
+    }
+    fprintf(out, "\n");
+}
+
+void DeliveryStats::report(FILE* out, uint64_t elapsedMs) {
+    double seconds = std::max<uint64_t>(elapsedMs, 1) / 1000.0;
+    uint64_t failed = 0;
+    uint64_t lost = 0;
+    for (const auto& entry : _failures) {
+        failed += entry.second;
+    }
+    for (const auto& entry : _lost) {
+        lost += entry.second;
+    }
+
+    fprintf(out, "===== [SIM] Results after %.0f s =====\n", seconds);
+    fprintf(out, "  Captured         %7llu images, %.1f MB (avg %.1f KB)\n",
+            (unsigned long long)_captures, _capturedBytes / 1048576.0,
+            _captures ? _capturedBytes / 1024.0 / _captures : 0.0);
+
+    std::vector<uint32_t> all;
+    for (auto& samples : _latency) {
+        all.insert(all.end(), samples.begin(), samples.end());
+    }
+    if (all.empty()) {
+        fprintf(out, "  Delivered              0\n");
+    }
+    printLatency(out, "Delivered", all, _captures);
+    for (int path = 0; path < VIA_COUNT; path++) {
+        char label[24];
+        snprintf(label, sizeof(label), "  via %s", PATH_NAMES[path]);
+        printLatency(out, label, _latency[path], _captures);
+    }
+
+    fprintf(out, "  Lost             %7llu (%5.1f%%)", (unsigned long long)lost,
+            _captures ? 100.0 * lost / _captures : 0.0);
+    printReasons(out, _lost);
+    fprintf(out, "  Failed attempts  %7llu", (unsigned long long)failed);
+    printReasons(out, _failures);
+    fprintf(out, "  Wire             MQTT %.1f MB, HTTP %.1f MB (%.2fx delivered bytes), "
+                 "%.1f KB/s delivered\n",
+            _wire[1] / 1048576.0, _wire[0] / 1048576.0,
+            _deliveredBytes ? (double)(_wire[0] + _wire[1]) / _deliveredBytes : 0.0,
+            _deliveredBytes / 1024.0 / seconds);
+    fflush(out);
+}
@@ -0,0 +1,61 @@
+/**
+ * delivery_stats.h - End-to-end results across the simulated fleet
+ *
+ * Latency is capture to delivery: the motion event to the final chunk ack
+ * (MQTT) or the 200/201 that stored the image (HTTP), including any time
+ * spent in the backlog. Failed attempts are counted by reason; an image that
+ * fails and is delivered later counts once in each. Single-threaded.
+ */
+
+#ifndef DELIVERY_STATS_H
+#define DELIVERY_STATS_H
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+enum DeliveryPath : uint8_t {
+    VIA_MQTT = 0,           // Chunked, acked by the backend
+    VIA_HTTP = 1,           // Multipart POST /upload-image (live or small backlog file)
+    VIA_RESUMABLE = 2,      // POST + PATCH /uploads
+    VIA_DEDUP = 3,          // Backlog file the server already had (hash check or session)
+    VIA_COUNT
+};
+
+class DeliveryStats {
+public:
+    DeliveryStats();
+
+    void captured(size_t bytes);
+    void delivered(DeliveryPath path, size_t bytes, uint64_t latencyMs);
+    void attemptFailed(const std::string& reason);
+    void lost(const std::string& reason, uint64_t images = 1);
+    void wire(bool mqtt, size_t bytes);     // Payloads and request bodies as sent
+
+    uint64_t captures() const { return _captures; }
+    uint64_t deliveries() const { return _delivered; }
+
+    // One progress line: totals so far plus the given live gauges
+    void progress(FILE* out, uint64_t elapsedMs, size_t backlog, size_t busy, size_t mqttUp,
+                  size_t cameras);
+    // Latency percentiles per path, failures and losses by reason, wire bytes
+    void report(FILE* out, uint64_t elapsedMs);
+
+private:
+    uint64_t _captures;
+    uint64_t _capturedBytes;
+    uint64_t _delivered;
+    uint64_t _deliveredBytes;
+    uint64_t _wire[2];                              // HTTP, MQTT
+    std::vector<uint32_t> _latency[VIA_COUNT];      // Every sample, ms
+    std::map<std::string, uint64_t> _failures;
+    std::map<std::string, uint64_t> _lost;
+
+    static void printLatency(FILE* out, const char* label, std::vector<uint32_t>& samples,
+                             uint64_t total);
+    static void printReasons(FILE* out, const std::map<std::string, uint64_t>& reasons);
+};
+
+#endif // DELIVERY_STATS_H
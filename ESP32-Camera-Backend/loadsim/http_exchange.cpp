@@ -0,0 +1,231 @@
+/**
+ * http_exchange.cpp - Non-blocking HTTP request implementation
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <strings.h>
+#include <unistd.h>
+#include "config.h"
+#include "http_exchange.h"
+
+RequestHead::RequestHead(const char* method, const std::string& path, const std::string& host) {
+    _text.reserve(1024);
+    _text.append(method).append(" ").append(path).append(" HTTP/1.1\r\nHost: ").append(host);
+    _text.append("\r\nUser-Agent: ESP32HTTPClient\r\nConnection: close\r\n");
+}
+
+void RequestHead::add(const char* name, const char* value) {
+    _text.append(name).append(": ").append(value).append("\r\n");
+}
+
+const std::string& RequestHead::finish(size_t contentLength) {
+    _text.append("Content-Length: ").append(std::to_string(contentLength)).append("\r\n\r\n");
+    return _text;
+}
+
+bool HttpTarget::resolve(const std::string& hostName, uint16_t port) {
+    char portStr[8];
+    snprintf(portStr, sizeof(portStr), "%u", port);
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    if (getaddrinfo(hostName.c_str(), portStr, &hints, &res) != 0 || !res) {
+        fprintf(stderr, "[HTTP] Cannot resolve %s\n", hostName.c_str());
+        return false;
+    }
+    memcpy(&addr, res->ai_addr, res->ai_addrlen);
+    addrLen = res->ai_addrlen;
+    freeaddrinfo(res);
+    host = hostName + ":" + portStr;
+    return true;
+}
+
+HttpExchange::HttpExchange(EventLoop& loop)
+    : _loop(loop), _fd(-1), _connected(false), _headOnly(false), _finished(false), _status(0),
+      _error(""), _deadline(0), _outSent(0), _bodyWant(-1) {}
+
+HttpExchange::~HttpExchange() {
+    close();
+}
+
+void HttpExchange::start(const HttpTarget& target, const std::string& head, const uint8_t* body,
+                         size_t bodyLen, bool headOnly, uint32_t timeoutMs, uint64_t nowMs) {
+    close();
+    _out.assign(head);
+    _out.append((const char*)body, bodyLen);
+    _outSent = 0;
+    _in.clear();
+    _headers.clear();
+    _body.clear();
+    _bodyWant = -1;
+    _headOnly = headOnly;
+    _finished = false;
+    _status = 0;
+    _error = "";
+    _connected = false;
+    _deadline = nowMs + timeoutMs;
+
+    _fd = socket(target.addr.ss_family, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (_fd < 0) {
+        fail(strerror(errno));
+        return;
+    }
+    if (::connect(_fd, (const sockaddr*)&target.addr, target.addrLen) != 0 && errno != EINPROGRESS) {
+        fail(strerror(errno));
+        return;
+    }
+    _loop.add(_fd, this, EPOLLOUT);
+}
+
+void HttpExchange::tick(uint64_t nowMs) {
+    if (_fd >= 0 && nowMs >= _deadline) {
+        fail("timeout");
+    }
+}
+
+void HttpExchange::cancel(const char* why) {
+    if (_fd < 0) {
+        // Nothing running: the earlier result goes
+        _outSent = 0;
+        _headers.clear();
+        _body.clear();
+    }
+    fail(why);
+}
+
+long HttpExchange::header(const char* name, long fallback) const {
+    size_t nameLen = strlen(name);
+    size_t pos = _headers.find("\r\n");
+    while (pos != std::string::npos && pos + 2 + nameLen < _headers.size()) {
+        const char* line = _headers.c_str() + pos + 2;
+        if (strncasecmp(line, name, nameLen) == 0 && line[nameLen] == ':') {
+            return strtol(line + nameLen + 1, nullptr, 10);
+        }
+        pos = _headers.find("\r\n", pos + 2);
+    }
+    return fallback;
+}
+
+void HttpExchange::close() {
+    if (_fd >= 0) {
+        _loop.remove(_fd);
+        _loop.forget(this);
+        ::close(_fd);
+        _fd = -1;
+    }
+}
+
+void HttpExchange::fail(const char* why) {
+    close();
+    _status = 0;
+    _error = why;
+    _finished = true;
+}
+
+void HttpExchange::complete() {
+    close();
+    _finished = true;
+}
+
+void HttpExchange::onEvent(uint32_t events) {
+    if (!_connected) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(_fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err) {
+            fail(strerror(err));
+            return;
+        }
+        _connected = true;
+    }
+    if (events & EPOLLOUT) {
+        while (_outSent < _out.size()) {
+            ssize_t n = send(_fd, _out.data() + _outSent, _out.size() - _outSent, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EAGAIN || errno == EINTR) {
+                    break;
+                }
+                // The server may answer early (413, 409) and close: read what it said
+                readResponse();
+                if (_fd >= 0) {
+                    fail(strerror(errno));
+                }
+                return;
+            }
+            _outSent += n;
+        }
+        if (_outSent == _out.size()) {
+            _out.clear();
+            _out.shrink_to_fit();
+            _loop.modify(_fd, this, EPOLLIN);
+        }
+    }
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        readResponse();
+    }
+}
+
+void HttpExchange::readResponse() {
+    char buf[16 * 1024];
+    for (;;) {
+        ssize_t n = recv(_fd, buf, sizeof(buf), 0);
+        if (n == 0) {
+            // Close ends a body without Content-Length; anything else is a failure
+            if (_status && _bodyWant < 0) {
+                complete();
+            } else {
+                fail(_status ? "truncated response" : "closed by server");
+            }
+            return;
+        }
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EINTR) {
+                fail(strerror(errno));
+            }
+            return;
+        }
+        if (!_status) {
+            _in.append(buf, n);
+            if (!parseHead()) {
+                return;     // Failed, or headers incomplete
+            }
+        } else if (_body.size() < SIM_HTTP_RESPONSE_MAX) {
+            _body.append(buf, n);
+        }
+        if (_bodyWant >= 0 && (long)_body.size() >= _bodyWant) {
+            complete();
+            return;
+        }
+    }
+}
+
+bool HttpExchange::parseHead() {
+    size_t end = _in.find("\r\n\r\n");
+    if (end == std::string::npos) {
+        if (_in.size() > 8192) {
+            fail("header too large");
+        }
+        return false;
+    }
+    int status = 0;
+    if (sscanf(_in.c_str(), "HTTP/1.%*d %d", &status) != 1 || status < 100) {
+        fail("bad status line");
+        return false;
+    }
+    if (status == 100) {
+        _in.erase(0, end + 4);  // Interim: the real response follows
+        return parseHead();
+    }
+    _status = status;
+    _headers.assign(_in, 0, end + 2);
+    _body.assign(_in, end + 4, std::string::npos);
+    _in.clear();
+    _bodyWant = (_headOnly || status == 204 || status == 304) ? 0 : header("Content-Length", -1);
+    return true;
+}
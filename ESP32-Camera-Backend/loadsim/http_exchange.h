@@ -0,0 +1,96 @@
+/**
+ * http_exchange.h - One HTTP request on its own connection, non-blocking
+ *
+ * What HTTPClient does for UploadManager (a fresh connection per request,
+ * Connection: close), on the shared EventLoop so one thread can drive
+ * hundreds of cameras. The owner starts a request and polls finished().
+ *
+ *   RequestHead head("PATCH", path, host);
+ *   addRangeHeaders(head.sink(), offset);          // upload_request.h
+ *   exchange.start(addr, head.finish(n), body, n, false, timeout, now);
+ *   ...
+ *   if (exchange.finished() && exchange.status() == 204) ...
+ */
+
+#ifndef HTTP_EXCHANGE_H
+#define HTTP_EXCHANGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/socket.h>
+#include "event_loop.h"
+
+// Request line and headers; upload_request.h builders write through sink()
+class RequestHead {
+public:
+    RequestHead(const char* method, const std::string& path, const std::string& host);
+
+    void add(const char* name, const char* value);
+    auto sink() {
+        return [this](const char* name, const char* value) { add(name, value); };
+    }
+    // Content-Length and the blank line
+    const std::string& finish(size_t contentLength);
+
+private:
+    std::string _text;
+};
+
+// Where requests go (resolved once)
+struct HttpTarget {
+    sockaddr_storage addr;
+    socklen_t addrLen;
+    std::string host;           // Host header
+
+    bool resolve(const std::string& hostName, uint16_t port);
+};
+
+class HttpExchange : public EventSource {
+public:
+    explicit HttpExchange(EventLoop& loop);
+    ~HttpExchange();
+
+    /**
+     * Connect and send head + body (copied). headOnly: no response body
+     * (HEAD). Any earlier result is discarded.
+     */
+    void start(const HttpTarget& target, const std::string& head, const uint8_t* body, size_t bodyLen,
+               bool headOnly, uint32_t timeoutMs, uint64_t nowMs);
+    void tick(uint64_t nowMs);      // Timeout
+    void cancel(const char* why);   // Finished, failed (running or not)
+
+    bool running() const { return _fd >= 0; }
+    bool finished() const { return _finished; }
+    int status() const { return _status; }              // 0 = no complete response
+    const char* error() const { return _error; }
+    long header(const char* name, long fallback) const; // Numeric response header
+    const std::string& body() const { return _body; }
+    size_t bytesSent() const { return _outSent; }        // Head and body that left
+
+    void onEvent(uint32_t events) override;
+
+private:
+    EventLoop& _loop;
+    int _fd;
+    bool _connected;
+    bool _headOnly;
+    bool _finished;
+    int _status;
+    const char* _error;
+    uint64_t _deadline;
+    std::string _out;
+    size_t _outSent;
+    std::string _in;            // Until the end of the headers
+    std::string _headers;
+    std::string _body;
+    long _bodyWant;             // -1 = until close
+
+    void close();
+    void fail(const char* why);
+    void complete();
+    void readResponse();
+    bool parseHead();
+};
+
+#endif // HTTP_EXCHANGE_H
@@ -0,0 +1,163 @@
+/**
+ * main.cpp - Fleet load simulator
+ *
+ * Runs CAMERAS virtual cameras against a real broker and backend (the Node
+ * server or receiver/) from one thread: Poisson motion events, lognormal
+ * image sizes, broker or WiFi outages, and the firmware's own chunk sender
+ * (xfer_sender.h) and request builders (upload_request.h) on the wire.
+ * Prints progress every REPORT_S seconds and, once captures have stopped and
+ * the backlogs drained (or DRAIN_S ran out), capture-to-delivery latency
+ * percentiles and failure counts. Ctrl+C reports early.
+ */
+
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <sys/resource.h>
+#include "config.h"
+#include "delivery_stats.h"
+#include "event_loop.h"
+#include "http_exchange.h"
+#include "ingest_stats.h"       // monotonicMs()
+#include "virtual_camera.h"
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onSignal(int) {
+    stopRequested = 1;
+}
+
+// One MQTT and up to one HTTP socket per camera
+static void raiseFileLimit(unsigned cameras) {
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < cameras * 2 + 64) {
+        limit.rlim_cur = std::min<rlim_t>(limit.rlim_max, cameras * 2 + 64);
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+// AuthManager::login, once for the fleet (every camera uses USERNAME)
+static std::string login(EventLoop& loop, const HttpTarget& target) {
+    char body[128];
+    int len = snprintf(body, sizeof(body), "{\"username\":\"%s\",\"password\":\"%s\"}",
+                       USERNAME, USER_PASSWORD);
+    RequestHead head("POST", SERVER_API_PATH "/auth/login", target.host);
+    head.add("Content-Type", "application/json");
+    HttpExchange http(loop);
+    http.start(target, head.finish(len), (const uint8_t*)body, len, false, SIM_CHECK_TIMEOUT_MS,
+               monotonicMs());
+    while (!http.finished() && !stopRequested) {
+        loop.run(50);
+        http.tick(monotonicMs());
+    }
+
+    const std::string& response = http.body();
+    size_t at = response.find("\"token\":\"");
+    if (http.status() != 200 || at == std::string::npos) {
+        fprintf(stderr, "⚠️ [SIM] Login failed (HTTP %d %s), uploads go out without a token\n",
+                http.status(), http.status() ? "" : http.error());
+        return "";
+    }
+    at += 9;
+    return response.substr(at, response.find('"', at) - at);
+}
+
+int main() {
+    SimSettings sim = SimSettings::fromEnv();
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    signal(SIGPIPE, SIG_IGN);
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    raiseFileLimit(sim.cameras);
+    sim.print(stdout);
+
+    EventLoop loop;
+    HttpTarget target;
+    if (!loop.begin() || !target.resolve(sim.httpHost, sim.httpPort)) {
+        return 1;
+    }
+    std::string token = login(loop, target);
+
+    // Image bodies are cut from this, so random bytes are made once
+    std::vector<uint8_t> noise(sim.imageKbMax * 1024 + 256 * 1024);
+    std::mt19937_64 random(sim.seed);
+    for (size_t i = 0; i + 8 <= noise.size(); i += 8) {
+        uint64_t v = random();
+        memcpy(noise.data() + i, &v, 8);
+    }
+
+    DeliveryStats stats;
+    uint64_t startedAt = monotonicMs();
+    std::vector<std::unique_ptr<VirtualCamera>> cameras;
+    cameras.reserve(sim.cameras);
+    for (unsigned i = 0; i < sim.cameras; i++) {
+        cameras.emplace_back(new VirtualCamera(i, loop, sim, target, token, noise, stats, startedAt));
+    }
+
+    uint64_t captureEnd = startedAt + sim.durationS * 1000ULL;
+    uint64_t drainEnd = captureEnd + sim.drainS * 1000ULL;
+    uint64_t outageAt = sim.outage != OUTAGE_NONE ? startedAt + sim.outageAtS * 1000ULL : UINT64_MAX;
+    uint64_t reportAt = startedAt + sim.reportSeconds * 1000ULL;
+    unsigned outageCameras = (unsigned)(sim.cameras * sim.outageShare + 0.5);
+    bool capturing = true;
+
+    while (!stopRequested) {
+        loop.run(5);
+        uint64_t now = monotonicMs();
+        for (auto& camera : cameras) {
+            camera->step(now);
+        }
+
+        if (now >= outageAt) {
+            printf("💥 [SIM] %s outage for %u of %u cameras, %u s\n",
+                   sim.outage == OUTAGE_BROKER ? "Broker" : "WiFi", outageCameras, sim.cameras,
+                   sim.outageForS);
+            for (unsigned i = 0; i < outageCameras; i++) {
+                cameras[i]->outage(sim.outage, now + sim.outageForS * 1000ULL);
+            }
+            outageAt = sim.outageEveryS ? outageAt + sim.outageEveryS * 1000ULL : UINT64_MAX;
+        }
+
+        if (capturing && now >= captureEnd) {
+            capturing = false;
+            outageAt = UINT64_MAX;
+            for (auto& camera : cameras) {
+                camera->stopCapturing();
+            }
+            printf("🎥 [SIM] Captures stopped, draining backlogs (up to %u s)\n", sim.drainS);
+        }
+
+        size_t pending = 0;
+        if (now >= reportAt || !capturing) {
+            for (auto& camera : cameras) {
+                pending += camera->pending();
+            }
+        }
+        if (now >= reportAt) {
+            reportAt = now + sim.reportSeconds * 1000ULL;
+            size_t backlog = 0;
+            size_t busy = 0;
+            size_t up = 0;
+            for (auto& camera : cameras) {
+                backlog += camera->backlog();
+                busy += camera->busy();
+                up += camera->mqttUp();
+            }
+            stats.progress(stdout, now - startedAt, backlog, busy, up, cameras.size());
+        }
+        if (!capturing && (pending == 0 || now >= drainEnd)) {
+            break;
+        }
+    }
+
+    size_t undelivered = 0;
+    for (auto& camera : cameras) {
+        undelivered += camera->pending();
+    }
+    stats.lost("undelivered", undelivered);
+    printf("\n");
+    stats.report(stdout, monotonicMs() - startedAt);
+    return 0;
+}
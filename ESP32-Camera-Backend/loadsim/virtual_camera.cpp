@@ -0,0 +1,483 @@
+/**
+ * virtual_camera.cpp - Simulated camera implementation
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <openssl/sha.h>
+#include "upload_request.h"
+#include "virtual_camera.h"
+
+static std::string deviceName(unsigned index) {
+    char name[24];
+    snprintf(name, sizeof(name), SIM_DEVICE_PREFIX "%04u", index + 1);
+    return name;
+}
+
+VirtualCamera::VirtualCamera(unsigned index, EventLoop& loop, const SimSettings& sim,
+                             const HttpTarget& target, const std::string& token,
+                             const std::vector<uint8_t>& noise, DeliveryStats& stats, uint64_t startMs)
+    : _id(deviceName(index)), _sim(sim), _target(target), _token(token), _noise(noise),
+      _stats(stats), _random(sim.seed * 1000003 + index), _mqttWasUp(false), _http(loop),
+      _started(false), _capturing(true), _seq(0), _haveLive(false), _backlogAt(0), _passBudget(0),
+      _holdUntil(0), _offlineUntil(0), _job(JOB_NONE), _fromBacklog(false), _offset(0), _patchLen(0),
+      _resumes(0), _reopening(false), _afterWait(JOB_NONE), _waitUntil(0) {
+    _bootAt = startMs + _random() % SIM_BOOT_SPREAD_MS;
+    _nextCaptureAt = UINT64_MAX;
+    _captureId[0] = _imageId[0] = _hash[0] = '\0';
+
+    if (sim.transport == TRANSPORT_MQTT) {
+        _mqttSettings.brokerHost = sim.brokerHost;
+        _mqttSettings.brokerPort = sim.brokerPort;
+        _mqttSettings.mqttUser = sim.mqttUser;
+        _mqttSettings.mqttPassword = sim.mqttPassword;
+        _mqttSettings.clientId = _id;
+        _mqtt.reset(new MqttClient(loop, _mqttSettings));
+
+        // Acks for this camera's chunks (MQTTManager::handleXferAck)
+        _topicImage = MQTT_TOPIC_ROOT "/" + _id + "/" MQTT_TOPIC_IMAGE;
+        _mqtt->subscribe(MQTT_TOPIC_ROOT "/" + _id + "/" MQTT_TOPIC_XFER);
+        _mqtt->onMessage([this](const char*, size_t, const uint8_t* payload, size_t len) {
+            if (_xfer.active()) {
+                _xfer.handleAck(payload, len);
+            }
+        });
+    }
+}
+
+void VirtualCamera::step(uint64_t now) {
+    if (!_started) {
+        if (now < _bootAt) {
+            return;
+        }
+        _started = true;
+        scheduleBacklog(now, _random() % _sim.backlogJitterMs);
+        if (_sim.eventsPerMin > 0) {
+            _nextCaptureAt = now + nextGap();
+        }
+    }
+
+    if (_mqtt) {
+        _mqtt->tick(now);
+        bool up = _mqtt->connected();
+        if (up && !_mqttWasUp) {
+            // Back after an outage, probably together with the rest of the fleet
+            scheduleBacklog(now, _random() % _sim.backlogJitterMs);
+        }
+        _mqttWasUp = up;
+    }
+
+    while (_capturing && now >= _nextCaptureAt) {
+        capture(_nextCaptureAt);
+        _nextCaptureAt += nextGap();
+    }
+
+    switch (_job) {
+        case JOB_NONE:
+            startNext(now);
+            break;
+        case JOB_XFER:
+            stepXfer(now);
+            break;
+        case JOB_WAIT:
+            if (now >= _waitUntil) {
+                if (_afterWait == JOB_OPEN) {
+                    startOpen(now);
+                } else {
+                    startOffset(now);
+                }
+            }
+            break;
+        default:
+            _http.tick(now);
+            if (_http.finished()) {
+                _stats.wire(false, _http.bytesSent());
+                httpDone(now);
+            }
+            break;
+    }
+}
+
+void VirtualCamera::outage(SimOutage kind, uint64_t until) {
+    if (kind == OUTAGE_WIFI) {
+        _offlineUntil = until;
+        if (_http.running()) {
+            _http.cancel("offline");
+        }
+    }
+    if (_mqtt) {
+        _mqtt->suspend(until);
+    }
+}
+
+// Poisson events: exponential gaps, ms
+uint64_t VirtualCamera::nextGap() {
+    std::exponential_distribution<double> gap(_sim.eventsPerMin / 60000.0);
+    return std::max<uint64_t>(1, (uint64_t)gap(_random));
+}
+
+void VirtualCamera::capture(uint64_t at) {
+    std::lognormal_distribution<double> kb(std::log(_sim.imageKbMedian), _sim.imageKbSigma);
+    double size = std::min<double>(std::max<double>(kb(_random), SIM_IMAGE_KB_MIN), _sim.imageKbMax);
+
+    Capture c;
+    c.seq = ++_seq;
+    c.size = (uint32_t)(size * 1024);
+    c.noiseAt = _random() % (_noise.size() - c.size + 1);
+    c.capturedAt = at;
+    c.wallAt = time(nullptr);
+    _stats.captured(c.size);
+
+    // The network task takes one job; the rest wait on SD
+    if (_haveLive || offline(at)) {
+        toBacklog(c);
+    } else {
+        _live = c;
+        _haveLive = true;
+    }
+}
+
+void VirtualCamera::toBacklog(const Capture& c) {
+    _backlog.push_back(c);
+    if (_backlog.size() > _sim.backlogMax) {
+        _backlog.pop_front();
+        _stats.lost("backlog-full");
+    }
+}
+
+void VirtualCamera::scheduleBacklog(uint64_t now, uint32_t delayMs) {
+    _backlogAt = now + delayMs;
+    _passBudget = 0;
+}
+
+void VirtualCamera::startNext(uint64_t now) {
+    if (_haveLive) {
+        _haveLive = false;
+        _current = _live;
+        _fromBacklog = false;
+        if (offline(now)) {
+            toBacklog(_current);
+        } else if (mqttUp()) {
+            startXfer(now);
+        } else if (held(now)) {
+            _stats.attemptFailed("http-held");
+            toBacklog(_current);
+        } else {
+            startPost(now);
+        }
+        return;
+    }
+
+    // NetworkTask::backgroundUpload, one file per round
+    if (offline(now)) {
+        return;
+    }
+    if (_passBudget == 0) {
+        if (_backlog.empty() || now < _backlogAt) {
+            return;
+        }
+        // Interval +-50% so cameras started together drift apart
+        scheduleBacklog(now, _sim.backlogIntervalMs / 2 + _random() % _sim.backlogIntervalMs);
+        _passBudget = FULL_UPLOAD_BATCH;
+    }
+    if (held(now)) {
+        _passBudget = 0;    // Server pushed back mid-pass
+        return;
+    }
+    if (_backlog.empty()) {
+        _passBudget = 0;
+        return;
+    }
+    _passBudget--;
+    _current = _backlog.front();
+    _backlog.pop_front();
+    _fromBacklog = true;
+    startCheck(now);
+}
+
+// Deterministic bytes for a capture: SOI, a tag unique per camera and
+// sequence, noise, EOI. The same capture always hashes the same.
+void VirtualCamera::render(const Capture& c) {
+    snprintf(_captureId, sizeof(_captureId), "%06lu-%08lu", (unsigned long)_sim.boot, (unsigned long)c.seq);
+    snprintf(_imageId, sizeof(_imageId), "%s.full", _captureId);
+
+    _image.resize(c.size);
+    memcpy(_image.data(), _noise.data() + c.noiseAt, c.size);
+    _image[0] = 0xFF;
+    _image[1] = 0xD8;
+    char tag[48];
+    int tagLen = snprintf(tag, sizeof(tag), "%s/%s", _id.c_str(), _captureId);
+    memcpy(_image.data() + 2, tag, std::min<size_t>(tagLen, c.size - 4));
+    _image[c.size - 2] = 0xFF;
+    _image[c.size - 1] = 0xD9;
+
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    SHA256(_image.data(), _image.size(), digest);
+    for (int i = 0; i < SHA256_DIGEST_LENGTH; i++) {
+        snprintf(_hash + i * 2, 3, "%02x", digest[i]);
+    }
+}
+
+void VirtualCamera::finish(bool ok, DeliveryPath path, const std::string& reason, uint64_t now) {
+    _job = JOB_NONE;
+    if (ok) {
+        _stats.delivered(path, _current.size, now - _current.capturedAt);
+        return;
+    }
+    _stats.attemptFailed(reason);
+    if (_fromBacklog) {
+        // Stays first in the queue; the pass ends
+        _backlog.push_front(_current);
+        if (_backlog.size() > _sim.backlogMax) {
+            _backlog.pop_front();
+            _stats.lost("backlog-full");
+        }
+        _passBudget = 0;
+    } else {
+        toBacklog(_current);
+    }
+}
+
+// ----- MQTT (MQTTManager::publishImageChunked) -----
+
+void VirtualCamera::startXfer(uint64_t now) {
+    render(_current);
+    size_t chunks = XferSender::chunkCount(_image.size(), _sim.chunkSize);
+    if (chunks == 0) {
+        finish(false, VIA_MQTT, "mqtt-too-large", now);
+        return;
+    }
+    _payload.resize(XferSender::payloadCapacity(_sim.chunkSize));
+    _acked.resize(XferSender::bitmapBytes(chunks));
+    _sentAt.resize(chunks);
+    XferMeta meta = { USERNAME, _captureId, "full", nullptr, _current.wallAt, nullptr };
+    _xfer.begin(_image.data(), _image.size(), _sim.chunkSize, _imageId, meta, _payload.data(),
+                _acked.data(), _sentAt.data(), (uint32_t)now);
+    _job = JOB_XFER;
+    stepXfer(now);
+}
+
+void VirtualCamera::stepXfer(uint64_t now) {
+    auto publish = [this](const char* chunk, size_t len) {
+        if (!_mqtt->publish(_topicImage, (const uint8_t*)chunk, len)) {
+            return false;
+        }
+        _stats.wire(true, len);
+        return true;
+    };
+
+    const char* failure = nullptr;
+    if (!_mqtt->connected() || !_xfer.fillWindow((uint32_t)now, publish)) {
+        failure = "mqtt-dropped";
+    } else if (_xfer.complete()) {
+        _xfer.end();
+        finish(true, VIA_MQTT, "", now);
+        return;
+    } else if (!_xfer.resendLost((uint32_t)now, publish)) {
+        failure = "mqtt-dropped";
+    } else if (_xfer.timedOut((uint32_t)now)) {
+        failure = "mqtt-timeout";
+    }
+    if (failure) {
+        _xfer.end();
+        finish(false, VIA_MQTT, failure, now);
+    }
+}
+
+// ----- HTTP (UploadManager) -----
+
+void VirtualCamera::addAuth(RequestHead& head) const {
+    addAuthHeaders(head.sink(), _token.c_str(), _id.c_str());
+}
+
+void VirtualCamera::send(const std::string& head, const uint8_t* body, size_t len, bool headOnly,
+                         uint32_t timeoutMs, uint64_t now) {
+    if (offline(now)) {
+        _http.cancel("offline");    // WiFi down: HTTPClient fails to connect
+        return;
+    }
+    _http.start(_target, head, body, len, headOnly, timeoutMs, now);
+}
+
+void VirtualCamera::startPost(uint64_t now) {
+    render(_current);
+    MultipartFraming multipart;
+    multipart.begin((unsigned long)now);
+    _body.resize(multipart.bodyLength(_image.size()));
+    memcpy(_body.data(), multipart.prologue, multipart.prologueLen);
+    memcpy(_body.data() + multipart.prologueLen, _image.data(), _image.size());
+    memcpy(_body.data() + multipart.prologueLen + _image.size(), multipart.epilogue, multipart.epilogueLen);
+
+    RequestHead head("POST", SERVER_API_PATH "/upload-image", _target.host);
+    addAuth(head);
+    addCaptureHeaders(head.sink(), _captureId, _current.wallAt);
+    // Live sends carry no hash; backlog files do (StorageManager::uploadStored)
+    addImageHeaders(head.sink(), "full", nullptr, _fromBacklog ? _hash : nullptr);
+    head.add("Content-Type", multipart.contentType);
+    send(head.finish(_body.size()), _body.data(), _body.size(), false, SIM_UPLOAD_TIMEOUT_MS, now);
+    _job = JOB_POST;
+}
+
+void VirtualCamera::startCheck(uint64_t now) {
+    render(_current);
+    RequestHead head("GET", std::string(SERVER_API_PATH "/upload-image/") + _hash, _target.host);
+    addAuth(head);
+    send(head.finish(0), nullptr, 0, false, SIM_CHECK_TIMEOUT_MS, now);
+    _job = JOB_CHECK;
+}
+
+void VirtualCamera::startOpen(uint64_t now) {
+    RequestHead head("POST", SERVER_API_PATH "/uploads", _target.host);
+    addAuth(head);
+    addSessionHeaders(head.sink(), _image.size(), _hash);
+    addCaptureHeaders(head.sink(), _captureId, _current.wallAt);
+    addImageHeaders(head.sink(), "full", nullptr, nullptr);
+    send(head.finish(0), nullptr, 0, false, RESUMABLE_CHUNK_TIMEOUT, now);
+    _job = JOB_OPEN;
+}
+
+void VirtualCamera::startPatch(uint64_t now) {
+    _patchLen = std::min<size_t>(RESUMABLE_CHUNK_BYTES, _image.size() - _offset);
+    RequestHead head("PATCH", _sessionPath, _target.host);
+    addAuth(head);
+    addRangeHeaders(head.sink(), _offset);
+    send(head.finish(_patchLen), _image.data() + _offset, _patchLen, false, RESUMABLE_CHUNK_TIMEOUT, now);
+    _job = JOB_PATCH;
+}
+
+void VirtualCamera::startOffset(uint64_t now) {
+    RequestHead head("HEAD", _sessionPath, _target.host);
+    addAuth(head);
+    send(head.finish(0), nullptr, 0, true, RESUMABLE_CHUNK_TIMEOUT, now);
+    _job = JOB_OFFSET;
+}
+
+void VirtualCamera::noteRetryAfter(uint64_t now) {
+    int status = _http.status();
+    if (status != 429 && status != 503) {
+        return;
+    }
+    long seconds = _http.header("Retry-After", 0);
+    uint64_t holdMs = (seconds > 0 ? seconds : RATE_DEFAULT_RETRY_S) * 1000ULL;
+    holdMs += _random() % (holdMs * RATE_HOLD_JITTER_PCT / 100 + 1);   // rate_limiter.h holdFor()
+    _holdUntil = std::max(_holdUntil, now + holdMs);
+}
+
+// 200/201 with "success": true, as UploadManager::handleResponse
+bool VirtualCamera::storedOk() const {
+    int status = _http.status();
+    const std::string& body = _http.body();
+    return (status == 200 || status == 201) &&
+           (body.find("\"success\":true") != std::string::npos ||
+            body.find("\"success\": true") != std::string::npos);
+}
+
+std::string VirtualCamera::failReason() const {
+    return _http.status() ? "http-" + std::to_string(_http.status()) : std::string("http-") + _http.error();
+}
+
+void VirtualCamera::httpDone(uint64_t now) {
+    int status = _http.status();
+    if (_job == JOB_POST || _job == JOB_OPEN || _job == JOB_PATCH) {
+        noteRetryAfter(now);    // As UploadManager: not for the hash check or HEAD
+    }
+
+    switch (_job) {
+        case JOB_POST:
+            finish(storedOk(), VIA_HTTP, failReason(), now);
+            break;
+
+        case JOB_CHECK:
+            // 200 = stored before (a reboot, a lost ack); anything else: upload
+            if (status == 200) {
+                finish(true, VIA_DEDUP, "", now);
+            } else if (held(now)) {
+                finish(false, VIA_HTTP, "http-held", now);
+            } else if (RESUMABLE_UPLOADS && _image.size() >= RESUMABLE_MIN_BYTES) {
+                _resumes = 0;
+                _reopening = false;
+                startOpen(now);
+            } else {
+                startPost(now);
+            }
+            break;
+
+        case JOB_OPEN: {
+            const std::string& body = _http.body();
+            bool ok = storedOk();
+            if (ok && body.find("\"duplicate\":true") != std::string::npos) {
+                finish(true, VIA_DEDUP, "", now);
+                break;
+            }
+            size_t idAt = body.find("\"id\":\"");
+            size_t offsetAt = body.find("\"offset\":");
+            if (ok && idAt != std::string::npos) {
+                idAt += 6;
+                _sessionPath = std::string(SERVER_API_PATH "/uploads/") +
+                               body.substr(idAt, body.find('"', idAt) - idAt);
+                _offset = offsetAt != std::string::npos ? strtoul(body.c_str() + offsetAt + 9, nullptr, 10) : 0;
+                if (_offset <= _image.size()) {
+                    startPatch(now);
+                    break;
+                }
+            }
+            if (_reopening) {
+                startPatch(now);    // uploadResumable: the old session url again, counted as a drop
+            } else {
+                finish(false, VIA_RESUMABLE, failReason(), now);
+            }
+            break;
+        }
+
+        case JOB_PATCH: {
+            if (status == 200 || status == 201) {
+                // Last range: the server stored the image and answers like /upload-image
+                finish(storedOk(), VIA_RESUMABLE, failReason(), now);
+                break;
+            }
+            long serverOffset = _http.header("Upload-Offset", -1);
+            if ((status == 204 || status == 409) && serverOffset >= 0) {
+                bool advanced = (size_t)serverOffset > _offset ||
+                                (status == 409 && (size_t)serverOffset != _offset);
+                _offset = std::min<size_t>(serverOffset, _image.size());
+                if (advanced) {
+                    startPatch(now);
+                    break;
+                }
+            }
+            patchFailed(status, now);
+            break;
+        }
+
+        case JOB_OFFSET: {
+            long serverOffset = _http.header("Upload-Offset", -1);
+            if (status == 200 && serverOffset >= 0) {
+                _offset = std::min<size_t>(serverOffset, _image.size());
+            }
+            startPatch(now);
+            break;
+        }
+
+        default:
+            break;
+    }
+}
+
+// UploadManager::uploadResumable after a PATCH that did not advance
+void VirtualCamera::patchFailed(int status, uint64_t now) {
+    if (held(now)) {
+        // Server overloaded: keep the session, the next backlog pass resumes it
+        finish(false, VIA_RESUMABLE, failReason(), now);
+        return;
+    }
+    if (++_resumes > RESUMABLE_MAX_RESUMES) {
+        finish(false, VIA_RESUMABLE, "resumable-gave-up", now);
+        return;
+    }
+    // Session expired: reopen; otherwise ask what arrived
+    _reopening = status == 404;
+    _afterWait = _reopening ? JOB_OPEN : JOB_OFFSET;
+    _waitUntil = now + RESUMABLE_RETRY_DELAY_MS * _resumes;
+    _job = JOB_WAIT;
+}
@@ -0,0 +1,160 @@
+/**
+ * virtual_camera.h - One simulated camera: captures, live send, SD backlog
+ *
+ * Follows the firmware's delivery rules with the real transfer code:
+ *
+ *   - A motion event makes one image (lognormal size). It goes out live over
+ *     MQTT (XferSender, the windowed chunk protocol) while the broker is
+ *     connected and as a multipart POST otherwise (NetworkTask::execute).
+ *     One live send at a time; captures meanwhile, and failed sends, are
+ *     queued on the "SD card" (oldest dropped past BACKLOG_MAX).
+ *   - Backlog passes (NetworkTask::backgroundUpload) start at a random point
+ *     in FULL_UPLOAD_START_JITTER_MS after boot / an MQTT reconnect, then
+ *     every FULL_UPLOAD_INTERVAL_MS +-50%, FULL_UPLOAD_BATCH files each,
+ *     ending at the first failure. Each file is checked by hash first, then
+ *     sent resumable (>= RESUMABLE_MIN_BYTES) or multipart
+ *     (StorageManager::uploadStored, UploadManager::uploadResumable).
+ *   - 429/503 hold HTTP for Retry-After (RATE_DEFAULT_RETRY_S without it).
+ *
+ * Requests are built with upload_request.h, so headers and multipart framing
+ * are byte for byte what UploadManager sends. The blocking loops of the
+ * firmware become a state machine advanced by step(). Image bytes are
+ * regenerated from (seq, size, noise offset) whenever needed, so a backlog
+ * of thousands of images costs a few bytes each.
+ */
+
+#ifndef VIRTUAL_CAMERA_H
+#define VIRTUAL_CAMERA_H
+
+#include <cstdint>
+#include <ctime>
+#include <deque>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "delivery_stats.h"
+#include "event_loop.h"
+#include "http_exchange.h"
+#include "mqtt_client.h"        // Receiver client, Settings from receiver/config.h
+#include "xfer_sender.h"
+
+class VirtualCamera {
+public:
+    VirtualCamera(unsigned index, EventLoop& loop, const SimSettings& sim, const HttpTarget& target,
+                  const std::string& token, const std::vector<uint8_t>& noise, DeliveryStats& stats,
+                  uint64_t startMs);
+
+    // MQTT upkeep, due captures, the running job; call every loop round
+    void step(uint64_t nowMs);
+
+    void stopCapturing() { _capturing = false; }
+    // Broker unreachable (MQTT only) or WiFi down (everything) until untilMs
+    void outage(SimOutage kind, uint64_t untilMs);
+
+    const std::string& id() const { return _id; }
+    bool busy() const { return _job != JOB_NONE; }
+    bool mqttUp() const { return _mqtt && _mqtt->connected(); }
+    size_t backlog() const { return _backlog.size(); }
+    // Captured, not yet delivered
+    size_t pending() const { return _backlog.size() + (_haveLive ? 1 : 0) + (busy() ? 1 : 0); }
+
+private:
+    enum Job : uint8_t {
+        JOB_NONE,
+        JOB_XFER,       // Live, chunked over MQTT
+        JOB_POST,       // Multipart POST /upload-image
+        JOB_CHECK,      // GET /upload-image/:hash (backlog)
+        JOB_OPEN,       // POST /uploads
+        JOB_PATCH,      // PATCH /uploads/:id
+        JOB_OFFSET,     // HEAD /uploads/:id after a failed PATCH
+        JOB_WAIT        // RESUMABLE_RETRY_DELAY_MS x resumes, then _afterWait
+    };
+
+    struct Capture {
+        uint32_t seq;
+        uint32_t size;
+        uint32_t noiseAt;       // Offset into the shared noise
+        uint64_t capturedAt;    // Monotonic ms, for latency
+        time_t wallAt;          // X-Captured-At
+    };
+
+    const std::string _id;
+    const SimSettings& _sim;
+    const HttpTarget& _target;
+    const std::string& _token;
+    const std::vector<uint8_t>& _noise;
+    DeliveryStats& _stats;
+    std::mt19937_64 _random;
+
+    Settings _mqttSettings;
+    std::unique_ptr<MqttClient> _mqtt;     // nullptr with TRANSPORT_HTTP
+    std::string _topicImage;
+    bool _mqttWasUp;
+    XferSender _xfer;
+    std::vector<char> _payload;
+    std::vector<uint8_t> _acked;
+    std::vector<uint16_t> _sentAt;
+    HttpExchange _http;
+
+    bool _started;
+    bool _capturing;
+    uint64_t _bootAt;
+    uint64_t _nextCaptureAt;
+    uint32_t _seq;
+    bool _haveLive;
+    Capture _live;
+    std::deque<Capture> _backlog;
+    uint64_t _backlogAt;        // Next backlog pass
+    unsigned _passBudget;       // Files left in the running pass
+    uint64_t _holdUntil;        // 429/503
+    uint64_t _offlineUntil;     // WiFi outage
+
+    // The image being sent
+    Job _job;
+    Capture _current;
+    bool _fromBacklog;
+    std::vector<uint8_t> _image;
+    std::vector<uint8_t> _body;
+    char _captureId[CAPTURE_ID_LEN];
+    char _imageId[CAPTURE_ID_LEN + 8];
+    char _hash[65];
+    std::string _sessionPath;
+    size_t _offset;
+    size_t _patchLen;
+    unsigned _resumes;
+    bool _reopening;
+    Job _afterWait;
+    uint64_t _waitUntil;
+
+    uint64_t nextGap();
+    void capture(uint64_t nowMs);
+    void toBacklog(const Capture& c);
+    void startNext(uint64_t nowMs);
+    void scheduleBacklog(uint64_t nowMs, uint32_t delayMs);
+    void render(const Capture& c);
+    void finish(bool ok, DeliveryPath path, const std::string& reason, uint64_t nowMs);
+
+    void startXfer(uint64_t nowMs);
+    void stepXfer(uint64_t nowMs);
+    void startPost(uint64_t nowMs);
+    void startCheck(uint64_t nowMs);
+    void startOpen(uint64_t nowMs);
+    void startPatch(uint64_t nowMs);
+    void startOffset(uint64_t nowMs);
+    void httpDone(uint64_t nowMs);
+    void patchFailed(int status, uint64_t nowMs);
+
+    void addAuth(RequestHead& head) const;
+    // _http.start, or an immediate failure while offline
+    void send(const std::string& head, const uint8_t* body, size_t len, bool headOnly,
+              uint32_t timeoutMs, uint64_t nowMs);
+    bool held(uint64_t nowMs) const { return nowMs < _holdUntil; }
+    bool offline(uint64_t nowMs) const { return nowMs < _offlineUntil; }
+    void noteRetryAfter(uint64_t nowMs);
+    bool storedOk() const;
+    std::string failReason() const;
+};
+
+#endif // VIRTUAL_CAMERA_H
@@ -0,0 +1,83 @@
+/**
+ * Ingest admission control for camera uploads
+ *
+ * Caps concurrent upload requests (INGEST_MAX_CONCURRENT) and body bytes per
+ * second (INGEST_MAX_BPS, 0 = no byte cap). Over either limit the request is
+ * refused before its body is read: 429 with a Retry-After of
+ * INGEST_RETRY_AFTER_S plus up to the same again at random, so a fleet that
+ * was refused together does not come back together. The firmware holds all
+ * HTTP uploads and its backlog for that long (rate_limiter.h).
+ */
+
+const limits = {
+  maxConcurrent: Math.max(1, parseInt(process.env.INGEST_MAX_CONCURRENT || '4', 10)),
+  maxBps: Math.max(0, parseInt(process.env.INGEST_MAX_BPS || '0', 10)),
+  retryAfterS: Math.max(1, parseInt(process.env.INGEST_RETRY_AFTER_S || '10', 10))
+};
+
+const state = {
+  inFlight: 0,
+  windowStart: Date.now(),
+  windowBytes: 0,
+  accepted: 0,
+  rejected: 0
+};
+
+const overloadListeners = [];
+
+const jitteredRetryAfter = () => limits.retryAfterS + Math.floor(Math.random() * (limits.retryAfterS + 1));
+
+exports.ingestLimit = (req, res, next) => {
+  const now = Date.now();
+  if (now - state.windowStart >= 1000) {
+    state.windowStart = now;
+    state.windowBytes = 0;
+  }
+
+  // A single body larger than the budget is let through on an empty window
+  const bytes = parseInt(req.headers['content-length'] || '0', 10) || 0;
+  const overBytes = limits.maxBps > 0 && state.windowBytes > 0 && state.windowBytes + bytes > limits.maxBps;
+
+  if (state.inFlight >= limits.maxConcurrent || overBytes) {
+    state.rejected++;
+    const retryAfter = jitteredRetryAfter();
+    res.set('Retry-After', String(retryAfter));
+    overloadListeners.forEach((listener) => listener({
+      inFlight: state.inFlight,
+      windowBytes: state.windowBytes,
+      retryAfterS: limits.retryAfterS
+    }));
+    return res.status(429).json({
+      success: false,
+      message: 'Server busy, retry later',
+      retryAfter
+    });
+  }
+
+  state.inFlight++;
+  state.accepted++;
+  state.windowBytes += bytes;
+
+  // 'close' also fires for aborted uploads; release exactly once
+  let released = false;
+  const release = () => {
+    if (!released) {
+      released = true;
+      state.inFlight--;
+    }
+  };
+  res.on('finish', release);
+  res.on('close', release);
+  next();
+};
+
+/**
+ * Call listener({ inFlight, windowBytes, retryAfterS }) on every refused request
+ */
+exports.onOverload = (listener) => {
+  overloadListeners.push(listener);
+};
+
+exports.limits = limits;
+
+exports.getIngestStats = () => ({ ...limits, ...state });
@@ -1,4 +1,5 @@
 const mongoose = require('mongoose');
+const crypto = require('crypto');
 
 const imageSchema = new mongoose.Schema({
   filename: {
@@ -17,10 +18,54 @@ const imageSchema = new mongoose.Schema({
     type: String,
     default: 'unknown'
   },
+  // On-device detector's confidence in detectedObject (0..1); absent when the camera has no model
+  confidence: {
+    type: Number
+  },
   userId: {
     type: mongoose.Schema.Types.ObjectId,
     ref: 'User',
     required: true
+  },
+  // Camera that took it (firmware deviceId(), e.g. "cam-246f28a1b2c3")
+  deviceId: {
+    type: String
+  },
+  // Thumbnail-first delivery: device id pairing the preview with the full image on its SD card
+  captureId: {
+    type: String
+  },
+  // Parsed from captureId "<boot>-<seq>" (firmware capture_sequence.h): orders a
+  // camera's captures without trusting its clock
+  captureBoot: {
+    type: Number
+  },
+  captureSeq: {
+    type: Number
+  },
+  // Device wall clock at capture (SNTP); absent when the camera had no time yet
+  capturedAt: {
+    type: Date
+  },
+  thumbnailPath: {
+    type: String
+  },
+  fullAvailable: {
+    type: Boolean,
+    default: true
+  },
+  // SHA-256 of the full image bytes; lets the device skip re-uploads after a crash
+  contentHash: {
+    type: String
+  },
+  // Motion crop: where the uploaded region sits in the full frame
+  roi: {
+    x: Number,
+    y: Number,
+    w: Number,
+    h: Number,
+    frameW: Number,
+    frameH: Number
   }
 }, {
   timestamps: true
@@ -29,5 +74,97 @@ const imageSchema = new mongoose.Schema({
 // Index for faster queries
 imageSchema.index({ timestamp: -1 });
 imageSchema.index({ userId: 1, timestamp: -1 });
+imageSchema.index({ captureId: 1 });
+imageSchema.index({ deviceId: 1, timestamp: -1 });
+imageSchema.index({ userId: 1, contentHash: 1 });
+imageSchema.index({ deviceId: 1, captureBoot: -1, captureSeq: -1 });
+
+/**
+ * Attach a late full-resolution upload to the record created from its thumbnail.
+ * Returns the updated record, or null if no thumbnail-only record exists.
+ */
+imageSchema.statics.attachFullImage = function (captureId, userId, { filename, path, contentHash, deviceId }) {
+  // Capture ids are per device; records from before device ids match any camera
+  const query = { captureId, userId, fullAvailable: false };
+  if (deviceId) {
+    query.deviceId = { $in: [deviceId, null] };
+  }
+  return this.findOneAndUpdate(
+    query,
+    { filename, path, contentHash, fullAvailable: true },
+    { new: true }
+  );
+};
+
+/**
+ * Record already created for this camera's capture id (thumbnail resent
+ * after a reboot or a lost response), or null.
+ */
+imageSchema.statics.findCapture = function (userId, deviceId, captureId) {
+  if (!deviceId || !captureId) return Promise.resolve(null);
+  return this.findOne({ userId, deviceId, captureId });
+};
+
+/**
+ * Ordering fields for a capture: { captureBoot, captureSeq } from a
+ * "<boot>-<seq>" id, capturedAt from Unix seconds. Older ids and unset
+ * clocks leave the fields out.
+ */
+imageSchema.statics.captureFields = function (captureId, capturedAtSeconds) {
+  const fields = {};
+  const match = /^(\d{6})-(\d{8})$/.exec(String(captureId || ''));
+  if (match) {
+    fields.captureBoot = Number(match[1]);
+    fields.captureSeq = Number(match[2]);
+  }
+  const seconds = Number(capturedAtSeconds);
+  if (Number.isFinite(seconds) && seconds > 0) {
+    fields.capturedAt = new Date(seconds * 1000);
+  }
+  return fields;
+};
+
+/**
+ * Record already holding these exact full-image bytes, or null.
+ */
+imageSchema.statics.findByContentHash = function (userId, contentHash) {
+  if (!contentHash) return Promise.resolve(null);
+  return this.findOne({ userId, contentHash });
+};
+
+/**
+ * SHA-256 of an image buffer as lowercase hex (matches X-Content-SHA256).
+ */
+imageSchema.statics.hashContent = function (buffer) {
+  return crypto.createHash('sha256').update(buffer).digest('hex');
+};
+
+imageSchema.statics.isContentHash = function (value) {
+  return /^[0-9a-f]{64}$/.test(String(value));
+};
+
+/**
+ * Parse the device's "x,y,w,h,frameW,frameH" ROI string.
+ * Returns undefined for missing or malformed values.
+ */
+imageSchema.statics.parseRoi = function (value) {
+  if (!value) return undefined;
+  const parts = String(value).split(',').map(Number);
+  if (parts.length !== 6 || !parts.every(Number.isInteger)) return undefined;
+  const [x, y, w, h, frameW, frameH] = parts;
+  return { x, y, w, h, frameW, frameH };
+};
+
+/**
+ * Parse the device's "label,confidence%" detection (X-Detection header or
+ * chunk "detection" field, e.g. "person,87") into
+ * { detectedObject, confidence } with confidence in 0..1.
+ * Returns undefined for missing or malformed values.
+ */
+imageSchema.statics.parseDetection = function (value) {
+  const match = /^([A-Za-z0-9_-]{1,12}),(\d{1,3})$/.exec(String(value || ''));
+  if (!match || Number(match[2]) > 100) return undefined;
+  return { detectedObject: match[1], confidence: Number(match[2]) / 100 };
+};
 
 module.exports = mongoose.model('Image', imageSchema);
@@ -0,0 +1,56 @@
+const mongoose = require('mongoose');
+
+// Unfinished sessions (and their partial files) are dropped after a day
+const SESSION_TTL_MS = 24 * 60 * 60 * 1000;
+
+/**
+ * Resumable device upload in progress. The bytes live in
+ * uploads/partial/<id>.part; its size is the acknowledged offset.
+ */
+const uploadSessionSchema = new mongoose.Schema({
+  userId: {
+    type: mongoose.Schema.Types.ObjectId,
+    ref: 'User',
+    required: true
+  },
+  // SHA-256 of the complete file: identifies the session across device reboots
+  contentHash: {
+    type: String,
+    required: true
+  },
+  length: {
+    type: Number,
+    required: true
+  },
+  captureId: {
+    type: String
+  },
+  kind: {
+    type: String
+  },
+  roi: {
+    type: String
+  },
+  // X-Captured-At (Unix seconds) of the original request
+  capturedAt: {
+    type: Number
+  },
+  expiresAt: {
+    type: Date,
+    default: () => new Date(Date.now() + SESSION_TTL_MS)
+  }
+}, {
+  timestamps: true
+});
+
+uploadSessionSchema.index({ userId: 1, contentHash: 1 }, { unique: true });
+uploadSessionSchema.index({ expiresAt: 1 }, { expireAfterSeconds: 0 });
+
+uploadSessionSchema.methods.touch = function () {
+  this.expiresAt = new Date(Date.now() + SESSION_TTL_MS);
+  return this.save();
+};
+
+uploadSessionSchema.statics.SESSION_TTL_MS = SESSION_TTL_MS;
+
+module.exports = mongoose.model('UploadSession', uploadSessionSchema);
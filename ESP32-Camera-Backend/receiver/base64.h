@@ -0,0 +1,66 @@
+/**
+ * base64.h - Base64 decoding straight into the destination buffer
+ */
+
+#ifndef RECEIVER_BASE64_H
+#define RECEIVER_BASE64_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Decoded size of a padded base64 string; -1 if len is not a multiple of 4
+inline long base64DecodedLen(const char* in, size_t len) {
+    if (len % 4) {
+        return -1;
+    }
+    long out = (long)(len / 4) * 3;
+    if (len && in[len - 1] == '=') out--;
+    if (len > 1 && in[len - 2] == '=') out--;
+    return out;
+}
+
+/**
+ * Decode len characters into out (base64DecodedLen(in, len) bytes).
+ * @return false on a character outside the alphabet.
+ */
+inline bool base64Decode(const char* in, size_t len, uint8_t* out) {
+    static int8_t table[256];
+    static bool ready = false;
+    if (!ready) {
+        const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        for (int i = 0; i < 256; i++) table[i] = -1;
+        for (int i = 0; i < 64; i++) table[(uint8_t)alphabet[i]] = (int8_t)i;
+        ready = true;
+    }
+
+    size_t full = len;
+    if (len && in[len - 1] == '=') {
+        full -= 4;  // Last quad handled below
+    }
+    for (size_t i = 0; i < full; i += 4) {
+        int a = table[(uint8_t)in[i]], b = table[(uint8_t)in[i + 1]];
+        int c = table[(uint8_t)in[i + 2]], d = table[(uint8_t)in[i + 3]];
+        if ((a | b | c | d) < 0) {
+            return false;
+        }
+        uint32_t v = (a << 18) | (b << 12) | (c << 6) | d;
+        *out++ = v >> 16;
+        *out++ = (v >> 8) & 0xFF;
+        *out++ = v & 0xFF;
+    }
+    if (full < len) {
+        int a = table[(uint8_t)in[full]], b = table[(uint8_t)in[full + 1]];
+        int c = in[full + 2] == '=' ? 0 : table[(uint8_t)in[full + 2]];
+        if ((a | b | c) < 0) {
+            return false;
+        }
+        uint32_t v = (a << 18) | (b << 12) | (c << 6);
+        *out++ = v >> 16;
+        if (in[full + 2] != '=') {
+            *out++ = (v >> 8) & 0xFF;
+        }
+    }
+    return true;
+}
+
+#endif // RECEIVER_BASE64_H
@@ -0,0 +1,512 @@
+/**
+ * chunk_assembler.cpp - MQTT image chunk reassembly
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include "base64.h"
+#include "chunk_assembler.h"
+
+static const uint8_t XFER_ACK_MAGIC = 0xB7;
+static const uint8_t XFER_VERSION = 1;
+static const uint8_t XFER_FLAG_COMPLETE = 0x01;
+
+// Top-level fields of a chunk (or legacy) payload; strings point into it
+struct ChunkAssembler::Chunk {
+    std::string_view id;
+    std::string_view data;
+    std::string_view imageData;     // Legacy one-shot JSON
+    std::string_view captureId;
+    std::string_view kind;
+    long index = -1;
+    long total = -1;
+    long win = 0;
+    long capturedAt = 0;
+};
+
+// ===== Minimal JSON scanning (flat objects from the firmware) =====
+
+static const char* skipWs(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+    return p;
+}
+
+// p at the opening quote; returns past the closing one, nullptr if unterminated
+static const char* skipString(const char* p, const char* end) {
+    p++;
+    while (p < end) {
+        const char* q = (const char*)memchr(p, '"', end - p);
+        if (!q) {
+            return nullptr;
+        }
+        size_t slashes = 0;
+        while (q - slashes > p && q[-1 - (long)slashes] == '\\') slashes++;
+        if (slashes % 2 == 0) {
+            return q + 1;
+        }
+        p = q + 1;
+    }
+    return nullptr;
+}
+
+static const char* skipValue(const char* p, const char* end) {
+    if (p >= end) {
+        return nullptr;
+    }
+    if (*p == '"') {
+        return skipString(p, end);
+    }
+    if (*p == '{' || *p == '[') {
+        int depth = 0;
+        while (p < end) {
+            if (*p == '"') {
+                p = skipString(p, end);
+                if (!p) {
+                    return nullptr;
+                }
+                continue;
+            }
+            if (*p == '{' || *p == '[') depth++;
+            if (*p == '}' || *p == ']') {
+                if (--depth == 0) {
+                    return p + 1;
+                }
+            }
+            p++;
+        }
+        return nullptr;
+    }
+    while (p < end && *p != ',' && *p != '}' && *p != ' ' && *p != '\n') p++;
+    return p;
+}
+
+static long parseLong(const char* p, const char* end) {
+    bool negative = p < end && *p == '-';
+    if (negative) p++;
+    if (p >= end || *p < '0' || *p > '9') {
+        return -1;
+    }
+    long v = 0;
+    while (p < end && *p >= '0' && *p <= '9' && v < 100000000000L) {
+        v = v * 10 + (*p++ - '0');
+    }
+    return negative ? -v : v;
+}
+
+bool ChunkAssembler::parse(const uint8_t* payload, size_t len, Chunk& c) {
+    const char* p = (const char*)payload;
+    const char* end = p + len;
+    p = skipWs(p, end);
+    if (p >= end || *p != '{') {
+        return false;
+    }
+    p++;
+    while (true) {
+        p = skipWs(p, end);
+        if (p < end && *p == '}') {
+            return true;
+        }
+        if (p >= end || *p != '"') {
+            return false;
+        }
+        const char* keyEnd = skipString(p, end);
+        if (!keyEnd) {
+            return false;
+        }
+        std::string_view key(p + 1, keyEnd - p - 2);
+        p = skipWs(keyEnd, end);
+        if (p >= end || *p != ':') {
+            return false;
+        }
+        p = skipWs(p + 1, end);
+        const char* valueEnd = skipValue(p, end);
+        if (!valueEnd) {
+            return false;
+        }
+        bool isString = *p == '"';
+        std::string_view str = isString ? std::string_view(p + 1, valueEnd - p - 2) : std::string_view();
+
+        if (key == "data") c.data = str;
+        else if (key == "id") c.id = str;
+        else if (key == "index") c.index = parseLong(p, valueEnd);
+        else if (key == "total") c.total = parseLong(p, valueEnd);
+        else if (key == "win") c.win = parseLong(p, valueEnd);
+        else if (key == "captureId") c.captureId = str;
+        else if (key == "kind") c.kind = str;
+        else if (key == "capturedAt") c.capturedAt = parseLong(p, valueEnd);
+        else if (key == "imageData") c.imageData = str;
+
+        p = skipWs(valueEnd, end);
+        if (p < end && *p == ',') {
+            p++;
+        }
+    }
+}
+
+// ===== ChunkAssembler =====
+
+ChunkAssembler::ChunkAssembler(const Settings& settings, ImageStore& store, IngestStats& stats)
+    : _settings(settings), _store(store), _stats(stats), _pool(nullptr), _doneSweepAt(0), _poolFull(0),
+      _oneShots(0) {}
+
+ChunkAssembler::~ChunkAssembler() {
+    free(_pool);
+}
+
+bool ChunkAssembler::begin() {
+    _pool = (uint8_t*)aligned_alloc(4096, _settings.slots * _settings.slotBytes);
+    if (!_pool) {
+        fprintf(stderr, "❌ [XFER] Cannot allocate %zu x %zu B assembly slots\n",
+                _settings.slots, _settings.slotBytes);
+        return false;
+    }
+    // Touch every page now so the first images do not pay for the faults
+    memset(_pool, 0, _settings.slots * _settings.slotBytes);
+
+    _slots.resize(_settings.slots);
+    for (size_t i = 0; i < _slots.size(); i++) {
+        Assembly& a = _slots[i];
+        a.used = false;
+        a.slot = _pool + i * _settings.slotBytes;
+        a.have.reserve(XFER_MAX_CHUNKS);
+        a.tail.resize(XFER_MAX_CHUNK_RAW);
+    }
+    _index.reserve(_settings.slots * 2);
+    printf("✅ [XFER] %zu assembly slots of %zu KB\n", _settings.slots, _settings.slotBytes / 1024);
+    return true;
+}
+
+void ChunkAssembler::handleMessage(const std::string& device, const uint8_t* payload, size_t len) {
+    _stats.wireBytes(device, len);
+
+    if (len >= 2 && payload[0] == 0xFF && payload[1] == 0xD8) {
+        storeRaw(device, payload, len);
+        return;
+    }
+
+    Chunk c;
+    if (!parse(payload, len, c)) {
+        fprintf(stderr, "⚠️ [XFER] %s: unparseable payload (%zu B)\n", device.c_str(), len);
+        return;
+    }
+    if (c.index >= 0 && c.total > 0 && !c.id.empty()) {
+        handleChunk(device, c);
+    } else if (!c.imageData.empty()) {
+        handleLegacy(device, c);
+    } else {
+        fprintf(stderr, "⚠️ [XFER] %s: payload is neither a chunk nor an image\n", device.c_str());
+    }
+}
+
+void ChunkAssembler::handleChunk(const std::string& device, const Chunk& c) {
+    if (c.total > XFER_MAX_CHUNKS || c.index >= c.total) {
+        fprintf(stderr, "⚠️ [XFER] %s: chunk %ld/%ld out of range\n", device.c_str(), c.index, c.total);
+        return;
+    }
+    uint16_t index = (uint16_t)c.index;
+    uint16_t total = (uint16_t)c.total;
+    std::string key;
+    key.reserve(device.size() + 1 + c.id.size());
+    key.append(device).append(1, '/').append(c.id);
+
+    // Resend after our completion ack was lost: repeat it, do not rebuild
+    auto done = _done.find(key);
+    if (done != _done.end()) {
+        // A rejected image stays rejected; the sender gives up on its own
+        if (c.win > 0 && done->second.stored) {
+            sendCompleteAck(device, std::string(c.id), total);
+        }
+        return;
+    }
+
+    Assembly* a;
+    auto it = _index.find(key);
+    if (it != _index.end()) {
+        a = &_slots[it->second];
+    } else {
+        a = open(device, c, key);
+        if (!a) {
+            return;     // Pool full: the windowed sender resends, legacy loses the image
+        }
+    }
+    if (total != a->total) {
+        return;
+    }
+    a->lastAt = monotonicMs();
+
+    bool isNew = !a->have[index];
+    if (isNew) {
+        if (!place(*a, index, c.data.data(), c.data.size())) {
+            _stats.imageDropped(device);
+            _done[key] = { a->lastAt, false };
+            release(*a);
+            return;
+        }
+        a->have[index] = 1;
+        a->received++;
+    }
+
+    if (a->received == a->total) {
+        finish(*a);
+        return;
+    }
+    if (a->window) {
+        if (ackNow(*a, index, isNew)) {
+            sendAck(*a);
+        } else if (!a->ackDueAt) {
+            a->ackDueAt = a->lastAt + XFER_ACK_DELAY_MS;
+        }
+    }
+}
+
+ChunkAssembler::Assembly* ChunkAssembler::open(const std::string& device, const Chunk& c,
+                                               const std::string& key) {
+    size_t i = 0;
+    while (i < _slots.size() && _slots[i].used) i++;
+    if (i == _slots.size()) {
+        if (_poolFull++ % 100 == 0) {
+            fprintf(stderr, "⚠️ [XFER] All %zu assembly slots busy, chunk from %s dropped\n",
+                    _slots.size(), device.c_str());
+        }
+        return nullptr;
+    }
+
+    Assembly& a = _slots[i];
+    a.used = true;
+    a.key = key;
+    a.device = device;
+    a.imageId.assign(c.id);
+    a.name.assign(c.captureId.empty() ? c.id : c.captureId);
+    a.kind.assign(c.kind);
+    a.capturedAt = c.capturedAt > 0 ? (time_t)c.capturedAt : 0;
+    a.total = (uint16_t)c.total;
+    a.received = 0;
+    a.window = c.win > 0 ? (uint16_t)c.win : 0;
+    a.firstMissing = 0;
+    a.sinceAck = 0;
+    a.chunkSize = 0;
+    a.lastSize = 0;
+    a.lastHeld = false;
+    a.have.assign(a.total, 0);
+    a.firstAt = a.lastAt = monotonicMs();
+    a.ackDueAt = 0;
+    _index[key] = i;
+    return &a;
+}
+
+// Decode one chunk into place; false if the image cannot be assembled
+bool ChunkAssembler::place(Assembly& a, uint16_t index, const char* data, size_t dataLen) {
+    long size = base64DecodedLen(data, dataLen);
+    if (size <= 0 || size > XFER_MAX_CHUNK_RAW) {
+        fprintf(stderr, "⚠️ [XFER] %s: chunk %u has %zu B of base64\n", a.key.c_str(), index, dataLen);
+        return false;
+    }
+    bool last = index == a.total - 1;
+
+    if (!last) {
+        if (!a.chunkSize) {
+            // First sized chunk: everything else can now be placed
+            a.chunkSize = (uint32_t)size;
+            size_t need = (size_t)(a.total - 1) * a.chunkSize + (a.lastSize ? a.lastSize : a.chunkSize);
+            if (need > _settings.slotBytes) {
+                fprintf(stderr, "⚠️ [XFER] %s: %zu B image does not fit a %zu B slot\n",
+                        a.key.c_str(), need, _settings.slotBytes);
+                return false;
+            }
+            if (a.lastHeld) {
+                memcpy(a.slot + (size_t)(a.total - 1) * a.chunkSize, a.tail.data(), a.lastSize);
+                a.lastHeld = false;
+            }
+        } else if ((uint32_t)size != a.chunkSize) {
+            fprintf(stderr, "⚠️ [XFER] %s: chunk %u is %ld B, others %u B\n",
+                    a.key.c_str(), index, size, a.chunkSize);
+            return false;
+        }
+        return base64Decode(data, dataLen, a.slot + (size_t)index * a.chunkSize);
+    }
+
+    a.lastSize = (uint32_t)size;
+    if (a.total == 1) {
+        return base64Decode(data, dataLen, a.slot);
+    }
+    if (!a.chunkSize) {
+        // Offset unknown until another chunk arrives
+        a.lastHeld = true;
+        return base64Decode(data, dataLen, a.tail.data());
+    }
+    if ((size_t)(a.total - 1) * a.chunkSize + a.lastSize > _settings.slotBytes) {
+        return false;
+    }
+    return base64Decode(data, dataLen, a.slot + (size_t)(a.total - 1) * a.chunkSize);
+}
+
+// Same rule as chunkTransfer.ackNow()
+bool ChunkAssembler::ackNow(Assembly& a, uint16_t index, bool isNew) {
+    if (!isNew) {
+        return true;
+    }
+    a.sinceAck++;
+    while (a.firstMissing < a.total && a.have[a.firstMissing]) a.firstMissing++;
+    uint16_t batch = a.window / 2 > 1 ? a.window / 2 : 1;
+    return index > a.firstMissing || a.sinceAck >= batch;
+}
+
+void ChunkAssembler::sendAck(Assembly& a) {
+    a.ackDueAt = 0;
+    a.sinceAck = 0;
+    if (!_sendAck) {
+        return;
+    }
+    uint8_t frame[4 + 255 + 5 + XFER_MAX_RANGES * 4];
+    size_t idLen = a.imageId.size() < 255 ? a.imageId.size() : 255;
+    frame[0] = XFER_ACK_MAGIC;
+    frame[1] = XFER_VERSION;
+    frame[2] = 0;
+    frame[3] = (uint8_t)idLen;
+    memcpy(frame + 4, a.imageId.data(), idLen);
+    size_t pos = 4 + idLen;
+
+    uint16_t cumAck = 0;
+    while (cumAck < a.total && a.have[cumAck]) cumAck++;
+    frame[pos] = a.total & 0xFF;
+    frame[pos + 1] = a.total >> 8;
+    frame[pos + 2] = cumAck & 0xFF;
+    frame[pos + 3] = cumAck >> 8;
+    size_t countAt = pos + 4;
+    pos += 5;
+
+    uint8_t ranges = 0;
+    for (uint16_t i = cumAck; i < a.total && ranges < XFER_MAX_RANGES;) {
+        if (!a.have[i]) {
+            i++;
+            continue;
+        }
+        uint16_t start = i;
+        while (i < a.total && a.have[i]) i++;
+        frame[pos] = start & 0xFF;
+        frame[pos + 1] = start >> 8;
+        frame[pos + 2] = i & 0xFF;
+        frame[pos + 3] = i >> 8;
+        pos += 4;
+        ranges++;
+    }
+    frame[countAt] = ranges;
+    _sendAck(a.device, frame, pos);
+}
+
+void ChunkAssembler::sendCompleteAck(const std::string& device, const std::string& imageId, uint16_t total) {
+    if (!_sendAck) {
+        return;
+    }
+    uint8_t frame[4 + 255 + 5];
+    size_t idLen = imageId.size() < 255 ? imageId.size() : 255;
+    frame[0] = XFER_ACK_MAGIC;
+    frame[1] = XFER_VERSION;
+    frame[2] = XFER_FLAG_COMPLETE;
+    frame[3] = (uint8_t)idLen;
+    memcpy(frame + 4, imageId.data(), idLen);
+    size_t pos = 4 + idLen;
+    frame[pos] = frame[pos + 2] = total & 0xFF;
+    frame[pos + 1] = frame[pos + 3] = total >> 8;
+    frame[pos + 4] = 0;
+    _sendAck(device, frame, pos + 5);
+}
+
+void ChunkAssembler::finish(Assembly& a) {
+    size_t size = a.total == 1 ? a.lastSize : (size_t)(a.total - 1) * a.chunkSize + a.lastSize;
+    ImageFile file;
+    bool ok = _store.create(file, a.device, a.name, a.kind, 0) &&
+              _store.write(file, a.slot, size, 0);
+    if (ok) {
+        ok = _store.commit(file, size, a.capturedAt);
+    } else {
+        _store.discard(file);
+    }
+
+    uint64_t now = monotonicMs();
+    if (ok) {
+        _stats.imageStored(a.device, PATH_MQTT, size, now - a.firstAt);
+    } else {
+        _stats.imageDropped(a.device);
+    }
+    if (ok && a.window) {
+        sendCompleteAck(a.device, a.imageId, a.total);
+    }
+    _done[a.key] = { now, ok };
+    release(a);
+}
+
+void ChunkAssembler::release(Assembly& a) {
+    _index.erase(a.key);
+    a.used = false;
+    a.ackDueAt = 0;
+}
+
+void ChunkAssembler::storeRaw(const std::string& device, const uint8_t* payload, size_t len) {
+    uint64_t startedAt = monotonicMs();
+    // Raw publishes carry no id: name them by arrival
+    char name[32];
+    snprintf(name, sizeof(name), "raw-%llu-%llu", (unsigned long long)startedAt,
+             (unsigned long long)++_oneShots);
+
+    ImageFile file;
+    if (_store.create(file, device, name, "full", 0) && _store.write(file, payload, len, 0) &&
+        _store.commit(file, len)) {
+        _stats.imageStored(device, PATH_MQTT, len, monotonicMs() - startedAt);
+        return;
+    }
+    _store.discard(file);
+    _stats.imageDropped(device);
+}
+
+void ChunkAssembler::handleLegacy(const std::string& device, const Chunk& c) {
+    uint64_t startedAt = monotonicMs();
+    long size = base64DecodedLen(c.imageData.data(), c.imageData.size());
+    if (size <= 0) {
+        _stats.imageDropped(device);
+        return;
+    }
+    std::vector<uint8_t> image(size);
+    if (!base64Decode(c.imageData.data(), c.imageData.size(), image.data())) {
+        _stats.imageDropped(device);
+        return;
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "json-%llu-%llu", (unsigned long long)startedAt,
+             (unsigned long long)++_oneShots);
+
+    ImageFile file;
+    if (_store.create(file, device, name, "full", 0) && _store.write(file, image.data(), size, 0) &&
+        _store.commit(file, size)) {
+        _stats.imageStored(device, PATH_MQTT, size, monotonicMs() - startedAt);
+        return;
+    }
+    _store.discard(file);
+    _stats.imageDropped(device);
+}
+
+void ChunkAssembler::tick(uint64_t now) {
+    for (Assembly& a : _slots) {
+        if (!a.used) {
+            continue;
+        }
+        if (now - a.lastAt >= XFER_STALE_MS) {
+            fprintf(stderr, "🗑️ [XFER] Timeout: dropped incomplete image %s (%u/%u chunks)\n",
+                    a.key.c_str(), a.received, a.total);
+            _stats.imageDropped(a.device);
+            release(a);
+        } else if (a.ackDueAt && now >= a.ackDueAt) {
+            sendAck(a);
+        }
+    }
+
+    if (now - _doneSweepAt < 1000) {
+        return;
+    }
+    _doneSweepAt = now;
+    for (auto it = _done.begin(); it != _done.end();) {
+        it = now - it->second.at >= XFER_DONE_MEMORY_MS ? _done.erase(it) : std::next(it);
+    }
+}
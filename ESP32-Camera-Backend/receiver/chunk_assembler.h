@@ -0,0 +1,107 @@
+/**
+ * chunk_assembler.h - Reassembles MQTT image chunks into preallocated slots
+ *
+ * Same wire format and ack rules as services/chunkTransfer.js: every chunk but
+ * the last decodes to the same size, so chunk i is base64-decoded straight to
+ * offset i * chunkSize of its slot; a last chunk that arrives before any other
+ * is held aside until that size is known. Nothing is allocated per image: the
+ * slots are one block carved up at startup, and a finished image goes to disk
+ * with a single write.
+ *
+ * Also takes the two one-shot forms the firmware can publish on the same
+ * topic: a raw JPEG (written straight from the MQTT receive buffer) and the
+ * legacy { imageData } JSON.
+ */
+
+#ifndef CHUNK_ASSEMBLER_H
+#define CHUNK_ASSEMBLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "config.h"
+#include "image_store.h"
+#include "ingest_stats.h"
+
+class ChunkAssembler {
+public:
+    // Publishes an ack frame to <root>/<device>/xfer
+    using AckSender = std::function<void(const std::string& device, const uint8_t* frame, size_t len)>;
+
+    ChunkAssembler(const Settings& settings, ImageStore& store, IngestStats& stats);
+    ~ChunkAssembler();
+
+    // Allocate the slot pool
+    bool begin();
+    void onAck(AckSender sender) { _sendAck = sender; }
+
+    // One publish on <root>/<device>/image
+    void handleMessage(const std::string& device, const uint8_t* payload, size_t len);
+
+    // Delayed acks, stale assemblies, finished-id memory; call every few ms
+    void tick(uint64_t nowMs);
+
+    size_t active() const { return _index.size(); }
+    uint64_t poolFull() const { return _poolFull; }
+
+private:
+    struct Chunk;
+
+    struct Assembly {
+        bool used;
+        std::string key;            // device/id
+        std::string device;
+        std::string imageId;
+        std::string name;           // File stem: captureId, else the image id
+        std::string kind;
+        time_t capturedAt;
+        uint16_t total;
+        uint16_t received;
+        uint16_t window;            // 0 = legacy sender, never acked
+        uint16_t firstMissing;
+        uint16_t sinceAck;
+        uint32_t chunkSize;         // Decoded size of chunks 0..total-2, 0 = not seen yet
+        uint32_t lastSize;          // Decoded size of chunk total-1, 0 = not seen yet
+        bool lastHeld;              // Last chunk is in tail, not in the slot
+        uint8_t* slot;
+        std::vector<uint8_t> have;  // Per chunk
+        std::vector<uint8_t> tail;  // XFER_MAX_CHUNK_RAW
+        uint64_t firstAt;
+        uint64_t lastAt;
+        uint64_t ackDueAt;          // 0 = no ack pending
+    };
+
+    const Settings& _settings;
+    ImageStore& _store;
+    IngestStats& _stats;
+    AckSender _sendAck;
+    uint8_t* _pool;
+    std::vector<Assembly> _slots;
+    std::unordered_map<std::string, size_t> _index;         // key -> slot
+    struct Done {
+        uint64_t at;
+        bool stored;                // false: rejected (too large, malformed, write failed)
+    };
+    std::unordered_map<std::string, Done> _done;            // key -> outcome
+    uint64_t _doneSweepAt;
+    uint64_t _poolFull;
+    uint64_t _oneShots;        // Raw / legacy images, for file names
+
+    static bool parse(const uint8_t* payload, size_t len, Chunk& c);
+    void handleChunk(const std::string& device, const Chunk& c);
+    void handleLegacy(const std::string& device, const Chunk& c);
+    void storeRaw(const std::string& device, const uint8_t* payload, size_t len);
+
+    Assembly* open(const std::string& device, const Chunk& c, const std::string& key);
+    bool place(Assembly& a, uint16_t index, const char* data, size_t dataLen);
+    bool ackNow(Assembly& a, uint16_t index, bool isNew);
+    void sendAck(Assembly& a);
+    void sendCompleteAck(const std::string& device, const std::string& imageId, uint16_t total);
+    void finish(Assembly& a);
+    void release(Assembly& a);
+};
+
+#endif // CHUNK_ASSEMBLER_H
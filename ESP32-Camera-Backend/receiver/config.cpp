@@ -0,0 +1,53 @@
+/**
+ * config.cpp - Settings from the environment
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include "config.h"
+
+static std::string envString(const char* name, const char* fallback) {
+    const char* v = getenv(name);
+    return v && *v ? v : fallback;
+}
+
+static unsigned long envNumber(const char* name, unsigned long fallback) {
+    const char* v = getenv(name);
+    return v && *v ? strtoul(v, nullptr, 10) : fallback;
+}
+
+Settings Settings::fromEnv() {
+    Settings s;
+
+    // mqtt://host[:port], as the backend's MQTT_BROKER
+    std::string broker = envString("MQTT_BROKER", MQTT_BROKER_DEFAULT);
+    if (broker.compare(0, 8, "mqtts://") == 0) {
+        fprintf(stderr, "⚠️ [CONFIG] mqtts:// is not supported, terminate TLS in front of the receiver\n");
+        broker = broker.substr(8);
+    } else if (broker.compare(0, 7, "mqtt://") == 0) {
+        broker = broker.substr(7);
+    }
+    size_t slash = broker.find('/');
+    if (slash != std::string::npos) {
+        broker.resize(slash);
+    }
+    size_t colon = broker.rfind(':');
+    s.brokerHost = broker.substr(0, colon);
+    s.brokerPort = colon == std::string::npos ? 1883 : (uint16_t)atoi(broker.c_str() + colon + 1);
+
+    s.mqttUser = envString("MQTT_USERNAME", "");
+    s.mqttPassword = envString("MQTT_PASSWORD", "");
+    s.clientId = envString("MQTT_CLIENT_ID", ("receiver-" + std::to_string(getpid())).c_str());
+    s.httpPort = (uint16_t)envNumber("RECEIVER_HTTP_PORT", HTTP_PORT_DEFAULT);
+    s.outputDir = envString("RECEIVER_OUT", OUTPUT_DIR_DEFAULT);
+    s.slots = envNumber("RECEIVER_SLOTS", ASSEMBLY_SLOTS);
+    s.slotBytes = envNumber("RECEIVER_SLOT_BYTES", ASSEMBLY_SLOT_BYTES);
+    s.reportSeconds = (unsigned)envNumber("REPORT_S", REPORT_INTERVAL_S);
+
+    // Slots are page aligned
+    s.slotBytes = (s.slotBytes + 4095) & ~(size_t)4095;
+    if (!s.slots) s.slots = 1;
+    if (!s.reportSeconds) s.reportSeconds = REPORT_INTERVAL_S;
+    return s;
+}
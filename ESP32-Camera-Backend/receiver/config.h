@@ -0,0 +1,63 @@
+/**
+ * config.h - Defaults for the reference ingestion receiver
+ *
+ * Every setting can be overridden from the environment (same names as the
+ * Node backend where one exists); see Settings::fromEnv().
+ */
+
+#ifndef RECEIVER_CONFIG_H
+#define RECEIVER_CONFIG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// ===== MQTT (firmware mqtt_manager.h) =====
+#define MQTT_BROKER_DEFAULT     "mqtt://localhost:1883"  // Plain TCP; terminate TLS in front if needed
+#define MQTT_TOPIC_ROOT         "cam"                    // <root>/<deviceId>/<leaf>
+#define MQTT_TOPIC_IMAGE        "image"
+#define MQTT_TOPIC_XFER         "xfer"                   // Chunk acks (services/chunkTransfer.js)
+#define MQTT_KEEPALIVE_S        60
+#define MQTT_RECONNECT_MS       2000
+#define MQTT_READ_BUFFER        (64 * 1024)              // Grows up to MQTT_MAX_PACKET
+#define MQTT_MAX_PACKET         (4 * 1024 * 1024)
+
+// ===== Chunk reassembly =====
+#define XFER_MAX_CHUNKS         1024        // Firmware limit (config.h XFER_MAX_CHUNKS)
+#define XFER_MAX_CHUNK_RAW      6144        // Decoded bytes per chunk; MQTT_BUFFER_SIZE 8192 bounds it
+#define XFER_MAX_RANGES         8
+#define XFER_ACK_DELAY_MS       40          // Tail of a window is acked after this
+#define XFER_STALE_MS           60000       // Incomplete image dropped
+#define XFER_DONE_MEMORY_MS     60000       // Finished ids re-acked, not stored twice
+#define ASSEMBLY_SLOTS          32          // Images reassembled at once
+#define ASSEMBLY_SLOT_BYTES     (1024 * 1024)
+
+// ===== HTTP (routes/images.js, routes/uploads.js) =====
+#define HTTP_PORT_DEFAULT       3000
+#define HTTP_MAX_HEADER         8192
+#define HTTP_MAX_CONNECTIONS    256
+#define HTTP_IDLE_MS            30000
+#define UPLOAD_MAX_BYTES        (8 * 1024 * 1024)
+#define UPLOAD_SESSION_MS       (60 * 60 * 1000)        // Resumable session lifetime
+
+// ===== Output =====
+#define OUTPUT_DIR_DEFAULT      "received"               // <dir>/<deviceId>/<captureId>.<kind>.jpg
+#define REPORT_INTERVAL_S       10
+#define LATENCY_SAMPLES         1024                      // Per device, ring buffer
+
+struct Settings {
+    std::string brokerHost;
+    uint16_t brokerPort;
+    std::string mqttUser;
+    std::string mqttPassword;
+    std::string clientId;
+    uint16_t httpPort;
+    std::string outputDir;
+    size_t slots;
+    size_t slotBytes;
+    unsigned reportSeconds;
+
+    static Settings fromEnv();
+};
+
+#endif // RECEIVER_CONFIG_H
@@ -0,0 +1,75 @@
+/**
+ * event_loop.cpp - epoll loop implementation
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include "event_loop.h"
+
+bool setNonBlocking(int fd) {
+    int flags = fcntl(fd, F_GETFL, 0);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+EventLoop::EventLoop() : _epfd(-1), _count(0) {}
+
+EventLoop::~EventLoop() {
+    if (_epfd >= 0) {
+        close(_epfd);
+    }
+}
+
+bool EventLoop::begin() {
+    _epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (_epfd < 0) {
+        perror("[LOOP] epoll_create1");
+        return false;
+    }
+    return true;
+}
+
+bool EventLoop::add(int fd, EventSource* source, uint32_t events) {
+    epoll_event ev = {};
+    ev.events = events;
+    ev.data.ptr = source;
+    return epoll_ctl(_epfd, EPOLL_CTL_ADD, fd, &ev) == 0;
+}
+
+bool EventLoop::modify(int fd, EventSource* source, uint32_t events) {
+    epoll_event ev = {};
+    ev.events = events;
+    ev.data.ptr = source;
+    return epoll_ctl(_epfd, EPOLL_CTL_MOD, fd, &ev) == 0;
+}
+
+void EventLoop::remove(int fd) {
+    epoll_ctl(_epfd, EPOLL_CTL_DEL, fd, nullptr);
+}
+
+void EventLoop::forget(EventSource* source) {
+    for (int i = 0; i < _count; i++) {
+        if (_events[i].data.ptr == source) {
+            _events[i].data.ptr = nullptr;
+        }
+    }
+}
+
+void EventLoop::run(int timeoutMs) {
+    int n = epoll_wait(_epfd, _events, MAX_EVENTS, timeoutMs);
+    if (n < 0) {
+        if (errno != EINTR) {
+            perror("[LOOP] epoll_wait");
+        }
+        return;
+    }
+    _count = n;
+    for (int i = 0; i < n; i++) {
+        EventSource* source = static_cast<EventSource*>(_events[i].data.ptr);
+        if (source) {
+            source->onEvent(_events[i].events);
+        }
+    }
+    _count = 0;
+}
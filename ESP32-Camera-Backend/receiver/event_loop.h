@@ -0,0 +1,47 @@
+/**
+ * event_loop.h - epoll loop shared by the MQTT client and the HTTP server
+ *
+ * One thread, level-triggered. Each registered fd carries the EventSource
+ * that handles it; sources change their own interest set through modify().
+ */
+
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <cstdint>
+#include <sys/epoll.h>
+
+class EventSource {
+public:
+    virtual ~EventSource() {}
+    virtual void onEvent(uint32_t events) = 0;
+};
+
+class EventLoop {
+public:
+    EventLoop();
+    ~EventLoop();
+
+    bool begin();
+    bool add(int fd, EventSource* source, uint32_t events);
+    bool modify(int fd, EventSource* source, uint32_t events);
+    void remove(int fd);
+
+    /**
+     * Wait up to timeoutMs and dispatch. A source may remove (and delete)
+     * itself from onEvent; later events for it in the same batch are dropped.
+     */
+    void run(int timeoutMs);
+    void forget(EventSource* source);   // Call before deleting a source
+
+private:
+    static const int MAX_EVENTS = 64;
+    int _epfd;
+    epoll_event _events[MAX_EVENTS];
+    int _count;         // Events in the batch being dispatched
+};
+
+// O_NONBLOCK on fd
+bool setNonBlocking(int fd);
+
+#endif // EVENT_LOOP_H
@@ -0,0 +1,835 @@
+/**
+ * http_server.cpp - Upload routes on the shared event loop
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "http_server.h"
+
+static const size_t SPLICE_STEP = 1024 * 1024;     // Per splice call, same as the pipe size
+static const size_t SMALL_BODY_MAX = 64 * 1024;    // JSON bodies (login)
+
+static const char* statusText(int status) {
+    switch (status) {
+        case 100: return "Continue";
+        case 200: return "OK";
+        case 201: return "Created";
+        case 204: return "No Content";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 409: return "Conflict";
+        case 411: return "Length Required";
+        case 413: return "Payload Too Large";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 503: return "Service Unavailable";
+        default: return "Unknown";
+    }
+}
+
+// Quote-free strings from headers into JSON
+static std::string jsonString(const std::string& s) {
+    std::string out = "\"";
+    for (char c : s) {
+        if (c != '"' && c != '\\' && (unsigned char)c >= 0x20) out += c;
+    }
+    return out + "\"";
+}
+
+// ===== Connection =====
+
+class HttpServer::Connection : public EventSource {
+public:
+    Connection(HttpServer& server, int fd);
+    ~Connection();
+
+    void onEvent(uint32_t events) override;
+
+    int fd() const { return _fd; }
+    uint64_t lastAt() const { return _lastAt; }
+    void detachSession() { _session = nullptr; }
+
+private:
+    enum Phase {
+        PHASE_HEAD,         // Reading request headers
+        PHASE_SMALL_BODY,   // Reading a JSON body into _body
+        PHASE_PROLOGUE,     // Reading a multipart part header
+        PHASE_SPLICE,       // Moving image bytes into _file / the session file
+        PHASE_DRAIN,        // Discarding the rest of the body, then responding
+        PHASE_RESPOND       // Writing _out
+    };
+    enum Action { ACTION_NONE, ACTION_LOGIN, ACTION_UPLOAD, ACTION_PATCH };
+
+    struct Request {
+        std::string method;
+        std::string path;
+        size_t contentLength;
+        bool hasLength;
+        bool chunked;
+        bool expectContinue;
+        bool close;
+        std::string contentType;
+        std::string device;
+        std::string captureId;
+        std::string kind;
+        std::string hash;
+        time_t capturedAt;
+        long uploadLength;
+        long uploadOffset;
+    };
+
+    HttpServer& _server;
+    int _fd;
+    Phase _phase;
+    bool _dead;
+    char _in[HTTP_MAX_HEADER];
+    size_t _inLen;
+    Request _req;
+    Action _action;
+    size_t _headLen;            // Request line and headers, for wire stats
+    size_t _bodyLeft;           // Body bytes not consumed yet
+    std::string _body;
+    std::string _boundary;
+    ImageFile _file;            // /upload-image target
+    Session* _session;          // PATCH target
+    off_t _fileOffset;
+    size_t _spliceLeft;
+    size_t _imageBytes;
+    std::string _out;
+    size_t _outSent;
+    bool _closeAfter;
+    uint64_t _startedAt;
+    uint64_t _lastAt;
+
+    bool step();
+    bool readHead();
+    bool readSmallBody();
+    bool readPrologue();
+    bool spliceBody();
+    bool drain();
+    bool writeOut();
+
+    void dispatch();
+    void parseHead(const char* head, size_t len);
+    void startUpload();
+    void startPatch(const std::string& id);
+    void openResumable();
+    void headSession(const std::string& id);
+    void finishBody();
+    void abortBody();
+
+    ssize_t readBody(char* dst, size_t max);
+    void sendContinue();
+    void buildResponse(int status, const std::string& json, const std::string& headers);
+    void respond(int status, const std::string& json, const std::string& headers = "");
+    void respondAfterBody(int status, const std::string& json, const std::string& headers = "");
+    void setInterest(bool out);
+};
+
+HttpServer::Connection::Connection(HttpServer& server, int fd)
+    : _server(server), _fd(fd), _phase(PHASE_HEAD), _dead(false), _inLen(0), _action(ACTION_NONE),
+      _headLen(0), _bodyLeft(0), _session(nullptr), _fileOffset(0), _spliceLeft(0), _imageBytes(0), _outSent(0),
+      _closeAfter(false), _startedAt(0), _lastAt(monotonicMs()) {}
+
+HttpServer::Connection::~Connection() {
+    abortBody();
+    close(_fd);
+}
+
+void HttpServer::Connection::onEvent(uint32_t events) {
+    _lastAt = monotonicMs();
+    if (events & (EPOLLHUP | EPOLLERR)) {
+        _dead = true;
+    }
+    while (!_dead && step()) {
+    }
+    if (_dead) {
+        _server.destroy(this);  // Deletes this
+    }
+}
+
+// One unit of progress; false when waiting for the socket
+bool HttpServer::Connection::step() {
+    switch (_phase) {
+        case PHASE_HEAD: return readHead();
+        case PHASE_SMALL_BODY: return readSmallBody();
+        case PHASE_PROLOGUE: return readPrologue();
+        case PHASE_SPLICE: return spliceBody();
+        case PHASE_DRAIN: return drain();
+        case PHASE_RESPOND: return writeOut();
+    }
+    return false;
+}
+
+bool HttpServer::Connection::readHead() {
+    const char* end = _inLen >= 4 ? (const char*)memmem(_in, _inLen, "\r\n\r\n", 4) : nullptr;
+    if (!end) {
+        if (_inLen == sizeof(_in)) {
+            _req.close = true;
+            respond(431, "{\"success\":false,\"message\":\"Headers too large\"}");
+            return true;
+        }
+        ssize_t n = recv(_fd, _in + _inLen, sizeof(_in) - _inLen, 0);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+            _dead = true;
+            return false;
+        }
+        if (n < 0) {
+            return false;
+        }
+        _inLen += n;
+        return true;
+    }
+
+    size_t headLen = end + 4 - _in;
+    _startedAt = monotonicMs();
+    parseHead(_in, headLen);
+    // Whatever followed the headers is the start of the body
+    memmove(_in, _in + headLen, _inLen - headLen);
+    _inLen -= headLen;
+    _headLen = headLen;
+    dispatch();
+    return true;
+}
+
+void HttpServer::Connection::parseHead(const char* head, size_t len) {
+    _req = Request();
+    _req.contentLength = 0;
+    _req.hasLength = _req.chunked = _req.expectContinue = _req.close = false;
+    _req.capturedAt = 0;
+    _req.uploadLength = _req.uploadOffset = -1;
+    _req.device = "unknown";
+
+    const char* p = head;
+    const char* end = head + len;
+    const char* eol = (const char*)memmem(p, end - p, "\r\n", 2);
+    const char* sp1 = (const char*)memchr(p, ' ', eol - p);
+    const char* sp2 = sp1 ? (const char*)memchr(sp1 + 1, ' ', eol - sp1 - 1) : nullptr;
+    if (sp1 && sp2) {
+        _req.method.assign(p, sp1 - p);
+        _req.path.assign(sp1 + 1, sp2 - sp1 - 1);
+        size_t query = _req.path.find('?');
+        if (query != std::string::npos) {
+            _req.path.resize(query);
+        }
+        _req.close = memmem(sp2, eol - sp2, "HTTP/1.0", 8) != nullptr;
+    }
+
+    for (p = eol + 2; p < end; p = eol + 2) {
+        eol = (const char*)memmem(p, end - p, "\r\n", 2);
+        if (!eol || eol == p) {
+            break;
+        }
+        const char* colon = (const char*)memchr(p, ':', eol - p);
+        if (!colon) {
+            continue;
+        }
+        std::string name(p, colon - p);
+        const char* v = colon + 1;
+        while (v < eol && (*v == ' ' || *v == '\t')) v++;
+        std::string value(v, eol - v);
+
+        const char* n = name.c_str();
+        if (!strcasecmp(n, "Content-Length")) {
+            _req.contentLength = strtoull(value.c_str(), nullptr, 10);
+            _req.hasLength = true;
+        } else if (!strcasecmp(n, "Transfer-Encoding")) {
+            _req.chunked = strcasestr(value.c_str(), "chunked") != nullptr;
+        } else if (!strcasecmp(n, "Expect")) {
+            _req.expectContinue = strcasestr(value.c_str(), "100-continue") != nullptr;
+        } else if (!strcasecmp(n, "Connection")) {
+            _req.close = strcasestr(value.c_str(), "close") != nullptr;
+        } else if (!strcasecmp(n, "Content-Type")) {
+            _req.contentType = value;
+        } else if (!strcasecmp(n, "X-Device-Id")) {
+            _req.device = value;
+        } else if (!strcasecmp(n, "X-Capture-Id")) {
+            _req.captureId = value;
+        } else if (!strcasecmp(n, "X-Image-Kind")) {
+            _req.kind = value;
+        } else if (!strcasecmp(n, "X-Content-SHA256")) {
+            _req.hash = value;
+            for (char& c : _req.hash) c = tolower(c);
+        } else if (!strcasecmp(n, "X-Captured-At")) {
+            _req.capturedAt = (time_t)strtoll(value.c_str(), nullptr, 10);
+        } else if (!strcasecmp(n, "Upload-Length")) {
+            _req.uploadLength = strtol(value.c_str(), nullptr, 10);
+        } else if (!strcasecmp(n, "Upload-Offset")) {
+            _req.uploadOffset = value.empty() ? -1 : strtol(value.c_str(), nullptr, 10);
+        }
+    }
+}
+
+void HttpServer::Connection::dispatch() {
+    _bodyLeft = _req.contentLength;
+    _action = ACTION_NONE;
+    const std::string& m = _req.method;
+    const std::string& path = _req.path;
+
+    if (_req.chunked) {
+        // The firmware always sends a length; chunked bodies would need a copy loop
+        _req.close = true;
+        respond(411, "{\"success\":false,\"message\":\"Content-Length required\"}");
+        return;
+    }
+
+    if (m == "POST" && path == "/api/auth/login") {
+        if (_bodyLeft > SMALL_BODY_MAX) {
+            _req.close = true;
+            respond(413, "{\"success\":false,\"message\":\"Body too large\"}");
+            return;
+        }
+        _action = ACTION_LOGIN;
+        _body.clear();
+        sendContinue();
+        _phase = PHASE_SMALL_BODY;
+    } else if (m == "POST" && path == "/api/upload-image") {
+        startUpload();
+    } else if (m == "GET" && path.compare(0, 18, "/api/upload-image/") == 0) {
+        bool known = _server._hashes.count(path.substr(18)) > 0;
+        respondAfterBody(known ? 200 : 404, known ? "{\"success\":true,\"exists\":true}"
+                                                  : "{\"success\":false,\"exists\":false}");
+    } else if (m == "POST" && path == "/api/uploads") {
+        openResumable();
+    } else if (m == "HEAD" && path.compare(0, 13, "/api/uploads/") == 0) {
+        headSession(path.substr(13));
+    } else if (m == "PATCH" && path.compare(0, 13, "/api/uploads/") == 0) {
+        startPatch(path.substr(13));
+    } else {
+        respondAfterBody(404, "{\"success\":false,\"message\":\"Not found\"}");
+    }
+}
+
+void HttpServer::Connection::startUpload() {
+    if (!_req.hasLength || _bodyLeft == 0) {
+        respondAfterBody(400, "{\"success\":false,\"message\":\"No image file provided\"}");
+        return;
+    }
+    if (_bodyLeft > UPLOAD_MAX_BYTES) {
+        _req.close = true;
+        respond(413, "{\"success\":false,\"message\":\"Image too large\"}");
+        return;
+    }
+    _action = ACTION_UPLOAD;
+    _fileOffset = 0;
+    _server._stats.wireBytes(_req.device, _headLen + _bodyLeft);
+
+    size_t b = _req.contentType.find("boundary=");
+    if (strncasecmp(_req.contentType.c_str(), "multipart/", 10) == 0 && b != std::string::npos) {
+        _boundary = _req.contentType.substr(b + 9);
+        if (!_boundary.empty() && _boundary[0] == '"') {
+            _boundary = _boundary.substr(1, _boundary.find('"', 1) - 1);
+        }
+        sendContinue();
+        _phase = PHASE_PROLOGUE;
+        return;
+    }
+
+    // Raw body: the whole thing is the image
+    _imageBytes = _spliceLeft = _bodyLeft;
+    std::string name = _req.captureId.empty() ? _server.uniqueName() : _req.captureId;
+    if (!_server._store.create(_file, _req.device, name, _req.kind, _imageBytes)) {
+        respondAfterBody(500, "{\"success\":false,\"message\":\"Cannot store image\"}");
+        return;
+    }
+    sendContinue();
+    _phase = PHASE_SPLICE;
+}
+
+// Single-part multipart as UploadManager::uploadImage and curl -F write it:
+// --boundary\r\n<part headers>\r\n\r\n<image>\r\n--boundary--\r\n
+bool HttpServer::Connection::readPrologue() {
+    const char* end = _inLen >= 4 ? (const char*)memmem(_in, _inLen, "\r\n\r\n", 4) : nullptr;
+    if (!end) {
+        size_t room = sizeof(_in) - _inLen;
+        if (room == 0 || _inLen >= _bodyLeft) {
+            respondAfterBody(400, "{\"success\":false,\"message\":\"Malformed multipart body\"}");
+            return true;
+        }
+        ssize_t n = recv(_fd, _in + _inLen, room < _bodyLeft - _inLen ? room : _bodyLeft - _inLen, 0);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+            _dead = true;
+            return false;
+        }
+        if (n < 0) {
+            return false;
+        }
+        _inLen += n;
+        return true;
+    }
+
+    size_t prologue = end + 4 - _in;
+    size_t epilogue = 4 + _boundary.size() + 4;     // \r\n--boundary--\r\n
+    if (_bodyLeft < prologue + epilogue + 1) {
+        respondAfterBody(400, "{\"success\":false,\"message\":\"No image file provided\"}");
+        return true;
+    }
+    memmove(_in, _in + prologue, _inLen - prologue);
+    _inLen -= prologue;
+    _bodyLeft -= prologue;
+
+    _imageBytes = _spliceLeft = _bodyLeft - epilogue;
+    std::string name = _req.captureId.empty() ? _server.uniqueName() : _req.captureId;
+    if (!_server._store.create(_file, _req.device, name, _req.kind, _imageBytes)) {
+        respondAfterBody(500, "{\"success\":false,\"message\":\"Cannot store image\"}");
+        return true;
+    }
+    _phase = PHASE_SPLICE;
+    return true;
+}
+
+bool HttpServer::Connection::spliceBody() {
+    ImageFile& file = _session ? _session->file : _file;
+
+    if (_spliceLeft && _inLen) {
+        // Bytes that came in with the headers
+        size_t n = _inLen < _spliceLeft ? _inLen : _spliceLeft;
+        if (!_server._store.write(file, (const uint8_t*)_in, n, _fileOffset)) {
+            abortBody();
+            _req.close = true;
+            respond(500, "{\"success\":false,\"message\":\"Write failed\"}");
+            return true;
+        }
+        memmove(_in, _in + n, _inLen - n);
+        _inLen -= n;
+        _fileOffset += n;
+        _spliceLeft -= n;
+        _bodyLeft -= n;
+        if (_session) {
+            _session->offset += n;
+        }
+        return true;
+    }
+    if (_spliceLeft) {
+        ssize_t n = _server._store.splice(_fd, file, _fileOffset, _spliceLeft < SPLICE_STEP ? _spliceLeft : SPLICE_STEP);
+        if (n < 0) {
+            _dead = true;   // Upload file discarded, session keeps what landed
+            return false;
+        }
+        if (n == 0) {
+            return false;
+        }
+        _fileOffset += n;
+        _spliceLeft -= n;
+        _bodyLeft -= n;
+        if (_session) {
+            _session->offset += n;
+            _session->lastAt = monotonicMs();
+        }
+        return true;
+    }
+
+    finishBody();
+    return true;
+}
+
+void HttpServer::Connection::finishBody() {
+    uint64_t now = monotonicMs();
+
+    if (_action == ACTION_UPLOAD) {
+        std::string path = _file.path;
+        bool ok = _server._store.commit(_file, _imageBytes, _req.capturedAt);
+        if (!ok) {
+            _server._stats.imageDropped(_req.device);
+            respondAfterBody(500, "{\"success\":false,\"message\":\"Cannot store image\"}");
+            return;
+        }
+        _server._stats.imageStored(_req.device, PATH_HTTP, _imageBytes, now - _startedAt);
+        if (!_req.hash.empty()) {
+            _server._hashes.insert(_req.hash);
+        }
+        respondAfterBody(201, "{\"success\":true,\"message\":\"Image saved\",\"data\":{\"image\":{\"filename\":" +
+                              jsonString(path.substr(path.rfind('/') + 1)) + "}}}");
+        return;
+    }
+
+    // PATCH
+    Session* s = _session;
+    _session = nullptr;
+    s->writer = nullptr;
+    s->lastAt = now;
+    std::string offset = "Upload-Offset: " + std::to_string(s->offset) + "\r\n";
+    if (s->offset < s->length) {
+        respondAfterBody(204, "", offset);
+        return;
+    }
+    std::string path = s->file.path;
+    bool ok = _server._store.commit(s->file, s->length, s->capturedAt);
+    if (ok) {
+        _server._stats.imageStored(s->device, PATH_RESUMABLE, s->length, now - s->openedAt);
+        _server._hashes.insert(s->hash);
+    } else {
+        _server._stats.imageDropped(s->device);
+    }
+    printf("📦 [HTTP] Upload session %s complete (%zu bytes)\n", s->id.c_str(), s->length);
+    _server.closeSession(*s, ok);
+    if (ok) {
+        respondAfterBody(201, "{\"success\":true,\"message\":\"Image saved\",\"data\":{\"image\":{\"filename\":" +
+                              jsonString(path.substr(path.rfind('/') + 1)) + "}}}", offset);
+    } else {
+        respondAfterBody(500, "{\"success\":false,\"message\":\"Cannot store image\"}");
+    }
+}
+
+// Connection lost or request refused mid-body
+void HttpServer::Connection::abortBody() {
+    if (_file.fd >= 0) {
+        _server._store.discard(_file);
+        _server._stats.imageDropped(_req.device);
+    }
+    if (_session) {
+        _session->writer = nullptr;
+        _session = nullptr;
+    }
+}
+
+void HttpServer::Connection::openResumable() {
+    long length = _req.uploadLength;
+    if (length <= 0 || length > UPLOAD_MAX_BYTES) {
+        respondAfterBody(400, "{\"success\":false,\"message\":\"Upload-Length must be 1.." +
+                              std::to_string(UPLOAD_MAX_BYTES) + "\"}");
+        return;
+    }
+    if (_req.hash.size() != 64) {
+        respondAfterBody(400, "{\"success\":false,\"message\":\"X-Content-SHA256 is required\"}");
+        return;
+    }
+    if (_server._hashes.count(_req.hash)) {
+        respondAfterBody(200, "{\"success\":true,\"message\":\"Duplicate upload ignored\","
+                              "\"data\":{\"duplicate\":true}}");
+        return;
+    }
+
+    // Same bytes as an unfinished session: resume it instead of starting over
+    Session* s = nullptr;
+    for (auto& entry : _server._sessions) {
+        if (entry.second.hash == _req.hash && entry.second.device == _req.device) {
+            s = &entry.second;
+            break;
+        }
+    }
+    if (s && s->length != (size_t)length) {
+        _server.closeSession(*s, false);
+        s = nullptr;
+    }
+    if (!s) {
+        std::string name = _req.captureId.empty() ? _server.uniqueName() : _req.captureId;
+        s = _server.openSession(_req.device, _req.hash, name, _req.kind, _req.capturedAt, length);
+        if (!s) {
+            respondAfterBody(500, "{\"success\":false,\"message\":\"Error creating upload session\"}");
+            return;
+        }
+    }
+    s->lastAt = monotonicMs();
+    _server._stats.wireBytes(s->device, _headLen);
+    printf("📦 [HTTP] Upload session %s: %zu/%zu bytes\n", s->id.c_str(), s->offset, s->length);
+    respondAfterBody(201, "{\"success\":true,\"data\":{\"id\":\"" + s->id + "\",\"offset\":" +
+                          std::to_string(s->offset) + ",\"length\":" + std::to_string(s->length) + "}}",
+                     "Location: /api/uploads/" + s->id + "\r\nUpload-Offset: " +
+                          std::to_string(s->offset) + "\r\n");
+}
+
+void HttpServer::Connection::headSession(const std::string& id) {
+    Session* s = _server.findSession(id);
+    if (!s) {
+        respondAfterBody(404, "");
+        return;
+    }
+    respondAfterBody(200, "", "Upload-Offset: " + std::to_string(s->offset) + "\r\nUpload-Length: " +
+                              std::to_string(s->length) + "\r\nCache-Control: no-store\r\n");
+}
+
+void HttpServer::Connection::startPatch(const std::string& id) {
+    Session* s = _server.findSession(id);
+    if (!s) {
+        respondAfterBody(404, "{\"success\":false,\"message\":\"Upload session not found\"}");
+        return;
+    }
+    std::string offset = "Upload-Offset: " + std::to_string(s->offset) + "\r\n";
+    if (_req.uploadOffset != (long)s->offset || s->writer) {
+        respondAfterBody(409, "{\"success\":false,\"message\":\"Offset mismatch\",\"data\":{\"offset\":" +
+                              std::to_string(s->offset) + "}}", offset);
+        return;
+    }
+    if (_bodyLeft > s->length - s->offset) {
+        respondAfterBody(400, "{\"success\":false,\"message\":\"Body runs past Upload-Length\"}");
+        return;
+    }
+    _action = ACTION_PATCH;
+    _session = s;
+    _server._stats.wireBytes(s->device, _headLen + _bodyLeft);
+    s->writer = this;
+    s->lastAt = monotonicMs();
+    _fileOffset = s->offset;
+    _spliceLeft = _bodyLeft;
+    sendContinue();
+    _phase = PHASE_SPLICE;
+}
+
+bool HttpServer::Connection::readSmallBody() {
+    char buf[4096];
+    while (_bodyLeft) {
+        ssize_t n = readBody(buf, _bodyLeft < sizeof(buf) ? _bodyLeft : sizeof(buf));
+        if (n <= 0) {
+            return false;
+        }
+        _body.append(buf, n);
+        _bodyLeft -= n;
+    }
+    // ACTION_LOGIN: any credentials do; this receiver does not authenticate
+    respondAfterBody(200, "{\"success\":true,\"message\":\"Login successful\","
+                          "\"data\":{\"token\":\"receiver\"}}");
+    return true;
+}
+
+bool HttpServer::Connection::drain() {
+    char buf[16 * 1024];
+    while (_bodyLeft) {
+        ssize_t n = readBody(buf, _bodyLeft < sizeof(buf) ? _bodyLeft : sizeof(buf));
+        if (n <= 0) {
+            return false;
+        }
+        _bodyLeft -= n;
+    }
+    _phase = PHASE_RESPOND;
+    setInterest(true);
+    return true;
+}
+
+// Body bytes, buffered ones first; 0 = wait, -1 = connection gone (_dead set)
+ssize_t HttpServer::Connection::readBody(char* dst, size_t max) {
+    if (_inLen) {
+        size_t n = _inLen < max ? _inLen : max;
+        memcpy(dst, _in, n);
+        memmove(_in, _in + n, _inLen - n);
+        _inLen -= n;
+        return n;
+    }
+    ssize_t n = recv(_fd, dst, max, 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EINTR)) {
+        _dead = true;
+        return -1;
+    }
+    return n < 0 ? 0 : n;
+}
+
+bool HttpServer::Connection::writeOut() {
+    while (_outSent < _out.size()) {
+        ssize_t n = send(_fd, _out.data() + _outSent, _out.size() - _outSent, MSG_NOSIGNAL);
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+            return false;
+        }
+        if (n <= 0) {
+            _dead = true;
+            return false;
+        }
+        _outSent += n;
+    }
+    if (_closeAfter) {
+        _dead = true;
+        return false;
+    }
+    // Keep-alive: next request (possibly already buffered)
+    _out.clear();
+    _outSent = 0;
+    _action = ACTION_NONE;
+    _phase = PHASE_HEAD;
+    setInterest(false);
+    return true;
+}
+
+void HttpServer::Connection::sendContinue() {
+    if (_req.expectContinue && _bodyLeft > _inLen) {
+        // Tiny, goes straight into an empty socket buffer
+        static const char msg[] = "HTTP/1.1 100 Continue\r\n\r\n";
+        send(_fd, msg, sizeof(msg) - 1, MSG_NOSIGNAL);
+    }
+}
+
+void HttpServer::Connection::buildResponse(int status, const std::string& json, const std::string& headers) {
+    char head[256];
+    snprintf(head, sizeof(head),
+             "HTTP/1.1 %d %s\r\n"
+             "Content-Type: application/json\r\n"
+             "Content-Length: %zu\r\n"
+             "%s",
+             status, statusText(status), json.size(), _closeAfter ? "Connection: close\r\n" : "");
+    _out = head;
+    _out += headers;
+    _out += "\r\n";
+    if (_req.method != "HEAD") {
+        _out += json;
+    }
+    _outSent = 0;
+}
+
+// Respond now; the connection closes afterwards if a body is left unread
+void HttpServer::Connection::respond(int status, const std::string& json, const std::string& headers) {
+    _closeAfter = _req.close || _bodyLeft > _inLen;
+    buildResponse(status, json, headers);
+    if (_closeAfter) {
+        _inLen = 0;
+    } else if (_bodyLeft) {
+        // Body already buffered: drop it, keep any request pipelined behind it
+        memmove(_in, _in + _bodyLeft, _inLen - _bodyLeft);
+        _inLen -= _bodyLeft;
+    }
+    _bodyLeft = 0;
+    _phase = PHASE_RESPOND;
+    setInterest(true);
+}
+
+// Respond once the rest of the body has been read (and dropped)
+void HttpServer::Connection::respondAfterBody(int status, const std::string& json, const std::string& headers) {
+    if (_bodyLeft > UPLOAD_MAX_BYTES) {
+        respond(status, json, headers);
+        return;
+    }
+    _closeAfter = _req.close;
+    buildResponse(status, json, headers);
+    _phase = PHASE_DRAIN;
+    setInterest(false);
+}
+
+void HttpServer::Connection::setInterest(bool out) {
+    _server._loop.modify(_fd, this, out ? EPOLLOUT : EPOLLIN);
+}
+
+// ===== HttpServer =====
+
+HttpServer::HttpServer(EventLoop& loop, const Settings& settings, ImageStore& store, IngestStats& stats)
+    : _loop(loop), _settings(settings), _store(store), _stats(stats), _fd(-1),
+      _random(std::random_device()()), _names(0) {}
+
+HttpServer::~HttpServer() {
+    while (!_connections.empty()) {
+        destroy(*_connections.begin());
+    }
+    for (auto& entry : _sessions) {
+        _store.discard(entry.second.file);
+    }
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+bool HttpServer::begin() {
+    _fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int one = 1;
+    setsockopt(_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(_settings.httpPort);
+    if (bind(_fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(_fd, 128) != 0) {
+        perror("❌ [HTTP] bind/listen");
+        return false;
+    }
+    if (!_loop.add(_fd, this, EPOLLIN)) {
+        return false;
+    }
+    printf("✅ [HTTP] Listening on port %u\n", _settings.httpPort);
+    return true;
+}
+
+void HttpServer::onEvent(uint32_t events) {
+    (void)events;
+    while (true) {
+        int fd = accept4(_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EINTR) {
+                perror("⚠️ [HTTP] accept");
+            }
+            return;
+        }
+        if (_connections.size() >= HTTP_MAX_CONNECTIONS) {
+            close(fd);
+            continue;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        Connection* c = new Connection(*this, fd);
+        _connections.insert(c);
+        _loop.add(fd, c, EPOLLIN);
+    }
+}
+
+void HttpServer::destroy(Connection* c) {
+    _loop.remove(c->fd());
+    _loop.forget(c);
+    _connections.erase(c);
+    delete c;
+}
+
+void HttpServer::tick(uint64_t now) {
+    for (auto it = _connections.begin(); it != _connections.end();) {
+        Connection* c = *it++;
+        if (now - c->lastAt() >= HTTP_IDLE_MS) {
+            destroy(c);
+        }
+    }
+    for (auto it = _sessions.begin(); it != _sessions.end();) {
+        Session& s = (it++)->second;
+        if (!s.writer && now - s.lastAt >= UPLOAD_SESSION_MS) {
+            printf("🗑️ [HTTP] Upload session %s expired at %zu/%zu bytes\n",
+                   s.id.c_str(), s.offset, s.length);
+            _stats.imageDropped(s.device);
+            closeSession(s, false);
+        }
+    }
+}
+
+HttpServer::Session* HttpServer::openSession(const std::string& device, const std::string& hash,
+                                             const std::string& name, const std::string& kind,
+                                             time_t capturedAt, size_t length) {
+    char id[17];
+    snprintf(id, sizeof(id), "%016llx", (unsigned long long)_random());
+    Session& s = _sessions[id];
+    s.id = id;
+    s.device = device;
+    s.hash = hash;
+    s.name = name;
+    s.kind = kind;
+    s.capturedAt = capturedAt;
+    s.length = length;
+    s.offset = 0;
+    s.openedAt = s.lastAt = monotonicMs();
+    s.writer = nullptr;
+    if (!_store.create(s.file, device, name, kind, length)) {
+        _sessions.erase(id);
+        return nullptr;
+    }
+    return &s;
+}
+
+HttpServer::Session* HttpServer::findSession(const std::string& id) {
+    auto it = _sessions.find(id);
+    return it == _sessions.end() ? nullptr : &it->second;
+}
+
+// stored: the file was committed; otherwise it is thrown away
+void HttpServer::closeSession(Session& s, bool stored) {
+    if (!stored) {
+        _store.discard(s.file);
+    }
+    if (s.writer) {
+        s.writer->detachSession();
+    }
+    std::string id = s.id;      // s is the map's own copy
+    _sessions.erase(id);
+}
+
+std::string HttpServer::uniqueName() {
+    char name[48];
+    snprintf(name, sizeof(name), "http-%llu-%llu", (unsigned long long)monotonicMs(),
+             (unsigned long long)++_names);
+    return name;
+}
@@ -0,0 +1,86 @@
+/**
+ * http_server.h - The firmware's HTTP upload routes, bodies spliced to disk
+ *
+ *   POST /api/auth/login          any credentials, returns a token (no auth here)
+ *   POST /api/upload-image        raw image/jpeg or single-part multipart
+ *   GET  /api/upload-image/:hash  200 if a body with that X-Content-SHA256 was stored
+ *   POST /api/uploads             open a resumable session (Upload-Length)
+ *   HEAD /api/uploads/:id         Upload-Offset
+ *   PATCH /api/uploads/:id        append at Upload-Offset
+ *
+ * Status codes and JSON match routes/images.js and routes/uploads.js closely
+ * enough for UploadManager. Image bytes never pass through user space: after
+ * the headers (and a multipart prologue) the body is spliced from the socket
+ * into the file, and only the few bytes that arrived with the headers are
+ * written by hand. A PATCH advances the session offset as bytes land, so a
+ * dropped connection resumes from what is actually on disk.
+ */
+
+#ifndef HTTP_SERVER_H
+#define HTTP_SERVER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include "config.h"
+#include "event_loop.h"
+#include "image_store.h"
+#include "ingest_stats.h"
+
+class HttpServer : public EventSource {
+public:
+    HttpServer(EventLoop& loop, const Settings& settings, ImageStore& store, IngestStats& stats);
+    ~HttpServer();
+
+    bool begin();
+
+    // Idle connections, expired sessions; call every second or so
+    void tick(uint64_t nowMs);
+
+    size_t connections() const { return _connections.size(); }
+    size_t sessions() const { return _sessions.size(); }
+
+    void onEvent(uint32_t events) override;    // Listening socket
+
+private:
+    class Connection;
+    friend class Connection;
+
+    struct Session {
+        std::string id;
+        std::string device;
+        std::string hash;
+        std::string name;
+        std::string kind;
+        time_t capturedAt;
+        size_t length;
+        size_t offset;          // Bytes on disk
+        ImageFile file;
+        uint64_t openedAt;
+        uint64_t lastAt;
+        Connection* writer;     // PATCH in progress, nullptr if none
+    };
+
+    EventLoop& _loop;
+    const Settings& _settings;
+    ImageStore& _store;
+    IngestStats& _stats;
+    int _fd;
+    std::unordered_set<Connection*> _connections;
+    std::unordered_map<std::string, Session> _sessions;     // id -> session
+    std::unordered_set<std::string> _hashes;                // X-Content-SHA256 of stored bodies
+    std::mt19937_64 _random;
+    uint64_t _names;            // Unnamed uploads, for file names
+
+    Session* openSession(const std::string& device, const std::string& hash, const std::string& name,
+                         const std::string& kind, time_t capturedAt, size_t length);
+    Session* findSession(const std::string& id);
+    void closeSession(Session& s, bool stored);
+    std::string uniqueName();
+    void destroy(Connection* c);
+};
+
+#endif // HTTP_SERVER_H
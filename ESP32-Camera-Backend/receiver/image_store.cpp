@@ -0,0 +1,149 @@
+/**
+ * image_store.cpp - Image files on disk
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "image_store.h"
+
+static const int PIPE_BYTES = 1024 * 1024;
+
+ImageStore::ImageStore() {
+    _pipe[0] = _pipe[1] = -1;
+}
+
+ImageStore::~ImageStore() {
+    if (_pipe[0] >= 0) {
+        close(_pipe[0]);
+        close(_pipe[1]);
+    }
+}
+
+bool ImageStore::begin(const std::string& dir) {
+    _dir = dir;
+    if (mkdir(_dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        perror("[STORE] mkdir");
+        return false;
+    }
+    if (pipe2(_pipe, O_CLOEXEC) != 0) {
+        perror("[STORE] pipe");
+        return false;
+    }
+    // Fewer splice round trips per body; the default is 64 KB
+    fcntl(_pipe[1], F_SETPIPE_SZ, PIPE_BYTES);
+    return true;
+}
+
+std::string ImageStore::safeName(const std::string& in) {
+    std::string out;
+    out.reserve(in.size());
+    for (char c : in) {
+        bool ok = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                  c == '-' || c == '_' || c == '.';
+        out += ok ? c : '_';
+    }
+    if (out.empty() || out[0] == '.') {
+        out.insert(out.begin(), '_');
+    }
+    return out;
+}
+
+bool ImageStore::create(ImageFile& file, const std::string& device, const std::string& name,
+                        const std::string& kind, size_t size) {
+    std::string dir = _dir + "/" + safeName(device);
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+        perror("[STORE] mkdir");
+        return false;
+    }
+    file.path = dir + "/" + safeName(name) + "." + safeName(kind.empty() ? "full" : kind) + ".jpg";
+    std::string part = file.path + ".part";
+    file.fd = open(part.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (file.fd < 0) {
+        perror("[STORE] open");
+        return false;
+    }
+    if (size && posix_fallocate(file.fd, 0, size) != 0) {
+        // Not fatal: the filesystem may not support it
+        ftruncate(file.fd, size);
+    }
+    return true;
+}
+
+bool ImageStore::write(ImageFile& file, const uint8_t* buf, size_t len, off_t offset) {
+    while (len) {
+        ssize_t n = pwrite(file.fd, buf, len, offset);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            perror("[STORE] pwrite");
+            return false;
+        }
+        buf += n;
+        len -= n;
+        offset += n;
+    }
+    return true;
+}
+
+ssize_t ImageStore::splice(int sock, ImageFile& file, off_t offset, size_t len) {
+    ssize_t in = ::splice(sock, nullptr, _pipe[1], nullptr, len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (in == 0) {
+        return -1;      // Peer closed mid-body
+    }
+    if (in < 0) {
+        return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+    }
+    // Drain the pipe completely, it is shared by every connection
+    loff_t at = offset;
+    ssize_t left = in;
+    while (left > 0) {
+        ssize_t out = ::splice(_pipe[0], nullptr, file.fd, &at, left, SPLICE_F_MOVE);
+        if (out < 0 && errno == EINTR) {
+            continue;
+        }
+        if (out <= 0) {
+            perror("[STORE] splice");
+            // Throw away what is stuck in the pipe so the next body starts clean
+            char sink[4096];
+            while (left > 0) {
+                ssize_t n = read(_pipe[0], sink, left < (ssize_t)sizeof(sink) ? left : sizeof(sink));
+                if (n <= 0) {
+                    break;
+                }
+                left -= n;
+            }
+            return -1;
+        }
+        left -= out;
+    }
+    return in;
+}
+
+bool ImageStore::commit(ImageFile& file, size_t size, time_t capturedAt) {
+    std::string part = file.path + ".part";
+    bool ok = ftruncate(file.fd, size) == 0;
+    if (capturedAt > 0) {
+        struct timespec times[2] = { { capturedAt, 0 }, { capturedAt, 0 } };
+        futimens(file.fd, times);
+    }
+    ok = close(file.fd) == 0 && ok;
+    file.fd = -1;
+    if (ok && rename(part.c_str(), file.path.c_str()) == 0) {
+        return true;
+    }
+    perror("[STORE] commit");
+    unlink(part.c_str());
+    return false;
+}
+
+void ImageStore::discard(ImageFile& file) {
+    if (file.fd >= 0) {
+        close(file.fd);
+        file.fd = -1;
+        unlink((file.path + ".part").c_str());
+    }
+}
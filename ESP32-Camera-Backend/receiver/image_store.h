@@ -0,0 +1,61 @@
+/**
+ * image_store.h - Image files on disk
+ *
+ * Files are written as <dir>/<deviceId>/<name>.jpg.part and renamed when
+ * complete, so anything watching the directory only sees whole images.
+ *
+ * Socket bodies (HTTP uploads) move with splice(2): socket -> pipe -> file,
+ * in the kernel, at an explicit file offset (resumable PATCH ranges land
+ * where they belong without seeking). Reassembled MQTT images are written
+ * from their assembly slot with one pwrite(2).
+ */
+
+#ifndef IMAGE_STORE_H
+#define IMAGE_STORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <ctime>
+#include <sys/types.h>
+
+struct ImageFile {
+    int fd = -1;
+    std::string path;       // Final name; the open file is path + ".part"
+};
+
+class ImageStore {
+public:
+    ImageStore();
+    ~ImageStore();
+
+    bool begin(const std::string& dir);
+
+    /**
+     * Create the .part file. name: capture id (or any unique stem), kind:
+     * "thumb" / "roi" / "full". size > 0 reserves the blocks up front.
+     */
+    bool create(ImageFile& file, const std::string& device, const std::string& name,
+                const std::string& kind, size_t size);
+
+    bool write(ImageFile& file, const uint8_t* buf, size_t len, off_t offset);
+
+    /**
+     * Move up to len bytes from a non-blocking socket to file at offset.
+     * @return bytes moved, 0 if the socket has nothing now, -1 on EOF/error.
+     */
+    ssize_t splice(int sock, ImageFile& file, off_t offset, size_t len);
+
+    // Trim to size, stamp mtime with the capture time (0 = now), close and rename into place
+    bool commit(ImageFile& file, size_t size, time_t capturedAt = 0);
+    void discard(ImageFile& file);
+
+    // Keep only [A-Za-z0-9._-] so ids from the network cannot leave the directory
+    static std::string safeName(const std::string& in);
+
+private:
+    std::string _dir;
+    int _pipe[2];
+};
+
+#endif // IMAGE_STORE_H
@@ -0,0 +1,91 @@
+/**
+ * ingest_stats.cpp - Per-device ingestion statistics
+ */
+
+#include <algorithm>
+#include <time.h>
+#include "config.h"
+#include "ingest_stats.h"
+
+uint64_t monotonicMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+IngestStats::IngestStats() : _startedAt(monotonicMs()), _intervalAt(_startedAt) {}
+
+IngestStats::Device& IngestStats::device(const std::string& id) {
+    auto it = _devices.find(id);
+    if (it != _devices.end()) {
+        return it->second;
+    }
+    Device& d = _devices[id];
+    std::fill(std::begin(d.images), std::end(d.images), 0);
+    d.bytes = d.wire = d.dropped = d.intervalImages = d.intervalBytes = 0;
+    d.latency.assign(LATENCY_SAMPLES, 0);
+    d.latencyNext = 0;
+    d.latencyCount = 0;
+    return d;
+}
+
+void IngestStats::imageStored(const std::string& id, IngestPath path, size_t bytes, uint64_t latencyMs) {
+    Device& d = device(id);
+    d.images[path]++;
+    d.bytes += bytes;
+    d.intervalImages++;
+    d.intervalBytes += bytes;
+    d.latency[d.latencyNext] = (uint32_t)latencyMs;
+    d.latencyNext = (d.latencyNext + 1) % LATENCY_SAMPLES;
+    d.latencyCount++;
+}
+
+void IngestStats::imageDropped(const std::string& id) {
+    device(id).dropped++;
+}
+
+void IngestStats::wireBytes(const std::string& id, size_t bytes) {
+    device(id).wire += bytes;
+}
+
+void IngestStats::report(FILE* out, bool final) {
+    uint64_t now = monotonicMs();
+    double intervalS = std::max<uint64_t>(now - _intervalAt, 1) / 1000.0;
+    double totalS = std::max<uint64_t>(now - _startedAt, 1) / 1000.0;
+    uint64_t allImages = 0;
+    uint64_t allBytes = 0;
+    uint64_t allInterval = 0;
+
+    std::vector<uint32_t> sorted;
+    sorted.reserve(LATENCY_SAMPLES);
+    for (auto& entry : _devices) {
+        Device& d = entry.second;
+        uint64_t images = d.images[PATH_MQTT] + d.images[PATH_HTTP] + d.images[PATH_RESUMABLE];
+        allImages += images;
+        allBytes += d.bytes;
+        allInterval += d.intervalBytes;
+        if (!final && !d.intervalImages) {
+            continue;   // Quiet camera
+        }
+        size_t n = std::min<uint64_t>(d.latencyCount, LATENCY_SAMPLES);
+        sorted.assign(d.latency.begin(), d.latency.begin() + n);
+        std::sort(sorted.begin(), sorted.end());
+        auto pct = [&](double p) { return n ? sorted[std::min(n - 1, (size_t)(n * p))] : 0u; };
+
+        fprintf(out, "[STATS] %-20s %5llu img (mqtt %llu http %llu resumable %llu), %8.1f KB/s now, "
+                     "%8.1f KB/s avg, wire %.2fx, latency p50 %u p95 %u max %u ms, dropped %llu\n",
+                entry.first.c_str(), (unsigned long long)images,
+                (unsigned long long)d.images[PATH_MQTT], (unsigned long long)d.images[PATH_HTTP],
+                (unsigned long long)d.images[PATH_RESUMABLE],
+                d.intervalBytes / 1024.0 / intervalS, d.bytes / 1024.0 / totalS,
+                d.bytes ? (double)d.wire / d.bytes : 0.0, pct(0.5), pct(0.95), n ? sorted[n - 1] : 0u,
+                (unsigned long long)d.dropped);
+        d.intervalImages = 0;
+        d.intervalBytes = 0;
+    }
+    fprintf(out, "[STATS] %zu devices, %llu images, %.1f MB, %.1f KB/s now, %.1f KB/s avg\n",
+            _devices.size(), (unsigned long long)allImages, allBytes / 1048576.0,
+            allInterval / 1024.0 / intervalS, allBytes / 1024.0 / totalS);
+    fflush(out);
+    _intervalAt = now;
+}
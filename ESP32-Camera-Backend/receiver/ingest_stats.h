@@ -0,0 +1,63 @@
+/**
+ * ingest_stats.h - Per-device throughput and reassembly latency
+ *
+ * Latency is first byte to file on disk: first MQTT chunk to the image
+ * written, request headers to body stored (HTTP), session open to last PATCH
+ * (resumable). Single-threaded, like the rest of the receiver.
+ */
+
+#ifndef INGEST_STATS_H
+#define INGEST_STATS_H
+
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+// Monotonic milliseconds
+uint64_t monotonicMs();
+
+enum IngestPath : uint8_t {
+    PATH_MQTT = 0,          // Chunked (windowed or legacy) or one raw JPEG publish
+    PATH_HTTP = 1,          // POST /api/upload-image, raw or multipart
+    PATH_RESUMABLE = 2,     // POST + PATCH /api/uploads
+    PATH_COUNT
+};
+
+class IngestStats {
+public:
+    IngestStats();
+
+    void imageStored(const std::string& device, IngestPath path, size_t bytes, uint64_t latencyMs);
+    void imageDropped(const std::string& device);           // Incomplete, oversized or write failed
+    void wireBytes(const std::string& device, size_t bytes); // Payload as received (base64, headers)
+
+    /**
+     * One line per device: images and bytes since the last report and in
+     * total, throughput, wire overhead, latency p50/p95/max over the last
+     * LATENCY_SAMPLES images. Resets the interval counters.
+     */
+    void report(FILE* out, bool final);
+
+private:
+    struct Device {
+        uint64_t images[PATH_COUNT];
+        uint64_t bytes;
+        uint64_t wire;
+        uint64_t dropped;
+        uint64_t intervalImages;
+        uint64_t intervalBytes;
+        std::vector<uint32_t> latency;  // Ring, LATENCY_SAMPLES
+        size_t latencyNext;
+        uint64_t latencyCount;
+    };
+
+    std::map<std::string, Device> _devices;
+    uint64_t _startedAt;
+    uint64_t _intervalAt;
+
+    Device& device(const std::string& id);
+};
+
+#endif // INGEST_STATS_H
@@ -0,0 +1,96 @@
+/**
+ * main.cpp - Reference ingestion receiver
+ *
+ * Stands in for the Node backend's ingestion paths when measuring how fast a
+ * fleet can be taken in: MQTT chunks (windowed and legacy) and the HTTP
+ * upload routes, written to <RECEIVER_OUT>/<deviceId>/. No database, no
+ * detection, no notifications. One thread, one epoll loop.
+ *
+ * Per-device throughput and latency go to stdout every REPORT_S seconds and
+ * once more on Ctrl+C.
+ */
+
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include "chunk_assembler.h"
+#include "config.h"
+#include "event_loop.h"
+#include "http_server.h"
+#include "image_store.h"
+#include "ingest_stats.h"
+#include "mqtt_client.h"
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void onSignal(int) {
+    stopRequested = 1;
+}
+
+int main() {
+    Settings settings = Settings::fromEnv();
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    signal(SIGPIPE, SIG_IGN);
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+
+    EventLoop loop;
+    ImageStore store;
+    IngestStats stats;
+    if (!loop.begin() || !store.begin(settings.outputDir)) {
+        return 1;
+    }
+
+    ChunkAssembler assembler(settings, store, stats);
+    HttpServer http(loop, settings, store, stats);
+    MqttClient mqtt(loop, settings);
+    if (!assembler.begin() || !http.begin()) {
+        return 1;
+    }
+
+    // <root>/<deviceId>/image
+    const std::string root = MQTT_TOPIC_ROOT "/";
+    const std::string leaf = "/" MQTT_TOPIC_IMAGE;
+    mqtt.subscribe(root + "+" + leaf);
+    mqtt.onMessage([&](const char* topic, size_t topicLen, const uint8_t* payload, size_t len) {
+        if (topicLen <= root.size() + leaf.size() || memcmp(topic, root.data(), root.size()) != 0 ||
+            memcmp(topic + topicLen - leaf.size(), leaf.data(), leaf.size()) != 0) {
+            return;
+        }
+        std::string device(topic + root.size(), topicLen - root.size() - leaf.size());
+        assembler.handleMessage(device, payload, len);
+    });
+    assembler.onAck([&](const std::string& device, const uint8_t* frame, size_t len) {
+        mqtt.publish(root + device + "/" MQTT_TOPIC_XFER, frame, len);
+    });
+
+    printf("📡 [RECEIVER] MQTT %s:%u, HTTP :%u, writing to %s/\n", settings.brokerHost.c_str(),
+           settings.brokerPort, settings.httpPort, settings.outputDir.c_str());
+
+    uint64_t now = monotonicMs();
+    uint64_t secondAt = now;
+    uint64_t reportAt = now + settings.reportSeconds * 1000ULL;
+    while (!stopRequested) {
+        // Short wait: delayed acks are due XFER_ACK_DELAY_MS after the chunk
+        loop.run(10);
+        now = monotonicMs();
+        mqtt.tick(now);
+        assembler.tick(now);
+        if (now - secondAt >= 1000) {
+            secondAt = now;
+            http.tick(now);
+        }
+        if (now >= reportAt) {
+            reportAt = now + settings.reportSeconds * 1000ULL;
+            stats.report(stdout, false);
+        }
+    }
+
+    printf("\n");
+    stats.report(stdout, true);
+    if (assembler.poolFull()) {
+        printf("⚠️ [RECEIVER] %llu chunks dropped with every assembly slot busy (raise RECEIVER_SLOTS)\n",
+               (unsigned long long)assembler.poolFull());
+    }
+    return 0;
+}
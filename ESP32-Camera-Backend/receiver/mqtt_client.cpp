@@ -0,0 +1,319 @@
+/**
+ * mqtt_client.cpp - Minimal MQTT 3.1.1 client implementation
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "ingest_stats.h"
+#include "mqtt_client.h"
+
+static const size_t OUT_LIMIT = 4 * 1024 * 1024;   // Acks beyond this are dropped (QoS 0)
+
+static void putString(std::vector<uint8_t>& v, const std::string& s) {
+    v.push_back((uint8_t)(s.size() >> 8));
+    v.push_back((uint8_t)(s.size() & 0xFF));
+    v.insert(v.end(), s.begin(), s.end());
+}
+
+MqttClient::MqttClient(EventLoop& loop, const Settings& settings)
+    : _loop(loop), _settings(settings), _fd(-1), _state(STATE_IDLE), _retryAt(0), _lastSentAt(0),
+      _packetId(0), _writeArmed(false), _in(MQTT_READ_BUFFER), _inLen(0), _outSent(0) {
+    _out.reserve(64 * 1024);
+}
+
+MqttClient::~MqttClient() {
+    if (_fd >= 0) {
+        _loop.remove(_fd);
+        close(_fd);
+    }
+}
+
+void MqttClient::tick(uint64_t now) {
+    if (_state == STATE_IDLE && now >= _retryAt) {
+        startConnect();
+    } else if (_state == STATE_CONNECTED && now - _lastSentAt >= MQTT_KEEPALIVE_S * 1000 / 2) {
+        queue(0xC0, {});    // PINGREQ
+    } else if ((_state == STATE_TCP || _state == STATE_CONNACK) && now - _lastSentAt >= 10000) {
+        drop("connect timeout");
+    }
+}
+
+void MqttClient::startConnect() {
+    char port[8];
+    snprintf(port, sizeof(port), "%u", _settings.brokerPort);
+    addrinfo hints = {};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* res = nullptr;
+    _retryAt = monotonicMs() + MQTT_RECONNECT_MS;
+    if (getaddrinfo(_settings.brokerHost.c_str(), port, &hints, &res) != 0 || !res) {
+        fprintf(stderr, "[MQTT] Cannot resolve %s\n", _settings.brokerHost.c_str());
+        return;
+    }
+
+    _fd = socket(res->ai_family, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    int rc = _fd >= 0 ? ::connect(_fd, res->ai_addr, res->ai_addrlen) : -1;
+    freeaddrinfo(res);
+    if (rc != 0 && errno != EINPROGRESS) {
+        perror("[MQTT] connect");
+        if (_fd >= 0) {
+            close(_fd);
+            _fd = -1;
+        }
+        return;
+    }
+    int one = 1;
+    setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));   // Acks are small and urgent
+
+    _state = STATE_TCP;
+    _inLen = 0;
+    _out.clear();
+    _outSent = 0;
+    _lastSentAt = monotonicMs();
+    _writeArmed = true;
+    _loop.add(_fd, this, EPOLLIN | EPOLLOUT);
+}
+
+void MqttClient::drop(const char* why) {
+    fprintf(stderr, "[MQTT] Disconnected: %s, retry in %d ms\n", why, MQTT_RECONNECT_MS);
+    if (_fd >= 0) {
+        _loop.remove(_fd);
+        close(_fd);
+        _fd = -1;
+    }
+    _state = STATE_IDLE;
+    _retryAt = monotonicMs() + MQTT_RECONNECT_MS;
+}
+
+void MqttClient::suspend(uint64_t untilMs) {
+    if (_fd >= 0) {
+        _loop.remove(_fd);
+        close(_fd);
+        _fd = -1;
+    }
+    _state = STATE_IDLE;
+    _retryAt = untilMs;
+}
+
+void MqttClient::sendConnect() {
+    std::vector<uint8_t> body;
+    putString(body, "MQTT");
+    body.push_back(4);      // 3.1.1
+    uint8_t flags = 0x02;   // Clean session
+    if (!_settings.mqttUser.empty()) {
+        flags |= 0x80;
+        if (!_settings.mqttPassword.empty()) {
+            flags |= 0x40;
+        }
+    }
+    body.push_back(flags);
+    body.push_back(MQTT_KEEPALIVE_S >> 8);
+    body.push_back(MQTT_KEEPALIVE_S & 0xFF);
+    putString(body, _settings.clientId);
+    if (flags & 0x80) {
+        putString(body, _settings.mqttUser);
+    }
+    if (flags & 0x40) {
+        putString(body, _settings.mqttPassword);
+    }
+    queue(0x10, body);
+}
+
+void MqttClient::sendSubscribe() {
+    std::vector<uint8_t> body;
+    _packetId = _packetId == 0xFFFF ? 1 : _packetId + 1;
+    body.push_back(_packetId >> 8);
+    body.push_back(_packetId & 0xFF);
+    for (const std::string& filter : _filters) {
+        putString(body, filter);
+        body.push_back(0);  // QoS 0: chunks are acked end to end instead
+    }
+    queue(0x82, body);
+}
+
+void MqttClient::queue(uint8_t header, const std::vector<uint8_t>& body) {
+    if (_fd < 0 || _out.size() - _outSent > OUT_LIMIT) {
+        return;
+    }
+    _out.push_back(header);
+    size_t len = body.size();
+    do {
+        uint8_t b = len & 0x7F;
+        len >>= 7;
+        _out.push_back(len ? (b | 0x80) : b);
+    } while (len);
+    _out.insert(_out.end(), body.begin(), body.end());
+    _lastSentAt = monotonicMs();
+    flush();
+}
+
+bool MqttClient::publish(const std::string& topic, const uint8_t* payload, size_t len) {
+    if (_state != STATE_CONNECTED) {
+        return false;
+    }
+    std::vector<uint8_t> body;
+    body.reserve(2 + topic.size() + len);
+    putString(body, topic);
+    body.insert(body.end(), payload, payload + len);
+    queue(0x30, body);
+    return true;
+}
+
+void MqttClient::flush() {
+    if (_state == STATE_TCP) {
+        return;     // Not writable yet
+    }
+    while (_outSent < _out.size()) {
+        ssize_t n = send(_fd, _out.data() + _outSent, _out.size() - _outSent, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EINTR) {
+                drop(strerror(errno));
+                return;
+            }
+            break;
+        }
+        _outSent += n;
+    }
+    if (_outSent == _out.size()) {
+        _out.clear();
+        _outSent = 0;
+    }
+    updateInterest();
+}
+
+void MqttClient::updateInterest() {
+    bool want = _outSent < _out.size();
+    if (_fd >= 0 && want != _writeArmed) {
+        _writeArmed = want;
+        _loop.modify(_fd, this, want ? (EPOLLIN | EPOLLOUT) : EPOLLIN);
+    }
+}
+
+void MqttClient::onEvent(uint32_t events) {
+    if (_state == STATE_TCP && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(_fd, SOL_SOCKET, SO_ERROR, &err, &len);
+        if (err) {
+            drop(strerror(err));
+            return;
+        }
+        _state = STATE_CONNACK;
+        sendConnect();
+        return;
+    }
+    if (events & EPOLLOUT) {
+        flush();
+    }
+    if (_fd >= 0 && (events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+        readPackets();
+    }
+}
+
+void MqttClient::readPackets() {
+    for (;;) {
+        if (_inLen == _in.size()) {
+            if (_in.size() >= MQTT_MAX_PACKET + 5) {
+                drop("packet too large");
+                return;
+            }
+            _in.resize(_in.size() * 2);
+        }
+        ssize_t n = recv(_fd, _in.data() + _inLen, _in.size() - _inLen, 0);
+        if (n == 0) {
+            drop("closed by broker");
+            return;
+        }
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EINTR) {
+                break;
+            }
+            drop(strerror(errno));
+            return;
+        }
+        _inLen += n;
+    }
+
+    // Every complete packet in the buffer, then keep the partial tail
+    size_t pos = 0;
+    while (_inLen - pos >= 2) {
+        size_t len = 0;
+        size_t i = 1;
+        int shift = 0;
+        bool complete = false;
+        while (pos + i < _inLen && i <= 4) {
+            uint8_t b = _in[pos + i++];
+            len |= (size_t)(b & 0x7F) << shift;
+            shift += 7;
+            if (!(b & 0x80)) {
+                complete = true;
+                break;
+            }
+        }
+        if (!complete) {
+            if (i > 4) {
+                drop("bad length");
+                return;
+            }
+            break;
+        }
+        if (len > MQTT_MAX_PACKET) {
+            drop("packet too large");
+            return;
+        }
+        if (_inLen - pos - i < len) {
+            break;
+        }
+        if (!handlePacket(_in[pos], _in.data() + pos + i, len)) {
+            return;     // Dropped
+        }
+        pos += i + len;
+    }
+    if (pos) {
+        memmove(_in.data(), _in.data() + pos, _inLen - pos);
+        _inLen -= pos;
+    }
+}
+
+bool MqttClient::handlePacket(uint8_t header, const uint8_t* body, size_t len) {
+    switch (header >> 4) {
+        case 2: {   // CONNACK
+            if (len < 2 || body[1] != 0) {
+                drop("connection refused");
+                return false;
+            }
+            _state = STATE_CONNECTED;
+            fprintf(stderr, "[MQTT] Connected to %s:%u as %s\n", _settings.brokerHost.c_str(),
+                    _settings.brokerPort, _settings.clientId.c_str());
+            sendSubscribe();
+            return true;
+        }
+        case 3: {   // PUBLISH
+            if (len < 2) {
+                return true;
+            }
+            size_t topicLen = (body[0] << 8) | body[1];
+            size_t pos = 2 + topicLen;
+            uint8_t qos = (header >> 1) & 3;
+            if (qos) {
+                if (len < pos + 2) {
+                    return true;
+                }
+                queue(0x40, { body[pos], body[pos + 1] });  // PUBACK
+                pos += 2;
+            }
+            if (pos <= len && _handler) {
+                _handler((const char*)body + 2, topicLen, body + pos, len - pos);
+            }
+            return _fd >= 0;
+        }
+        default:    // SUBACK, PINGRESP, PUBACK
+            return true;
+    }
+}
@@ -0,0 +1,72 @@
+/**
+ * mqtt_client.h - Minimal MQTT 3.1.1 client for the receiver
+ *
+ * Just what ingestion needs: CONNECT (clean session, optional credentials),
+ * SUBSCRIBE, inbound PUBLISH at QoS 0/1, outbound PUBLISH at QoS 0 (chunk
+ * acks), keepalive and reconnect. Non-blocking on the shared EventLoop;
+ * outbound packets are buffered until the socket takes them.
+ */
+
+#ifndef MQTT_CLIENT_H
+#define MQTT_CLIENT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "config.h"
+#include "event_loop.h"
+
+class MqttClient : public EventSource {
+public:
+    // topic is not NUL-terminated; payload stays valid only during the call
+    using MessageHandler = std::function<void(const char* topic, size_t topicLen,
+                                              const uint8_t* payload, size_t len)>;
+
+    MqttClient(EventLoop& loop, const Settings& settings);
+    ~MqttClient();
+
+    void onMessage(MessageHandler handler) { _handler = handler; }
+    void subscribe(const std::string& filter) { _filters.push_back(filter); }
+
+    // Reconnects and keepalive; call at least every second
+    void tick(uint64_t nowMs);
+
+    bool publish(const std::string& topic, const uint8_t* payload, size_t len);
+    bool connected() const { return _state == STATE_CONNECTED; }
+    // Close the connection and stay away until untilMs (loadsim/ outages)
+    void suspend(uint64_t untilMs);
+
+    void onEvent(uint32_t events) override;
+
+private:
+    enum State { STATE_IDLE, STATE_TCP, STATE_CONNACK, STATE_CONNECTED };
+
+    EventLoop& _loop;
+    const Settings& _settings;
+    MessageHandler _handler;
+    std::vector<std::string> _filters;
+    int _fd;
+    State _state;
+    uint64_t _retryAt;
+    uint64_t _lastSentAt;
+    uint16_t _packetId;
+    bool _writeArmed;
+    std::vector<uint8_t> _in;
+    size_t _inLen;
+    std::vector<uint8_t> _out;
+    size_t _outSent;
+
+    void startConnect();
+    void drop(const char* why);
+    void queue(uint8_t header, const std::vector<uint8_t>& body);
+    void flush();
+    void updateInterest();
+    void readPackets();
+    bool handlePacket(uint8_t header, const uint8_t* body, size_t len);
+    void sendConnect();
+    void sendSubscribe();
+};
+
+#endif // MQTT_CLIENT_H
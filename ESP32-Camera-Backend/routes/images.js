@@ -3,11 +3,14 @@ const multer = require('multer');
 const path = require('path');
 const fs = require('fs');
 const { protect } = require('../middlewares/auth');
+const { ingestLimit } = require('../middlewares/ingestLimit');
 const {
   uploadImage,
+  checkUpload,
   getImages,
   getImageById,
   deleteImage,
+  requestFullImage,
   updateConfig,
   checkNewImages,
   saveSnapshot
@@ -50,11 +53,13 @@ const upload = multer({
 });
 
 // Routes
-router.post('/upload-image', protect, upload.single('image'), uploadImage);
+router.post('/upload-image', protect, ingestLimit, upload.single('image'), uploadImage);
+router.get('/upload-image/:hash', protect, checkUpload);
 router.post('/snapshot', protect, upload.single('image'), saveSnapshot);
 router.get('/images/check-new', protect, checkNewImages);
 router.get('/images', protect, getImages);
 router.get('/images/:id', protect, getImageById);
+router.post('/images/:id/fetch-full', protect, requestFullImage);
 router.delete('/images/:id', protect, deleteImage);
 router.put('/config', protect, updateConfig);
 
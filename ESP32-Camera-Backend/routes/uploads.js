@@ -0,0 +1,19 @@
+const express = require('express');
+const router = express.Router();
+const { protect } = require('../middlewares/auth');
+const { ingestLimit } = require('../middlewares/ingestLimit');
+const {
+  createUpload,
+  getUploadOffset,
+  appendUpload
+} = require('../controllers/uploadController');
+
+router.use(protect); // All routes are protected
+
+// Resumable uploads: create (or reopen by content hash), query offset, append bytes
+// Create and append go through ingest admission (429 + Retry-After when busy)
+router.post('/', ingestLimit, createUpload);
+router.head('/:id', getUploadOffset);
+router.patch('/:id', ingestLimit, appendUpload);
+
+module.exports = router;
@@ -0,0 +1,120 @@
+/**
+ * Receiver side of the windowed MQTT image transfer
+ * (mirrors firmware MQTTManager::publishImageChunked / handleXferAck)
+ *
+ * Chunks carry "win" (the sender's window). The receiver acks on
+ * <root>/<deviceId>/xfer with the chunks it holds, and the camera resends only
+ * what is missing:
+ *
+ *   [0] 0xB7 magic  [1] version 1  [2] flags (bit 0 = image complete)
+ *   [3] idLen  [4..] image id (ASCII)
+ *   u16 total, u16 cumAck (every chunk below it arrived),
+ *   u8 rangeCount, rangeCount x (u16 start, u16 end) held ranges above cumAck
+ *
+ * All integers little-endian. No dependencies, so the load test can use it too.
+ */
+
+const XFER_ACK_MAGIC = 0xb7;
+const XFER_VERSION = 1;
+const XFER_MAX_RANGES = 8;
+const XFER_FLAG_COMPLETE = 0x01;
+
+// Tail of a window that does not fill an ack batch is acked after this
+const ACK_DELAY_MS = parseInt(process.env.XFER_ACK_DELAY_MS || '40', 10);
+
+function writeAck(imageId, total, cumAck, ranges, complete) {
+  const id = Buffer.from(String(imageId), 'ascii').subarray(0, 255);
+  const frame = Buffer.alloc(4 + id.length + 5 + ranges.length * 4);
+  frame[0] = XFER_ACK_MAGIC;
+  frame[1] = XFER_VERSION;
+  frame[2] = complete ? XFER_FLAG_COMPLETE : 0;
+  frame[3] = id.length;
+  id.copy(frame, 4);
+  let pos = 4 + id.length;
+  frame.writeUInt16LE(total, pos);
+  frame.writeUInt16LE(cumAck, pos + 2);
+  frame[pos + 4] = ranges.length;
+  pos += 5;
+  ranges.forEach(([start, end]) => {
+    frame.writeUInt16LE(start, pos);
+    frame.writeUInt16LE(end, pos + 2);
+    pos += 4;
+  });
+  return frame;
+}
+
+/**
+ * Ack frame for imageId; chunks[i] === null means chunk i is missing
+ */
+function encodeAck(imageId, chunks) {
+  let cumAck = 0;
+  while (cumAck < chunks.length && chunks[cumAck] !== null) cumAck++;
+
+  const ranges = [];
+  for (let i = cumAck; i < chunks.length && ranges.length < XFER_MAX_RANGES;) {
+    if (chunks[i] === null) {
+      i++;
+      continue;
+    }
+    const start = i;
+    while (i < chunks.length && chunks[i] !== null) i++;
+    ranges.push([start, i]);
+  }
+  return writeAck(imageId, chunks.length, cumAck, ranges, cumAck === chunks.length);
+}
+
+/**
+ * Ack frame telling the sender the whole image arrived
+ */
+function encodeCompleteAck(imageId, total) {
+  return writeAck(imageId, total, total, [], true);
+}
+
+/**
+ * Parse an ack frame; null if it is not one
+ */
+function decodeAck(frame) {
+  if (frame.length < 4 || frame[0] !== XFER_ACK_MAGIC || frame[1] !== XFER_VERSION) {
+    return null;
+  }
+  const idLen = frame[3];
+  let pos = 4 + idLen;
+  if (frame.length < pos + 5) return null;
+  const ack = {
+    id: frame.toString('ascii', 4, pos),
+    complete: (frame[2] & XFER_FLAG_COMPLETE) !== 0,
+    total: frame.readUInt16LE(pos),
+    cumAck: frame.readUInt16LE(pos + 2),
+    ranges: []
+  };
+  const count = frame[pos + 4];
+  pos += 5;
+  for (let r = 0; r < count && pos + 4 <= frame.length; r++, pos += 4) {
+    ack.ranges.push([frame.readUInt16LE(pos), frame.readUInt16LE(pos + 2)]);
+  }
+  return ack;
+}
+
+/**
+ * Record that chunk index arrived for an assembly entry
+ * ({ chunks, window, sinceAck, firstMissing }) and decide whether to ack now.
+ * Now: on a duplicate (our last ack was lost), on a chunk past a hole (the
+ * sender should hear about the loss), and every window/2 new chunks.
+ * Otherwise the caller acks after ACK_DELAY_MS.
+ */
+function ackNow(entry, index, isNew) {
+  if (!isNew) return true;
+  entry.sinceAck = (entry.sinceAck || 0) + 1;
+  while (entry.firstMissing < entry.chunks.length && entry.chunks[entry.firstMissing] !== null) {
+    entry.firstMissing++;
+  }
+  return index > entry.firstMissing || entry.sinceAck >= Math.max(1, Math.floor(entry.window / 2));
+}
+
+module.exports = {
+  ACK_DELAY_MS,
+  encodeAck,
+  encodeCompleteAck,
+  decodeAck,
+  ackNow
+};
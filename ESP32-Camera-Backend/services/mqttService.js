@@ -10,6 +10,165 @@ const mongoose = require('mongoose');
 const Image = require('../models/Image');
 const User = require('../models/User');
 const notificationService = require('./notificationService');
+const ingest = require('../middlewares/ingestLimit');
+const chunkTransfer = require('./chunkTransfer');
+
+// Binary remote-tuning protocol (mirrors firmware command_manager.h)
+const CMD_MAGIC = 0xc7;
+const ACK_MAGIC = 0xa7;
+const CMD_VERSION = 1;
+const CMD_HEADER_LEN = 7;
+const ACK_FRAME_LEN = 14;
+
+const OPCODES = {
+  capture: { code: 0x01 },
+  stream_on: { code: 0x02 },
+  stream_off: { code: 0x03 },
+  reboot: { code: 0x04 },
+  sync_sd: { code: 0x05 },
+  fetch_full: { code: 0x06, string: true, maxLen: 31 },
+  set_jpeg_quality: { code: 0x10, size: 1 },
+  set_framesize: { code: 0x11, size: 1 },
+  set_cooldown: { code: 0x12, size: 4 },
+  set_chunk_size: { code: 0x13, size: 2 },
+  set_stream_fps: { code: 0x14, size: 1 },
+  set_roi: { code: 0x15, encode: encodeRoi }
+};
+
+/**
+ * set_roi parameter: 'auto' (or nothing) = motion crops, 'off' = disabled,
+ * { x, y, w, h } = fixed box in full-frame pixels
+ */
+function encodeRoi(value) {
+  if (value === undefined || value === null || value === 'auto') {
+    return Buffer.alloc(0);
+  }
+  const box = value === 'off' ? { x: 0, y: 0, w: 0, h: 0 } : value;
+  const param = Buffer.alloc(8);
+  ['x', 'y', 'w', 'h'].forEach((key, i) => {
+    const n = Number(box[key]);
+    if (!Number.isInteger(n) || n < 0 || n > 0xffff) {
+      throw new Error(`Invalid set_roi ${key}: ${box[key]}`);
+    }
+    param.writeUInt16LE(n, i * 2);
+  });
+  return param;
+}
+
+const ACK_RESULTS = ['ok', 'unknown_opcode', 'bad_length', 'bad_value', 'busy', 'failed'];
+
+// Topic layout (mirrors firmware config.h): <root>/<deviceId>/<leaf>
+// Commands: <root>/<deviceId>/command, <root>/group/<group>/command, <root>/all/command
+const TOPIC_ROOT = process.env.MQTT_TOPIC_ROOT || 'cam';
+
+/**
+ * Split a device topic into { deviceId, leaf }; null for anything else
+ */
+function parseDeviceTopic(topic) {
+  const parts = topic.split('/');
+  if (parts.length !== 3 || parts[0] !== TOPIC_ROOT || parts[1] === 'all' || parts[1] === 'group') {
+    return null;
+  }
+  return { deviceId: parts[1], leaf: parts[2] };
+}
+
+// FNV-1a: stable device -> worker partition across processes
+function deviceHash(deviceId) {
+  let hash = 0x811c9dc5;
+  for (let i = 0; i < deviceId.length; i++) {
+    hash ^= deviceId.charCodeAt(i);
+    hash = Math.imul(hash, 0x01000193) >>> 0;
+  }
+  return hash;
+}
+
+// CBOR telemetry keys (mirrors firmware telemetry_manager.h)
+// Positive key = absolute value, negative key = delta since previous frame
+const TELEMETRY_KEYS = {
+  0: 'version',
+  1: 'seq',
+  2: 'uptimeS',
+  3: 'intervalMs',
+  10: 'heapFree',
+  11: 'heapMin',
+  12: 'heapLargest',
+  13: 'psramFree',
+  14: 'rssi',
+  15: 'queueDepth',
+  16: 'heapLargestMin',
+  17: 'arenaHighWater',
+  20: 'frames',
+  21: 'uploadsOk',
+  22: 'uploadsFail',
+  23: 'uploadBytes',
+  24: 'errors',
+  25: 'mqttFail',
+  26: 'captures',
+  27: 'arenaFallbacks',
+  30: 'fpsX10',
+  31: 'uploadBps'
+};
+const TELEMETRY_GAUGES = new Set([10, 11, 12, 13, 14, 15, 16, 17]);
+
+/**
+ * Minimal CBOR decoder for the telemetry subset (ints, strings, arrays, maps)
+ */
+function decodeCbor(buf) {
+  let offset = 0;
+
+  const readLength = (info) => {
+    if (info < 24) return info;
+    if (info === 24) { const v = buf.readUInt8(offset); offset += 1; return v; }
+    if (info === 25) { const v = buf.readUInt16BE(offset); offset += 2; return v; }
+    if (info === 26) { const v = buf.readUInt32BE(offset); offset += 4; return v; }
+    if (info === 27) { const v = Number(buf.readBigUInt64BE(offset)); offset += 8; return v; }
+    throw new Error(`Unsupported CBOR length encoding ${info}`);
+  };
+
+  const readItem = () => {
+    const initial = buf.readUInt8(offset++);
+    const major = initial >> 5;
+    const info = initial & 0x1f;
+
+    switch (major) {
+      case 0: return readLength(info);
+      case 1: return -1 - readLength(info);
+      case 2: {
+        const len = readLength(info);
+        const bytes = buf.subarray(offset, offset + len);
+        offset += len;
+        return bytes;
+      }
+      case 3: {
+        const len = readLength(info);
+        const text = buf.toString('utf8', offset, offset + len);
+        offset += len;
+        return text;
+      }
+      case 4: {
+        const len = readLength(info);
+        const arr = [];
+        for (let i = 0; i < len; i++) arr.push(readItem());
+        return arr;
+      }
+      case 5: {
+        const len = readLength(info);
+        const map = new Map();
+        for (let i = 0; i < len; i++) {
+          const key = readItem();
+          map.set(key, readItem());
+        }
+        return map;
+      }
+      default:
+        throw new Error(`Unsupported CBOR major type ${major}`);
+    }
+  };
+
+  return readItem();
+}
+
+const isCborMap = (message) => message.length > 0 && (message[0] >> 5) === 5;
 
 class MQTTService {
   constructor() {
@@ -24,20 +183,45 @@ class MQTTService {
       password: process.env.MQTT_PASSWORD || '',
       reconnectPeriod: 5000,
       connectTimeout: 30000,
+      // Scale-out: images are partitioned by device over MQTT_WORKERS processes
+      // (chunks of one image must reach the same worker, which round-robin
+      // sharing does not promise). Every worker reads every status and task
+      // report, so each keeps the whole fleet and unbroken telemetry deltas
+      workers: Math.max(1, parseInt(process.env.MQTT_WORKERS || '1', 10)),
+      workerIndex: parseInt(process.env.MQTT_WORKER_INDEX || '0', 10),
+      // Fleet rate hints on <root>/all/rate (firmware rate_limiter.h)
+      rateHintInterval: parseInt(process.env.RATE_HINT_INTERVAL_MS || '60000', 10),
     };
 
-    // Topics
+    // Topic filters (see TOPIC_ROOT)
     this.topics = {
-      imageUpload: 'esp32/camera/image',
-      status: 'esp32/camera/status',
-      command: 'esp32/camera/command',
-      notification: 'esp32/camera/notification'
+      imageUpload: `${TOPIC_ROOT}/+/image`,
+      status: `${TOPIC_ROOT}/+/status`,
+      ack: `${TOPIC_ROOT}/+/ack`,
+      tasks: `${TOPIC_ROOT}/+/tasks`,
+      notification: `${TOPIC_ROOT}/notification`,
+      broadcast: `${TOPIC_ROOT}/all/command`,
+      rate: `${TOPIC_ROOT}/all/rate`
     };
 
-    // Buffer for chunked image uploads
+    this.rateHintTimer = null;
+    this.lastOverloadHintAt = 0;
+    this.overloadHooked = false;
+
+    // Outstanding binary commands keyed by sequence number. Random start so
+    // several backend workers rarely share a seq on the same device
+    this.commandSeq = Math.floor(Math.random() * 0x10000);
+    this.pendingCommands = new Map();
+
+    // Buffer for chunked image uploads, keyed by "<deviceId>/<imageId>"
     this.chunkBuffer = new Map();
+    // Reassembled image keys -> completion time (acks for late resends)
+    this.completedImages = new Map();
 
-    // Store last known status
+    // Per-device state: status, reconstructed telemetry, task report
+    this.devices = new Map();
+
+    // Store last known status (most recent device, for single-camera clients)
     this.lastStatus = { status: 'unknown', ip: 'unknown' };
     
     // Load saved state from disk
@@ -109,6 +293,7 @@ class MQTTService {
         
         // Subscribe to topics
         this.subscribeToTopics();
+        this.startRateHints();
       });
 
       this.client.on('error', (error) => {
@@ -136,8 +321,18 @@ class MQTTService {
    * Subscribe to MQTT topics
    */
   subscribeToTopics() {
-    const topics = Object.values(this.topics);
-    
+    // Nothing is $share'd: CBOR telemetry is delta-encoded per device, so a
+    // worker that saw only some frames of a camera could never rebuild its
+    // gauges, and getDevices() would list a fraction of the fleet. Acks
+    // resolve promises held by the worker that sent the command
+    const topics = [
+      this.topics.status,
+      this.topics.tasks,
+      this.topics.imageUpload,
+      this.topics.ack,
+      this.topics.notification
+    ];
+
     topics.forEach(topic => {
       this.client.subscribe(topic, (err) => {
         if (err) {
@@ -147,6 +342,91 @@ class MQTTService {
         }
       });
     });
+    if (this.config.workers > 1) {
+      console.log(`🧩 Image worker ${this.config.workerIndex + 1}/${this.config.workers}`);
+    }
+  }
+
+  /**
+   * Publish the fleet rate hint now and every rateHintInterval, and
+   * immediately on HTTP overload. Worker 0 only, so workers do not overwrite
+   * each other's retained hint
+   */
+  startRateHints() {
+    if (this.config.workerIndex !== 0) {
+      return;
+    }
+    if (!this.rateHintTimer) {
+      this.publishRateHints();
+      this.rateHintTimer = setInterval(() => this.publishRateHints(), this.config.rateHintInterval);
+    }
+    if (!this.overloadHooked) {
+      this.overloadHooked = true;
+      ingest.onOverload(({ retryAfterS }) => {
+        // One hint per Retry-After period is enough; cameras add their own jitter
+        if (Date.now() - this.lastOverloadHintAt < retryAfterS * 1000) return;
+        this.lastOverloadHintAt = Date.now();
+        this.publishRateHints(retryAfterS);
+      });
+    }
+  }
+
+  /**
+   * Retained hint: the ingest byte budget split over the known cameras, how
+   * many may upload backlog at once, and an optional fleet-wide hold.
+   * The next periodic hint (retryAfterS 0) lifts the hold for late joiners.
+   * ingest.limits are per process, so the fleet budget is MQTT_WORKERS times
+   * that; devices is the whole fleet (status is not shared between workers).
+   */
+  publishRateHints(retryAfterS = 0) {
+    const devices = Math.max(1, this.devices.size);
+    const workers = this.config.workers;
+    const maxBps = ingest.limits.maxBps * workers;
+    const maxConcurrent = ingest.limits.maxConcurrent * workers;
+    const bps = maxBps ? Math.max(1, Math.floor(maxBps / devices)) : 0;
+    const hint = {
+      bps,
+      burst: bps ? Math.max(bps * 2, 16384) : 0,
+      maxConcurrent,
+      devices,
+      retryAfterS
+    };
+    if (this.publish(this.topics.rate, JSON.stringify(hint), { retain: true })) {
+      console.log('🚦 Rate hint:', hint);
+    }
+    return hint;
+  }
+
+  /**
+   * Whether this worker reassembles images for deviceId
+   */
+  ownsDevice(deviceId) {
+    return this.config.workers <= 1 || deviceHash(deviceId) % this.config.workers === this.config.workerIndex;
+  }
+
+  /**
+   * Per-device state record, created on first message
+   */
+  device(deviceId) {
+    let device = this.devices.get(deviceId);
+    if (!device) {
+      device = { deviceId, status: { status: 'unknown' }, telemetry: null, tasks: null };
+      this.devices.set(deviceId, device);
+      console.log(`🆕 Camera ${deviceId} joined (${this.devices.size} known)`);
+    }
+    return device;
+  }
+
+  /**
+   * Command topic for a target: deviceId string, { deviceId }, { group }, or
+   * nothing for the whole fleet
+   */
+  commandTopic(target) {
+    if (target && target.group) {
+      return `${TOPIC_ROOT}/group/${target.group}/command`;
+    }
+    const deviceId = typeof target === 'string' ? target : target && target.deviceId;
+    return deviceId ? `${TOPIC_ROOT}/${deviceId}/command` : this.topics.broadcast;
   }
 
   /**
@@ -156,17 +436,29 @@ class MQTTService {
     try {
       console.log(`📨 MQTT Message received on topic: ${topic}`);
 
-      switch (topic) {
-        case this.topics.imageUpload:
-          await this.handleImageUpload(message);
+      if (topic === this.topics.notification) {
+        await this.handleNotification(message);
+        return;
+      }
+
+      const parsed = parseDeviceTopic(topic);
+      switch (parsed && parsed.leaf) {
+        case 'image':
+          if (this.ownsDevice(parsed.deviceId)) {
+            await this.handleImageUpload(parsed.deviceId, message);
+          }
           break;
 
-        case this.topics.status:
-          await this.handleStatusUpdate(message);
+        case 'status':
+          await this.handleStatusUpdate(parsed.deviceId, message);
           break;
 
-        case this.topics.notification:
-          await this.handleNotification(message);
+        case 'ack':
+          this.handleCommandAck(parsed.deviceId, message);
+          break;
+
+        case 'tasks':
+          this.handleTaskStats(parsed.deviceId, message);
           break;
 
         default:
@@ -182,19 +474,19 @@ class MQTTService {
    * Payload format: JSON with { userId, imageData (base64), timestamp }
    * OR Chunked format: { id, index, total, data, userId }
    */
-  async handleImageUpload(message) {
+  async handleImageUpload(deviceId, message) {
     try {
       const payload = JSON.parse(message.toString());
       
       // Check if this is a chunked upload
       if (payload.index !== undefined && payload.total !== undefined && payload.id) {
-        await this.handleChunk(payload);
+        await this.handleChunk(deviceId, payload);
         return;
       }
 
       console.log('📸 Processing image upload via MQTT...');
 
-      const { userId, imageData, timestamp, detectedObject } = payload;
+      const { userId, imageData, timestamp, detectedObject, detection } = payload;
 
       // Validate payload
       if (!userId || !imageData) {
@@ -207,7 +499,9 @@ class MQTTService {
         userId,
         imageData,
         timestamp,
-        detectedObject
+        detectedObject,
+        detection,
+        deviceId
       });
 
     } catch (error) {
@@ -217,9 +511,19 @@ class MQTTService {
 
   /**
    * Handle chunked image upload
+   * Chunks with "win" come from the windowed sender: ack what we hold on
+   * <root>/<deviceId>/xfer so the camera resends only the missing ones.
    */
-  async handleChunk(payload) {
-    const { id, index, total, data, userId } = payload;
+  async handleChunk(deviceId, payload) {
+    const { index, total, data, userId, captureId, kind, roi, capturedAt, detection, win } = payload;
+    // Image ids are only unique per device
+    const id = `${deviceId}/${payload.id}`;
+
+    // Resend after our completion ack was lost: repeat it, do not rebuild
+    if (this.completedImages.has(id)) {
+      if (win) this.publishChunkAck(deviceId, chunkTransfer.encodeCompleteAck(payload.id, total));
+      return;
+    }
     
     // 1. Initialize buffer if new
     if (!this.chunkBuffer.has(id)) {
@@ -227,13 +531,24 @@ class MQTTService {
         chunks: new Array(total).fill(null),
         receivedCount: 0,
         timestamp: Date.now(),
-        userId: userId // Save info from first received chunk
+        userId: userId, // Save info from first received chunk
+        captureId,
+        kind,
+        roi,
+        capturedAt,
+        detection,
+        window: win || 0,
+        firstMissing: 0,
+        sinceAck: 0,
+        ackTimer: null
       });
       
       // Set timeout to clean up incomplete uploads
       setTimeout(() => {
-        if (this.chunkBuffer.has(id)) {
+        const stale = this.chunkBuffer.get(id);
+        if (stale) {
           console.log(`🗑️ Timeout: Dropped incomplete image ${id}`);
+          clearTimeout(stale.ackTimer);
           this.chunkBuffer.delete(id);
         }
       }, 60000); // 60s timeout
@@ -242,7 +557,8 @@ class MQTTService {
     const bufferEntry = this.chunkBuffer.get(id);
 
     // 2. Store chunk
-    if (bufferEntry.chunks[index] === null) {
+    const isNew = bufferEntry.chunks[index] === null;
+    if (isNew) {
       bufferEntry.chunks[index] = data;
       bufferEntry.receivedCount++;
     }
@@ -252,6 +568,12 @@ class MQTTService {
     // 3. Check if complete
     if (bufferEntry.receivedCount === total) {
       console.log(`🎉 Image ${id} reassembled successfully!`);
+      clearTimeout(bufferEntry.ackTimer);
+      this.chunkBuffer.delete(id);
+      if (bufferEntry.window) {
+        this.rememberCompleted(id);
+        this.publishChunkAck(deviceId, chunkTransfer.encodeCompleteAck(payload.id, total));
+      }
       
       // Reassemble full base64 string
       const fullBase64 = bufferEntry.chunks.join('');
@@ -261,19 +583,72 @@ class MQTTService {
         userId: bufferEntry.userId,
         imageData: fullBase64,
         timestamp: new Date().toISOString(),
-        detectedObject: 'unknown' // Default for now
+        detection: bufferEntry.detection,
+        captureId: bufferEntry.captureId,
+        kind: bufferEntry.kind,
+        roi: bufferEntry.roi,
+        capturedAt: bufferEntry.capturedAt,
+        deviceId
       });
-      
-      // Cleanup
-      this.chunkBuffer.delete(id);
+      return;
+    }
+
+    // 4. Windowed sender: ack now or shortly (the tail of a window)
+    if (bufferEntry.window) {
+      if (chunkTransfer.ackNow(bufferEntry, index, isNew)) {
+        this.sendChunkAck(deviceId, payload.id, bufferEntry);
+      } else if (!bufferEntry.ackTimer) {
+        bufferEntry.ackTimer = setTimeout(() => {
+          bufferEntry.ackTimer = null;
+          if (this.chunkBuffer.get(id) === bufferEntry) {
+            this.sendChunkAck(deviceId, payload.id, bufferEntry);
+          }
+        }, chunkTransfer.ACK_DELAY_MS);
+      }
+    }
+  }
+
+  /**
+   * Ack the chunks held for a partly received image
+   */
+  sendChunkAck(deviceId, imageId, entry) {
+    clearTimeout(entry.ackTimer);
+    entry.ackTimer = null;
+    entry.sinceAck = 0;
+    this.publishChunkAck(deviceId, chunkTransfer.encodeAck(imageId, entry.chunks));
+  }
+
+  /**
+   * QoS 0 and unlogged: one per few chunks, and the camera resends on loss
+   */
+  publishChunkAck(deviceId, frame) {
+    if (!this.client || !this.client.connected) return;
+    this.client.publish(`${TOPIC_ROOT}/${deviceId}/xfer`, frame, { qos: 0 });
+  }
+
+  /**
+   * Keep completed image ids for a minute so late resends are acked, not rebuilt
+   */
+  rememberCompleted(id) {
+    const now = Date.now();
+    this.completedImages.set(id, now);
+    for (const [key, at] of this.completedImages) {
+      if (now - at < 60000) break; // Insertion order = age order
+      this.completedImages.delete(key);
     }
   }
 
   /**
    * Process complete image data (save to disk/DB)
    */
-  async processCompleteImage({ userId, imageData, timestamp, detectedObject }) {
+  async processCompleteImage({ userId, imageData, timestamp, detectedObject, detection, captureId, kind, roi, capturedAt, deviceId }) {
     try {
+      // The camera's detector label ("person,87") wins over a bare detectedObject
+      const parsed = Image.parseDetection(detection);
+      if (parsed) {
+        detectedObject = parsed.detectedObject;
+      }
+
       // Resolve userId if it's a username (string) instead of ObjectId
       let resolvedUserId = userId;
       if (userId && !mongoose.Types.ObjectId.isValid(userId)) {
@@ -300,6 +675,20 @@ class MQTTService {
       // Decode base64 image
       const imageBuffer = Buffer.from(imageData, 'base64');
       
+      // ROI crops stand in for the thumbnail; the full frame stays on the device SD
+      const isThumbnail = kind === 'thumb' || kind === 'roi';
+
+      // Same bytes resent after a device reboot: keep the first copy
+      const contentHash = isThumbnail ? undefined : Image.hashContent(imageBuffer);
+      const existing = isThumbnail
+        ? await Image.findCapture(resolvedUserId, deviceId, captureId)
+        : await Image.findByContentHash(resolvedUserId, contentHash);
+      if (existing) {
+        console.log(`♻️ Duplicate image ignored (${isThumbnail ? `${deviceId}/${captureId}` : contentHash.slice(0, 12)}), ` +
+          `already stored as ${existing._id}`);
+        return;
+      }
+
       // Generate filename
       const filename = `capture-${Date.now()}-${Math.floor(Math.random() * 1000000000)}.jpg`;
       const uploadDir = path.join(__dirname, '../uploads');
@@ -309,7 +698,24 @@ class MQTTService {
       await fs.mkdir(uploadDir, { recursive: true });
       await fs.writeFile(imagePath, imageBuffer);
 
-      console.log(`✅ Image saved: ${filename}`);
+      console.log(`✅ Image saved: ${filename} (${imageBuffer.length} bytes${kind ? `, ${kind}` : ''})`);
+
+      // Late full-resolution image for a thumbnail we already announced
+      if (kind === 'full' && captureId) {
+        const updated = await Image.attachFullImage(captureId, resolvedUserId, {
+          filename,
+          path: '/uploads/' + filename,
+          contentHash,
+          deviceId
+        });
+        if (updated) {
+          console.log(`✅ Full image attached to capture ${captureId}`);
+          if (this.io) {
+            this.io.emit('image-full-ready', { id: updated._id, path: updated.path });
+          }
+          return;
+        }
+      }
 
       // Save to MongoDB
       const image = await Image.create({
@@ -317,7 +723,15 @@ class MQTTService {
         path: '/uploads/' + filename,
         timestamp: timestamp ? new Date(timestamp) : new Date(),
         detectedObject: detectedObject || 'unknown',
-        userId: resolvedUserId
+        confidence: parsed?.confidence,
+        userId: resolvedUserId,
+        deviceId,
+        captureId,
+        thumbnailPath: isThumbnail ? '/uploads/' + filename : undefined,
+        fullAvailable: !isThumbnail,
+        contentHash,
+        roi: kind === 'roi' ? Image.parseRoi(roi) : undefined,
+        ...Image.captureFields(captureId, capturedAt)
       });
 
       console.log(`✅ Image record created in database`);
@@ -326,16 +740,22 @@ class MQTTService {
       if (this.io) {
         this.io.emit('new-image', {
           id: image._id,
+          deviceId: image.deviceId,
           filename: image.filename,
           path: image.path,
+          thumbnailPath: image.thumbnailPath,
+          fullAvailable: image.fullAvailable,
+          roi: image.roi,
           timestamp: image.timestamp,
-          detectedObject: image.detectedObject
+          detectedObject: image.detectedObject,
+          confidence: image.confidence
         });
         console.log('📡 Real-time update sent to frontend');
       }
 
       // Get user for notifications
-      const user = await User.findById(resolvedUserId);
+      // Captures the device labelled background are kept but don't alert anyone
+      const user = detectedObject === 'background' ? null : await User.findById(resolvedUserId);
       if (user) {
         // Send notification via MQTT
         this.publish(this.topics.notification, JSON.stringify({
@@ -366,8 +786,14 @@ class MQTTService {
   /**
    * Handle ESP32 status updates
    */
-  async handleStatusUpdate(message) {
+  async handleStatusUpdate(deviceId, message) {
     try {
+      // Binary CBOR heartbeat
+      if (isCborMap(message)) {
+        this.handleTelemetry(deviceId, message);
+        return;
+      }
+
       // Check if message is JSON or plain text
       let status;
       try {
@@ -377,24 +803,29 @@ class MQTTService {
         status = { status: message.toString() };
       }
       
-      console.log('📊 ESP32 Status:', status);
+      console.log(`📊 ESP32 Status [${deviceId}]:`, status);
 
       // Update Stream URL if provided by ESP32
       if (status.streamUrl) {
         console.log(`🎥 Auto-configuring Stream URL: ${status.streamUrl}`);
         process.env.ESP32_STREAM_URL = status.streamUrl;
         
-        // Save to disk for persistence
-        await this.saveState({
+        // Save to disk for persistence (every worker sees this; one writes it)
+        if (this.ownsDevice(deviceId)) {
+          await this.saveState({
+            deviceId,
             streamUrl: status.streamUrl,
             ip: status.ip,
             status: status.status,
             lastUpdated: new Date().toISOString()
-        });
+          });
+        }
       }
 
       // Update last known status
-      this.lastStatus = { ...this.lastStatus, ...status, lastSeen: new Date() };
+      const device = this.device(deviceId);
+      device.status = { ...device.status, ...status, deviceId, lastSeen: new Date() };
+      this.lastStatus = device.status;
 
       // Broadcast status to frontend
       if (this.io) {
@@ -405,6 +836,103 @@ class MQTTService {
     }
   }
 
+  /**
+   * Decode CBOR telemetry frame and fold deltas into absolute state
+   */
+  handleTelemetry(deviceId, message) {
+    const frame = decodeCbor(message);
+    const device = this.device(deviceId);
+    const prev = device.telemetry;
+    const seq = frame.get(1);
+
+    // Gauge deltas are only valid on top of an unbroken sequence
+    const hasGap = !prev || seq !== prev.seq + 1;
+    const isKeyframe = [...frame.keys()].some((key) => TELEMETRY_GAUGES.has(key));
+    if (hasGap && !isKeyframe) {
+      console.log(`📉 Telemetry seq gap on ${deviceId} (${prev ? prev.seq : 'none'} -> ${seq}), waiting for keyframe`);
+    }
+
+    const next = {
+      gauges: { ...(prev && !hasGap ? prev.gauges : {}) },
+      totals: { ...(prev ? prev.totals : {}) },
+      rates: {},
+      seq
+    };
+
+    for (const [key, value] of frame) {
+      const absKey = Math.abs(key);
+      const name = TELEMETRY_KEYS[absKey] || `key${absKey}`;
+
+      if (key >= 0 && TELEMETRY_GAUGES.has(key)) {
+        next.gauges[name] = value;
+      } else if (key < 0 && TELEMETRY_GAUGES.has(absKey)) {
+        if (next.gauges[name] !== undefined) next.gauges[name] += value;
+      } else if (key < 0) {
+        next.totals[name] = (next.totals[name] || 0) + value;
+      } else if (absKey === 30) {
+        next.rates.fps = value / 10;
+      } else if (absKey === 31) {
+        next.rates.uploadBps = value;
+      } else {
+        next[name] = value;
+      }
+    }
+
+    device.telemetry = next;
+
+    const snapshot = {
+      deviceId,
+      ...next.gauges,
+      ...next.rates,
+      totals: next.totals,
+      uptimeS: next.uptimeS,
+      seq,
+      frameBytes: message.length,
+      receivedAt: new Date()
+    };
+    console.log('📈 ESP32 Telemetry:', snapshot);
+
+    device.status = { ...device.status, deviceId, telemetry: snapshot, lastSeen: new Date() };
+    this.lastStatus = device.status;
+    if (this.io) {
+      this.io.emit('esp32-telemetry', snapshot);
+    }
+  }
+
+  /**
+   * Per-task CPU share and stack headroom (firmware task_monitor.h)
+   */
+  handleTaskStats(deviceId, message) {
+    const report = JSON.parse(message.toString());
+    const tasks = (report.tasks || [])
+      .map((t) => ({
+        name: t.n,
+        core: t.c,
+        priority: t.p,
+        cpuPct: t.cpuX10 !== undefined ? t.cpuX10 / 10 : null,
+        stackFree: t.stack
+      }))
+      .sort((a, b) => (b.cpuPct || 0) - (a.cpuPct || 0));
+
+    const snapshot = {
+      deviceId,
+      uptimeS: report.uptimeS,
+      intervalMs: report.intervalMs,
+      tasks,
+      receivedAt: new Date()
+    };
+    console.log(`🧵 ESP32 ${deviceId} tasks over ${report.intervalMs} ms:`);
+    console.table(tasks);
+
+    const device = this.device(deviceId);
+    device.tasks = snapshot;
+    device.status = { ...device.status, deviceId, tasks: snapshot, lastSeen: new Date() };
+    this.lastStatus = device.status;
+    if (this.io) {
+      this.io.emit('esp32-tasks', snapshot);
+    }
+  }
+
   /**
    * Handle notifications
    */
@@ -444,9 +972,109 @@ class MQTTService {
 
   /**
    * Send command to ESP32
+   * Strings are sent as legacy text verbs; { op, value } objects use the binary protocol.
+   * Objects may carry deviceId or group; without either the whole fleet gets it.
    */
-  sendCommand(command) {
-    return this.publish(this.topics.command, JSON.stringify(command));
+  sendCommand(command, target) {
+    if (command && typeof command === 'object' && command.op) {
+      const { deviceId, group } = command;
+      return this.sendTuningCommand(command.op, command.value, undefined,
+        target || (group ? { group } : deviceId));
+    }
+    return this.publish(this.commandTopic(target), String(command));
+  }
+
+  /**
+   * Encode and publish a binary command frame to target (see commandTopic).
+   * Resolves with the first matching ack, or rejects after timeoutMs.
+   */
+  sendTuningCommand(op, value = 0, timeoutMs = 10000, target = undefined) {
+    const spec = OPCODES[op];
+    if (!spec) {
+      return Promise.reject(new Error(`Unknown command: ${op}`));
+    }
+
+    let param = null;
+    if (spec.encode) {
+      try {
+        param = spec.encode(value);
+      } catch (error) {
+        return Promise.reject(error);
+      }
+    } else if (spec.string) {
+      param = Buffer.from(String(value), 'ascii');
+      if (param.length === 0 || param.length > spec.maxLen) {
+        return Promise.reject(new Error(`Invalid ${op} parameter length ${param.length}`));
+      }
+    }
+
+    const paramLen = param ? param.length : (spec.size || 0);
+    const frame = Buffer.alloc(CMD_HEADER_LEN + paramLen);
+    this.commandSeq = (this.commandSeq + 1) & 0xffff;
+    const seq = this.commandSeq;
+
+    frame[0] = CMD_MAGIC;
+    frame[1] = CMD_VERSION;
+    frame[2] = spec.code;
+    frame[3] = 0;
+    frame.writeUInt16LE(seq, 4);
+    frame[6] = paramLen;
+    if (param) param.copy(frame, CMD_HEADER_LEN);
+    else if (paramLen === 1) frame.writeUInt8(value, CMD_HEADER_LEN);
+    else if (paramLen === 2) frame.writeUInt16LE(value, CMD_HEADER_LEN);
+    else if (paramLen === 4) frame.writeUInt32LE(value, CMD_HEADER_LEN);
+
+    return new Promise((resolve, reject) => {
+      const timer = setTimeout(() => {
+        this.pendingCommands.delete(seq);
+        reject(new Error(`Command ${op} (seq ${seq}) timed out`));
+      }, timeoutMs);
+
+      const deviceId = typeof target === 'string' ? target : target && target.deviceId;
+      this.pendingCommands.set(seq, { op, deviceId, sentAt: Date.now(), resolve, timer });
+
+      if (!this.publish(this.commandTopic(target), frame, { qos: 0 })) {
+        clearTimeout(timer);
+        this.pendingCommands.delete(seq);
+        reject(new Error('MQTT client not connected'));
+      }
+    });
+  }
+
+  /**
+   * Decode binary ack frame from ESP32
+   */
+  handleCommandAck(deviceId, message) {
+    if (message.length < ACK_FRAME_LEN || message[0] !== ACK_MAGIC) {
+      console.error('❌ Invalid command ack frame');
+      return;
+    }
+
+    const seq = message.readUInt16LE(4);
+    const ack = {
+      deviceId,
+      opcode: message[2],
+      result: ACK_RESULTS[message[3]] || `error_${message[3]}`,
+      seq,
+      execLatencyUs: message.readUInt32LE(6),
+      value: message.readInt32LE(10)
+    };
+
+    // Same seq from another camera (or another worker's command) is not ours
+    const pending = this.pendingCommands.get(seq);
+    if (pending && (!pending.deviceId || pending.deviceId === deviceId)) {
+      clearTimeout(pending.timer);
+      this.pendingCommands.delete(seq);
+      ack.op = pending.op;
+      ack.roundTripMs = Date.now() - pending.sentAt;
+      pending.resolve(ack);
+    }
+
+    console.log('🛠️ Command ack:', ack);
+
+    if (this.io) {
+      this.io.emit('command-ack', ack);
+    }
   }
 
   /**
@@ -456,6 +1084,13 @@ class MQTTService {
     return this.lastStatus;
   }
 
+  /**
+   * Last known status of every camera seen by this worker
+   */
+  getDevices() {
+    return [...this.devices.values()].map((device) => device.status);
+  }
+
   /**
    * Set Socket.IO instance for real-time updates
    */
@@ -468,6 +1103,10 @@ class MQTTService {
    * Disconnect from MQTT broker
    */
   disconnect() {
+    if (this.rateHintTimer) {
+      clearInterval(this.rateHintTimer);
+      this.rateHintTimer = null;
+    }
     if (this.client) {
       this.client.end();
       console.log('🔌 MQTT Disconnected');
@@ -0,0 +1,240 @@
+#!/usr/bin/env node
+
+/**
+ * Fleet load test for the per-device MQTT topic layout
+ * Run with: node test-fleet.js   (mosquitto on MQTT_BROKER, e.g. docker-compose.mqtt.yml)
+ *
+ * DEVICES simulated cameras connect as cam-sim-<n> and behave like the
+ * firmware: status every STATUS_MS on cam/<id>/status, a chunked thumbnail
+ * every IMAGE_MS on cam/<id>/image, binary acks on cam/<id>/ack for
+ * commands received on cam/<id>/command, cam/group/<g>/command and
+ * cam/all/command.
+ *
+ * WORKERS ingestion clients split the load the way the backend does with
+ * MQTT_WORKERS: every worker reads all status (counted for its own devices),
+ * images partitioned by device. Worker 0 also broadcasts a capture command
+ * every COMMAND_MS and times how long the whole fleet takes to ack.
+ *
+ * Reported: per-worker message share, status latency percentiles, images
+ * reassembled vs sent, and command fan-out latency.
+ */
+
+const mqtt = require('mqtt');
+const crypto = require('crypto');
+
+const BROKER = process.env.MQTT_BROKER || 'mqtt://localhost:1883';
+const DEVICES = parseInt(process.env.DEVICES || '100', 10);
+const WORKERS = parseInt(process.env.WORKERS || '3', 10);
+const GROUPS = parseInt(process.env.GROUPS || '4', 10);
+const DURATION_S = parseInt(process.env.DURATION_S || '30', 10);
+const STATUS_MS = parseInt(process.env.STATUS_MS || '1000', 10);
+const IMAGE_MS = parseInt(process.env.IMAGE_MS || '10000', 10);
+const COMMAND_MS = parseInt(process.env.COMMAND_MS || '5000', 10);
+const IMAGE_BYTES = parseInt(process.env.IMAGE_BYTES || String(24 * 1024), 10);
+const CHUNK_BYTES = 3072;      // MQTT_CHUNK_SIZE_DEFAULT on the device
+const ROOT = 'cam';
+
+const colors = {
+  reset: '\x1b[0m',
+  green: '\x1b[32m',
+  red: '\x1b[31m',
+  yellow: '\x1b[33m',
+  blue: '\x1b[34m'
+};
+
+const log = {
+  success: (msg) => console.log(`${colors.green}✓${colors.reset} ${msg}`),
+  error: (msg) => console.log(`${colors.red}✗${colors.reset} ${msg}`),
+  info: (msg) => console.log(`${colors.blue}ℹ${colors.reset} ${msg}`),
+  warn: (msg) => console.log(`${colors.yellow}⚠${colors.reset} ${msg}`)
+};
+
+// Same partition function as services/mqttService.js
+function deviceHash(deviceId) {
+  let hash = 0x811c9dc5;
+  for (let i = 0; i < deviceId.length; i++) {
+    hash ^= deviceId.charCodeAt(i);
+    hash = Math.imul(hash, 0x01000193) >>> 0;
+  }
+  return hash;
+}
+
+const percentile = (sorted, p) =>
+  sorted.length ? sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))] : 0;
+
+function connect(clientId) {
+  return new Promise((resolve, reject) => {
+    const client = mqtt.connect(BROKER, { clientId, clean: true, reconnectPeriod: 0 });
+    client.once('connect', () => resolve(client));
+    client.once('error', reject);
+  });
+}
+
+const stats = {
+  imagesSent: 0,
+  statusSent: 0,
+  commandRounds: []
+};
+
+// ===== Simulated camera =====
+async function startDevice(index) {
+  const id = `cam-sim-${String(index).padStart(4, '0')}`;
+  const group = `g${index % GROUPS}`;
+  const client = await connect(id);
+  client.subscribe([`${ROOT}/${id}/command`, `${ROOT}/group/${group}/command`, `${ROOT}/all/command`]);
+
+  client.on('message', (topic, frame) => {
+    // Binary command: ack with the same opcode and seq (command_manager.h layout)
+    if (frame.length < 7 || frame[0] !== 0xc7) return;
+    const ack = Buffer.alloc(14);
+    ack[0] = 0xa7;
+    ack[1] = 1;
+    ack[2] = frame[2];
+    ack[3] = 0;
+    ack.writeUInt16LE(frame.readUInt16LE(4), 4);
+    ack.writeUInt32LE(150, 6);
+    client.publish(`${ROOT}/${id}/ack`, ack);
+  });
+
+  const image = crypto.randomBytes(IMAGE_BYTES);
+  let imageSeq = 0;
+  const sendImage = () => {
+    const imageId = String(++imageSeq);
+    const total = Math.ceil(image.length / CHUNK_BYTES);
+    for (let i = 0; i < total; i++) {
+      const data = image.subarray(i * CHUNK_BYTES, (i + 1) * CHUNK_BYTES).toString('base64');
+      client.publish(`${ROOT}/${id}/image`, JSON.stringify({ id: imageId, index: i, total, data, userId: 'sim' }));
+    }
+    stats.imagesSent++;
+  };
+  const sendStatus = () => {
+    client.publish(`${ROOT}/${id}/status`, JSON.stringify({ status: 'online', sentAt: Date.now() }));
+    stats.statusSent++;
+  };
+
+  // Spread devices over the interval so the load is not one burst per second
+  const timers = [];
+  setTimeout(() => {
+    timers.push(setInterval(sendStatus, STATUS_MS));
+    timers.push(setInterval(sendImage, IMAGE_MS));
+  }, Math.random() * STATUS_MS);
+
+  return { id, client, stop: () => timers.forEach(clearInterval) };
+}
+
+// ===== Ingestion worker =====
+async function startWorker(index) {
+  const client = await connect(`fleet-worker-${index}-${process.pid}`);
+  const worker = { index, client, status: 0, images: 0, chunks: 0, latencies: [], partial: new Map() };
+  client.subscribe([`${ROOT}/+/status`, `${ROOT}/+/image`, `${ROOT}/+/ack`]);
+
+  client.on('message', (topic, message) => {
+    const [, deviceId, leaf] = topic.split('/');
+    if (leaf === 'status') {
+      if (deviceHash(deviceId) % WORKERS !== index) return;
+      worker.status++;
+      worker.latencies.push(Date.now() - JSON.parse(message.toString()).sentAt);
+    } else if (leaf === 'image') {
+      if (deviceHash(deviceId) % WORKERS !== index) return;
+      worker.chunks++;
+      const chunk = JSON.parse(message.toString());
+      const key = `${deviceId}/${chunk.id}`;
+      const received = (worker.partial.get(key) || 0) + 1;
+      if (received === chunk.total) {
+        worker.partial.delete(key);
+        worker.images++;
+      } else {
+        worker.partial.set(key, received);
+      }
+    } else if (leaf === 'ack' && worker.onAck) {
+      worker.onAck(deviceId, message.readUInt16LE(4));
+    }
+  });
+  return worker;
+}
+
+// Worker 0: broadcast a capture and wait for every camera's ack
+function commandRound(worker, seq) {
+  return new Promise((resolve) => {
+    const pending = new Set();
+    const start = Date.now();
+    const timer = setTimeout(() => {
+      worker.onAck = null;
+      resolve({ ms: Date.now() - start, acked: DEVICES - pending.size, complete: false });
+    }, COMMAND_MS - 100);
+    for (let i = 0; i < DEVICES; i++) pending.add(`cam-sim-${String(i).padStart(4, '0')}`);
+
+    worker.onAck = (deviceId, ackSeq) => {
+      if (ackSeq !== seq || !pending.delete(deviceId)) return;
+      if (pending.size === 0) {
+        clearTimeout(timer);
+        worker.onAck = null;
+        resolve({ ms: Date.now() - start, acked: DEVICES, complete: true });
+      }
+    };
+
+    const frame = Buffer.from([0xc7, 1, 0x01, 0, seq & 0xff, seq >> 8, 0]);
+    worker.client.publish(`${ROOT}/all/command`, frame);
+  });
+}
+
+async function run() {
+  console.log('\n' + '='.repeat(60));
+  console.log('MQTT Fleet Load Test');
+  console.log('='.repeat(60) + '\n');
+  log.info(`${DEVICES} cameras, ${WORKERS} workers, ${DURATION_S}s against ${BROKER}`);
+
+  const workers = [];
+  for (let i = 0; i < WORKERS; i++) workers.push(await startWorker(i));
+
+  const devices = [];
+  const connectStart = Date.now();
+  for (let i = 0; i < DEVICES; i++) devices.push(await startDevice(i));
+  log.success(`Fleet connected in ${Date.now() - connectStart} ms`);
+
+  let seq = 1;
+  const commander = setInterval(async () => {
+    stats.commandRounds.push(await commandRound(workers[0], seq));
+    seq = (seq + 1) & 0xffff;
+  }, COMMAND_MS);
+
+  await new Promise((resolve) => setTimeout(resolve, DURATION_S * 1000));
+  clearInterval(commander);
+  devices.forEach((d) => d.stop());
+  await new Promise((resolve) => setTimeout(resolve, 2000)); // Let in-flight messages land
+
+  // ===== Report =====
+  console.log('');
+  const totalStatus = workers.reduce((sum, w) => sum + w.status, 0);
+  const totalImages = workers.reduce((sum, w) => sum + w.images, 0);
+  workers.forEach((w) => {
+    const share = totalStatus ? Math.round(w.status * 100 / totalStatus) : 0;
+    log.info(`Worker ${w.index}: ${w.status} status (${share}%), ${w.images} images from ${w.chunks} chunks, ` +
+      `${w.partial.size} incomplete`);
+  });
+
+  const latencies = workers.flatMap((w) => w.latencies).sort((a, b) => a - b);
+  log.info(`Status latency p50 ${percentile(latencies, 0.5)} ms, p95 ${percentile(latencies, 0.95)} ms, ` +
+    `p99 ${percentile(latencies, 0.99)} ms`);
+
+  const lost = stats.statusSent - totalStatus;
+  (lost === 0 ? log.success : log.warn)(`Status delivered ${totalStatus}/${stats.statusSent}`);
+  (totalImages === stats.imagesSent ? log.success : log.warn)(
+    `Images reassembled ${totalImages}/${stats.imagesSent}`);
+
+  const rounds = stats.commandRounds;
+  const complete = rounds.filter((r) => r.complete);
+  const fanout = complete.map((r) => r.ms).sort((a, b) => a - b);
+  (complete.length === rounds.length ? log.success : log.warn)(
+    `Broadcast commands fully acked ${complete.length}/${rounds.length}, ` +
+    `fan-out p50 ${percentile(fanout, 0.5)} ms, max ${fanout[fanout.length - 1] || 0} ms`);
+
+  devices.forEach((d) => d.client.end(true));
+  workers.forEach((w) => w.client.end(true));
+  process.exit(totalImages === stats.imagesSent && complete.length === rounds.length ? 0 : 1);
+}
+
+run().catch((error) => {
+  log.error(`Load test failed: ${error.message}`);
+  process.exit(1);
+});
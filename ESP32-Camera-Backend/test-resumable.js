@@ -0,0 +1,207 @@
+#!/usr/bin/env node
+
+/**
+ * Resumable upload demo over a flaky link
+ * Run with: node test-resumable.js   (backend running on BASE_URL)
+ *
+ * A local TCP proxy cuts every connection after a random number of request
+ * bytes (exponential, mean MEAN_BYTES_BETWEEN_DROPS). The same image size is
+ * then delivered twice through it:
+ *   1. POST /api/upload-image, restarting from byte zero after each drop
+ *   2. POST /api/uploads + PATCH ranges, resuming from the server offset
+ * and the bytes each approach put on the wire are compared.
+ */
+
+const net = require('net');
+const crypto = require('crypto');
+const axios = require('axios');
+const FormData = require('form-data');
+
+const BASE_URL = process.env.BASE_URL || 'http://localhost:3000';
+const PROXY_PORT = parseInt(process.env.PROXY_PORT || '3999', 10);
+const IMAGE_BYTES = parseInt(process.env.IMAGE_BYTES || String(200 * 1024), 10);
+const MEAN_BYTES_BETWEEN_DROPS = parseInt(process.env.MEAN_DROP_BYTES || String(120 * 1024), 10);
+const CHUNK_BYTES = 16 * 1024;   // Matches RESUMABLE_CHUNK_BYTES on the device
+const MAX_ATTEMPTS = 50;
+
+const colors = {
+  reset: '\x1b[0m',
+  green: '\x1b[32m',
+  red: '\x1b[31m',
+  yellow: '\x1b[33m',
+  blue: '\x1b[34m'
+};
+
+const log = {
+  success: (msg) => console.log(`${colors.green}✓${colors.reset} ${msg}`),
+  error: (msg) => console.log(`${colors.red}✗${colors.reset} ${msg}`),
+  info: (msg) => console.log(`${colors.blue}ℹ${colors.reset} ${msg}`),
+  warn: (msg) => console.log(`${colors.yellow}⚠${colors.reset} ${msg}`)
+};
+
+// Deterministic PRNG so both runs see the same sequence of drops
+let seed = parseInt(process.env.SEED || '1234', 10);
+const random = () => {
+  seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+  return seed / 0x7fffffff;
+};
+
+// ===== Drop-injecting proxy =====
+const wire = { bytes: 0, drops: 0 };
+
+function startProxy() {
+  const target = new URL(BASE_URL);
+  const server = net.createServer((client) => {
+    const budget = Math.floor(-Math.log(1 - random()) * MEAN_BYTES_BETWEEN_DROPS);
+    let forwarded = 0;
+    const upstream = net.connect(parseInt(target.port || '80', 10), target.hostname);
+
+    client.on('data', (chunk) => {
+      const room = budget - forwarded;
+      if (chunk.length <= room) {
+        forwarded += chunk.length;
+        wire.bytes += chunk.length;
+        upstream.write(chunk);
+        return;
+      }
+      // Link dies mid-request: deliver what fit, then reset both sides
+      if (room > 0) {
+        wire.bytes += room;
+        upstream.write(chunk.subarray(0, room));
+      }
+      wire.drops++;
+      client.destroy();
+      setTimeout(() => upstream.destroy(), 200); // Let the partial bytes land
+    });
+    upstream.on('data', (chunk) => client.write(chunk));
+    upstream.on('end', () => client.end());
+    client.on('error', () => upstream.destroy());
+    upstream.on('error', () => client.destroy());
+  });
+  return new Promise((resolve) => server.listen(PROXY_PORT, () => resolve(server)));
+}
+
+const PROXY_URL = `http://localhost:${PROXY_PORT}`;
+
+// Random body wrapped in JPEG markers; distinct per run so dedupe does not kick in
+function createTestImage(size) {
+  const body = crypto.randomBytes(size - 4);
+  return Buffer.concat([Buffer.from([0xFF, 0xD8]), body, Buffer.from([0xFF, 0xD9])]);
+}
+
+async function getToken() {
+  const user = {
+    username: 'resume_' + Date.now(),
+    password: 'password123',
+    email: `resume${Date.now()}@example.com`
+  };
+  const response = await axios.post(`${BASE_URL}/api/auth/register`, user);
+  return response.data.data.token;
+}
+
+// ===== 1. All-or-nothing multipart upload =====
+async function uploadRestarting(image, token) {
+  const start = wire.bytes;
+  for (let attempt = 1; attempt <= MAX_ATTEMPTS; attempt++) {
+    const form = new FormData();
+    form.append('image', image, { filename: 'capture.jpg', contentType: 'image/jpeg' });
+    try {
+      await axios.post(`${PROXY_URL}/api/upload-image`, form, {
+        headers: { ...form.getHeaders(), Authorization: `Bearer ${token}` },
+        maxBodyLength: Infinity
+      });
+      return { ok: true, attempts: attempt, bytes: wire.bytes - start };
+    } catch (error) {
+      // Dropped: next pass starts from byte zero
+    }
+  }
+  return { ok: false, attempts: MAX_ATTEMPTS, bytes: wire.bytes - start };
+}
+
+// ===== 2. Resumable upload =====
+async function uploadResumable(image, token) {
+  const start = wire.bytes;
+  const auth = { Authorization: `Bearer ${token}` };
+  const contentHash = crypto.createHash('sha256').update(image).digest('hex');
+  let attempts = 0;
+
+  const open = async () => {
+    const response = await axios.post(`${PROXY_URL}/api/uploads`, null, {
+      headers: { ...auth, 'Upload-Length': image.length, 'X-Content-SHA256': contentHash }
+    });
+    return response.data.data;
+  };
+  const offsetOf = async (id) => {
+    const response = await axios.head(`${PROXY_URL}/api/uploads/${id}`, { headers: auth });
+    return parseInt(response.headers['upload-offset'], 10);
+  };
+
+  let session = null;
+  let offset = 0;
+  while (attempts < MAX_ATTEMPTS) {
+    attempts++;
+    try {
+      if (!session) {
+        session = await open();
+        offset = session.offset;
+      }
+      const end = Math.min(offset + CHUNK_BYTES, image.length);
+      const response = await axios.patch(`${PROXY_URL}/api/uploads/${session.id}`, image.subarray(offset, end), {
+        headers: { ...auth, 'Content-Type': 'application/offset+octet-stream', 'Upload-Offset': offset },
+        validateStatus: (status) => status < 500
+      });
+      if (response.status === 200 || response.status === 201) {
+        return { ok: true, attempts, bytes: wire.bytes - start };
+      }
+      if (response.status === 423) {
+        // The server is still writing a PATCH we gave up on: wait, then ask
+        await new Promise((resolve) => setTimeout(resolve, 1000));
+        offset = await offsetOf(session.id);
+        continue;
+      }
+      offset = parseInt(response.headers['upload-offset'], 10);
+    } catch (error) {
+      // Dropped: ask the server what it kept (or reopen the session)
+      try {
+        if (session) offset = await offsetOf(session.id);
+      } catch (e) {
+        session = null;
+      }
+    }
+  }
+  return { ok: false, attempts, bytes: wire.bytes - start };
+}
+
+async function run() {
+  console.log('\n' + '='.repeat(60));
+  console.log('Resumable Upload Demo');
+  console.log('='.repeat(60) + '\n');
+  log.info(`Image ${IMAGE_BYTES} B, link drops every ~${MEAN_BYTES_BETWEEN_DROPS} B on average`);
+
+  const token = await getToken();
+  const proxy = await startProxy();
+
+  const plain = await uploadRestarting(createTestImage(IMAGE_BYTES), token);
+  const plainDrops = wire.drops;
+  (plain.ok ? log.success : log.error)(
+    `Restart-from-zero: ${plain.ok ? 'stored' : 'gave up'} after ${plain.attempts} attempts, ` +
+    `${plain.bytes} B on the wire (${plainDrops} drops)`);
+
+  const resumed = await uploadResumable(createTestImage(IMAGE_BYTES), token);
+  (resumed.ok ? log.success : log.error)(
+    `Resumable:         ${resumed.ok ? 'stored' : 'gave up'} after ${resumed.attempts} requests, ` +
+    `${resumed.bytes} B on the wire (${wire.drops - plainDrops} drops)`);
+
+  if (plain.bytes > 0) {
+    const saved = plain.bytes - resumed.bytes;
+    log.info(`Bandwidth saved: ${saved} B (${Math.round(saved * 100 / plain.bytes)}%)`);
+  }
+
+  proxy.close();
+  process.exit(resumed.ok ? 0 : 1);
+}
+
+run().catch((error) => {
+  log.error(`Demo failed: ${error.response?.data?.message || error.message}`);
+  process.exit(1);
+});
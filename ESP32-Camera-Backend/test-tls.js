@@ -0,0 +1,149 @@
+#!/usr/bin/env node
+
+/**
+ * Full vs resumed TLS handshakes against the MQTT broker
+ * Run with: node test-tls.js   (TLS listener on MQTT_TLS_HOST:MQTT_TLS_PORT,
+ * see mosquitto/config/mosquitto.conf)
+ *
+ * Mirrors what a camera does (tls_client.h): TLS 1.2, the session from the
+ * last connection offered on the next one. ROUNDS connections are made
+ * without a session, then ROUNDS offering the previous one, each followed by
+ * an MQTT CONNECT so the broker has to answer through the tunnel.
+ *
+ * Reported per mode: handshake time percentiles, bytes on the wire and client
+ * CPU time per handshake (the device's heap peak is in its [TLS] log line).
+ * Also prints the SHA-256 pin of each public key in the broker's chain, in
+ * the form MQTT_TLS_PINS (config.h) expects. The camera accepts a leaf pin
+ * as is; a CA pin only when the leaf verifies up to that CA.
+ */
+
+const net = require('net');
+const tls = require('tls');
+const crypto = require('crypto');
+
+const HOST = process.env.MQTT_TLS_HOST || 'localhost';
+const PORT = parseInt(process.env.MQTT_TLS_PORT || '8883', 10);
+const ROUNDS = parseInt(process.env.ROUNDS || '20', 10);
+
+const colors = {
+  reset: '\x1b[0m',
+  green: '\x1b[32m',
+  red: '\x1b[31m',
+  yellow: '\x1b[33m',
+  blue: '\x1b[34m'
+};
+
+const log = {
+  success: (msg) => console.log(`${colors.green}✓${colors.reset} ${msg}`),
+  error: (msg) => console.log(`${colors.red}✗${colors.reset} ${msg}`),
+  info: (msg) => console.log(`${colors.blue}ℹ${colors.reset} ${msg}`),
+  warn: (msg) => console.log(`${colors.yellow}⚠${colors.reset} ${msg}`)
+};
+
+const percentile = (sorted, p) =>
+  sorted.length ? sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))] : 0;
+
+// MQTT 3.1.1 CONNECT, clean session, no credentials
+function connectPacket(clientId) {
+  const id = Buffer.from(clientId);
+  const variable = Buffer.from([0, 4, 0x4d, 0x51, 0x54, 0x54, 4, 0x02, 0, 60, id.length >> 8, id.length & 0xff]);
+  const body = Buffer.concat([variable, id]);
+  return Buffer.concat([Buffer.from([0x10, body.length]), body]);
+}
+
+// One connection: handshake, CONNECT/CONNACK, close
+function connectOnce(session) {
+  return new Promise((resolve, reject) => {
+    // Own TCP socket: its byte counters are what went over the air
+    const raw = net.connect(PORT, HOST);
+    raw.once('error', reject);
+    raw.once('connect', () => {
+      const cpuStart = process.cpuUsage();
+      const startedAt = process.hrtime.bigint();
+      let newSession = null;
+      const socket = tls.connect({
+        socket: raw,
+        servername: HOST,
+        session,
+        maxVersion: 'TLSv1.2',      // What the camera's mbedTLS speaks
+        rejectUnauthorized: false   // Trust is checked by pin, as on the camera
+      });
+      socket.on('session', (s) => { newSession = s; });
+      socket.once('error', reject);
+      socket.once('secureConnect', () => {
+        const cpu = process.cpuUsage(cpuStart);
+        const result = {
+          handshakeMs: Number(process.hrtime.bigint() - startedAt) / 1e6,
+          cpuMs: (cpu.user + cpu.system) / 1000,
+          resumed: socket.isSessionReused(),
+          chain: socket.getPeerCertificate(true)
+        };
+        socket.write(connectPacket(`tls-test-${process.pid}`));
+        socket.once('data', (data) => {
+          result.connack = data[0] === 0x20 && data[3] === 0;
+          result.wireBytes = raw.bytesWritten + raw.bytesRead;
+          result.session = newSession;
+          socket.end();
+          resolve(result);
+        });
+      });
+    });
+  });
+}
+
+function printPins(cert) {
+  const seen = new Set();
+  for (let c = cert; c && c.raw && !seen.has(c.fingerprint256); c = c.issuerCertificate) {
+    seen.add(c.fingerprint256);
+    // SubjectPublicKeyInfo DER, as mbedtls_pk_write_pubkey_der writes it
+    const x509 = new crypto.X509Certificate(c.raw);
+    const spki = x509.publicKey.export({ type: 'spki', format: 'der' });
+    const pin = crypto.createHash('sha256').update(spki).digest('hex');
+    const role = c === cert ? 'leaf' : x509.ca ? 'CA, chain must verify to it' : 'not a CA, never accepted';
+    log.info(`  ${pin}  ${c.subject ? c.subject.CN || '' : ''} (${role})`);
+  }
+  if (net.isIP(HOST)) {
+    log.warn(`${HOST} is an address: the camera cannot check the certificate name, pin the leaf or a private CA`);
+  }
+}
+
+function summary(name, results) {
+  const ms = results.map((r) => r.handshakeMs).sort((a, b) => a - b);
+  const avg = (key) => results.reduce((sum, r) => sum + r[key], 0) / (results.length || 1);
+  log.info(`${name}: handshake p50 ${percentile(ms, 0.5).toFixed(1)} ms, p95 ${percentile(ms, 0.95).toFixed(1)} ms, ` +
+    `${Math.round(avg('wireBytes'))} B on the wire, ${avg('cpuMs').toFixed(2)} ms client CPU`);
+}
+
+async function run() {
+  console.log('\n' + '='.repeat(60));
+  console.log('MQTT TLS Session Resumption Test');
+  console.log('='.repeat(60) + '\n');
+  log.info(`${ROUNDS} full + ${ROUNDS} resumed handshakes against ${HOST}:${PORT}`);
+
+  const full = [];
+  for (let i = 0; i < ROUNDS; i++) full.push(await connectOnce(undefined));
+  if (!full.every((r) => r.connack)) log.warn('Broker refused some MQTT CONNECTs');
+
+  log.info('Public key pins (MQTT_TLS_PINS):');
+  printPins(full[0].chain);
+
+  const resumed = [];
+  let session = full[full.length - 1].session;
+  for (let i = 0; i < ROUNDS; i++) {
+    const r = await connectOnce(session);
+    session = r.session || session;
+    resumed.push(r);
+  }
+
+  console.log('');
+  summary('Full', full);
+  summary('Resumed', resumed);
+  const reused = resumed.filter((r) => r.resumed).length;
+  (reused === ROUNDS ? log.success : log.warn)(`Broker resumed ${reused}/${ROUNDS} offered sessions`);
+  process.exit(reused === ROUNDS ? 0 : 1);
+}
+
+run().catch((error) => {
+  log.error(`TLS test failed: ${error.message}`);
+  process.exit(1);
+});
@@ -0,0 +1,293 @@
+#!/usr/bin/env node
+
+/**
+ * Lossy-link test for chunked MQTT image transfer
+ * Run with: node test-xfer.js   (mosquitto on MQTT_BROKER, e.g. docker-compose.mqtt.yml)
+ *
+ * DEVICES simulated cameras each send IMAGES images of IMAGE_BYTES, twice:
+ *   legacy    every chunk published once, QoS 0, nothing comes back
+ *   windowed  the firmware's sliding window (mqtt_manager.cpp
+ *             publishImageChunked): WINDOW chunks in flight, holes resent
+ *             after REORDER_MS, anything unacked resent after RTO_MS, the
+ *             image given up after TIMEOUT_MS
+ *
+ * One receiver reassembles and acks with services/chunkTransfer.js, the same
+ * code the backend runs. LOSS (0..1) drops that share of chunks on the way in
+ * and of acks on the way back, standing in for a bad WiFi link.
+ *
+ * Reported per mode: images delivered, goodput (image bytes that arrived
+ * whole per second), wire overhead (bytes published per image byte
+ * delivered) and send-to-reassembled latency percentiles.
+ */
+
+const mqtt = require('mqtt');
+const crypto = require('crypto');
+const chunkTransfer = require('./services/chunkTransfer');
+
+const BROKER = process.env.MQTT_BROKER || 'mqtt://localhost:1883';
+const DEVICES = parseInt(process.env.DEVICES || '4', 10);
+const IMAGES = parseInt(process.env.IMAGES || '20', 10);
+const IMAGE_BYTES = parseInt(process.env.IMAGE_BYTES || String(24 * 1024), 10);
+const LOSS = parseFloat(process.env.LOSS || '0.05');
+const CHUNK_BYTES = 3072;      // MQTT_CHUNK_SIZE_DEFAULT on the device
+const WINDOW = 8;              // XFER_WINDOW
+const REORDER_MS = 250;        // XFER_REORDER_MS
+const RTO_MS = 1500;           // XFER_RTO_MS
+const TIMEOUT_MS = 20000;      // XFER_TIMEOUT_MS
+const ROOT = `xfer-test-${process.pid}`;
+
+const colors = {
+  reset: '\x1b[0m',
+  green: '\x1b[32m',
+  red: '\x1b[31m',
+  yellow: '\x1b[33m',
+  blue: '\x1b[34m'
+};
+
+const log = {
+  success: (msg) => console.log(`${colors.green}✓${colors.reset} ${msg}`),
+  error: (msg) => console.log(`${colors.red}✗${colors.reset} ${msg}`),
+  info: (msg) => console.log(`${colors.blue}ℹ${colors.reset} ${msg}`),
+  warn: (msg) => console.log(`${colors.yellow}⚠${colors.reset} ${msg}`)
+};
+
+const percentile = (sorted, p) =>
+  sorted.length ? sorted[Math.min(sorted.length - 1, Math.floor(sorted.length * p))] : 0;
+
+const lost = () => Math.random() < LOSS;
+
+function connect(clientId) {
+  return new Promise((resolve, reject) => {
+    const client = mqtt.connect(BROKER, { clientId, clean: true, reconnectPeriod: 0 });
+    client.once('connect', () => resolve(client));
+    client.once('error', reject);
+  });
+}
+
+// ===== Receiver (the backend's handleChunk, minus storage) =====
+async function startReceiver(mode) {
+  const client = await connect(`xfer-rx-${mode}-${process.pid}`);
+  const rx = { client, entries: new Map(), completed: new Map(), ackBytes: 0 };
+  await new Promise((resolve) => client.subscribe(`${ROOT}/${mode}/+/image`, resolve));
+
+  const publishAck = (deviceId, frame) => {
+    rx.ackBytes += frame.length;
+    client.publish(`${ROOT}/${mode}/${deviceId}/xfer`, frame, { qos: 0 });
+  };
+  const sendAck = (deviceId, imageId, entry) => {
+    clearTimeout(entry.ackTimer);
+    entry.ackTimer = null;
+    entry.sinceAck = 0;
+    publishAck(deviceId, chunkTransfer.encodeAck(imageId, entry.chunks));
+  };
+
+  client.on('message', (topic, message) => {
+    if (lost()) return;
+    const deviceId = topic.split('/')[2];
+    const { id: imageId, index, total, data, win } = JSON.parse(message.toString());
+    const key = `${deviceId}/${imageId}`;
+
+    if (rx.completed.has(key)) {
+      if (win) publishAck(deviceId, chunkTransfer.encodeCompleteAck(imageId, total));
+      return;
+    }
+    let entry = rx.entries.get(key);
+    if (!entry) {
+      entry = { chunks: new Array(total).fill(null), receivedCount: 0, window: win || 0,
+        firstMissing: 0, sinceAck: 0, ackTimer: null };
+      rx.entries.set(key, entry);
+    }
+    const isNew = entry.chunks[index] === null;
+    if (isNew) {
+      entry.chunks[index] = data;
+      entry.receivedCount++;
+    }
+
+    if (entry.receivedCount === total) {
+      clearTimeout(entry.ackTimer);
+      rx.entries.delete(key);
+      rx.completed.set(key, Date.now());
+      if (entry.window) publishAck(deviceId, chunkTransfer.encodeCompleteAck(imageId, total));
+      return;
+    }
+    if (entry.window) {
+      if (chunkTransfer.ackNow(entry, index, isNew)) {
+        sendAck(deviceId, imageId, entry);
+      } else if (!entry.ackTimer) {
+        entry.ackTimer = setTimeout(() => {
+          entry.ackTimer = null;
+          if (rx.entries.get(key) === entry) sendAck(deviceId, imageId, entry);
+        }, chunkTransfer.ACK_DELAY_MS);
+      }
+    }
+  });
+  return rx;
+}
+
+// ===== Simulated camera =====
+async function startDevice(mode, index) {
+  const id = `cam-sim-${String(index).padStart(4, '0')}`;
+  const client = await connect(`xfer-${mode}-${id}-${process.pid}`);
+  const dev = { id, client, wireBytes: 0, sends: 0, onAck: null };
+  await new Promise((resolve) => client.subscribe(`${ROOT}/${mode}/${id}/xfer`, resolve));
+
+  client.on('message', (topic, frame) => {
+    if (lost() || !dev.onAck) return;
+    const ack = chunkTransfer.decodeAck(frame);
+    if (ack) dev.onAck(ack);
+  });
+
+  dev.publishChunk = (imageId, image, i, total, win) => {
+    const chunk = { id: imageId, index: i, total,
+      data: image.subarray(i * CHUNK_BYTES, (i + 1) * CHUNK_BYTES).toString('base64'), userId: 'sim' };
+    if (win) chunk.win = win;
+    const payload = JSON.stringify(chunk);
+    dev.wireBytes += payload.length;
+    dev.sends++;
+    client.publish(`${ROOT}/${mode}/${id}/image`, payload, { qos: 0 });
+  };
+  return dev;
+}
+
+// Legacy: fire and forget, success is whatever the receiver rebuilt
+function sendLegacy(dev, imageId, image) {
+  const total = Math.ceil(image.length / CHUNK_BYTES);
+  for (let i = 0; i < total; i++) dev.publishChunk(imageId, image, i, total, 0);
+  return Promise.resolve(true);
+}
+
+// Windowed: same rules as MQTTManager::publishImageChunked / handleXferAck
+function sendWindowed(dev, imageId, image) {
+  return new Promise((resolve) => {
+    const total = Math.ceil(image.length / CHUNK_BYTES);
+    const acked = new Uint8Array(total);
+    const sentAt = new Array(total).fill(0);
+    const startedAt = Date.now();
+    let lastProgressAt = startedAt;
+    let cumAck = 0;
+    let sackEnd = 0;
+    let next = 0;
+    let timer = null;
+
+    const send = (i) => {
+      sentAt[i] = Date.now();
+      dev.publishChunk(imageId, image, i, total, WINDOW);
+    };
+    const finish = (ok) => {
+      clearInterval(timer);
+      dev.onAck = null;
+      resolve(ok);
+    };
+    const pump = () => {
+      while (next < total && next < cumAck + WINDOW) {
+        if (!acked[next]) send(next);
+        next++;
+      }
+      const now = Date.now();
+      for (let i = cumAck; i < Math.min(sackEnd, next); i++) {
+        if (!acked[i] && now - sentAt[i] >= REORDER_MS) send(i);
+      }
+      if (now - lastProgressAt >= RTO_MS) {
+        lastProgressAt = now;
+        for (let i = cumAck; i < next; i++) {
+          if (!acked[i] && now - sentAt[i] >= RTO_MS) send(i);
+        }
+      }
+      if (now - startedAt >= TIMEOUT_MS) finish(false);
+    };
+
+    dev.onAck = (ack) => {
+      if (ack.id !== imageId || ack.total !== total) return;
+      let progress = false;
+      const mark = (from, to) => {
+        for (let i = from; i < Math.min(to, total); i++) {
+          if (!acked[i]) {
+            acked[i] = 1;
+            progress = true;
+          }
+        }
+      };
+      mark(0, ack.cumAck);
+      ack.ranges.forEach(([start, end]) => {
+        mark(start, end);
+        sackEnd = Math.max(sackEnd, Math.min(end, total));
+      });
+      while (cumAck < total && acked[cumAck]) cumAck++;
+      if (ack.complete || cumAck === total) {
+        finish(true);
+        return;
+      }
+      if (progress) lastProgressAt = Date.now();
+      pump();
+    };
+
+    timer = setInterval(pump, 10);
+    pump();
+  });
+}
+
+async function runMode(mode, send) {
+  const rx = await startReceiver(mode);
+  const devices = [];
+  for (let i = 0; i < DEVICES; i++) devices.push(await startDevice(mode, i));
+
+  const startedAt = new Map();
+  const senderOk = { acked: 0, failed: 0 };
+  const runStart = Date.now();
+  await Promise.all(devices.map(async (dev) => {
+    for (let n = 0; n < IMAGES; n++) {
+      const imageId = String(n + 1);
+      startedAt.set(`${dev.id}/${imageId}`, Date.now());
+      const ok = await send(dev, imageId, crypto.randomBytes(IMAGE_BYTES));
+      ok ? senderOk.acked++ : senderOk.failed++;
+    }
+  }));
+  await new Promise((resolve) => setTimeout(resolve, 1000)); // Let in-flight chunks land
+  const elapsedS = (Date.now() - runStart) / 1000;
+
+  const sent = DEVICES * IMAGES;
+  const delivered = rx.completed.size;
+  const deliveredBytes = delivered * IMAGE_BYTES;
+  const wireBytes = devices.reduce((sum, d) => sum + d.wireBytes, 0) + rx.ackBytes;
+  const sends = devices.reduce((sum, d) => sum + d.sends, 0);
+  const latencies = [...rx.completed].map(([key, at]) => at - startedAt.get(key)).sort((a, b) => a - b);
+
+  devices.forEach((d) => d.client.end(true));
+  rx.client.end(true);
+  return { mode, sent, delivered, deliveredBytes, wireBytes, sends, elapsedS, latencies, senderOk };
+}
+
+function report(r) {
+  const chunksPerImage = Math.ceil(IMAGE_BYTES / CHUNK_BYTES);
+  const overhead = r.deliveredBytes ? (r.wireBytes / r.deliveredBytes).toFixed(2) : '∞';
+  (r.delivered === r.sent ? log.success : log.warn)(
+    `${r.mode}: delivered ${r.delivered}/${r.sent} images (${Math.round(r.delivered * 100 / r.sent)}%)`);
+  log.info(`  goodput ${(r.deliveredBytes / 1024 / r.elapsedS).toFixed(1)} KB/s over ${r.elapsedS.toFixed(1)} s, ` +
+    `${r.sends} chunk sends for ${r.sent * chunksPerImage} chunks, wire ${overhead} B per image byte`);
+  log.info(`  latency p50 ${percentile(r.latencies, 0.5)} ms, p95 ${percentile(r.latencies, 0.95)} ms, ` +
+    `p99 ${percentile(r.latencies, 0.99)} ms`);
+  if (r.mode === 'windowed') {
+    log.info(`  sender view: ${r.senderOk.acked} acked, ${r.senderOk.failed} given up`);
+  }
+}
+
+async function run() {
+  console.log('\n' + '='.repeat(60));
+  console.log('MQTT Chunk Transfer Loss Test');
+  console.log('='.repeat(60) + '\n');
+  log.info(`${DEVICES} cameras x ${IMAGES} images of ${IMAGE_BYTES} B, ${Math.round(LOSS * 100)}% loss ` +
+    `each way, against ${BROKER}`);
+
+  const legacy = await runMode('legacy', sendLegacy);
+  const windowed = await runMode('windowed', sendWindowed);
+  console.log('');
+  report(legacy);
+  report(windowed);
+
+  process.exit(windowed.delivered === windowed.sent ? 0 : 1);
+}
+
+run().catch((error) => {
+  log.error(`Transfer test failed: ${error.message}`);
+  process.exit(1);
+});